@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/net.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_ACCEPTORS 16
+#define DEADLINE_MS 15000
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+typedef struct {
+    int listen_fd;
+    bool one_per_tick;          /* the old loop: one accept() every 5 ms */
+    atomic_int *accepted;
+    atomic_bool *stop;
+} Acceptor;
+
+static void *acceptor_main(void *arg) {
+    Acceptor *a = (Acceptor*)arg;
+    int fds[64];
+    struct pollfd pfd = { .fd = a->listen_fd, .events = POLLIN, .revents = 0 };
+    while (!atomic_load(a->stop)) {
+        if (a->one_per_tick) {
+            int fd = accept(a->listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                close(fd);
+                atomic_fetch_add(a->accepted, 1);
+            }
+            sleep_ms(5);
+            continue;
+        }
+        if (poll(&pfd, 1, 50) <= 0) continue;
+        int n;
+        do {
+            n = net_accept_batch(a->listen_fd, fds, 64);
+            for (int i=0;i<n;i++) close(fds[i]);
+            if (n > 0) atomic_fetch_add(a->accepted, n);
+        } while (n == 64);
+    }
+    return NULL;
+}
+
+static int connect_nonblock(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int fl = fcntl(fd, F_GETFL, 0);
+    (void)fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)port);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Fires conns non-blocking connects at once and times how long the
+ * acceptors take to pick all of them up. */
+static void run(const char *label, int port, int conns, int acceptors, int backlog, bool one_per_tick) {
+    int flags = NET_LISTEN_NONBLOCK | ((acceptors > 1) ? NET_LISTEN_REUSEPORT : 0);
+
+    atomic_int accepted;
+    atomic_bool stop;
+    atomic_init(&accepted, 0);
+    atomic_init(&stop, false);
+
+    Acceptor acc[MAX_ACCEPTORS];
+    pthread_t tids[MAX_ACCEPTORS];
+    for (int i=0;i<acceptors;i++) {
+        acc[i].listen_fd = net_listen_tcp_opts(port, backlog, flags);
+        if (acc[i].listen_fd < 0) {
+            perror("net_listen_tcp_opts");
+            exit(1);
+        }
+        acc[i].one_per_tick = one_per_tick;
+        acc[i].accepted = &accepted;
+        acc[i].stop = &stop;
+    }
+    for (int i=0;i<acceptors;i++) pthread_create(&tids[i], NULL, acceptor_main, &acc[i]);
+
+    int *cfds = (int*)malloc((size_t)conns * sizeof(int));
+    if (!cfds) exit(1);
+    int failed = 0;
+    uint64_t t0 = now_us();
+    for (int i=0;i<conns;i++) {
+        cfds[i] = connect_nonblock(port);
+        if (cfds[i] < 0) failed++;
+    }
+    uint64_t t_fired = now_us();
+
+    int target = conns - failed;
+    while (atomic_load(&accepted) < target && now_us() - t0 < (uint64_t)DEADLINE_MS * 1000ULL) sleep_ms(1);
+    uint64_t t_done = now_us();
+    int got = atomic_load(&accepted);
+
+    atomic_store(&stop, true);
+    for (int i=0;i<acceptors;i++) pthread_join(tids[i], NULL);
+    for (int i=0;i<acceptors;i++) close(acc[i].listen_fd);
+    for (int i=0;i<conns;i++) if (cfds[i] >= 0) close(cfds[i]);
+    free(cfds);
+
+    double secs = (double)(t_done - t0) / 1e6;
+    printf("%-22s %6d %8d %8d %7d %10.1f %12.0f\n", label, backlog, got, conns - got,
+           (int)((t_fired - t0) / 1000), secs * 1000.0, secs > 0 ? got / secs : 0.0);
+    /* Let TIME_WAIT and the accept queue settle before the next run. */
+    sleep_ms(200);
+}
+
+int main(int argc, char **argv) {
+    int conns = (argc >= 2) ? atoi(argv[1]) : 10000;
+    int acceptors = (argc >= 3) ? atoi(argv[2]) : 4;
+    int backlog = (argc >= 4) ? atoi(argv[3]) : NET_DEFAULT_BACKLOG;
+    int port = (argc >= 5) ? atoi(argv[4]) : 47000;
+    if (conns < 1) conns = 1;
+    if (acceptors < 1) acceptors = 1;
+    if (acceptors > MAX_ACCEPTORS) acceptors = MAX_ACCEPTORS;
+
+    printf("%d connects per run, %ld cpus\n", conns, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-22s %6s %8s %8s %7s %10s %12s\n", "mode", "backlog", "accepted", "missing", "fire_ms", "total_ms", "conns/s");
+
+    char label[64];
+    run("one per 5ms tick", port, conns, 1, 16, true);
+    run("drain, 1 listener", port + 1, conns, 1, backlog, false);
+    (void)snprintf(label, sizeof(label), "reuseport x%d", acceptors);
+    run(label, port + 2, conns, acceptors, backlog, false);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../server/batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static uint32_t lcg(uint32_t *s) {
+    *s = *s * 1664525u + 1013904223u;
+    return *s >> 8;
+}
+
+/* Heads for the nearest fruit on the observations alone, with the odd
+ * random turn; cheap enough not to hide the simulator. */
+static void policy(const Batch *b, uint8_t *act, uint32_t *rng) {
+    const BatchSpec *s = &b->spec;
+    for (int i=0;i<s->games;i++) {
+        const int16_t *fo = b->fruit_obs + (size_t)i * MAX_FRUITS * 2;
+        for (int k=0;k<s->snakes;k++) {
+            const int16_t *o = b->snake_obs + ((size_t)i * (size_t)s->snakes + (size_t)k) * BATCH_SNAKE_FIELDS;
+            uint8_t *a = &act[(size_t)i * (size_t)s->snakes + (size_t)k];
+            *a = BATCH_KEEP;
+            if (!o[BATCH_ALIVE]) continue;
+            if ((lcg(rng) & 15) == 0) {
+                *a = (uint8_t)(lcg(rng) & 3);
+                continue;
+            }
+            int best = -1, bd = 0;
+            for (int f=0;f<MAX_FRUITS;f++) {
+                if (fo[2 * f] < 0) continue;
+                int d = abs(fo[2 * f] - o[BATCH_HEAD_X]) + abs(fo[2 * f + 1] - o[BATCH_HEAD_Y]);
+                if (best < 0 || d < bd) { best = f; bd = d; }
+            }
+            if (best < 0) continue;
+            int dx = fo[2 * best] - o[BATCH_HEAD_X], dy = fo[2 * best + 1] - o[BATCH_HEAD_Y];
+            for (uint8_t d=0;d<4;d++) {
+                int mx, my;
+                dir_delta(d, &mx, &my);
+                if (mx * dx + my * dy > 0 && !dir_is_opposite((uint8_t)o[BATCH_DIR], d)) {
+                    *a = d;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static uint64_t fnv(uint64_t h, const void *p, size_t n) {
+    const uint8_t *b = (const uint8_t*)p;
+    for (size_t i=0;i<n;i++) h = (h ^ b[i]) * 0x100000001B3ULL;
+    return h;
+}
+
+/* Every thread count runs the same games with the same policy; a digest
+ * of every step's observations has to match the single thread's. */
+static bool run(const BatchSpec *base, int threads, int cores, int steps, double *base_rate, uint64_t *base_hash) {
+    BatchSpec spec = *base;
+    spec.threads = threads;
+    Batch b;
+    if (!batch_init(&b, &spec)) {
+        fprintf(stderr, "batch_init failed\n");
+        return false;
+    }
+    size_t n = (size_t)spec.games * (size_t)spec.snakes;
+    uint8_t *act = (uint8_t*)malloc(n);
+    if (!act) return false;
+
+    uint32_t rng = 12345u;
+    uint64_t h = 0xCBF29CE484222325ULL, busy = 0;
+    bool stepped = true;
+    for (int k=0;k<steps;k++) {
+        policy(&b, act, &rng);
+        uint64_t t0 = now_us();
+        if (!batch_step(&b, act)) stepped = false;
+        busy += now_us() - t0;
+        h = fnv(h, b.snake_obs, n * BATCH_SNAKE_FIELDS * sizeof(int16_t));
+        h = fnv(h, b.fruit_obs, (size_t)spec.games * MAX_FRUITS * 2 * sizeof(int16_t));
+        h = fnv(h, b.done, (size_t)spec.games);
+        if (b.grid) h = fnv(h, b.grid, (size_t)spec.games * (size_t)spec.w * (size_t)spec.h);
+    }
+
+    double rate = busy ? (double)b.ticks * 1e6 / (double)busy : 0.0;
+    if (threads == 1) {
+        *base_rate = rate;
+        *base_hash = h;
+    }
+    bool ok = h == *base_hash && stepped;
+    if (!stepped) fprintf(stderr, "%llu episodes failed to start\n", (unsigned long long)b.failed);
+    printf("%8d %12.0f %12.0f %8.2fx %9llu %9.1f %6s\n", threads, rate, rate / (threads < cores ? threads : cores),
+           *base_rate > 0 ? rate / *base_rate : 0.0, (unsigned long long)b.episodes,
+           b.episodes ? (double)b.episode_ticks / (double)b.episodes : 0.0, ok ? "ok" : "BAD");
+    free(act);
+    batch_free(&b);
+    return ok;
+}
+
+/* Usage: bench_batch [games] [snakes] [w] [h] [steps] [max_threads] [gen:STYLE] [grid] */
+int main(int argc, char **argv) {
+    BatchSpec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.games = (argc >= 2) ? atoi(argv[1]) : 4096;
+    spec.snakes = (argc >= 3) ? atoi(argv[2]) : 2;
+    spec.w = (argc >= 4) ? atoi(argv[3]) : 32;
+    spec.h = (argc >= 5) ? atoi(argv[4]) : 32;
+    int steps = (argc >= 6) ? atoi(argv[5]) : 500;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (argc >= 7) ? atoi(argv[6]) : (int)(ncpu > 0 ? ncpu : 1);
+    if (argc >= 8 && strcmp(argv[7], "open") != 0) {
+        if (!mapgen_parse(argv[7], &spec.gen)) {
+            fprintf(stderr, "bad map spec: %s\n", argv[7]);
+            return 1;
+        }
+        spec.walls = true;
+    }
+    spec.grid = argc >= 9 && strcmp(argv[8], "grid") == 0;
+    spec.max_ticks = 1000;
+    spec.seed = 7;
+    if (max_threads < 1) max_threads = 1;
+
+    char map[64] = "open";
+    if (spec.walls) mapgen_format(&spec.gen, map, sizeof(map));
+    printf("%d games of %d snakes on %dx%d %s%s, %d steps, %ld cpus\n", spec.games, spec.snakes, spec.w, spec.h, map,
+           spec.grid ? " with grids" : "", steps, ncpu);
+    printf("%8s %12s %12s %9s %9s %9s %6s\n", "threads", "ticks/s", "per core", "speedup", "episodes", "mean len",
+           "check");
+    double base_rate = 0.0;
+    uint64_t base_hash = 0;
+    int bad = 0;
+    for (int t=1;t<=max_threads;t=(t<max_threads && t*2>max_threads)?max_threads:t*2) {
+        if (!run(&spec, t, ncpu > 0 ? (int)ncpu : 1, steps, &base_rate, &base_hash)) bad++;
+    }
+    return bad ? 1 : 0;
+}
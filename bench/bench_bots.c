@@ -0,0 +1,75 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../server/bot.h"
+#include "../server/game.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Usage: bench_bots [w] [h] [bots] [ticks] [budget_ms] */
+int main(int argc, char **argv) {
+    int w = (argc >= 2) ? atoi(argv[1]) : 500;
+    int h = (argc >= 3) ? atoi(argv[2]) : 500;
+    int nbots = (argc >= 4) ? atoi(argv[3]) : 30;
+    int ticks = (argc >= 5) ? atoi(argv[4]) : 1000;
+    int budget_ms = (argc >= 6) ? atoi(argv[5]) : 5;
+    srand(1);
+
+    Game g;
+    if (!game_init(&g, MAX_PLAYERS)) return 1;
+    g.world = 1;
+    g.tick_ms = 120;
+    gen_map(&g, w, h, 1);
+
+    BotPlanner bp;
+    if (!bot_planner_init(&bp, w, h, g.max_players, (uint32_t)budget_ms * 1000u)) return 1;
+    nbots = bot_spawn(&g, nbots);
+
+    uint32_t *samples = (uint32_t*)malloc((size_t)ticks * sizeof(uint32_t));
+    if (!samples) return 1;
+    uint64_t eaten = 0;
+
+    for (int t=0;t<ticks;t++) {
+        uint64_t t0 = now_us();
+        bots_think(&bp, &g);
+        samples[t] = (uint32_t)(now_us() - t0);
+        tick_game(&g, g.tick_ms);
+    }
+    for (int i=0;i<g.max_players;i++) if (g.players[i].used) eaten += g.players[i].score;
+
+    qsort(samples, (size_t)ticks, sizeof(uint32_t), cmp_u32);
+    uint64_t sum = 0;
+    for (int t=0;t<ticks;t++) sum += samples[t];
+    printf("map %dx%d, %d bots, %d fruits, %d ticks\n", w, h, nbots, (int)g.num_fruits, ticks);
+    printf("bot decision per tick: avg %llu us, p50 %u us, p99 %u us, max %u us\n",
+           (unsigned long long)(sum / (uint64_t)ticks),
+           samples[ticks / 2], samples[(ticks * 99) / 100], samples[ticks - 1]);
+    printf("fruits eaten: %llu\n", (unsigned long long)eaten);
+    uint64_t over = bp.over_budget;
+    bot_stats_report(&bp, stdout);
+    /* A tick preempted mid-search can overrun on a busy host; a p99 over
+     * the budget means the planner itself does. */
+    bool bad = samples[(ticks * 99) / 100] > (uint32_t)budget_ms * 1000u;
+    if (over) {
+        printf("%s: %llu of %d ticks over the %d ms budget\n", bad ? "BAD" : "warning", (unsigned long long)over,
+               ticks, budget_ms);
+    }
+
+    free(samples);
+    bot_planner_free(&bp);
+    game_free(&g);
+    return bad ? 1 : 0;
+}
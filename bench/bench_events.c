@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../server/eventlog.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_us(long us) {
+    struct timespec ts;
+    ts.tv_sec = us / 1000000L;
+    ts.tv_nsec = (us % 1000000L) * 1000L;
+    nanosleep(&ts, NULL);
+}
+
+typedef struct {
+    int id;
+    int events;
+    int burst;              /* events between pauses, 0 = flat out */
+    uint64_t total_ns;      /* spent emitting, pauses left out */
+} Producer;
+
+/* A mix shaped like a busy server: mostly pickups and deaths. Timed a
+ * batch at a time, since a clock read costs about as much as an emit. */
+static void *produce(void *arg) {
+    Producer *p = (Producer*)arg;
+    uint32_t rng = 17u + (uint32_t)p->id;
+    int batch = p->burst > 0 ? p->burst : 1000;
+    for (int i=0;i<p->events;) {
+        int end = (i + batch < p->events) ? i + batch : p->events;
+        uint64_t t0 = now_ns();
+        for (;i<end;i++) {
+            rng = rng * 1664525u + 1013904223u;
+            uint8_t type = (rng >> 28) < 12 ? EV_FRUIT : ((rng >> 28) < 15 ? EV_DEATH : EV_JOIN);
+            eventlog_emit(type, (int)((rng >> 8) % 32u), (uint16_t)((rng >> 4) & 3u),
+                          rng & 0xFFFu, (rng >> 12) & 0xFFFu, (uint32_t)i);
+        }
+        p->total_ns += now_ns() - t0;
+        if (p->burst > 0) sleep_us(1000);
+    }
+    return NULL;
+}
+
+static void remove_logs(const char *path) {
+    char name[600];
+    (void)unlink(path);
+    for (int i=1;i<10000;i++) {
+        (void)snprintf(name, sizeof(name), "%s.%d", path, i);
+        if (unlink(name) != 0) break;
+    }
+}
+
+static bool read_file(const char *name, uint64_t *events, uint64_t *dropped, uint64_t *by_type) {
+    EventReader r;
+    char err[128];
+    if (!event_reader_open(&r, name, err, sizeof(err))) return false;
+    while (event_reader_next(&r)) {
+        *events += r.count;
+        for (uint32_t k=0;k<r.count;k++) by_type[r.type[k]]++;
+        for (uint32_t k=0;k<r.count;k++) if (r.type[k] == EV_DROPPED) *dropped += r.a[k];
+    }
+    event_reader_close(&r);
+    return true;
+}
+
+/* Reads back the rotated files and then the last one; returns the files
+ * read. */
+static int read_back(const char *path, uint64_t *events, uint64_t *dropped, uint64_t *by_type, double *ms) {
+    char name[600];
+    int files = 0;
+    *events = 0;
+    *dropped = 0;
+    uint64_t t0 = now_ns();
+    for (int i=1;;i++) {
+        (void)snprintf(name, sizeof(name), "%s.%d", path, i);
+        if (!read_file(name, events, dropped, by_type)) break;
+        files++;
+    }
+    if (read_file(path, events, dropped, by_type)) files++;
+    *ms = (double)(now_ns() - t0) / 1e6;
+    return files;
+}
+
+static bool run(const char *path, const char *label, int threads, int per_thread, int burst, uint64_t rotate) {
+    remove_logs(path);
+    if (!eventlog_open(path, rotate, EVENT_RING_DEFAULT)) {
+        perror(path);
+        return false;
+    }
+    Producer ps[64];
+    pthread_t tids[64];
+    uint64_t t0 = now_ns();
+    for (int i=0;i<threads;i++) {
+        memset(&ps[i], 0, sizeof(ps[i]));
+        ps[i].id = i;
+        ps[i].events = per_thread;
+        ps[i].burst = burst;
+        (void)pthread_create(&tids[i], NULL, produce, &ps[i]);
+    }
+    uint64_t total_ns = 0;
+    for (int i=0;i<threads;i++) {
+        pthread_join(tids[i], NULL);
+        total_ns += ps[i].total_ns;
+    }
+    double wall_ms = (double)(now_ns() - t0) / 1e6;
+    EventLogStats st;
+    eventlog_close(&st);
+
+    uint64_t emitted = (uint64_t)threads * (uint64_t)per_thread;
+    uint64_t by_type[256] = {0};
+    uint64_t read = 0, dropped_marked = 0;
+    double read_ms = 0;
+    int files = read_back(path, &read, &dropped_marked, by_type, &read_ms);
+    uint64_t kept = read - by_type[EV_DROPPED];
+    bool ok = !st.failed && kept + st.dropped == emitted && dropped_marked == st.dropped && (int)st.files == files;
+
+    printf("%-7s %2d x %8d %8.1f %7.0f %9llu %5u %9.1f %8.1f %5s\n",
+           label, threads, per_thread, wall_ms, (double)total_ns / (double)emitted,
+           (unsigned long long)st.dropped, (unsigned)st.files, read_ms,
+           read_ms > 0 ? (double)read / read_ms / 1000.0 : 0.0, ok ? "ok" : "BAD");
+    remove_logs(path);
+    return ok;
+}
+
+/* Usage: bench_events [events per thread] [threads] [path] */
+int main(int argc, char **argv) {
+    int per_thread = (argc >= 2) ? atoi(argv[1]) : 1000000;
+    int threads = (argc >= 3) ? atoi(argv[2]) : 4;
+    const char *path = (argc >= 4) ? argv[3] : "/tmp/bench_events.log";
+    if (per_thread < 1) per_thread = 1;
+    if (threads < 1) threads = 1;
+    if (threads > 64) threads = 64;
+
+    printf("ring of %d events, %d-event blocks, 16 MiB files\n", EVENT_RING_DEFAULT, EVENT_BLOCK_MAX);
+    printf("%-7s %13s %8s %7s %9s %5s %9s %8s %5s\n",
+           "load", "producers", "wall ms", "emit ns", "dropped", "files", "read ms", "Mev/s", "check");
+    int bad = 0;
+    /* paced: bursts a tick's worth at a time, as the server does */
+    if (!run(path, "paced", 1, per_thread / 10, 1000, 16u << 20)) bad++;
+    if (!run(path, "paced", threads, per_thread / 10, 1000, 16u << 20)) bad++;
+    /* flat out: faster than any disk, so the ring overflows and drops */
+    if (!run(path, "flood", 1, per_thread, 0, 16u << 20)) bad++;
+    if (!run(path, "flood", threads, per_thread, 0, 16u << 20)) bad++;
+    return bad ? 1 : 0;
+}
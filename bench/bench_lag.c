@@ -0,0 +1,203 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../server/game.h"
+#include "../server/lagcomp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static uint32_t lcg(uint32_t *s) {
+    *s = *s * 1664525u + 1013904223u;
+    return *s >> 8;
+}
+
+/* The turn slot i makes going into tick t, or 255; the same script for
+ * both runs. None into the first tick: a stamp of 0 means no stamp. */
+static uint8_t turn_at(uint32_t t, int i) {
+    if (t < 2) return 255;
+    uint32_t s = t * 2654435761u ^ (uint32_t)i * 40503u;
+    (void)lcg(&s);
+    uint32_t r = lcg(&s);
+    return (r & 3) == 0 ? (uint8_t)((r >> 4) & 3) : 255;
+}
+
+static bool setup(Game *g, int w, int h, int snakes) {
+    if (!game_init(g, snakes)) return false;
+    srand(7);
+    g->world = 0;
+    g->tick_ms = 120;
+    gen_map(g, w, h, 0);
+    for (int i=0;i<snakes;i++) {
+        int slot = alloc_slot(g);
+        if (slot < 0) break;
+        init_player(&g->players[slot], find_free_cell(g), 0);
+        init_player_meta(&g->meta[slot], "snake");
+    }
+    ensure_fruits_count(g);
+    return true;
+}
+
+/* Snakes that ended up somewhere else, or -1 when the fruit did too. */
+static int diverged(const Game *a, const Game *b) {
+    if (a->tick != b->tick || a->rng != b->rng || a->num_fruits != b->num_fruits) return -1;
+    for (int f=0;f<a->num_fruits;f++) {
+        if (a->fruits[f].pos.x != b->fruits[f].pos.x || a->fruits[f].pos.y != b->fruits[f].pos.y) return -1;
+    }
+    int n = 0;
+    for (int i=0;i<a->max_players;i++) {
+        const Player *p = &a->players[i], *q = &b->players[i];
+        if (p->alive != q->alive || p->dir != q->dir || p->score != q->score || p->len != q->len ||
+            memcmp(p->body, q->body, (size_t)p->len * sizeof(Cell)) != 0) n++;
+    }
+    return n;
+}
+
+/* Deaths and pickups as the event log would have them, in order. */
+typedef struct {
+    uint64_t deaths, fruit;
+    uint64_t hash;
+} Tally;
+
+static void tally(Tally *t, uint32_t tick, int slot, const LagOutcome *o) {
+    if (!o->die && !o->ate) return;
+    if (o->die) t->deaths++;
+    else t->fruit++;
+    uint32_t v[6] = { tick, (uint32_t)slot, o->die ? o->die : 0x100u | o->fruit, (uint32_t)o->at.x,
+                      (uint32_t)o->at.y, o->score };
+    for (int k=0;k<6;k++) t->hash = (t->hash ^ v[k]) * 0x100000001B3ULL;
+}
+
+/* The on-time game's, off the scratch of the tick just run. */
+static void tally_tick(Tally *t, const Game *g) {
+    for (int i=0;i<g->max_players;i++) {
+        const TickMove *m = &g->moves[i];
+        if (!(m->flags & MOVE_ACTIVE)) continue;
+        LagOutcome o = { m->die, !m->die && (m->flags & MOVE_GROW), m->fruit, m->die ? g->players[i].body[0] : m->next,
+                         g->players[i].score };
+        tally(t, g->tick, i, &o);
+    }
+}
+
+static void tally_final(void *ctx, const LagFrame *f, int n) {
+    for (int i=0;i<n;i++) tally((Tally*)ctx, f->tick, i, &f->outcome[i]);
+}
+
+static bool lagging(int i, bool mixed) {
+    return !mixed || (i & 1);
+}
+
+/* Turns meant for tick meant reach the server now, stamped with the tick
+ * before it; as in the server, only the living queue a turn lag_input
+ * turns down. */
+static void deliver(LagComp *lc, Game *g, int snakes, bool mixed, uint32_t meant, uint32_t *seq) {
+    for (int i=0;i<snakes;i++) {
+        uint8_t dir = turn_at(meant, i);
+        if (dir == 255 || !lagging(i, mixed)) continue;
+        ++seq[i];
+        if (!lag_input(lc, g, i, dir, seq[i], meant, meant - 1) && g->players[i].alive) {
+            queue_input(&g->players[i], dir, seq[i], meant);
+        }
+    }
+}
+
+/* Every snake's turns (or every other one's, mixed) reach the server lag
+ * ticks late, stamped with the tick its client last saw; the rest arrive
+ * on time. Run against a game that got every turn on time: with one lag
+ * for everybody inside the window the two have to end the same. Mixed,
+ * a snake the on-time game killed can be saved by a late turn, and the
+ * turns its player sent while it lay dead are gone, so some divergence
+ * is expected and only counted. The deaths and pickups lag compensation
+ * hands on as final have to be the on-time game's too, one for one. */
+static bool run(int snakes, int w, int h, int ticks, int depth, int lag, bool mixed) {
+    Game ref, g;
+    LagComp lc;
+    if (!setup(&ref, w, h, snakes) || !setup(&g, w, h, snakes)) return false;
+    if (!lag_init(&lc, snakes, depth)) return false;
+    Tally ref_log = { 0, 0, 0xCBF29CE484222325ULL }, lag_log = ref_log;
+    lc.on_final = tally_final;
+    lc.final_ctx = &lag_log;
+
+    uint64_t ref_us = 0;
+    for (int k=0;k<ticks;k++) {
+        uint32_t t = ref.tick + 1;
+        for (int i=0;i<snakes;i++) ref.players[i].pending_dir = turn_at(t, i);
+        uint64_t t0 = now_us();
+        tick_game(&ref, ref.tick_ms);
+        ref_us += now_us() - t0;
+        tally_tick(&ref_log, &ref);
+    }
+
+    uint32_t seq[1024] = {0};
+    uint64_t lag_us = 0;
+    for (int k=0;k<ticks;k++) {
+        uint32_t t = g.tick + 1;
+        if (lag > 0 && t > (uint32_t)lag) deliver(&lc, &g, snakes, mixed, t - (uint32_t)lag, seq);
+        uint64_t t0 = now_us();
+        lag_rewind(&lc, &g);
+        for (int i=0;i<snakes;i++) {
+            if (lag == 0 || !lagging(i, mixed)) g.players[i].pending_dir = turn_at(t, i);
+        }
+        lag_tick(&lc, &g, g.tick_ms);
+        lag_us += now_us() - t0;
+    }
+    /* Turns still in flight at the end: deliver them a tick's worth at a
+     * time, rewinding after each as the server would before its tick. */
+    for (uint32_t meant=g.tick-(uint32_t)lag+1;lag>0 && meant<=g.tick;meant++) {
+        deliver(&lc, &g, snakes, mixed, meant, seq);
+        lag_rewind(&lc, &g);
+    }
+    /* The game is over: what is still held is final. */
+    lag_reset(&lc);
+
+    int off = diverged(&ref, &g);
+    bool logged = lag_log.deaths == ref_log.deaths && lag_log.fruit == ref_log.fruit && lag_log.hash == ref_log.hash;
+    bool ok = mixed || (off == 0 && logged);
+    char offs[16];
+    if (off < 0) (void)snprintf(offs, sizeof(offs), "fruit");
+    else (void)snprintf(offs, sizeof(offs), "%d", off);
+    const LagStats *st = &lc.stats;
+    int alive = 0;
+    for (int i=0;i<snakes;i++) if (g.players[i].alive) alive++;
+    printf("%5d %4d %-5s %8llu %8.1f %8.1f %8llu %8.2f %6.1f %6d %8s %6llu %6llu %6s %5s\n",
+           depth, lag, mixed ? "half" : "all", (unsigned long long)st->late,
+           st->rewinds ? (double)st->ticks / (double)st->rewinds : 0.0,
+           st->rewinds ? (double)st->total_us / (double)st->rewinds : 0.0, (unsigned long long)st->max_us,
+           st->frames ? (double)st->frame_us / (double)st->frames : 0.0,
+           ref_us ? (double)lag_us / (double)ref_us : 0.0, alive, offs, (unsigned long long)lag_log.deaths,
+           (unsigned long long)lag_log.fruit, logged ? "same" : "differ", ok ? "ok" : "BAD");
+    lag_free(&lc);
+    game_free(&ref);
+    game_free(&g);
+    return ok;
+}
+
+/* Usage: bench_lag [snakes] [w] [h] [ticks] */
+int main(int argc, char **argv) {
+    int snakes = (argc >= 2) ? atoi(argv[1]) : 32;
+    int w = (argc >= 3) ? atoi(argv[2]) : 96;
+    int h = (argc >= 4) ? atoi(argv[3]) : 64;
+    int ticks = (argc >= 5) ? atoi(argv[4]) : 2000;
+    if (snakes < 2) snakes = 2;
+    if (snakes > 1024) snakes = 1024;
+
+    printf("%d snakes on %dx%d, %d ticks\n", snakes, w, h, ticks);
+    printf("%5s %4s %-5s %8s %8s %8s %8s %8s %6s %6s %8s %6s %6s %6s %5s\n",
+           "depth", "lag", "who", "late", "re-run", "rewind", "max us", "frame us", "cost", "alive", "diverged",
+           "deaths", "fruit", "log", "check");
+    int bad = 0;
+    if (!run(snakes, w, h, ticks, 4, 0, false)) bad++;
+    for (int lag=1;lag<=8;lag*=2) {
+        if (!run(snakes, w, h, ticks, lag, lag, false)) bad++;
+    }
+    if (!run(snakes, w, h, ticks, LAG_MAX_TICKS, 8, false)) bad++;
+    if (!run(snakes, w, h, ticks, 4, 4, true)) bad++;
+    return bad ? 1 : 0;
+}
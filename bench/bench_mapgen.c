@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/hash.h"
+#include "../server/mapgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/* Fingerprint of the walls, for the same-seed-same-board check. */
+static uint64_t board_hash(const World *wd) {
+    uint32_t chunks = 0;
+    size_t len = world_encoded_size(wd, &chunks);
+    uint8_t *buf = (uint8_t*)malloc(len ? len : 1);
+    if (!buf) exit(1);
+    (void)world_encode(wd, buf, len);
+    uint64_t h = hash64(buf, len);
+    free(buf);
+    return h;
+}
+
+/* An independent check of the generator's promise: a plain BFS from the
+ * first open cell must reach every open cell. Returns the cells missed. */
+static uint64_t unreachable(const World *wd, uint64_t *open_out) {
+    size_t n = (size_t)wd->w * (size_t)wd->h;
+    uint8_t *cell = (uint8_t*)malloc(n);
+    uint32_t *queue = (uint32_t*)malloc(n * sizeof(uint32_t));
+    if (!cell || !queue) exit(1);
+    world_copy_walls(wd, cell);
+    uint64_t open = 0;
+    size_t start = n;
+    for (size_t i=0;i<n;i++) {
+        if (cell[i]) continue;
+        open++;
+        if (start == n) start = i;
+    }
+    uint64_t seen = 0;
+    if (start < n) {
+        size_t head = 0, tail = 0;
+        queue[tail++] = (uint32_t)start;
+        cell[start] = 2;
+        while (head < tail) {
+            uint32_t i = queue[head++];
+            seen++;
+            int32_t x = (int32_t)(i % (uint32_t)wd->w), y = (int32_t)(i / (uint32_t)wd->w);
+            const int dx[4] = { 1, -1, 0, 0 }, dy[4] = { 0, 0, 1, -1 };
+            for (int d=0;d<4;d++) {
+                int32_t nx = x + dx[d], ny = y + dy[d];
+                if (nx < 0 || ny < 0 || nx >= wd->w || ny >= wd->h) continue;
+                size_t j = (size_t)ny * (size_t)wd->w + (size_t)nx;
+                if (cell[j]) continue;
+                cell[j] = 2;
+                queue[tail++] = (uint32_t)j;
+            }
+        }
+    }
+    free(cell);
+    free(queue);
+    *open_out = open;
+    return open - seen;
+}
+
+/* Usage: bench_mapgen [max side] [seed] [runs] */
+int main(int argc, char **argv) {
+    int max_side = (argc >= 2) ? atoi(argv[1]) : 4096;
+    uint64_t seed = (argc >= 3) ? strtoull(argv[2], NULL, 10) : 42;
+    int runs = (argc >= 4) ? atoi(argv[3]) : 3;
+    if (runs < 1) runs = 1;
+
+    const char *styles[] = { "gen:open", "gen:caves", "gen:rooms", "gen:scatter" };
+    int sides[] = { 256, 1024, 4096, 8192 };
+    int bad = 0;
+
+    printf("generate + seal + load into the World, best of %d; seed %llu\n", runs, (unsigned long long)seed);
+    printf("%-8s %11s %9s %7s %9s %8s %7s %8s %6s\n",
+           "style", "board", "ms", "open%", "sealed", "pockets", "tries", "chunks", "check");
+    for (int s=0;s<4;s++) {
+        for (int z=0;z<4 && sides[z]<=max_side;z++) {
+            int side = sides[z];
+            MapGenSpec spec;
+            if (!mapgen_parse(styles[s], &spec)) return 1;
+            spec.seed = seed;
+
+            uint64_t best = UINT64_MAX, first_hash = 0;
+            bool same = true;
+            MapGenStats st;
+            World wd;
+            for (int r=0;r<runs;r++) {
+                uint64_t t0 = now_us();
+                if (!mapgen_build(&wd, side, side, &spec, &st)) {
+                    fprintf(stderr, "%s %dx%d failed\n", styles[s], side, side);
+                    return 1;
+                }
+                uint64_t d = now_us() - t0;
+                if (d < best) best = d;
+                uint64_t h = board_hash(&wd);
+                if (r == 0) first_hash = h;
+                else if (h != first_hash) same = false;
+                if (r + 1 < runs) world_free(&wd);
+            }
+
+            uint64_t open = 0;
+            uint64_t missed = unreachable(&wd, &open);
+            bool ok = same && missed == 0 && open == st.open_cells;
+            if (!ok) bad++;
+            printf("%-8s %5dx%-5d %9.1f %6.1f%% %9llu %8u %7u %8zu %6s\n",
+                   styles[s] + 4, side, side, (double)best / 1000.0,
+                   100.0 * (double)open / ((double)side * (double)side),
+                   (unsigned long long)st.sealed_cells, st.sealed_regions, st.attempts,
+                   wd.chunk_count, ok ? "ok" : (same ? "UNREACH" : "NONDET"));
+            world_free(&wd);
+        }
+    }
+    return bad ? 1 : 0;
+}
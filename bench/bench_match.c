@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/net.h"
+#include "../server/game.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void play(Game *g, int ticks) {
+    for (int k=0;k<ticks;k++) {
+        for (int i=0;i<g->max_players;i++) {
+            Player *p = &g->players[i];
+            if (p->used && p->alive && (k % 5) == 0) p->pending_dir = (uint8_t)((k / 5 + i) & 3);
+        }
+        tick_game(g, g->tick_ms);
+    }
+}
+
+/* What a new process has to do before its first tick, minus exec and the
+ * clients reconnecting: allocate, build the board, bind, seat everyone. */
+static uint64_t cold_start(Game *g, int w, int h, int snakes, const NetAddr *addr, int *lfd) {
+    uint64_t t0 = now_us();
+    if (!game_init(g, MAX_PLAYERS)) exit(1);
+    g->world = 0;
+    g->tick_ms = 120;
+    gen_map(g, w, h, 0);
+    *lfd = net_listen(addr, NET_DEFAULT_BACKLOG, NET_LISTEN_NONBLOCK);
+    for (int i=0;i<snakes;i++) {
+        int slot = alloc_slot(g);
+        if (slot < 0) break;
+        init_player(&g->players[slot], find_free_cell(g), 0);
+        init_player_meta(&g->meta[slot], "snake");
+    }
+    ensure_fruits_count(g);
+    tick_game(g, g->tick_ms);
+    return now_us() - t0;
+}
+
+/* Usage: bench_match [snakes] [matches] [tcp port] */
+int main(int argc, char **argv) {
+    int snakes = (argc >= 2) ? atoi(argv[1]) : MAX_PLAYERS;
+    int matches = (argc >= 3) ? atoi(argv[2]) : 20;
+    int port = (argc >= 4) ? atoi(argv[3]) : 6101;
+    if (matches < 1) matches = 1;
+
+    NetAddr addr;
+    char spec[32];
+    (void)snprintf(spec, sizeof(spec), "tcp:127.0.0.1:%d", port);
+    if (!net_addr_parse(spec, port, &addr)) return 1;
+
+    printf("%d snakes, %d matches of 200 ticks; times in us per match start\n", snakes, matches);
+    printf("%-12s %12s %12s %8s\n", "board", "new process", "reset", "ratio");
+    int boards[][2] = { { 40, 20 }, { 1024, 1024 }, { 4096, 4096 } };
+    for (int b=0;b<3;b++) {
+        int w = boards[b][0], h = boards[b][1];
+        uint64_t cold = 0, warm = 0;
+        for (int m=0;m<matches;m++) {
+            srand(7);
+            Game g;
+            int lfd = -1;
+            cold += cold_start(&g, w, h, snakes, &addr, &lfd);
+            play(&g, 200);
+            net_unlisten(&addr, lfd);
+            game_free(&g);
+        }
+
+        srand(7);
+        Game g;
+        int lfd = -1;
+        (void)cold_start(&g, w, h, snakes, &addr, &lfd);
+        for (int m=0;m<matches;m++) {
+            play(&g, 200);
+            g.game_over = true;
+            uint64_t t0 = now_us();
+            reset_match(&g, now_ms());
+            tick_game(&g, g.tick_ms);
+            warm += now_us() - t0;
+        }
+        net_unlisten(&addr, lfd);
+        game_free(&g);
+
+        printf("%5dx%-6d %12.0f %12.0f %7.0fx\n", w, h, (double)cold / matches, (double)warm / matches,
+               (warm > 0) ? (double)cold / (double)warm : 0.0);
+    }
+    return 0;
+}
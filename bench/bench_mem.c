@@ -0,0 +1,128 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../server/game.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Linked with -Wl,--wrap for the allocator entry points, so every heap
+ * call the game makes is counted. */
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+
+static unsigned long g_allocs;
+
+void *__wrap_malloc(size_t n) {
+    __atomic_fetch_add(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    __atomic_fetch_add(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n) {
+    __atomic_fetch_add(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, n);
+}
+
+static long rss_kib(void) {
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return -1;
+    long size = 0, resident = 0;
+    int ok = fscanf(f, "%ld %ld", &size, &resident);
+    fclose(f);
+    if (ok != 2) return -1;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static uint32_t lcg(uint32_t *s) {
+    *s = *s * 1664525u + 1013904223u;
+    return *s >> 8;
+}
+
+static void steer_and_respawn(Game *g, uint32_t *rng) {
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        if (!p->used) continue;
+        if (!p->alive) {
+            init_player(p, find_free_cell(g), p->score);
+            continue;
+        }
+        if ((lcg(rng) & 7) == 0) p->pending_dir = (uint8_t)(lcg(rng) & 3);
+    }
+}
+
+static void run(int w, int h, int snakes, int ticks, bool reserve) {
+    srand(7);
+    long rss0 = rss_kib();
+    unsigned long a0 = g_allocs;
+
+    Game g;
+    if (!game_init(&g, MAX_PLAYERS)) return;
+    g.world = 0;
+    g.tick_ms = 120;
+    gen_map(&g, w, h, 0);
+    /* An empty reservation makes every layer fall back to the heap. */
+    if (!reserve) (void)world_reserve(&g.map, 0, 0);
+    ensure_fruits_count(&g);
+    long idle = rss_kib() - rss0;
+    unsigned long setup_allocs = g_allocs - a0;
+
+    for (int i=0;i<snakes;i++) {
+        int slot = alloc_slot(&g);
+        if (slot < 0) break;
+        init_player(&g.players[slot], find_free_cell(&g), 0);
+        init_player_meta(&g.meta[slot], "snake");
+    }
+
+    /* Long enough for the layer sweep to have recycled a few times. */
+    uint32_t rng = 12345u;
+    for (int k=0;k<ticks;k++) {
+        steer_and_respawn(&g, &rng);
+        tick_game(&g, g.tick_ms);
+    }
+    unsigned long a1 = g_allocs;
+    for (int k=0;k<ticks;k++) {
+        steer_and_respawn(&g, &rng);
+        tick_game(&g, g.tick_ms);
+    }
+    double per_tick = (double)(g_allocs - a1) / ticks;
+    long active = rss_kib() - rss0;
+
+    printf("%5dx%-6d %7s %8lu %10ld %10ld %10zu %10.3f\n", w, h, reserve ? "pool" : "heap",
+           setup_allocs, idle, active, world_memory(&g.map) / 1024, per_tick);
+    game_free(&g);
+}
+
+/* Usage: bench_mem [snakes] [ticks] */
+int main(int argc, char **argv) {
+    int snakes = (argc >= 2) ? atoi(argv[1]) : MAX_PLAYERS;
+    int ticks = (argc >= 3) ? atoi(argv[2]) : 2000;
+    if (ticks < 1) ticks = 1;
+
+    printf("%d snakes, %d warm-up + %d measured ticks; sizes in KiB\n", snakes, ticks, ticks);
+    printf("%-12s %7s %8s %10s %10s %10s %10s\n", "board", "layers", "allocs",
+           "idle rss", "active rss", "map live", "allocs/tick");
+    int boards[][2] = { { 40, 20 }, { 1024, 1024 }, { 8192, 8192 } };
+    /* Each case runs in its own process, so freed memory the allocator
+     * keeps around does not leak into the next resident-size reading. */
+    for (int b=0;b<3;b++) {
+        for (int pooled=0;pooled<2;pooled++) {
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                run(boards[b][0], boards[b][1], snakes, ticks, pooled != 0);
+                fflush(stdout);
+                _exit(0);
+            }
+            if (pid > 0) (void)waitpid(pid, NULL, 0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/recording.h"
+#include "../server/game.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t lcg(uint32_t *s) {
+    *s = *s * 1664525u + 1013904223u;
+    return *s >> 8;
+}
+
+/* The fields of the server's build_state that change from tick to tick. */
+static void snapshot(Game *g, uint32_t frame, MsgState *st) {
+    memset(st, 0, sizeof(*st));
+    st->tick_ms = g->tick_ms;
+    st->w = (uint32_t)g->w;
+    st->h = (uint32_t)g->h;
+    st->elapsed_sec = (uint16_t)(frame * g->tick_ms / 1000u);
+    uint8_t np = 0;
+    for (int i=0;i<MAX_PLAYERS;i++) {
+        Player *p = &g->players[i];
+        PlayerState *ps = &st->players[i];
+        ps->player_id = (uint8_t)i;
+        ps->connected = p->connected;
+        ps->active = p->active;
+        ps->alive = p->alive;
+        ps->dir = p->dir;
+        ps->score = p->score;
+        ps->len = (p->len < MAX_SEGMENTS) ? p->len : MAX_SEGMENTS;
+        for (int k=0;k<(int)ps->len;k++) ps->body[k] = p->body[k];
+        if (p->used) np++;
+    }
+    st->num_players = np;
+    st->num_fruits = g->num_fruits;
+    for (int i=0;i<(int)g->num_fruits;i++) st->fruits[i].pos = g->fruits[i].pos;
+}
+
+/* Usage: bench_rec [frames] [snakes] [keyframe_every] [seeks] */
+int main(int argc, char **argv) {
+    int frames = (argc >= 2) ? atoi(argv[1]) : 10000;
+    int snakes = (argc >= 3) ? atoi(argv[2]) : 16;
+    int every = (argc >= 4) ? atoi(argv[3]) : REC_DEFAULT_KEYFRAME_EVERY;
+    int seeks = (argc >= 5) ? atoi(argv[4]) : 2000;
+    if (frames < 1 || every < 1 || seeks < 1) return 1;
+
+    char path[64];
+    (void)snprintf(path, sizeof(path), "/tmp/bench_rec_%d.rec", (int)getpid());
+
+    srand(7);
+    Game g;
+    if (!game_init(&g, MAX_PLAYERS)) return 1;
+    g.world = 0;
+    g.tick_ms = 120;
+    gen_map(&g, 200, 100, 0);
+    for (int i=0;i<snakes;i++) {
+        int slot = alloc_slot(&g);
+        if (slot < 0) break;
+        init_player(&g.players[slot], find_free_cell(&g), 0);
+        init_player_meta(&g.meta[slot], "snake");
+    }
+    ensure_fruits_count(&g);
+
+    /* Every frame is kept raw too, to check what the reader hands back. */
+    uint8_t **raw = (uint8_t**)calloc((size_t)frames, sizeof(uint8_t*));
+    uint32_t *raw_len = (uint32_t*)calloc((size_t)frames, sizeof(uint32_t));
+    static MsgState st;
+    static uint8_t buf[MSG_STATE_MAX_LEN];
+    static uint8_t config[4];
+    if (!raw || !raw_len) return 1;
+
+    RecWriter w;
+    if (!rec_writer_open(&w, path, g.tick_ms, (uint32_t)every, config, sizeof(config))) {
+        perror(path);
+        return 1;
+    }
+    uint32_t rng = 12345u;
+    uint64_t raw_bytes = 0, write_ns = 0;
+    for (int f=0;f<frames;f++) {
+        for (int i=0;i<g.max_players;i++) {
+            Player *p = &g.players[i];
+            if (!p->used) continue;
+            if (!p->alive) init_player(p, find_free_cell(&g), p->score);
+            else if ((lcg(&rng) & 7) == 0) p->pending_dir = (uint8_t)(lcg(&rng) & 3);
+        }
+        tick_game(&g, g.tick_ms);
+        snapshot(&g, (uint32_t)f, &st);
+        uint32_t len = (uint32_t)msg_state_encode(&st, buf);
+        raw[f] = (uint8_t*)malloc(len);
+        if (!raw[f]) return 1;
+        memcpy(raw[f], buf, len);
+        raw_len[f] = len;
+        raw_bytes += len;
+        uint64_t t0 = now_ns();
+        if (!rec_writer_frame(&w, buf, len)) return 1;
+        write_ns += now_ns() - t0;
+    }
+    if (!rec_writer_close(&w)) return 1;
+    struct stat sb;
+    if (stat(path, &sb) != 0) return 1;
+
+    printf("%d frames, %d snakes, keyframe every %d\n", frames, snakes, every);
+    printf("raw %.0f B/frame, recorded %.0f B/frame (%.1fx smaller), write %.2f us/frame\n",
+           (double)raw_bytes / frames, (double)sb.st_size / frames,
+           (double)raw_bytes / (double)sb.st_size, (double)write_ns / frames / 1000.0);
+
+    RecReader r;
+    char err[128];
+    uint64_t t0 = now_ns();
+    if (!rec_open(&r, path, err, sizeof(err))) {
+        fprintf(stderr, "%s: %s\n", path, err);
+        return 1;
+    }
+    printf("open %.1f us\n", (double)(now_ns() - t0) / 1000.0);
+
+    int bad = 0;
+    t0 = now_ns();
+    for (int f=0;f<frames;f++) {
+        if (!rec_next(&r) || r.state_len != raw_len[f] || memcmp(r.state, raw[f], raw_len[f]) != 0) bad++;
+    }
+    printf("sequential read %.2f us/frame\n", (double)(now_ns() - t0) / frames / 1000.0);
+
+    uint64_t worst = 0, total = 0;
+    for (int s=0;s<seeks;s++) {
+        uint32_t target = lcg(&rng) % (uint32_t)frames;
+        uint64_t t1 = now_ns();
+        bool ok = rec_seek(&r, target);
+        uint64_t d = now_ns() - t1;
+        total += d;
+        if (d > worst) worst = d;
+        if (!ok || r.frame != target || memcmp(r.state, raw[target], raw_len[target]) != 0) bad++;
+    }
+    printf("random seek %.1f us avg, %.1f us worst over %d seeks\n",
+           (double)total / seeks / 1000.0, (double)worst / 1000.0, seeks);
+    printf("%d mismatched frames\n", bad);
+
+    rec_close(&r);
+    (void)unlink(path);
+    for (int f=0;f<frames;f++) free(raw[f]);
+    free(raw);
+    free(raw_len);
+    game_free(&g);
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/net.h"
+#include "../common/protocol.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Reads one message and throws the payload away; returns its length. */
+static long skip_msg(int fd, uint16_t *type) {
+    uint32_t len = 0;
+    if (net_recv_header(fd, type, &len) != 0) return -1;
+    uint8_t chunk[65536];
+    uint32_t left = len;
+    while (left > 0) {
+        uint32_t n = (left < sizeof(chunk)) ? left : (uint32_t)sizeof(chunk);
+        if (net_recv_all(fd, chunk, (int)n) != 0) return -1;
+        left -= n;
+    }
+    return (long)len;
+}
+
+/* One join until the client could draw: WELCOME, plus CONFIG unless the
+ * resume matched, with the map only when want_map is set (a cold map
+ * cache). Returns the bytes received, or -1. */
+static long join(int port, const MsgResume *resume, bool want_map, MsgWelcome *out, int *fd_out) {
+    int fd = net_connect_tcp("127.0.0.1", port);
+    if (fd < 0) return -1;
+    uint8_t buf[WIRE_SIZE(msg_welcome)];
+    if (resume) {
+        (void)net_send_msg(fd, MSG_RESUME, buf, (uint32_t)msg_resume_encode(resume, buf));
+    } else {
+        MsgHello h;
+        memset(&h, 0, sizeof(h));
+        h.version = PROTOCOL_VERSION;
+        (void)snprintf(h.name, sizeof(h.name), "bench");
+        (void)net_send_msg(fd, MSG_HELLO, buf, (uint32_t)msg_hello_encode(&h, buf));
+    }
+
+    uint16_t t = 0;
+    uint32_t l = 0;
+    if (net_recv_header(fd, &t, &l) != 0 || t != MSG_WELCOME || l != WIRE_SIZE(msg_welcome) ||
+        net_recv_all(fd, buf, (int)l) != 0 || !msg_welcome_decode(out, buf, l)) {
+        close(fd);
+        return -1;
+    }
+    long bytes = (long)(WIRE_SIZE(msg_header) + WIRE_SIZE(msg_welcome));
+    bool cached = resume && memcmp(resume->config_hash, out->config_hash, CONFIG_HASH_LEN) == 0;
+    if (!cached) {
+        MsgConfigRequest req;
+        req.want_map = want_map ? 1 : 0;
+        (void)net_send_msg(fd, MSG_CONFIG_REQUEST, buf, (uint32_t)msg_config_request_encode(&req, buf));
+        long n = skip_msg(fd, &t);
+        if (n < 0 || t != MSG_CONFIG) { close(fd); return -1; }
+        bytes += (long)WIRE_SIZE(msg_header) + n;
+    }
+    *fd_out = fd;
+    return bytes;
+}
+
+static void report(const char *label, uint64_t *us, int n, long bytes) {
+    qsort(us, (size_t)n, sizeof(uint64_t), cmp_u64);
+    printf("%-16s %10.2f %10.2f %10.2f %12ld\n", label,
+           us[n / 2] / 1000.0, us[(n * 99) / 100] / 1000.0, us[n - 1] / 1000.0, bytes);
+}
+
+int main(int argc, char **argv) {
+    int w = (argc >= 2) ? atoi(argv[1]) : 20000;
+    int h = (argc >= 3) ? atoi(argv[2]) : 20000;
+    int rounds = (argc >= 4) ? atoi(argv[3]) : 50;
+    int port = (argc >= 5) ? atoi(argv[4]) : 47100;
+    const char *server = (argc >= 6) ? argv[5] : "./server/server";
+    if (rounds < 1) rounds = 1;
+
+    char pbuf[16], wbuf[16], hbuf[16];
+    (void)snprintf(pbuf, sizeof(pbuf), "%d", port);
+    (void)snprintf(wbuf, sizeof(wbuf), "%d", w);
+    (void)snprintf(hbuf, sizeof(hbuf), "%d", h);
+
+    /* Walled generated board: the border alone gives a long chunk list. An
+     * acceptor thread keeps the 5 ms game-loop poll out of the timings. */
+    pid_t pid = fork();
+    if (pid < 0) return 1;
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(127);
+        execl(server, server, pbuf, "-", "0", "1", "120", wbuf, hbuf, "--acceptors", "1", (char*)NULL);
+        _exit(127);
+    }
+
+    int probe = -1;
+    for (int i=0;i<100 && probe < 0;i++) {
+        sleep_ms(50);
+        probe = net_connect_tcp("127.0.0.1", port);
+    }
+    if (probe < 0) {
+        fprintf(stderr, "server did not start\n");
+        kill(pid, SIGKILL);
+        return 1;
+    }
+    close(probe);
+
+    uint64_t *fresh = (uint64_t*)calloc((size_t)rounds, sizeof(uint64_t));
+    uint64_t *warm = (uint64_t*)calloc((size_t)rounds, sizeof(uint64_t));
+    uint64_t *resumed = (uint64_t*)calloc((size_t)rounds, sizeof(uint64_t));
+    if (!fresh || !warm || !resumed) return 1;
+    long fresh_bytes = 0, warm_bytes = 0, resumed_bytes = 0;
+    int done = 0;
+
+    for (int r=0;r<rounds;r++) {
+        MsgWelcome wel;
+        int fd = -1;
+        uint64_t t0 = now_us();
+        long b = join(port, NULL, true, &wel, &fd);
+        if (b < 0) break;
+        fresh[r] = now_us() - t0;
+        fresh_bytes = b;
+        (void)net_send_msg(fd, MSG_LEAVE, NULL, 0);
+        close(fd);
+
+        t0 = now_us();
+        b = join(port, NULL, false, &wel, &fd);
+        if (b < 0) break;
+        warm[r] = now_us() - t0;
+        warm_bytes = b;
+        close(fd);
+
+        MsgResume res;
+        res.version = PROTOCOL_VERSION;
+        memcpy(res.token, wel.token, RESUME_TOKEN_LEN);
+        memcpy(res.config_hash, wel.config_hash, CONFIG_HASH_LEN);
+        t0 = now_us();
+        b = join(port, &res, false, &wel, &fd);
+        if (b < 0) break;
+        resumed[r] = now_us() - t0;
+        resumed_bytes = b;
+
+        /* Leave properly so the slot is freed for the next round. */
+        (void)net_send_msg(fd, MSG_LEAVE, NULL, 0);
+        close(fd);
+        done++;
+    }
+
+    kill(pid, SIGINT);
+    (void)waitpid(pid, NULL, 0);
+
+    if (done == 0) {
+        fprintf(stderr, "no round completed\n");
+        return 1;
+    }
+    printf("%dx%d walled board, %d rounds\n", w, h, done);
+    printf("%-16s %10s %10s %10s %12s\n", "join", "p50_ms", "p99_ms", "max_ms", "bytes");
+    report("hello, cold map", fresh, done, fresh_bytes);
+    report("hello, cached", warm, done, warm_bytes);
+    report("resume", resumed, done, resumed_bytes);
+    free(fresh);
+    free(warm);
+    free(resumed);
+    return 0;
+}
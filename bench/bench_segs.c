@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../server/game.h"
+#include "../server/segs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t lcg(uint32_t *s) {
+    *s = *s * 1664525u + 1013904223u;
+    return *s >> 8;
+}
+
+static volatile long g_sink;
+
+/* Snakes laid out as random walks, so neighbouring segments share rows
+ * and columns the way real bodies do. */
+static void fill(Game *g, int snakes, int len, int w, int h) {
+    g->w = w;
+    g->h = h;
+    uint32_t rng = 99u;
+    for (int i=0;i<snakes && i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        init_player(p, (Cell){ (int)(lcg(&rng) % (uint32_t)w), (int)(lcg(&rng) % (uint32_t)h) }, 0);
+        p->len = (uint16_t)len;
+        for (int k=1;k<len;k++) {
+            Cell c = p->body[k-1];
+            int dx, dy;
+            dir_delta((uint8_t)(lcg(&rng) & 3), &dx, &dy);
+            c.x = (c.x + dx + w) % w;
+            c.y = (c.y + dy + h) % h;
+            p->body[k] = c;
+        }
+    }
+}
+
+typedef struct {
+    const char *name;
+    seg_find_fn fn;
+} Kernel;
+
+/* Usage: bench_segs [queries] */
+int main(int argc, char **argv) {
+    int queries = (argc >= 2) ? atoi(argv[1]) : 20000;
+    if (queries < 1) queries = 1;
+
+    printf("dispatch picks %s\n", seg_kernel_name());
+    printf("%-12s %-14s %12s %12s %9s\n", "snakes x len", "kernel", "ns/query", "segs/ns", "speedup");
+
+    int shapes[][2] = { { 4, 64 }, { 32, 64 }, { 32, 1024 }, { 1000, 256 } };
+    for (int s=0;s<4;s++) {
+        int snakes = shapes[s][0], len = shapes[s][1];
+        Game g;
+        if (!game_init(&g, snakes)) return 1;
+        fill(&g, snakes, len, 4096, 4096);
+
+        uint64_t t0 = now_ns();
+        for (int i=0;i<100;i++) pack_bodies(&g);
+        double pack_ns = (double)(now_ns() - t0) / 100.0;
+        size_t n = g.segs.count;
+
+        /* Mostly misses, which is the case find_free_cell hopes for and
+         * the one that scans the whole table. */
+        Cell *q = (Cell*)malloc((size_t)queries * sizeof(Cell));
+        if (!q) return 1;
+        uint32_t rng = 7u;
+        for (int i=0;i<queries;i++) {
+            if ((i & 15) == 0) {
+                const Player *p = &g.players[lcg(&rng) % (uint32_t)snakes];
+                q[i] = p->body[lcg(&rng) % p->len];
+            } else {
+                q[i] = (Cell){ (int)(lcg(&rng) % 4096u), (int)(lcg(&rng) % 4096u) };
+            }
+        }
+
+        char shape[32];
+        (void)snprintf(shape, sizeof(shape), "%dx%d", snakes, len);
+
+        t0 = now_ns();
+        long hits_ref = 0;
+        for (int i=0;i<queries;i++) hits_ref += occupied_by_snake(&g, q[i].x, q[i].y) ? 1 : 0;
+        double base = (double)(now_ns() - t0) / queries;
+        printf("%-12s %-14s %12.1f %12.2f %8.2fx\n", shape, "players walk", base, (double)n / base, 1.0);
+
+        Kernel ks[] = { { "packed scalar", seg_find_scalar }, { "packed sse2", seg_kernel_sse2() },
+                        { "packed avx2", seg_kernel_avx2() } };
+        for (int k=0;k<3;k++) {
+            if (!ks[k].fn) {
+                printf("%-12s %-14s %12s\n", shape, ks[k].name, "n/a");
+                continue;
+            }
+            long hits = 0;
+            t0 = now_ns();
+            for (int i=0;i<queries;i++) hits += (ks[k].fn(g.segs.x, g.segs.y, n, q[i].x, q[i].y) >= 0) ? 1 : 0;
+            double per = (double)(now_ns() - t0) / queries;
+            if (hits != hits_ref) {
+                fprintf(stderr, "%s: %ld hits, expected %ld\n", ks[k].name, hits, hits_ref);
+                return 1;
+            }
+            printf("%-12s %-14s %12.1f %12.2f %8.2fx\n", shape, ks[k].name, per, (double)n / per, base / per);
+        }
+        printf("%-12s %-14s %12.1f\n", shape, "pack", pack_ns);
+        g_sink += hits_ref;
+        free(q);
+        game_free(&g);
+    }
+    return 0;
+}
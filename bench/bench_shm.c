@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/protocol.h"
+#include "../common/shm.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_us(int us) {
+    struct timespec ts = { us / 1000000, (long)(us % 1000000) * 1000L };
+    nanosleep(&ts, NULL);
+}
+
+/* Payload tick t is every byte (uint8_t)(t * 131 + i): a torn copy mixes
+ * two ticks and fails the check. */
+static void fill(uint8_t *buf, uint32_t len, uint32_t t) {
+    for (uint32_t i=0;i<len;i++) buf[i] = (uint8_t)(t * 131u + i);
+}
+
+static bool intact(const uint8_t *buf, uint32_t len, uint32_t t) {
+    for (uint32_t i=0;i<len;i++) if (buf[i] != (uint8_t)(t * 131u + i)) return false;
+    return true;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t len;
+    int pace_us;              /* between publishes, 0 = back to back */
+    int stop;
+    uint64_t published;
+    uint64_t publish_ns;
+} Writer;
+
+typedef struct {
+    Writer *w;
+    uint64_t reads, ok, busy, torn, stale;
+    uint64_t ns;
+} Reader;
+
+static ShmWriter g_shm;
+
+static void *writer_main(void *arg) {
+    Writer *w = (Writer*)arg;
+    uint8_t *buf = (uint8_t*)malloc(w->len);
+    if (!buf) return NULL;
+    for (uint32_t t=1;!__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE);t++) {
+        fill(buf, w->len, t);
+        uint64_t t0 = now_ns();
+        shm_writer_state(&g_shm, t, buf, w->len);
+        w->publish_ns += now_ns() - t0;
+        w->published++;
+        if (w->pace_us > 0) sleep_us(w->pace_us);
+    }
+    free(buf);
+    return NULL;
+}
+
+static void *reader_main(void *arg) {
+    Reader *rd = (Reader*)arg;
+    ShmReader r;
+    char err[128];
+    if (!shm_reader_open(&r, rd->w->name, err, sizeof(err))) {
+        fprintf(stderr, "reader: %s\n", err);
+        return NULL;
+    }
+    static __thread uint8_t buf[MSG_STATE_MAX_LEN];
+    uint64_t last = 0;
+    while (!__atomic_load_n(&rd->w->stop, __ATOMIC_ACQUIRE)) {
+        uint32_t len;
+        uint64_t tick;
+        uint64_t t0 = now_ns();
+        ShmResult rc = shm_read_state(&r, buf, sizeof(buf), &len, &tick, NULL);
+        rd->ns += now_ns() - t0;
+        rd->reads++;
+        if (rc == SHM_BUSY) rd->busy++;
+        if (rc != SHM_OK) continue;
+        rd->ok++;
+        if (tick < last) rd->stale++;
+        last = tick;
+        if (len != rd->w->len || !intact(buf, len, (uint32_t)tick)) rd->torn++;
+    }
+    shm_reader_close(&r);
+    return NULL;
+}
+
+static bool run(const char *name, uint32_t len, int readers, int pace_us, int ms) {
+    Writer w;
+    memset(&w, 0, sizeof(w));
+    w.name = name;
+    w.len = len;
+    w.pace_us = pace_us;
+    Reader *rd = (Reader*)calloc((size_t)readers, sizeof(Reader));
+    pthread_t *tids = (pthread_t*)calloc((size_t)readers, sizeof(pthread_t));
+    if (!rd || !tids) return false;
+
+    /* Publish one first so no reader starts on an empty section. */
+    uint8_t *first = (uint8_t*)malloc(len);
+    if (!first) return false;
+    fill(first, len, 0);
+    shm_writer_state(&g_shm, 0, first, len);
+    free(first);
+
+    pthread_t wt;
+    for (int i=0;i<readers;i++) {
+        rd[i].w = &w;
+        (void)pthread_create(&tids[i], NULL, reader_main, &rd[i]);
+    }
+    (void)pthread_create(&wt, NULL, writer_main, &w);
+    sleep_us(ms * 1000);
+    __atomic_store_n(&w.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(wt, NULL);
+    Reader sum;
+    memset(&sum, 0, sizeof(sum));
+    for (int i=0;i<readers;i++) {
+        pthread_join(tids[i], NULL);
+        sum.reads += rd[i].reads;
+        sum.ok += rd[i].ok;
+        sum.busy += rd[i].busy;
+        sum.torn += rd[i].torn;
+        sum.stale += rd[i].stale;
+        sum.ns += rd[i].ns;
+    }
+    double secs = ms / 1000.0;
+    printf("%7d %8s %12.0f %10.0f %12.0f %10.0f %8.3f %6llu %6s\n", readers,
+           pace_us ? "paced" : "flat out", (double)w.published / secs,
+           w.published ? (double)w.publish_ns / (double)w.published : 0.0, (double)sum.reads / secs,
+           sum.reads ? (double)sum.ns / (double)sum.reads : 0.0,
+           sum.reads ? 100.0 * (double)sum.busy / (double)sum.reads : 0.0, (unsigned long long)sum.torn,
+           (sum.torn == 0 && sum.stale == 0) ? "ok" : "BAD");
+    free(rd);
+    free(tids);
+    return sum.torn == 0 && sum.stale == 0;
+}
+
+/* Usage: bench_shm [payload bytes] [max readers] [ms per run] */
+int main(int argc, char **argv) {
+    uint32_t len = (argc >= 2) ? (uint32_t)atoi(argv[1]) : 4096;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_readers = (argc >= 3) ? atoi(argv[2]) : (int)(ncpu > 1 ? ncpu - 1 : 1);
+    int ms = (argc >= 4) ? atoi(argv[3]) : 500;
+    if (len < 1 || len > MSG_STATE_MAX_LEN) len = 4096;
+    if (max_readers < 1) max_readers = 1;
+
+    char name[64];
+    (void)snprintf(name, sizeof(name), "/snake-bench-%d", (int)getpid());
+    char err[128];
+    if (!shm_writer_open(&g_shm, name, 0, err, sizeof(err))) {
+        fprintf(stderr, "%s: %s\n", name, err);
+        return 1;
+    }
+    printf("%u-byte snapshots, %d ms a run, %ld cpus\n", (unsigned)len, ms, ncpu);
+    printf("%7s %8s %12s %10s %12s %10s %8s %6s %6s\n", "readers", "writer", "writes/s", "write ns", "reads/s",
+           "read ns", "busy %", "torn", "check");
+    int bad = 0;
+    for (int n=1;n<=max_readers;n*=2) {
+        if (!run(name, len, n, 0, ms)) bad++;
+        if (!run(name, len, n, 1000, ms)) bad++;
+    }
+    shm_writer_close(&g_shm);
+    return bad ? 1 : 0;
+}
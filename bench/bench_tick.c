@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../server/game.h"
+#include "../server/pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static uint32_t lcg(uint32_t *s) {
+    *s = *s * 1664525u + 1013904223u;
+    return *s >> 8;
+}
+
+/* Same seed for every thread count, so each run simulates the same match. */
+static void setup(Game *g, int w, int h, int snakes) {
+    srand(7);
+    g->world = 0;
+    g->tick_ms = 120;
+    gen_map(g, w, h, 0);
+    for (int i=0;i<snakes;i++) {
+        int slot = alloc_slot(g);
+        if (slot < 0) break;
+        init_player(&g->players[slot], find_free_cell(g), 0);
+        init_player_meta(&g->meta[slot], "snake");
+    }
+    ensure_fruits_count(g);
+}
+
+static void steer_and_respawn(Game *g, uint32_t *rng) {
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        if (!p->used) continue;
+        if (!p->alive) {
+            init_player(p, find_free_cell(g), p->score);
+            continue;
+        }
+        if ((lcg(rng) & 7) == 0) p->pending_dir = (uint8_t)(lcg(rng) & 3);
+    }
+}
+
+/* Usage: bench_tick [snakes] [w] [h] [ticks] [max_threads] */
+int main(int argc, char **argv) {
+    int snakes = (argc >= 2) ? atoi(argv[1]) : 4000;
+    int w = (argc >= 3) ? atoi(argv[2]) : 1024;
+    int h = (argc >= 4) ? atoi(argv[3]) : 1024;
+    int ticks = (argc >= 5) ? atoi(argv[4]) : 200;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (argc >= 6) ? atoi(argv[5]) : (int)(ncpu > 0 ? ncpu : 1);
+    if (max_threads < 1) max_threads = 1;
+
+    printf("%d snakes on %dx%d, %d ticks, %ld cpus\n", snakes, w, h, ticks, ncpu);
+    printf("%8s %12s %12s %9s %8s\n", "threads", "us/tick", "ticks/s", "speedup", "deaths");
+
+    double base = 0.0;
+    for (int t=1;t<=max_threads;t++) {
+        Game g;
+        if (!game_init(&g, snakes)) return 1;
+        setup(&g, w, h, snakes);
+        g.pool = (t > 1) ? pool_create(t) : NULL;
+
+        uint32_t rng = 12345u;
+        uint64_t busy = 0;
+        long deaths = 0;
+        for (int k=0;k<ticks;k++) {
+            steer_and_respawn(&g, &rng);
+            uint64_t t0 = now_us();
+            tick_game(&g, g.tick_ms);
+            busy += now_us() - t0;
+            for (int i=0;i<g.max_players;i++) if (g.players[i].used && !g.players[i].alive) deaths++;
+        }
+
+        double per_tick = (double)busy / (double)ticks;
+        if (t == 1) base = per_tick;
+        printf("%8d %12.1f %12.1f %8.2fx %8ld\n", t, per_tick, 1e6 / per_tick, base / per_tick, deaths);
+
+        pool_destroy(g.pool);
+        game_free(&g);
+    }
+    return 0;
+}
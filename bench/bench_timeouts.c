@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/net.h"
+#include "../common/protocol.h"
+#include "../server/timer.h"
+
+#include <dirent.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+static uint32_t lcg(uint32_t *s) {
+    *s = *s * 1664525u + 1013904223u;
+    return *s >> 8;
+}
+
+/* ---- the wheel on its own ---- */
+
+typedef struct {
+    Timer t;
+    uint64_t deadline_ms;
+} BenchTimer;
+
+static uint64_t g_late_ms, g_early;
+static size_t g_fired;
+
+static void on_fire(Timer *t, void *arg) {
+    const BenchTimer *b = (const BenchTimer*)t->data;
+    uint64_t now = *(const uint64_t*)arg;
+    if (now < b->deadline_ms) g_early++;
+    else if (now - b->deadline_ms > g_late_ms) g_late_ms = now - b->deadline_ms;
+    g_fired++;
+}
+
+/* n timers over a minute of 10 ms ticks, half of them cancelled or
+ * re-armed before they fire, the way idle deadlines get pushed back. */
+static void bench_wheel(int n) {
+    BenchTimer *ts = (BenchTimer*)calloc((size_t)n, sizeof(BenchTimer));
+    if (!ts) exit(1);
+    TimerWheel tw;
+    timer_wheel_init(&tw, 0, 10);
+    uint32_t rng = 99u;
+
+    uint64_t t0 = now_ns();
+    for (int i=0;i<n;i++) {
+        timer_init(&ts[i].t, on_fire, &ts[i]);
+        ts[i].deadline_ms = 1 + lcg(&rng) % 60000u;
+        timer_arm(&tw, &ts[i].t, ts[i].deadline_ms);
+    }
+    double arm_ns = (double)(now_ns() - t0) / n;
+
+    int cancelled = 0;
+    t0 = now_ns();
+    for (int i=0;i<n;i+=2) {
+        if (i % 4 == 0) {
+            timer_cancel(&tw, &ts[i].t);
+            cancelled++;
+        } else {
+            ts[i].deadline_ms += 30000u;
+            timer_arm(&tw, &ts[i].t, ts[i].deadline_ms);
+        }
+    }
+    double change_ns = (double)(now_ns() - t0) / ((n + 1) / 2);
+
+    t0 = now_ns();
+    for (uint64_t ms=0;ms<=100000u;ms+=10) (void)timer_wheel_advance(&tw, ms, &ms);
+    double advance_ns = (double)(now_ns() - t0);
+
+    printf("wheel: %d timers, arm %.0f ns, cancel/re-arm %.0f ns, 100 s of ticks %.2f ms\n",
+           n, arm_ns, change_ns, advance_ns / 1e6);
+    printf("       fired %zu of %d, %llu early, latest %llu ms after its deadline, %zu left\n",
+           g_fired, n - cancelled, (unsigned long long)g_early, (unsigned long long)g_late_ms, tw.count);
+    free(ts);
+}
+
+/* ---- a server under stalled connections ---- */
+
+static int count_dir(const char *path) {
+    DIR *d = opendir(path);
+    if (!d) return -1;
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] != '.') n++;
+    }
+    closedir(d);
+    return n;
+}
+
+static void usage_of(pid_t pid, int *threads, int *fds) {
+    char path[64];
+    (void)snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    *threads = count_dir(path);
+    (void)snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+    *fds = count_dir(path);
+}
+
+static int connect_small(int port) {
+    int fd = net_connect_tcp("127.0.0.1", port);
+    if (fd < 0) return -1;
+    int small = 4096;
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    return fd;
+}
+
+static bool send_hello(int fd) {
+    MsgHello h;
+    memset(&h, 0, sizeof(h));
+    h.version = PROTOCOL_VERSION;
+    (void)snprintf(h.name, sizeof(h.name), "stall");
+    uint8_t buf[WIRE_SIZE(msg_hello)];
+    return net_send_msg(fd, MSG_HELLO, buf, (uint32_t)msg_hello_encode(&h, buf)) == 0;
+}
+
+/* HELLO through CONFIG, without the map. */
+static bool handshake(int fd) {
+    uint8_t buf[WIRE_SIZE(msg_welcome)];
+    uint16_t t = 0;
+    uint32_t l = 0;
+    if (!send_hello(fd)) return false;
+    if (net_recv_header(fd, &t, &l) != 0 || t != MSG_WELCOME || net_discard(fd, l) != 0) return false;
+    MsgConfigRequest req;
+    req.want_map = 0;
+    if (net_send_msg(fd, MSG_CONFIG_REQUEST, buf, (uint32_t)msg_config_request_encode(&req, buf)) != 0) return false;
+    return net_recv_header(fd, &t, &l) == 0 && t == MSG_CONFIG && net_discard(fd, l) == 0;
+}
+
+/* Usage: bench_timeouts [silent conns] [wheel timers] [tcp port] [server] */
+int main(int argc, char **argv) {
+    int silent = (argc >= 2) ? atoi(argv[1]) : 500;
+    int timers = (argc >= 3) ? atoi(argv[2]) : 1000000;
+    int port = (argc >= 4) ? atoi(argv[3]) : 47200;
+    const char *server = (argc >= 5) ? argv[4] : "./server/server";
+    if (silent < 0) silent = 0;
+    if (timers < 1) timers = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    bench_wheel(timers);
+
+    /* A large walled board makes each full config about 650 KB, so a
+     * client asking for it over and over without reading stalls the
+     * server's send in well under a second. */
+    char pbuf[16];
+    (void)snprintf(pbuf, sizeof(pbuf), "%d", port);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return 1;
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(127);
+        execl(server, server, "--handshake-sec", "1", "--idle-sec", "2", "--send-stall-ms", "500",
+              pbuf, "-", "0", "1", "120", "20000", "20000", (char*)NULL);
+        _exit(127);
+    }
+    int probe = -1;
+    for (int i=0;i<100 && probe < 0;i++) {
+        sleep_ms(50);
+        probe = net_connect_tcp("127.0.0.1", port);
+    }
+    if (probe < 0) {
+        fprintf(stderr, "server did not start\n");
+        kill(pid, SIGKILL);
+        return 1;
+    }
+    close(probe);
+    sleep_ms(100);
+
+    int base_threads, base_fds;
+    usage_of(pid, &base_threads, &base_fds);
+
+    /* Silent: connect and never send. Half: HELLO, then nothing, holding
+     * a slot mid-handshake. Idle: a finished handshake, then silence.
+     * Flood: pings to stay alive while asking for configs it never reads. */
+    int half = MAX_PLAYERS / 4, idle = MAX_PLAYERS / 4, flood = MAX_PLAYERS / 8;
+    int total = silent + half + idle + flood;
+    int *fds = (int*)malloc((size_t)total * sizeof(int));
+    if (!fds) return 1;
+    int open_fds = 0, bad = 0;
+    for (int i=0;i<total;i++) {
+        int fd = connect_small(port);
+        if (fd < 0) { bad++; continue; }
+        fds[open_fds++] = fd;
+        if (i < silent) continue;
+        if (i < silent + half) { if (!send_hello(fd)) bad++; continue; }
+        if (!handshake(fd)) bad++;
+    }
+    int flood_from = open_fds - flood;
+    uint64_t t0 = now_ns();
+    int stalled_threads = 0, stalled_fds = 0;
+    while (now_ns() - t0 < 4000000000ULL) {
+        for (int i=flood_from;i<open_fds;i++) {
+            uint8_t buf[WIRE_SIZE(msg_ping)];
+            MsgPing ping;
+            ping.client_ms = 0;
+            (void)net_send_msg(fds[i], MSG_PING, buf, (uint32_t)msg_ping_encode(&ping, buf));
+            MsgConfigRequest req;
+            uint8_t rbuf[WIRE_SIZE(msg_config_request)];
+            req.want_map = 1;
+            (void)net_send_msg(fds[i], MSG_CONFIG_REQUEST, rbuf, (uint32_t)msg_config_request_encode(&req, rbuf));
+        }
+        if (stalled_threads == 0 && now_ns() - t0 > 300000000ULL) usage_of(pid, &stalled_threads, &stalled_fds);
+        sleep_ms(50);
+    }
+    int after_threads, after_fds;
+    usage_of(pid, &after_threads, &after_fds);
+
+    /* Every slot should be free again. */
+    int joined = 0;
+    int fresh[MAX_PLAYERS];
+    for (int i=0;i<MAX_PLAYERS;i++) {
+        fresh[i] = net_connect_tcp("127.0.0.1", port);
+        if (fresh[i] >= 0 && handshake(fresh[i])) joined++;
+    }
+
+    printf("server: %d silent, %d mid-handshake, %d idle, %d flooding connections (%d failed to set up)\n",
+           silent, half, idle, flood, bad);
+    printf("%-26s %8s %8s\n", "", "threads", "fds");
+    printf("%-26s %8d %8d\n", "before", base_threads, base_fds);
+    printf("%-26s %8d %8d\n", "stalled", stalled_threads, stalled_fds);
+    printf("%-26s %8d %8d\n", "4 s later", after_threads, after_fds);
+    printf("fresh joins afterwards: %d of %d\n", joined, MAX_PLAYERS);
+
+    for (int i=0;i<MAX_PLAYERS;i++) if (fresh[i] >= 0) close(fresh[i]);
+    for (int i=0;i<open_fds;i++) close(fds[i]);
+    free(fds);
+    kill(pid, SIGINT);
+    (void)waitpid(pid, NULL, 0);
+    bool ok = g_early == 0 && after_threads <= base_threads + 1 && after_fds <= base_fds + 1 && joined == MAX_PLAYERS;
+    return ok ? 0 : 1;
+}
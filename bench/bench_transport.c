@@ -0,0 +1,136 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/net.h"
+#include "../common/protocol.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void fill_state(MsgState *st, int players, int segs) {
+    memset(st, 0, sizeof(*st));
+    st->tick_ms = 120;
+    st->w = 2000;
+    st->h = 1000;
+    st->num_players = (uint8_t)players;
+    st->num_fruits = MAX_FRUITS;
+    for (int i=0;i<players;i++) {
+        PlayerState *ps = &st->players[i];
+        ps->player_id = (uint8_t)i;
+        ps->connected = ps->active = ps->alive = 1;
+        ps->len = (uint16_t)segs;
+        for (int k=0;k<segs;k++) ps->body[k] = (Cell){ 100 + i * 50 - k, 200 + i };
+    }
+    for (int i=0;i<MAX_FRUITS;i++) st->fruits[i].pos = (Cell){ 10 * i, 20 * i };
+}
+
+/* The far end: echoes MSG_STATE, swallows MSG_STATE_VIEW and answers
+ * MSG_PING once a stream of them has been drained. */
+static void *peer_main(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    static uint8_t buf[MSG_STATE_MAX_LEN];
+    for (;;) {
+        uint16_t t;
+        uint32_t l;
+        if (net_recv_header(fd, &t, &l) != 0 || l > sizeof(buf)) break;
+        if (net_recv_all(fd, buf, (int)l) != 0) break;
+        if (t == MSG_STATE) (void)net_send_msg(fd, MSG_STATE, buf, l);
+        else if (t == MSG_PING) (void)net_send_msg(fd, MSG_PONG, buf, l);
+    }
+    close(fd);
+    return NULL;
+}
+
+/* Connects a pair of stream fds over the transport; false when it is not
+ * available here. */
+static bool open_link(const char *spec, int fds[2]) {
+    if (strcmp(spec, "pair") == 0) return socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0;
+    NetAddr a;
+    if (!net_addr_parse(spec, 0, &a)) return false;
+    int lfd = net_listen(&a, 1, 0);
+    if (lfd < 0) return false;
+    fds[0] = net_connect(&a);
+    fds[1] = (fds[0] >= 0) ? accept(lfd, NULL, NULL) : -1;
+    net_unlisten(&a, lfd);
+    if (fds[1] < 0) {
+        if (fds[0] >= 0) close(fds[0]);
+        return false;
+    }
+    return true;
+}
+
+static void run(const char *label, const char *spec, const uint8_t *frame, uint32_t len, int iters) {
+    int fds[2];
+    if (!open_link(spec, fds)) {
+        printf("%-8s %8u %10s\n", label, len, "n/a");
+        return;
+    }
+    pthread_t th;
+    if (pthread_create(&th, NULL, peer_main, (void*)(intptr_t)fds[1]) != 0) exit(1);
+
+    static uint8_t back[MSG_STATE_MAX_LEN];
+    uint16_t t;
+    uint32_t l;
+
+    /* Latency: one frame out, the same frame back, one at a time. */
+    uint64_t t0 = now_ns();
+    for (int i=0;i<iters;i++) {
+        if (net_send_msg(fds[0], MSG_STATE, frame, len) != 0) exit(1);
+        if (net_recv_header(fds[0], &t, &l) != 0 || net_recv_all(fds[0], back, (int)l) != 0) exit(1);
+    }
+    double rtt_us = (double)(now_ns() - t0) / iters / 1000.0;
+
+    /* Throughput: a burst of frames one way, then a ping to wait for the
+     * peer to have read them all. */
+    int burst = iters * 4;
+    uint8_t ping[WIRE_SIZE(msg_ping)] = { 0 };
+    t0 = now_ns();
+    for (int i=0;i<burst;i++) {
+        if (net_send_msg(fds[0], MSG_STATE_VIEW, frame, len) != 0) exit(1);
+    }
+    if (net_send_msg(fds[0], MSG_PING, ping, sizeof(ping)) != 0) exit(1);
+    if (net_recv_header(fds[0], &t, &l) != 0 || net_recv_all(fds[0], back, (int)l) != 0) exit(1);
+    uint64_t ns = now_ns() - t0;
+    double msgs = (double)burst / ((double)ns / 1e9);
+    double mbs = (double)(len + WIRE_SIZE(msg_header)) * msgs / (1024.0 * 1024.0);
+
+    printf("%-8s %8u %10.1f %12.0f %10.0f\n", label, len, rtt_us, msgs, mbs);
+    close(fds[0]);
+    pthread_join(th, NULL);
+}
+
+/* Usage: bench_transport [iters] [tcp port] */
+int main(int argc, char **argv) {
+    int iters = (argc >= 2) ? atoi(argv[1]) : 20000;
+    int port = (argc >= 3) ? atoi(argv[2]) : 6100;
+    if (iters < 1) iters = 1;
+
+    char tcp[64], unx[64];
+    (void)snprintf(tcp, sizeof(tcp), "tcp:127.0.0.1:%d", port);
+    (void)snprintf(unx, sizeof(unx), "unix:@snake-bench-%d", (int)getpid());
+
+    static MsgState st;
+    static uint8_t frame[MSG_STATE_MAX_LEN];
+    int shapes[][2] = { { 4, 8 }, { MAX_PLAYERS, 16 }, { MAX_PLAYERS, MAX_SEGMENTS } };
+
+    printf("%d round trips, %d streamed frames per case\n", iters, iters * 4);
+    printf("%-8s %8s %10s %12s %10s\n", "link", "bytes", "rtt us", "msgs/s", "MiB/s");
+    for (int s=0;s<3;s++) {
+        fill_state(&st, shapes[s][0], shapes[s][1]);
+        uint32_t len = (uint32_t)msg_state_encode(&st, frame);
+        run("tcp", tcp, frame, len, iters);
+        run("unix", unx, frame, len, iters);
+        run("pair", "pair", frame, len, iters);
+    }
+    return 0;
+}
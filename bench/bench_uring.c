@@ -0,0 +1,276 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/net.h"
+#include "../common/protocol.h"
+#include "../server/uring.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void fill_state(MsgState *st, int players, int segs) {
+    memset(st, 0, sizeof(*st));
+    st->tick_ms = 120;
+    st->w = 2000;
+    st->h = 1000;
+    st->num_players = (uint8_t)players;
+    st->num_fruits = MAX_FRUITS;
+    for (int i=0;i<players;i++) {
+        PlayerState *ps = &st->players[i];
+        ps->player_id = (uint8_t)i;
+        ps->connected = ps->active = ps->alive = 1;
+        ps->len = (uint16_t)segs;
+        for (int k=0;k<segs;k++) ps->body[k] = (Cell){ 100 + i * 50 - k, 200 + i };
+    }
+    for (int i=0;i<MAX_FRUITS;i++) st->fruits[i].pos = (Cell){ 10 * i, 20 * i };
+}
+
+/* The clients: one thread reading every client socket through epoll and
+ * throwing the snapshots away. */
+typedef struct {
+    int n;
+    const int *fds;
+    int stop;
+} Drain;
+
+static void *drain_main(void *arg) {
+    Drain *d = (Drain*)arg;
+    int ep = epoll_create1(0);
+    for (int i=0;i<d->n;i++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = d->fds[i] };
+        (void)epoll_ctl(ep, EPOLL_CTL_ADD, d->fds[i], &ev);
+    }
+    static uint8_t buf[1 << 16];
+    struct epoll_event evs[64];
+    while (!__atomic_load_n(&d->stop, __ATOMIC_ACQUIRE)) {
+        int k = epoll_wait(ep, evs, 64, 20);
+        for (int i=0;i<k;i++) (void)recv(evs[i].data.fd, buf, sizeof(buf), MSG_DONTWAIT);
+    }
+    close(ep);
+    return NULL;
+}
+
+/* The server side of the thread backend: one blocked reader per client,
+ * header then payload as client_thread reads them. */
+static uint64_t g_recv_calls;
+
+static void *reader_main(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    uint8_t in[64];
+    for (;;) {
+        uint16_t t;
+        uint32_t l;
+        if (net_recv_header(fd, &t, &l) != 0 || l > sizeof(in) || net_recv_all(fd, in, (int)l) != 0) break;
+        __atomic_fetch_add(&g_recv_calls, 2, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    double syscalls;        /* server side, per tick */
+    double tick_us;         /* from the first send to the last completion */
+    uint32_t p50_us, p99_us, max_us;
+} Result;
+
+/* Every tick each client sends one MSG_INPUT and is sent one snapshot;
+ * lat[] gets each send's completion time from the start of the tick.
+ * Returns 1, 0 on a failure, or -1 when there is no io_uring here. */
+static int run(bool uring, int n, int ticks, const uint8_t *frame, uint32_t len, Result *res) {
+    int *srv = (int*)calloc((size_t)n, sizeof(int));
+    int *cli = (int*)calloc((size_t)n, sizeof(int));
+    uint32_t *lat = (uint32_t*)calloc((size_t)n * (size_t)ticks, sizeof(uint32_t));
+    if (!srv || !cli || !lat) return 0;
+    for (int i=0;i<n;i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+            perror("socketpair");
+            return 0;
+        }
+        srv[i] = sv[0];
+        cli[i] = sv[1];
+    }
+    Drain drain = { n, cli, 0 };
+    pthread_t drain_tid;
+    if (pthread_create(&drain_tid, NULL, drain_main, &drain) != 0) return 0;
+
+    uint8_t input[WIRE_SIZE(msg_header) + WIRE_SIZE(msg_input)];
+    MsgHeader ih = { MSG_INPUT, (uint32_t)WIRE_SIZE(msg_input) };
+    MsgInput mi;
+    memset(&mi, 0, sizeof(mi));
+    mi.dir = 1;
+    (void)msg_header_encode(&ih, input);
+    (void)msg_input_encode(&mi, input + WIRE_SIZE(msg_header));
+
+    uint8_t hdr[WIRE_SIZE(msg_header)];
+    MsgHeader sh = { MSG_STATE, len };
+    (void)msg_header_encode(&sh, hdr);
+
+    Uring ring;
+    struct iovec *iov = NULL;
+    struct msghdr *msg = NULL;
+    pthread_t *readers = NULL;
+    uint64_t syscalls = 0, busy_ns = 0;
+    bool ok = true;
+    int rc = 1;
+
+    if (uring) {
+        char err[128];
+        if (!uring_init(&ring, 4096, 1024, 2048, err, sizeof(err))) {
+            fprintf(stderr, "io_uring: %s\n", err);
+            ok = false;
+            rc = -1;
+            goto out;
+        }
+        iov = (struct iovec*)calloc((size_t)n * 2, sizeof(struct iovec));
+        msg = (struct msghdr*)calloc((size_t)n, sizeof(struct msghdr));
+        for (int i=0;i<n;i++) {
+            struct io_uring_sqe *sqe = uring_sqe(&ring);
+            uring_prep_recv_multishot(sqe, srv[i], (uint64_t)i << 1 | 1);
+        }
+        (void)uring_submit(&ring, 0, 0);
+        ring.stats = (UringStats){0};
+    } else {
+        readers = (pthread_t*)calloc((size_t)n, sizeof(pthread_t));
+        for (int i=0;i<n;i++) (void)pthread_create(&readers[i], NULL, reader_main, (void*)(intptr_t)srv[i]);
+        __atomic_store_n(&g_recv_calls, 0, __ATOMIC_RELAXED);
+    }
+
+    for (int k=0;k<ticks && ok;k++) {
+        for (int i=0;i<n;i++) (void)send(cli[i], input, sizeof(input), MSG_NOSIGNAL);
+        uint32_t *l = lat + (size_t)k * (size_t)n;
+        uint64_t t0 = now_ns();
+        if (!uring) {
+            for (int i=0;i<n;i++) {
+                if (net_send_msg(srv[i], MSG_STATE, frame, len) != 0) ok = false;
+                l[i] = (uint32_t)((now_ns() - t0) / 1000);
+            }
+            syscalls += (uint64_t)n;
+            busy_ns += now_ns() - t0;
+            continue;
+        }
+        for (int i=0;i<n;i++) {
+            iov[2 * i] = (struct iovec){ hdr, sizeof(hdr) };
+            iov[2 * i + 1] = (struct iovec){ (void*)frame, len };
+            memset(&msg[i], 0, sizeof(msg[i]));
+            msg[i].msg_iov = &iov[2 * i];
+            msg[i].msg_iovlen = 2;
+            uring_prep_sendmsg(uring_sqe(&ring), srv[i], &msg[i], (uint64_t)i << 1);
+        }
+        /* Reap the sends and the tick's inputs, submitting re-armed
+         * receives with the next wait. */
+        int sent = 0;
+        uint64_t in_bytes = 0;
+        while (ok && (sent < n || in_bytes < (uint64_t)n * sizeof(input))) {
+            if (uring_submit(&ring, 1, 1000) != 0) ok = false;
+            struct io_uring_cqe *cqe;
+            while ((cqe = uring_peek(&ring)) != NULL) {
+                int i = (int)(cqe->user_data >> 1);
+                if (cqe->user_data & 1) {
+                    if (cqe->res > 0) {
+                        in_bytes += (uint64_t)cqe->res;
+                        uring_buf_return(&ring, cqe);
+                    } else if (cqe->res != -ENOBUFS) {
+                        ok = false;
+                    }
+                    if (!(cqe->flags & IORING_CQE_F_MORE)) uring_prep_recv_multishot(uring_sqe(&ring), srv[i], cqe->user_data);
+                } else {
+                    if (cqe->res != (int)(sizeof(hdr) + len)) ok = false;
+                    l[i] = (uint32_t)((now_ns() - t0) / 1000);
+                    sent++;
+                }
+                uring_cqe_seen(&ring);
+            }
+        }
+        busy_ns += now_ns() - t0;
+    }
+
+    if (uring && ok) syscalls = ring.stats.enters;
+    else if (!uring) syscalls += __atomic_load_n(&g_recv_calls, __ATOMIC_RELAXED);
+    qsort(lat, (size_t)n * (size_t)ticks, sizeof(uint32_t), cmp_u32);
+    size_t total = (size_t)n * (size_t)ticks;
+    res->syscalls = (double)syscalls / ticks;
+    res->tick_us = (double)busy_ns / ticks / 1000.0;
+    res->p50_us = lat[total / 2];
+    res->p99_us = lat[total * 99 / 100];
+    res->max_us = lat[total - 1];
+
+out:
+    for (int i=0;i<n;i++) shutdown(srv[i], SHUT_RDWR);
+    if (readers) {
+        for (int i=0;i<n;i++) pthread_join(readers[i], NULL);
+    }
+    if (uring && iov) uring_free(&ring);
+    __atomic_store_n(&drain.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(drain_tid, NULL);
+    for (int i=0;i<n;i++) {
+        close(srv[i]);
+        close(cli[i]);
+    }
+    free(readers);
+    free(iov);
+    free(msg);
+    free(srv);
+    free(cli);
+    free(lat);
+    return ok ? 1 : (rc < 0 ? -1 : 0);
+}
+
+/* Usage: bench_uring [ticks] [max clients] */
+int main(int argc, char **argv) {
+    int ticks = (argc >= 2) ? atoi(argv[1]) : 200;
+    int max_clients = (argc >= 3) ? atoi(argv[2]) : 512;
+    if (ticks < 1) ticks = 1;
+
+    /* Two sockets a client. */
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        (void)setrlimit(RLIMIT_NOFILE, &rl);
+        if (rl.rlim_cur != RLIM_INFINITY && (rlim_t)max_clients * 2 + 64 > rl.rlim_cur) {
+            max_clients = (int)((rl.rlim_cur - 64) / 2);
+        }
+    }
+
+    static MsgState st;
+    static uint8_t frame[MSG_STATE_MAX_LEN];
+    fill_state(&st, 8, 16);
+    uint32_t len = (uint32_t)msg_state_encode(&st, frame);
+
+    printf("%d ticks, %u-byte snapshots and one input per client per tick, socketpairs\n", ticks, (unsigned)len);
+    printf("%-8s %8s %12s %10s %9s %9s %9s\n", "backend", "clients", "syscalls/t", "tick us", "p50 us", "p99 us", "max us");
+    int bad = 0;
+    for (int n=MAX_PLAYERS;n<=max_clients;n*=4) {
+        for (int u=0;u<2;u++) {
+            Result r;
+            memset(&r, 0, sizeof(r));
+            int rc = run(u == 1, n, ticks, frame, len, &r);
+            if (rc <= 0) {
+                printf("%-8s %8d %12s\n", u ? "uring" : "threads", n, rc < 0 ? "n/a" : "FAILED");
+                if (rc == 0) bad++;
+                continue;
+            }
+            printf("%-8s %8d %12.1f %10.0f %9u %9u %9u\n", u ? "uring" : "threads", n, r.syscalls, r.tick_us,
+                   (unsigned)r.p50_us, (unsigned)r.p99_us, (unsigned)r.max_us);
+        }
+    }
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Keeps the optimiser from dropping work whose result is never used. */
+static volatile uint64_t g_sink;
+
+static void report(const char *label, uint64_t ns, int iters, size_t bytes) {
+    double per = (double)ns / iters;
+    double mbs = (double)bytes * iters / ((double)ns / 1e9) / (1024.0 * 1024.0);
+    printf("%-26s %10.1f %12.0f %10zu\n", label, per, mbs, bytes);
+}
+
+static void fill_state(MsgState *st, int players, int segs) {
+    memset(st, 0, sizeof(*st));
+    st->tick_ms = 120;
+    st->mode = 1;
+    st->w = 2000;
+    st->h = 1000;
+    st->time_left_sec = 77;
+    st->elapsed_sec = 43;
+    st->num_players = (uint8_t)players;
+    st->num_fruits = MAX_FRUITS;
+    for (int i=0;i<players;i++) {
+        PlayerState *ps = &st->players[i];
+        ps->player_id = (uint8_t)i;
+        ps->connected = ps->active = ps->alive = 1;
+        ps->score = (uint16_t)(i * 7);
+        ps->time_sec = 43;
+        ps->dir = (uint8_t)(i & 3);
+        ps->len = (uint16_t)segs;
+        for (int k=0;k<segs;k++) ps->body[k] = (Cell){ 100 + i * 50 - k, 200 + i };
+    }
+    for (int i=0;i<MAX_FRUITS;i++) {
+        st->fruits[i].pos = (Cell){ 10 * i, 20 * i };
+        st->fruits[i].visited_mask = 0x5u << i;
+    }
+}
+
+int main(int argc, char **argv) {
+    int iters = (argc >= 2) ? atoi(argv[1]) : 200000;
+    if (iters < 1) iters = 1;
+
+    static MsgState st, back;
+    static uint8_t buf[MSG_STATE_MAX_LEN];
+
+    printf("%-26s %10s %12s %10s\n", "case", "ns/msg", "MiB/s", "bytes");
+
+    int shapes[][2] = { { 4, 8 }, { MAX_PLAYERS, MAX_SEGMENTS } };
+    for (int s=0;s<2;s++) {
+        fill_state(&st, shapes[s][0], shapes[s][1]);
+        size_t len = msg_state_encode(&st, buf);
+        char label[64];
+
+        uint64_t t0 = now_ns();
+        for (int i=0;i<iters;i++) {
+            st.elapsed_sec = (uint16_t)i;
+            g_sink += msg_state_encode(&st, buf);
+        }
+        (void)snprintf(label, sizeof(label), "state %dx%d encode", shapes[s][0], shapes[s][1]);
+        report(label, now_ns() - t0, iters, len);
+
+        t0 = now_ns();
+        for (int i=0;i<iters;i++) {
+            if (!msg_state_decode(&back, buf, len)) {
+                fprintf(stderr, "decode failed\n");
+                return 1;
+            }
+            g_sink += back.players[0].len;
+        }
+        (void)snprintf(label, sizeof(label), "state %dx%d decode", shapes[s][0], shapes[s][1]);
+        report(label, now_ns() - t0, iters, len);
+
+        if (back.players[1].body[2].x != st.players[1].body[2].x || back.tick_ms != st.tick_ms) {
+            fprintf(stderr, "round trip mismatch\n");
+            return 1;
+        }
+    }
+
+    /* Long snakes winding across a wrapping edge, as a view feed on a big
+     * board would carry them: every body of a snapshot packed and unpacked,
+     * against the raw cells the old format sent. */
+    enum { BODY_SNAKES = MAX_PLAYERS, BODY_SEGS = VIEW_MAX_SEGMENTS, BODY_W = 2000, BODY_H = 1000 };
+    static Cell bodies[BODY_SNAKES][BODY_SEGS], unpacked[BODY_SEGS];
+    static uint8_t packed[BODY_SNAKES * BODY_MAX_LEN(BODY_SEGS)];
+    for (int i=0;i<BODY_SNAKES;i++) {
+        Cell c = { BODY_W - 40 + i, 30 * i };
+        for (int k=0;k<BODY_SEGS;k++) {
+            bodies[i][k] = c;
+            if ((k / 16) & 1) c.y = (c.y + 1) % BODY_H;
+            else c.x = (c.x + 1) % BODY_W;
+        }
+    }
+    size_t body_bytes = 0;
+    for (int i=0;i<BODY_SNAKES;i++)
+        body_bytes += body_encode(bodies[i], BODY_SEGS, BODY_W, BODY_H, packed + body_bytes);
+    size_t raw_bytes = (size_t)BODY_SNAKES * BODY_SEGS * WIRE_LEN_CELL;
+    int body_iters = iters / 100 > 0 ? iters / 100 : 1;
+
+    uint64_t t0 = now_ns();
+    for (int i=0;i<body_iters;i++) {
+        size_t off = 0;
+        bodies[0][0].x = i & 1;
+        for (int p=0;p<BODY_SNAKES;p++) off += body_encode(bodies[p], BODY_SEGS, BODY_W, BODY_H, packed + off);
+        g_sink += off;
+    }
+    report("bodies 32x1024 encode", now_ns() - t0, body_iters, body_bytes);
+    bodies[0][0].x = BODY_W - 40;
+    for (size_t p=0, off=0;p<BODY_SNAKES;p++) off += body_encode(bodies[p], BODY_SEGS, BODY_W, BODY_H, packed + off);
+
+    t0 = now_ns();
+    for (int i=0;i<body_iters;i++) {
+        size_t off = 0;
+        for (int p=0;p<BODY_SNAKES;p++) {
+            int n;
+            size_t used = body_decode(packed + off, body_bytes - off, BODY_W, BODY_H, unpacked, BODY_SEGS, &n);
+            if (used == 0 || n != BODY_SEGS) {
+                fprintf(stderr, "body decode failed\n");
+                return 1;
+            }
+            off += used;
+        }
+        g_sink += unpacked[BODY_SEGS - 1].x;
+    }
+    report("bodies 32x1024 decode", now_ns() - t0, body_iters, body_bytes);
+    if (memcmp(unpacked, bodies[BODY_SNAKES - 1], sizeof(unpacked)) != 0) {
+        fprintf(stderr, "body round trip mismatch\n");
+        return 1;
+    }
+    printf("%-26s %10s %12s %10zu  (%.1fx smaller)\n", "bodies 32x1024 raw cells", "", "",
+           raw_bytes, (double)raw_bytes / (double)body_bytes);
+
+    /* Reading a few header fields in place against decoding the whole
+     * record, which is what a relay or a logger would do. */
+    MsgStateView hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.tick_ms = 120;
+    hdr.w = 200000;
+    hdr.h = 100000;
+    hdr.view_x = 4000;
+    hdr.view_y = 9000;
+    hdr.num_players = 12;
+    size_t hlen = msg_state_view_encode(&hdr, buf);
+
+    t0 = now_ns();
+    for (int i=0;i<iters * 10;i++) {
+        MsgStateView h;
+        buf[0] = (uint8_t)i;
+        if (!msg_state_view_decode(&h, buf, hlen)) return 1;
+        g_sink += h.view_x + h.num_players;
+    }
+    report("view header decode", now_ns() - t0, iters * 10, hlen);
+
+    t0 = now_ns();
+    for (int i=0;i<iters * 10;i++) {
+        buf[0] = (uint8_t)i;
+        const uint8_t *v = msg_state_view_at(buf, hlen);
+        if (!v) return 1;
+        g_sink += msg_state_view_view_x(v) + msg_state_view_num_players(v);
+    }
+    report("view header in place", now_ns() - t0, iters * 10, hlen);
+    return 0;
+}
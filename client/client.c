@@ -2,19 +2,25 @@
 
 #include "../common/net.h"
 #include "../common/protocol.h"
+#include "../common/recording.h"
+#include "../common/world.h"
 
-#include <arpa/inet.h>
+#include <fcntl.h>
 #include <ncurses.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include "client.h"
+#include "mapcache.h"
+#include "../server/server.h"
 
 static volatile sig_atomic_t g_running = 1;
 
@@ -41,10 +47,53 @@ static void read_line(const char *prompt, char *out, size_t cap, const char *def
     if (out[0] == 0 && def) (void)snprintf(out, cap, "%s", def);
 }
 
-static int spawn_server_process(int port, const char *map_path, int mode, int world, int time_limit, int w, int h) {
+/* The bundled board for "New game" with obstacles, found next to the
+ * binary (client/client sits one level below data/) and then under the
+ * working directory. Without either the game gets a generated board with
+ * obstacles, "-", instead. */
+static const char *local_map_path(char *out, size_t cap) {
+    char exe[4096];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n > 0) {
+        exe[n] = '\0';
+        char *slash = strrchr(exe, '/');
+        if (slash) *slash = '\0';
+        if (slash && (size_t)snprintf(out, cap, "%s/../data/map1.txt", exe) < cap && access(out, R_OK) == 0) return out;
+    }
+    if (access("data/map1.txt", R_OK) == 0) return "data/map1.txt";
+    return "-";
+}
+
+/* Runs the server for "New game" in a forked child that keeps talking to
+ * us over a socketpair. Nothing is exec'd, so it does not matter which
+ * directory the client was started from, and there is nothing to wait
+ * for: our MSG_HELLO sits in the socket until the game is up and the
+ * server picks it up. The child's output would land on our curses screen,
+ * so it goes to a log file instead (/dev/null when that cannot be made).
+ * Returns our end of the pair, or -1. */
+static int start_local_server(int port, const char *map_path, int mode, int world, int time_limit, int w, int h) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return -1;
+    fflush(stdout);
     pid_t pid = fork();
-    if (pid < 0) return -1;
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
     if (pid == 0) {
+        close(sv[0]);
+        const char *tmp = getenv("TMPDIR");
+        char log[512];
+        (void)snprintf(log, sizeof(log), "%s/snake-local-%d.log", (tmp && tmp[0]) ? tmp : "/tmp", port);
+        int lfd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (lfd < 0) lfd = open("/dev/null", O_WRONLY);
+        if (lfd >= 0) {
+            (void)dup2(lfd, STDOUT_FILENO);
+            (void)dup2(lfd, STDERR_FILENO);
+            if (lfd > STDERR_FILENO) close(lfd);
+        }
+
         char pbuf[16], mbuf[16], worldbuf[16], tbuf[16], wdim[16], hdim[16];
         (void)snprintf(pbuf, sizeof(pbuf), "%d", port);
         (void)snprintf(mbuf, sizeof(mbuf), "%d", mode);
@@ -56,9 +105,9 @@ static int spawn_server_process(int port, const char *map_path, int mode, int wo
         char *argvv[10];
         int i = 0;
 
-        argvv[i++] = (char *)"./server/server";
+        argvv[i++] = (char *)"server";
         argvv[i++] = pbuf;
-        argvv[i++] = (char *)(map_path ? map_path : "data/map1.txt");
+        argvv[i++] = (char *)(map_path ? map_path : "-");
         argvv[i++] = mbuf;
         argvv[i++] = worldbuf;
         argvv[i++] = tbuf;
@@ -68,119 +117,466 @@ static int spawn_server_process(int port, const char *map_path, int mode, int wo
           argvv[i++] = hdim;
         }
 
-        argvv[i++] = NULL;
+        argvv[i] = NULL;
 
-        execv(argvv[0], argvv);
-        _exit(127);
+        _exit(run_server(i, argvv, sv[1]));
     }
-    return 0; 
+    close(sv[1]);
+    return sv[0];
+}
+
+/* What a client keeps between connections: enough to take its slot back
+ * with MSG_RESUME and to skip the map download when it has not changed. */
+typedef struct {
+    int player_id;
+    bool has_token;
+    uint8_t token[RESUME_TOKEN_LEN];
+    bool has_config;
+    uint8_t config_hash[CONFIG_HASH_LEN];
+    MsgConfig cfg;
+    World map;
+    /* Set between MSG_CONFIG_CHANGED and the MSG_CONFIG it asked for. */
+    bool reload_pending;
+    bool reload_want_map;
+    uint8_t reload_config_hash[CONFIG_HASH_LEN];
+    uint8_t reload_map_hash[CONFIG_HASH_LEN];
+    /* The verified cache entry a config request left the map out for,
+     * held until that MSG_CONFIG arrives. */
+    uint8_t *cached_map;
+    uint32_t cached_len;
+} ClientSession;
+
+/* Asks for the config, leaving the map out only when the cache entry for
+ * map_hash has been read back and still hashes to its name: it is kept in
+ * the session, so nothing can go missing before the reply. Returns whether
+ * the map was asked for, or -1. */
+static int request_config(int fd, ClientSession *cs, const uint8_t map_hash[CONFIG_HASH_LEN]) {
+    free(cs->cached_map);
+    cs->cached_map = mapcache_load(map_hash, &cs->cached_len);
+
+    MsgConfigRequest req;
+    uint8_t out[WIRE_SIZE(msg_config_request)];
+    req.want_map = cs->cached_map ? 0 : 1;
+    if (net_send_msg(fd, MSG_CONFIG_REQUEST, out, (uint32_t)msg_config_request_encode(&req, out)) != 0) return -1;
+    return req.want_map;
+}
+
+static bool decode_board(const MsgConfig *cfg, const uint8_t *map_bytes, uint32_t map_len, World *map) {
+    bool ok = world_init(map, (int32_t)cfg->w, (int32_t)cfg->h) &&
+              world_decode(map, map_bytes, map_len, cfg->num_chunks);
+    if (!ok) world_free(map);
+    return ok;
 }
 
-static int connect_and_handshake(const char *host, int port, const char *name, int *out_fd, int *out_player_id, MsgConfig *out_cfg, uint8_t **out_map) {
-    int fd = net_connect_tcp(host, port);
+/* Decodes a MSG_CONFIG payload, taking the walls from the cache when the
+ * server left them out, and replaces the session's board with it. */
+static bool apply_config(ClientSession *cs, const uint8_t *buf, uint32_t l,
+                         const uint8_t map_hash[CONFIG_HASH_LEN], bool want_map) {
+    MsgConfig cfg;
+    if (!msg_config_decode(&cfg, buf, l)) return false;
+
+    uint32_t map_len = cfg.map_len;
+    if (WIRE_SIZE(msg_config) + map_len != l) return false;
+
+    const uint8_t *map_bytes = buf + WIRE_SIZE(msg_config);
+    uint8_t *cached = cs->cached_map;
+    cs->cached_map = NULL;
+    if (map_len == 0 && !want_map) {
+        if (!cached) return false;
+        map_bytes = cached;
+        map_len = cs->cached_len;
+    } else {
+        mapcache_store(map_hash, map_bytes, map_len);
+    }
+
+    World map;
+    bool ok = decode_board(&cfg, map_bytes, map_len, &map);
+    free(cached);
+    if (!ok) return false;
+
+    if (cs->has_config) world_free(&cs->map);
+    cs->cfg = cfg;
+    cs->map = map;
+    cs->has_config = true;
+    return true;
+}
+
+static bool recv_config(int fd, ClientSession *cs, const uint8_t map_hash[CONFIG_HASH_LEN]) {
+    int want_map = request_config(fd, cs, map_hash);
+    if (want_map < 0) return false;
+
+    uint16_t t=0; uint32_t l=0;
+    if (net_recv_header(fd, &t, &l) != 0 || t != MSG_CONFIG || l < WIRE_SIZE(msg_config)) return false;
+
+    uint8_t *buf = (uint8_t*)malloc(l);
+    if (!buf) return false;
+    if (net_recv_all(fd, buf, (int)l) != 0) { free(buf); return false; }
+    bool ok = apply_config(cs, buf, l, map_hash, want_map != 0);
+    free(buf);
+    return ok;
+}
+
+/* Joins with MSG_HELLO, or with MSG_RESUME once the session holds a token.
+ * fd, when >= 0, is an already connected stream used instead of dialing
+ * host, which is any net_addr_parse address with port as the default.
+ * Returns 0 on success, -2 when the server refused the token, else -1. */
+static int connect_and_handshake(const char *host, int port, int fd, const char *name, ClientSession *cs, int *out_fd) {
+    if (fd < 0) {
+        NetAddr addr;
+        if (!net_addr_parse(host, port, &addr)) return -1;
+        /* An inherited pair cannot be dialed again once it has dropped. */
+        if (addr.kind == NET_PAIR && cs->has_token) return -1;
+        fd = net_connect(&addr);
+    }
     if (fd < 0) return -1;
 
-    MsgHello h;
-    memset(&h, 0, sizeof(h));
-    (void)snprintf(h.name, sizeof(h.name), "%s", (name && name[0]) ? name : "player");
-    if (net_send_msg(fd, MSG_HELLO, &h, (uint32_t)sizeof(h)) != 0) { close(fd); return -1; }
+    uint8_t buf[WIRE_SIZE(msg_welcome)];
+    uint32_t n;
+    uint16_t type;
+    if (cs->has_token) {
+        MsgResume r;
+        r.version = PROTOCOL_VERSION;
+        memcpy(r.token, cs->token, RESUME_TOKEN_LEN);
+        memcpy(r.config_hash, cs->config_hash, CONFIG_HASH_LEN);
+        if (!cs->has_config) memset(r.config_hash, 0, CONFIG_HASH_LEN);
+        type = MSG_RESUME;
+        n = (uint32_t)msg_resume_encode(&r, buf);
+    } else {
+        MsgHello h;
+        memset(&h, 0, sizeof(h));
+        h.version = PROTOCOL_VERSION;
+        (void)snprintf(h.name, sizeof(h.name), "%s", (name && name[0]) ? name : "player");
+        type = MSG_HELLO;
+        n = (uint32_t)msg_hello_encode(&h, buf);
+    }
+    if (net_send_msg(fd, type, buf, n) != 0) { close(fd); return -1; }
 
     uint16_t t=0; uint32_t l=0;
-    if (net_recv_header(fd, &t, &l) != 0 || t != MSG_WELCOME || l != sizeof(MsgWelcome)) { close(fd); return -1; }
+    if (net_recv_header(fd, &t, &l) != 0) { close(fd); return -1; }
+    if (t == MSG_BYE) { close(fd); return -2; }
+    if (t != MSG_WELCOME || l != WIRE_SIZE(msg_welcome)) { close(fd); return -1; }
     MsgWelcome w;
-    if (net_recv_all(fd, &w, (int)sizeof(w)) != 0) { close(fd); return -1; }
-    int pid = (int)ntohl(w.player_id);
+    if (net_recv_all(fd, buf, (int)l) != 0) { close(fd); return -1; }
+    (void)msg_welcome_decode(&w, buf, l);
+    if (w.version != PROTOCOL_VERSION) { close(fd); return -1; }
+
+    bool cached = cs->has_token && cs->has_config &&
+                  memcmp(w.config_hash, cs->config_hash, CONFIG_HASH_LEN) == 0;
+    if (!cached && !recv_config(fd, cs, w.map_hash)) { close(fd); return -1; }
+
+    cs->player_id = (int)w.player_id;
+    memcpy(cs->token, w.token, RESUME_TOKEN_LEN);
+    memcpy(cs->config_hash, w.config_hash, CONFIG_HASH_LEN);
+    cs->has_token = true;
+    cs->reload_pending = false;
+    *out_fd = fd;
+    return 0;
+}
 
-    if (net_recv_header(fd, &t, &l) != 0 || t != MSG_CONFIG || l < sizeof(MsgConfig)) { close(fd); return -1; }
+#define RESUME_ATTEMPTS 10
+#define RESUME_RETRY_MS 500
+
+#define HUD_ROWS 10
+
+#define PING_INTERVAL_MS 1000
+
+/* Round trip comes from MSG_PING/MSG_PONG, input-to-effect from the
+ * input_ms the server echoes once a tick has consumed our press. With
+ * SNAKE_LATENCY_LOG set, each sample is appended to that file. */
+typedef struct {
+    uint32_t next_seq;
+    uint32_t acked_seq;
+    uint32_t last_ping;
+    int rtt_ms;
+    int input_ms;
+    FILE *log;
+} Latency;
+
+static uint32_t client_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL);
+}
 
-    uint8_t *buf = (uint8_t*)malloc(l);
-    if (!buf) { close(fd); return -1; }
-    if (net_recv_all(fd, buf, (int)l) != 0) { free(buf); close(fd); return -1; }
+static void latency_init(Latency *lat) {
+    memset(lat, 0, sizeof(*lat));
+    lat->next_seq = 1;
+    lat->last_ping = client_ms() - PING_INTERVAL_MS;
+    lat->rtt_ms = -1;
+    lat->input_ms = -1;
+    const char *path = getenv("SNAKE_LATENCY_LOG");
+    if (path && path[0]) lat->log = fopen(path, "a");
+}
 
-    MsgConfig cfg;
-    memcpy(&cfg, buf, sizeof(cfg));
+static void latency_log(Latency *lat, const char *kind, uint32_t seq, int ms) {
+    if (!lat->log) return;
+    fprintf(lat->log, "%u %s seq=%u %dms\n", (unsigned)client_ms(), kind, (unsigned)seq, ms);
+    fflush(lat->log);
+}
 
-    uint16_t W = ntohs(cfg.w);
-    uint16_t H = ntohs(cfg.h);
-    uint32_t map_len = ntohl(cfg.map_len);
-    if (map_len != (uint32_t)W * (uint32_t)H) { free(buf); close(fd); return -1; }
-    if (sizeof(MsgConfig) + map_len != l) { free(buf); close(fd); return -1; }
+static void latency_on_state(Latency *lat, const PlayerState *me) {
+    if (me->input_seq == 0 || (int32_t)(me->input_seq - lat->acked_seq) <= 0) return;
+    lat->acked_seq = me->input_seq;
+    lat->input_ms = (int)(client_ms() - me->input_ms);
+    latency_log(lat, "input", me->input_seq, lat->input_ms);
+}
 
-    uint8_t *map = (uint8_t*)malloc(map_len);
-    if (!map) { free(buf); close(fd); return -1; }
-    memcpy(map, buf + sizeof(MsgConfig), map_len);
-    free(buf);
+typedef struct {
+    MsgState st;
+    bool windowed;
+    int view_x, view_y, view_w, view_h;
+    bool head_hidden[MAX_PLAYERS];
+    int mm_w, mm_h;
+    uint8_t minimap[MINIMAP_MAX_W * MINIMAP_MAX_H];
+    /* Windowed bodies, which run past PlayerState's MAX_SEGMENTS; last,
+     * so a reset need not clear them. */
+    Cell bodies[MAX_PLAYERS][VIEW_MAX_SEGMENTS];
+} ViewFrame;
+
+static void view_frame_reset(ViewFrame *vf) {
+    memset(vf, 0, offsetof(ViewFrame, bodies));
+}
+
+typedef struct {
+    int x, y, w, h;
+    int W, H;
+    bool wrap;
+} Camera;
+
+static int cam_origin(int head, int view, int size, bool wrap) {
+    int o = head - view / 2;
+    if (wrap) return ((o % size) + size) % size;
+    if (o > size - view) o = size - view;
+    if (o < 0) o = 0;
+    return o;
+}
 
-    if (out_fd) *out_fd = fd;
-    if (out_player_id) *out_player_id = pid;
-    if (out_cfg) *out_cfg = cfg;
-    if (out_map) *out_map = map;
-    else free(map);
+static bool cam_axis(int v, int origin, int view, int size, bool wrap, int *out) {
+    int d = v - origin;
+    if (wrap && d < 0) d += size;
+    if (d < 0 || d >= view) return false;
+    *out = d;
+    return true;
+}
 
-    return 0;
+static bool to_screen(const Camera *c, int x, int y, int *sx, int *sy) {
+    if (x < 0 || x >= c->W || y < 0 || y >= c->H) return false;
+    return cam_axis(x, c->x, c->w, c->W, c->wrap, sx) &&
+           cam_axis(y, c->y, c->h, c->H, c->wrap, sy);
 }
 
-static void draw_game(const MsgState *st, const uint8_t *map, int my_id) {
-    int W = (int)ntohs(st->w);
-    int H = (int)ntohs(st->h);
+static void viewport_size(int W, int H, int *vw, int *vh) {
+    int cols = COLS;
+    int rows = LINES - HUD_ROWS;
+    if (cols < 1) cols = 1;
+    if (rows < 1) rows = 1;
+    *vw = (W < cols) ? W : cols;
+    *vh = (H < rows) ? H : rows;
+}
+
+/* Asks for an area-of-interest feed when the board does not fit the
+ * terminal, and for the full state again when it does. */
+static void send_viewport(int fd, int W, int H) {
+    int vw, vh;
+    viewport_size(W, H, &vw, &vh);
+    MsgViewport vp;
+    memset(&vp, 0, sizeof(vp));
+    if (vw < W || vh < H) {
+        vp.view_w = (uint16_t)(vw > VIEW_MAX_W ? VIEW_MAX_W : vw);
+        vp.view_h = (uint16_t)(vh > VIEW_MAX_H ? VIEW_MAX_H : vh);
+    }
+    uint8_t out[WIRE_SIZE(msg_viewport)];
+    (void)net_send_msg(fd, MSG_VIEWPORT, out, (uint32_t)msg_viewport_encode(&vp, out));
+}
+
+/* Unpacks a MSG_STATE_VIEW payload into the same shape as a full
+ * MsgState, so both feeds draw through one path. */
+static bool decode_state_view(const uint8_t *buf, uint32_t len, ViewFrame *vf) {
+    MsgStateView hdr;
+    if (!msg_state_view_decode(&hdr, buf, len)) return false;
+    uint32_t off = (uint32_t)WIRE_SIZE(msg_state_view);
+
+    view_frame_reset(vf);
+    MsgState *st = &vf->st;
+    st->tick = hdr.tick;
+    st->tick_ms = hdr.tick_ms;
+    st->game_over = hdr.game_over;
+    st->mode = hdr.mode;
+    st->w = hdr.w;
+    st->h = hdr.h;
+    st->time_left_sec = hdr.time_left_sec;
+    st->elapsed_sec = hdr.elapsed_sec;
+    st->global_freeze_ms = hdr.global_freeze_ms;
+
+    vf->windowed = true;
+    vf->view_x = (int)hdr.view_x;
+    vf->view_y = (int)hdr.view_y;
+    vf->view_w = hdr.view_w;
+    vf->view_h = hdr.view_h;
+
+    for (int i=0;i<(int)hdr.num_players;i++) {
+        PlayerView pv;
+        if (!player_view_decode(&pv, buf + off, len - off)) return false;
+        off += (uint32_t)WIRE_SIZE(player_view);
+        uint16_t segs = pv.seg_count;
+        if (pv.player_id >= MAX_PLAYERS) return false;
+
+        PlayerState *ps = &st->players[pv.player_id];
+        ps->player_id = pv.player_id;
+        ps->connected = pv.connected;
+        ps->active = pv.active;
+        ps->alive = pv.alive;
+        ps->paused = pv.paused;
+        ps->score = pv.score;
+        ps->time_sec = pv.time_sec;
+        ps->dir = pv.dir;
+        ps->input_seq = pv.input_seq;
+        ps->input_ms = pv.input_ms;
+        vf->head_hidden[pv.player_id] = !pv.head_in_view;
+
+        int n;
+        Cell *body = vf->bodies[pv.player_id];
+        size_t used = body_decode(buf + off, len - off, hdr.w, hdr.h, body, VIEW_MAX_SEGMENTS, &n);
+        if (used == 0 || n != (int)segs) return false;
+        off += (uint32_t)used;
+        ps->len = segs;
+        memcpy(ps->body, body, (size_t)(segs < MAX_SEGMENTS ? segs : MAX_SEGMENTS) * sizeof(Cell));
+        st->num_players++;
+    }
+
+    if (hdr.num_fruits > MAX_FRUITS) return false;
+    for (int i=0;i<(int)hdr.num_fruits;i++) {
+        if (!fruit_state_decode(&st->fruits[i], buf + off, len - off)) return false;
+        off += (uint32_t)WIRE_SIZE(fruit_state);
+    }
+    st->num_fruits = hdr.num_fruits;
+
+    if (hdr.minimap_w > MINIMAP_MAX_W || hdr.minimap_h > MINIMAP_MAX_H) return false;
+    vf->mm_w = hdr.minimap_w;
+    vf->mm_h = hdr.minimap_h;
+    uint32_t mm = (uint32_t)(vf->mm_w * vf->mm_h);
+    if (len - off < mm) return false;
+    memcpy(vf->minimap, buf + off, mm);
+    off += mm;
+    return off == len;
+}
+
+static void draw_minimap(const ViewFrame *vf, int row, int col) {
+    if (vf->mm_w <= 0 || vf->mm_h <= 0) return;
+    if (col + vf->mm_w + 2 > COLS) return;
+    mvaddch(row, col, '+');
+    for (int x=0;x<vf->mm_w;x++) mvaddch(row, col+1+x, '-');
+    mvaddch(row, col+1+vf->mm_w, '+');
+    for (int y=0;y<vf->mm_h;y++) {
+        mvaddch(row+1+y, col, '|');
+        for (int x=0;x<vf->mm_w;x++) {
+            uint8_t m = vf->minimap[y*vf->mm_w + x];
+            char ch = '.';
+            if (m & MINIMAP_FRUIT) ch = '*';
+            if (m & MINIMAP_SNAKE) ch = 'x';
+            if (m & MINIMAP_SELF) ch = '@';
+            mvaddch(row+1+y, col+1+x, ch);
+        }
+        mvaddch(row+1+y, col+1+vf->mm_w, '|');
+    }
+    mvaddch(row+1+vf->mm_h, col, '+');
+    for (int x=0;x<vf->mm_w;x++) mvaddch(row+1+vf->mm_h, col+1+x, '-');
+    mvaddch(row+1+vf->mm_h, col+1+vf->mm_w, '+');
+}
+
+static void draw_game(const ViewFrame *vf, const World *map, int my_id, int world, const Latency *lat) {
+    const MsgState *st = &vf->st;
+    int W = (int)st->w;
+    int H = (int)st->h;
+
+    /* The camera follows our head; the server chooses it for windowed
+     * feeds, otherwise it is derived locally from the full state. */
+    Camera cam;
+    cam.W = W;
+    cam.H = H;
+    cam.wrap = (world == 0);
+    if (vf->windowed) {
+        cam.x = vf->view_x;
+        cam.y = vf->view_y;
+        cam.w = vf->view_w;
+        cam.h = vf->view_h;
+    } else {
+        viewport_size(W, H, &cam.w, &cam.h);
+        const PlayerState *me = (my_id >= 0 && my_id < MAX_PLAYERS) ? &st->players[my_id] : NULL;
+        int hx = W / 2, hy = H / 2;
+        if (me && me->len > 0) { hx = me->body[0].x; hy = me->body[0].y; }
+        cam.x = cam_origin(hx, cam.w, W, cam.wrap);
+        cam.y = cam_origin(hy, cam.h, H, cam.wrap);
+    }
 
     erase();
 
-    for (int y=0;y<H;y++) {
-        for (int x=0;x<W;x++) {
+    for (int sy=0;sy<cam.h;sy++) {
+        for (int sx=0;sx<cam.w;sx++) {
+            int x = cam.x + sx;
+            int y = cam.y + sy;
+            if (x >= W) x -= W;
+            if (y >= H) y -= H;
             char ch = ' ';
-            if (map && map[y*W + x] == 1) ch = '#';
-            mvaddch(y, x, ch);
+            if (world_is_wall(map, x, y)) ch = '#';
+            mvaddch(sy, sx, ch);
         }
     }
 
     int nf = (int)st->num_fruits;
     if (nf > MAX_FRUITS) nf = MAX_FRUITS;
     for (int i=0;i<nf;i++) {
-        int fx = st->fruits[i].pos.x;
-        int fy = st->fruits[i].pos.y;
-        if (fx>=0 && fx<W && fy>=0 && fy<H) mvaddch(fy, fx, '*');
+        int sx, sy;
+        if (to_screen(&cam, st->fruits[i].pos.x, st->fruits[i].pos.y, &sx, &sy)) mvaddch(sy, sx, '*');
     }
 
     for (int i=0;i<MAX_PLAYERS;i++) {
         const PlayerState *ps = &st->players[i];
         if (!ps->active || !ps->alive) continue;
 
-        int len = (int)ntohs(ps->len);
-        if (len > MAX_SEGMENTS) len = MAX_SEGMENTS;
+        const Cell *body = vf->windowed ? vf->bodies[i] : ps->body;
+        int len = (int)ps->len;
+        int cap = vf->windowed ? VIEW_MAX_SEGMENTS : MAX_SEGMENTS;
+        if (len > cap) len = cap;
         for (int k=0;k<len;k++) {
-            int sx = ps->body[k].x;
-            int sy = ps->body[k].y;
-            if (sx<0 || sx>=W || sy<0 || sy>=H) continue;
-            char c = (k==0) ? (i==my_id ? '@' : 'O') : (i==my_id ? 'o' : 'x');
+            int sx, sy;
+            if (!to_screen(&cam, body[k].x, body[k].y, &sx, &sy)) continue;
+            bool head = (k == 0) && !vf->head_hidden[i];
+            char c = head ? (i==my_id ? '@' : 'O') : (i==my_id ? 'o' : 'x');
             mvaddch(sy, sx, c);
         }
     }
 
-    int hud_y = H + 1;
+    int hud_y = cam.h + 1;
     mvprintw(hud_y, 0, "WASD/Arrows=move | P=pause | Q=leave");
     mvprintw(hud_y+1, 0, "Mode=%s | Freeze=%dms | GameOver=%d",
              st->mode ? "TIME" : "STANDARD",
-             (int)ntohs(st->global_freeze_ms),
+             (int)st->global_freeze_ms,
              (int)st->game_over);
     
-    mvprintw(hud_y+2, 0, "Elapsed: %us", (unsigned)ntohs(st->elapsed_sec));
+    char rtt[16] = "-", input[16] = "-";
+    if (lat->rtt_ms >= 0) (void)snprintf(rtt, sizeof(rtt), "%dms", lat->rtt_ms);
+    if (lat->input_ms >= 0) (void)snprintf(input, sizeof(input), "%dms", lat->input_ms);
+    mvprintw(hud_y+2, 0, "Elapsed: %us | RTT=%s | Input=%s   ", (unsigned)st->elapsed_sec, rtt, input);
 
     if (st->mode == 1) {
-    mvprintw(hud_y+3, 0, "Remaining: %us", (unsigned)ntohs(st->time_left_sec));
+    mvprintw(hud_y+3, 0, "Remaining: %us", (unsigned)st->time_left_sec);
     }
 
     int row = hud_y + (st->mode == 1 ? 4 : 3);
 
-    mvprintw(row++, 0, "Scores:");
-      for (int i = 0; i < MAX_PLAYERS; i++) {
+    mvprintw(row++, 0, vf->windowed ? "Scores (nearby):" : "Scores:");
+    for (int i = 0; i < MAX_PLAYERS && row < LINES; i++) {
         const PlayerState *ps = &st->players[i];
         if (!ps->connected) continue;
 
-    mvprintw(row++, 0, "P%d score=%u time=%us %s%s", i, (unsigned)ntohs(ps->score), (unsigned)ntohs(ps->time_sec), ps->alive ? "" : "DEAD ",ps->paused ? "PAUSED" : "");
+        mvprintw(row++, 0, "P%d score=%u time=%us %s%s", i, (unsigned)ps->score, (unsigned)ps->time_sec, ps->alive ? "" : "DEAD ",ps->paused ? "PAUSED" : "");
+    }
+
+    if (vf->windowed) draw_minimap(vf, hud_y, 44);
 
     refresh();
-}}
+}
 
 static uint8_t key_to_dir(int ch) {
     switch (ch) {
@@ -196,19 +592,24 @@ static uint8_t key_to_dir(int ch) {
     }
 }
 
-int run_game_session(const char *host, int port, const char *name) {
-    int fd = -1, my_id = -1;
-    MsgConfig cfg;
-    uint8_t *map = NULL;
+int run_game_session(const char *host, int port, int local_fd, const char *name) {
+    int fd = -1;
+    ClientSession cs;
+    memset(&cs, 0, sizeof(cs));
 
-    if (connect_and_handshake(host, port, name, &fd, &my_id, &cfg, &map) != 0) {
+    if (connect_and_handshake(host, port, local_fd, name, &cs, &fd) != 0) {
         printf("Connect/handshake failed.\n");
+        if (cs.has_config) world_free(&cs.map);
+        free(cs.cached_map);
         return 1;
     }
 
-    uint16_t W = ntohs(cfg.w);
-    uint16_t H = ntohs(cfg.h);
-    uint32_t map_len = ntohl(cfg.map_len);
+    int my_id = cs.player_id;
+    int W = (int)cs.cfg.w;
+    int H = (int)cs.cfg.h;
+
+    static ViewFrame vf;
+    static uint8_t view_buf[STATE_VIEW_MAX_LEN > MSG_STATE_MAX_LEN ? STATE_VIEW_MAX_LEN : MSG_STATE_MAX_LEN];
 
     initscr();
     cbreak();
@@ -218,11 +619,19 @@ int run_game_session(const char *host, int port, const char *name) {
     curs_set(0);
 
     bool local_running = true;
+    int world = cs.cfg.world;
+    send_viewport(fd, W, H);
 
+    Latency lat;
+    latency_init(&lat);
+
+  for (;;) {
     while (g_running && local_running) {
         int ch = getch();
         if (ch != ERR) {
-            if (ch == 27 || ch == 'q' || ch == 'Q') {
+            if (ch == KEY_RESIZE) {
+                send_viewport(fd, W, H);
+            } else if (ch == 27 || ch == 'q' || ch == 'Q') {
                 (void)net_send_msg(fd, MSG_LEAVE, NULL, 0);
                 local_running = false;
             } else if (ch == 'p' || ch == 'P') {
@@ -230,27 +639,52 @@ int run_game_session(const char *host, int port, const char *name) {
             } else {
                 uint8_t d = key_to_dir(ch);
                 if (d != 255) {
-                    MsgInput in; in.dir = d;
-                    (void)net_send_msg(fd, MSG_INPUT, &in, (uint32_t)sizeof(in));
+                    MsgInput in;
+                    in.dir = d;
+                    in.seq = lat.next_seq++;
+                    in.client_ms = client_ms();
+                    in.tick = vf.st.tick;
+                    uint8_t out[WIRE_SIZE(msg_input)];
+                    (void)net_send_msg(fd, MSG_INPUT, out, (uint32_t)msg_input_encode(&in, out));
                 }
             }
         }
 
+        uint32_t now = client_ms();
+        if (now - lat.last_ping >= PING_INTERVAL_MS) {
+            MsgPing ping;
+            ping.client_ms = now;
+            uint8_t out[WIRE_SIZE(msg_ping)];
+            (void)net_send_msg(fd, MSG_PING, out, (uint32_t)msg_ping_encode(&ping, out));
+            lat.last_ping = now;
+        }
+
         uint16_t t=0; uint32_t l=0;
         if (net_recv_header(fd, &t, &l) != 0) break;
 
-        if (t == MSG_STATE && l == sizeof(MsgState)) {
-            MsgState st;
-            if (net_recv_all(fd, &st, (int)sizeof(st)) != 0) break;
-            draw_game(&st, map, my_id);
+        if (t == MSG_STATE_VIEW && l <= sizeof(view_buf)) {
+            if (net_recv_all(fd, view_buf, (int)l) != 0) break;
+            if (!decode_state_view(view_buf, l, &vf)) break;
+            if (my_id >= 0 && my_id < MAX_PLAYERS) latency_on_state(&lat, &vf.st.players[my_id]);
+            draw_game(&vf, &cs.map, my_id, world, &lat);
+        } else if (t == MSG_STATE && l <= sizeof(view_buf)) {
+            view_frame_reset(&vf);
+            if (net_recv_all(fd, view_buf, (int)l) != 0) break;
+            if (!msg_state_decode(&vf.st, view_buf, l)) break;
+            MsgState st = vf.st;
+            if (my_id >= 0 && my_id < MAX_PLAYERS) latency_on_state(&lat, &st.players[my_id]);
+            draw_game(&vf, &cs.map, my_id, world, &lat);
 
         if (st.game_over) {
-            nodelay(stdscr, FALSE);
+            /* A daemon keeps us attached and counts down to the next match;
+             * q still leaves through the key handling above. */
+            bool lobby = st.lobby_sec > 0;
+            if (!lobby) nodelay(stdscr, FALSE);
             clear();
             int row = 0;
 
         mvprintw(row++, 0, "=== GAME OVER ===");
-        mvprintw(row++, 0, "Elapsed: %us", (unsigned)ntohs(st.elapsed_sec));
+        mvprintw(row++, 0, "Elapsed: %us", (unsigned)st.elapsed_sec);
         if (st.mode == 1) mvprintw(row++, 0, "Time limit reached.");
 
         row++;
@@ -262,13 +696,18 @@ int run_game_session(const char *host, int port, const char *name) {
         for (int i = 0; i < MAX_PLAYERS; i++) {
           PlayerState *ps = &st.players[i];
 
-          if (!ps->connected && !ps->active && ntohs(ps->len) == 0 && ntohs(ps->score) == 0) continue;
+          if (!ps->connected && !ps->active && ps->len == 0 && ps->score == 0) continue;
           char player_label[8];
           snprintf(player_label, sizeof(player_label), "P%d", i);
-          mvprintw(row++, 0, "%-6s %8u %8u", player_label,  (unsigned)ntohs(ps->score), (unsigned)ntohs(ps->time_sec));
+          mvprintw(row++, 0, "%-6s %8u %8u", player_label,  (unsigned)ps->score, (unsigned)ps->time_sec);
     }
 
         row++;
+        if (lobby) {
+          mvprintw(row++, 0, "Next match in %us. Press q to leave.", (unsigned)st.lobby_sec);
+          refresh();
+          continue;
+        }
         mvprintw(row++, 0, "Press any key to return to menu...");
         refresh();
         getch();
@@ -282,23 +721,182 @@ int run_game_session(const char *host, int port, const char *name) {
             napms(1200);
             local_running = false;
         }
+        } else if (t == MSG_PONG && l == WIRE_SIZE(msg_ping)) {
+            uint8_t in[WIRE_SIZE(msg_ping)];
+            if (net_recv_all(fd, in, (int)sizeof(in)) != 0) break;
+            lat.rtt_ms = (int)(client_ms() - msg_ping_client_ms(in));
+            latency_log(&lat, "rtt", 0, lat.rtt_ms);
+        } else if (t == MSG_CONFIG_CHANGED && l == WIRE_SIZE(msg_config_changed)) {
+            MsgConfigChanged cc;
+            uint8_t in[WIRE_SIZE(msg_config_changed)];
+            if (net_recv_all(fd, in, (int)sizeof(in)) != 0) break;
+            (void)msg_config_changed_decode(&cc, in, sizeof(in));
+            if (memcmp(cc.config_hash, cs.config_hash, CONFIG_HASH_LEN) != 0) {
+                int want_map = request_config(fd, &cs, cc.map_hash);
+                if (want_map < 0) break;
+                cs.reload_pending = true;
+                cs.reload_want_map = want_map != 0;
+                memcpy(cs.reload_config_hash, cc.config_hash, CONFIG_HASH_LEN);
+                memcpy(cs.reload_map_hash, cc.map_hash, CONFIG_HASH_LEN);
+            }
+        } else if (t == MSG_CONFIG && cs.reload_pending && l >= WIRE_SIZE(msg_config)) {
+            uint8_t *buf = (uint8_t*)malloc(l);
+            if (!buf) break;
+            if (net_recv_all(fd, buf, (int)l) != 0) { free(buf); break; }
+            bool ok = apply_config(&cs, buf, l, cs.reload_map_hash, cs.reload_want_map);
+            free(buf);
+            if (!ok) break;
+            cs.reload_pending = false;
+            memcpy(cs.config_hash, cs.reload_config_hash, CONFIG_HASH_LEN);
+            W = (int)cs.cfg.w;
+            H = (int)cs.cfg.h;
+            world = cs.cfg.world;
+            clear();
+            send_viewport(fd, W, H);
         } else {
-            if (l > 0) {
-                uint8_t *tmp = (uint8_t*)malloc(l);
-                if (!tmp) break;
-                if (net_recv_all(fd, tmp, (int)l) != 0) { free(tmp); break; }
-                free(tmp);
+            if (net_discard(fd, l) != 0) break;
+            if (t == MSG_BYE) { local_running = false; break; }
+        }
+    }
+    if (!g_running || !local_running) break;
+
+    /* The connection dropped without a goodbye: take the slot back. */
+    close(fd);
+    fd = -1;
+    int rc = -1;
+    for (int attempt=0;attempt<RESUME_ATTEMPTS && g_running && rc == -1;attempt++) {
+        erase();
+        mvprintw(0, 0, "Connection lost, resuming (%d/%d)...", attempt + 1, RESUME_ATTEMPTS);
+        refresh();
+        napms(RESUME_RETRY_MS);
+        rc = connect_and_handshake(host, port, -1, name, &cs, &fd);
+    }
+    if (rc != 0) break;
+
+    my_id = cs.player_id;
+    W = (int)cs.cfg.w;
+    H = (int)cs.cfg.h;
+    world = cs.cfg.world;
+    send_viewport(fd, W, H);
+  }
+
+    endwin();
+    if (lat.log) fclose(lat.log);
+    if (fd >= 0) close(fd);
+    if (cs.has_config) world_free(&cs.map);
+    free(cs.cached_map);
+    return 0;
+}
+
+#define REPLAY_MIN_SPEED 0.25
+#define REPLAY_MAX_SPEED 16.0
+
+/* Plays a --record file: frames come out at the recorded tick rate times
+ * the speed, and seeks go through the keyframe index. The camera is the
+ * board centre until f picks a snake to follow. */
+static int run_replay(const char *path) {
+    RecReader rr;
+    char err[128];
+    if (!rec_open(&rr, path, err, sizeof(err))) {
+        printf("Cannot replay %s: %s.\n", path, err);
+        return 1;
+    }
+    if (!rec_next(&rr)) {
+        printf("Cannot replay %s: no frames.\n", path);
+        rec_close(&rr);
+        return 1;
+    }
+
+    static ViewFrame vf;
+    World map;
+    memset(&map, 0, sizeof(map));
+    bool have_map = false;
+    int world = 0;
+    uint32_t config_gen = 0;
+    Latency lat;
+    memset(&lat, 0, sizeof(lat));
+    lat.rtt_ms = -1;
+    lat.input_ms = -1;
+
+    initscr();
+    cbreak();
+    noecho();
+    keypad(stdscr, TRUE);
+    nodelay(stdscr, TRUE);
+    curs_set(0);
+
+    uint32_t tick_ms = rr.tick_ms ? rr.tick_ms : 120;
+    uint32_t per_min = 60000u / tick_ms;
+    double speed = 1.0;
+    bool paused = false;
+    int follow = -1;
+    uint32_t due = client_ms();
+    bool redraw = true;
+
+    while (g_running) {
+        int ch = getch();
+        long jump = 0;
+        if (ch == 27 || ch == 'q' || ch == 'Q') break;
+        else if (ch == ' ') paused = !paused;
+        else if ((ch == '+' || ch == '=') && speed < REPLAY_MAX_SPEED) speed *= 2.0;
+        else if (ch == '-' && speed > REPLAY_MIN_SPEED) speed /= 2.0;
+        else if (ch == KEY_RIGHT) jump = (long)(10000u / tick_ms);
+        else if (ch == KEY_LEFT) jump = -(long)(10000u / tick_ms);
+        else if (ch == KEY_UP) jump = (long)per_min;
+        else if (ch == KEY_DOWN) jump = -(long)per_min;
+        else if (ch == KEY_HOME || ch == 'g') jump = -(long)rr.frame - 1;
+        else if (ch == 'f' || ch == 'F') {
+            int next = -1;
+            for (int k=1;k<=MAX_PLAYERS;k++) {
+                int i = (follow + 1 + k) % (MAX_PLAYERS + 1) - 1;
+                if (i < 0 || (vf.st.players[i].len > 0 && vf.st.players[i].active)) { next = i; break; }
+            }
+            follow = next;
+            redraw = true;
+        }
+
+        if (jump != 0) {
+            long target = (long)rr.frame + jump;
+            if (target < 0) target = 0;
+            (void)rec_seek(&rr, (uint32_t)target);
+            due = client_ms();
+            redraw = true;
+        } else if (!paused && (int32_t)(client_ms() - due) >= 0) {
+            if (rec_next(&rr)) redraw = true;
+            else paused = true;
+            due += (uint32_t)(tick_ms / speed);
+            if ((int32_t)(client_ms() - due) > (int32_t)tick_ms) due = client_ms();
+        }
+
+        if (redraw) {
+            if (rr.config_gen != config_gen) {
+                MsgConfig cfg;
+                World next;
+                if (!msg_config_decode(&cfg, rr.config, rr.config_len) ||
+                    WIRE_SIZE(msg_config) + cfg.map_len != rr.config_len ||
+                    !decode_board(&cfg, rr.config + WIRE_SIZE(msg_config), cfg.map_len, &next)) break;
+                if (have_map) world_free(&map);
+                map = next;
+                have_map = true;
+                world = cfg.world;
+                config_gen = rr.config_gen;
             }
-            if (t == MSG_BYE) break;
+            view_frame_reset(&vf);
+            if (!msg_state_decode(&vf.st, rr.state, rr.state_len)) break;
+            draw_game(&vf, &map, follow, world, &lat);
+            uint32_t at = rr.frame * tick_ms / 1000u;
+            uint32_t end = (rr.frames - 1) * tick_ms / 1000u;
+            mvprintw(LINES - 1, 0, "Replay %02u:%02u / %02u:%02u  x%g%s | Space=pause +/-=speed Left/Right=10s Up/Down=1min F=follow Q=quit",
+                     at / 60, at % 60, end / 60, end % 60, speed, paused ? " paused" : "");
+            refresh();
+            redraw = false;
         }
+        napms(5);
     }
 
     endwin();
-    close(fd);
-    free(map);
-    (void)map_len;
-    (void)W;
-    (void)H;
+    if (have_map) world_free(&map);
+    rec_close(&rr);
     return 0;
 }
 
@@ -306,16 +904,20 @@ int main(void) {
     signal(SIGINT, on_sigint);
 
     while (g_running) {
+        /* Reap local games that have finished since the last round. */
+        while (waitpid(-1, NULL, WNOHANG) > 0) {}
+
         printf("\n=== Multiplayer Snake ===\n");
         printf("1) New game\n");
         printf("2) Connect\n");
-        printf("3) Quit\n");
+        printf("3) Replay\n");
+        printf("4) Quit\n");
 
         char choice_s[32];
-        read_line("Option: ", choice_s, sizeof(choice_s), "3");
+        read_line("Option: ", choice_s, sizeof(choice_s), "4");
         int choice = atoi(choice_s);
 
-        if (choice == 3) break;
+        if (choice == 4) break;
 
         if (choice == 1) {
             char name[SNAKE_NAME_MAX];
@@ -350,32 +952,39 @@ int main(void) {
             world = (world == 0) ? 0 : 1;
             time_limit = (time_limit <= 0) ? 120 : time_limit;
 
-            const char *map_path = (world == 0) ? "-" : "data/map1.txt";  
+            char map_buf[4096];
+            const char *map_path = (world == 0) ? "-" : local_map_path(map_buf, sizeof(map_buf));
 
-            if (spawn_server_process(port, map_path, mode, world, time_limit, w, h) != 0) {
+            int local_fd = start_local_server(port, map_path, mode, world, time_limit, w, h);
+            if (local_fd < 0) {
               printf("Failed to start the server.\n");
               continue;
             }
 
-            struct timespec ts;
-            ts.tv_sec = 0;
-            ts.tv_nsec = 200 * 1000000L;
-            nanosleep(&ts, NULL);
-
-            (void)run_game_session("127.0.0.1", port, name);
+            (void)run_game_session("127.0.0.1", port, local_fd, name);
 
         } else if (choice == 2) {
             char name[SNAKE_NAME_MAX];
             char host[128];
             char port_s[32];
 
-            read_line("Host: ", host, sizeof(host), "127.0.0.1");
-            read_line("Port: ", port_s, sizeof(port_s), "5555");
-
-            int port = atoi(port_s);
-            if (port <= 0 || port > 65535) { printf("Wrong input.\n"); continue; }
+            read_line("Host (or unix:/path): ", host, sizeof(host), "127.0.0.1");
+            NetAddr addr;
+            if (!net_addr_parse(host, 5555, &addr)) { printf("Wrong input.\n"); continue; }
+            int port = addr.port;
+            if (addr.kind == NET_TCP) {
+                char def_port[16];
+                (void)snprintf(def_port, sizeof(def_port), "%d", addr.port);
+                read_line("Port: ", port_s, sizeof(port_s), def_port);
+                port = atoi(port_s);
+                if (port <= 0 || port > 65535) { printf("Wrong input.\n"); continue; }
+            }
 
-            (void)run_game_session(host, port, name);
+            (void)run_game_session(host, port, -1, name);
+        } else if (choice == 3) {
+            char path[256];
+            read_line("Recording: ", path, sizeof(path), "match.rec");
+            (void)run_replay(path);
         } else {
             printf("Wrong option.\n");
         }
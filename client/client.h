@@ -1,6 +1,9 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
-int run_game_session(const char *host, int port, const char *name);
+/* local_fd, when >= 0, is an already connected stream to the server (the
+ * local game's socketpair); otherwise host:port is dialed. Reconnects
+ * always dial host:port. */
+int run_game_session(const char *host, int port, int local_fd, const char *name);
 
 #endif
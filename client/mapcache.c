@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mapcache.h"
+#include "../common/hash.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool cache_dir(char *out, size_t cap) {
+    const char *dir = getenv("SNAKE_MAP_CACHE");
+    if (dir && dir[0]) return snprintf(out, cap, "%s", dir) < (int)cap;
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0]) return snprintf(out, cap, "%s/snake/maps", xdg) < (int)cap;
+    const char *home = getenv("HOME");
+    if (home && home[0]) return snprintf(out, cap, "%s/.cache/snake/maps", home) < (int)cap;
+    return false;
+}
+
+static bool entry_path(const uint8_t hash[CONFIG_HASH_LEN], char *out, size_t cap) {
+    char dir[512];
+    if (!cache_dir(dir, sizeof(dir))) return false;
+    char hex[CONFIG_HASH_LEN * 2 + 1];
+    for (int i=0;i<CONFIG_HASH_LEN;i++) (void)snprintf(hex + i * 2, 3, "%02x", hash[i]);
+    return snprintf(out, cap, "%s/%s.map", dir, hex) < (int)cap;
+}
+
+/* mkdir -p */
+static bool make_dirs(const char *path) {
+    char buf[512];
+    if (snprintf(buf, sizeof(buf), "%s", path) >= (int)sizeof(buf)) return false;
+    for (char *p = buf + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = 0;
+        if (mkdir(buf, 0755) != 0 && errno != EEXIST) return false;
+        *p = '/';
+    }
+    return mkdir(buf, 0755) == 0 || errno == EEXIST;
+}
+
+uint8_t *mapcache_load(const uint8_t hash[CONFIG_HASH_LEN], uint32_t *len) {
+    char path[600];
+    if (!entry_path(hash, path, sizeof(path))) return NULL;
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    uint8_t *data = NULL;
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+    if (size >= 0 && size <= 0x7FFFFFFFL && fseek(f, 0, SEEK_SET) == 0) {
+        data = (uint8_t*)malloc((size_t)size + 1);
+        if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    if (!data) return NULL;
+
+    uint8_t check[CONFIG_HASH_LEN];
+    hash64_bytes(hash64(data, (size_t)size), check);
+    if (memcmp(check, hash, CONFIG_HASH_LEN) != 0) {
+        free(data);
+        (void)unlink(path);
+        return NULL;
+    }
+    /* Recently used, as far as trim_cache is concerned. */
+    (void)utimensat(AT_FDCWD, path, NULL, 0);
+    *len = (uint32_t)size;
+    return data;
+}
+
+typedef struct {
+    char name[CONFIG_HASH_LEN * 2 + 8];
+    struct timespec used;
+    uint64_t size;
+} CacheEntry;
+
+static int entry_older(const void *a, const void *b) {
+    const struct timespec *x = &((const CacheEntry*)a)->used, *y = &((const CacheEntry*)b)->used;
+    if (x->tv_sec != y->tv_sec) return (x->tv_sec > y->tv_sec) - (x->tv_sec < y->tv_sec);
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/* Removes the least recently used entries of dir until it is within both
+ * caps. Other files in the directory are left alone. */
+static void trim_cache(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    CacheEntry *list = NULL;
+    size_t n = 0, cap = 0;
+    uint64_t total = 0;
+    char path[600];
+    for (struct dirent *de = readdir(d); de; de = readdir(d)) {
+        size_t nl = strlen(de->d_name);
+        if (nl != CONFIG_HASH_LEN * 2 + 4 || strcmp(de->d_name + nl - 4, ".map") != 0) continue;
+        struct stat st;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int)sizeof(path)) continue;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 64;
+            CacheEntry *grown = (CacheEntry*)realloc(list, ncap * sizeof(CacheEntry));
+            if (!grown) break;
+            list = grown;
+            cap = ncap;
+        }
+        memcpy(list[n].name, de->d_name, nl + 1);
+        list[n].used = st.st_mtim;
+        list[n].size = (uint64_t)st.st_size;
+        total += list[n].size;
+        n++;
+    }
+    closedir(d);
+
+    if (n > MAPCACHE_MAX_ENTRIES || total > MAPCACHE_MAX_BYTES) {
+        qsort(list, n, sizeof(CacheEntry), entry_older);
+        for (size_t i=0;i<n && (n - i > MAPCACHE_MAX_ENTRIES || total > MAPCACHE_MAX_BYTES);i++) {
+            if (snprintf(path, sizeof(path), "%s/%s", dir, list[i].name) >= (int)sizeof(path)) continue;
+            if (unlink(path) == 0) total -= list[i].size;
+        }
+    }
+    free(list);
+}
+
+void mapcache_store(const uint8_t hash[CONFIG_HASH_LEN], const uint8_t *data, uint32_t len) {
+    char dir[512], path[600], tmp[640];
+    if (len > MAPCACHE_MAX_BYTES) return;
+    if (!cache_dir(dir, sizeof(dir)) || !make_dirs(dir)) return;
+    if (!entry_path(hash, path, sizeof(path))) return;
+    if (snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid()) >= (int)sizeof(tmp)) return;
+
+    /* Write then rename, so a concurrent reader never sees half a map. */
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return;
+    bool ok = fwrite(data, 1, len, f) == len;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        (void)unlink(tmp);
+        return;
+    }
+    trim_cache(dir);
+}
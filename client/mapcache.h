@@ -0,0 +1,28 @@
+#ifndef MAPCACHE_H
+#define MAPCACHE_H
+
+#include "../common/protocol.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* On-disk cache of map payloads keyed by the hash the server advertises in
+ * MSG_WELCOME. The directory is $SNAKE_MAP_CACHE, else
+ * $XDG_CACHE_HOME/snake/maps, else ~/.cache/snake/maps.
+ *
+ * The cache is kept to MAPCACHE_MAX_ENTRIES files and MAPCACHE_MAX_BYTES
+ * in all, least recently used out first: a hit bumps the entry's mtime
+ * and every store trims the directory. */
+
+#define MAPCACHE_MAX_ENTRIES 64
+#define MAPCACHE_MAX_BYTES (256u * 1024u * 1024u)
+
+/* Returns a malloc'd copy of the entry after checking it still hashes to
+ * its name; a corrupt entry is removed and reported as a miss. */
+uint8_t *mapcache_load(const uint8_t hash[CONFIG_HASH_LEN], uint32_t *len);
+
+/* Best effort: a failed store only costs a download next time. A map
+ * larger than the whole cache is not kept. */
+void mapcache_store(const uint8_t hash[CONFIG_HASH_LEN], const uint8_t *data, uint32_t len);
+
+#endif
@@ -0,0 +1,85 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+bool arena_init(Arena *a, size_t cap) {
+    memset(a, 0, sizeof(*a));
+    cap = align_up(cap);
+    a->base = (unsigned char*)calloc(1, cap ? cap : ARENA_ALIGN);
+    if (!a->base) return false;
+    a->cap = cap;
+    return true;
+}
+
+void arena_free(Arena *a) {
+    free(a->base);
+    memset(a, 0, sizeof(*a));
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+    size = align_up(size);
+    if (size > a->cap - a->used) return NULL;
+    void *p = a->base + a->used;
+    a->used += size;
+    return p;
+}
+
+bool block_pool_init(BlockPool *bp, size_t block, uint32_t count) {
+    memset(bp, 0, sizeof(*bp));
+    bp->block = align_up(block < sizeof(uint32_t) ? sizeof(uint32_t) : block);
+    if (!arena_init(&bp->arena, bp->block * count)) return false;
+    bp->count = count;
+    return true;
+}
+
+void block_pool_free(BlockPool *bp) {
+    arena_free(&bp->arena);
+    memset(bp, 0, sizeof(*bp));
+}
+
+static unsigned char *block_at(const BlockPool *bp, uint32_t i) {
+    return bp->arena.base + (size_t)i * bp->block;
+}
+
+/* The first word of a free block links to the next one. Every push and
+ * pop bumps the tag, so a stale head can never be swapped back in. */
+void *block_pool_get(BlockPool *bp) {
+    uint64_t head = __atomic_load_n(&bp->head, __ATOMIC_ACQUIRE);
+    while ((uint32_t)head != 0) {
+        unsigned char *b = block_at(bp, (uint32_t)head - 1);
+        uint32_t link = __atomic_load_n((uint32_t*)b, __ATOMIC_RELAXED);
+        uint64_t next = ((head >> 32) + 1) << 32 | link;
+        if (__atomic_compare_exchange_n(&bp->head, &head, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n((uint32_t*)b, 0, __ATOMIC_RELAXED);
+            return b;
+        }
+    }
+    if (__atomic_load_n(&bp->next, __ATOMIC_RELAXED) >= bp->count) return NULL;
+    uint32_t i = __atomic_fetch_add(&bp->next, 1, __ATOMIC_RELAXED);
+    if (i >= bp->count) return NULL;
+    return block_at(bp, i);
+}
+
+void block_pool_put(BlockPool *bp, void *p) {
+    unsigned char *b = (unsigned char*)p;
+    memset(b, 0, bp->block);
+    uint32_t idx = (uint32_t)((size_t)(b - bp->arena.base) / bp->block) + 1;
+    uint64_t head = __atomic_load_n(&bp->head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        __atomic_store_n((uint32_t*)b, (uint32_t)head, __ATOMIC_RELAXED);
+        uint64_t next = ((head >> 32) + 1) << 32 | idx;
+        if (__atomic_compare_exchange_n(&bp->head, &head, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return;
+    }
+}
+
+bool block_pool_owns(const BlockPool *bp, const void *p) {
+    const unsigned char *b = (const unsigned char*)p;
+    return bp->arena.base && b >= bp->arena.base && b < bp->arena.base + (size_t)bp->count * bp->block;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* One zeroed block reserved up front; allocations bump a cursor and are
+ * all released by arena_free. Large blocks are fresh zero pages from the
+ * kernel, so the part nobody has written yet costs no resident memory. */
+typedef struct {
+    unsigned char *base;
+    size_t cap;
+    size_t used;
+} Arena;
+
+bool arena_init(Arena *a, size_t cap);
+void arena_free(Arena *a);
+/* 16-byte aligned and zeroed; NULL once the arena is full. */
+void *arena_alloc(Arena *a, size_t size);
+
+/* Fixed-size blocks carved lazily from one arena and recycled through a
+ * tagged free list, so gets and puts may race from any thread. */
+typedef struct {
+    Arena arena;
+    size_t block;
+    uint32_t count;
+    uint32_t next;            /* blocks handed out from the arena so far */
+    uint64_t head;            /* tag << 32 | (index + 1), 0 when empty */
+} BlockPool;
+
+bool block_pool_init(BlockPool *bp, size_t block, uint32_t count);
+void block_pool_free(BlockPool *bp);
+/* A zeroed block, or NULL when the pool is exhausted. */
+void *block_pool_get(BlockPool *bp);
+void block_pool_put(BlockPool *bp, void *p);
+bool block_pool_owns(const BlockPool *bp, const void *p);
@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH64_INIT 1469598103934665603ULL
+
+/* FNV-1a; used to fingerprint payloads, not for anything adversarial.
+ * hash64_update continues a hash over data that is not contiguous. */
+static inline uint64_t hash64_update(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static inline uint64_t hash64(const void *data, size_t len) {
+    return hash64_update(HASH64_INIT, data, len);
+}
+
+static inline void hash64_bytes(uint64_t h, uint8_t out[8]) {
+    for (int i = 0; i < 8; i++) out[i] = (uint8_t)(h >> (56 - 8 * i));
+}
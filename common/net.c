@@ -1,21 +1,29 @@
 #define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /* SO_REUSEPORT */
 
 #include "net.h"
 #include "protocol.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+/* A peer that reset the connection is an error here, not a SIGPIPE. */
 int net_send_all(int fd, const void *buf, int len) {
     const char *p = (const char *)buf;
     int sent = 0;
     while (sent < len) {
-        int n = (int)send(fd, p + sent, (size_t)(len - sent), 0);
+        int n = (int)send(fd, p + sent, (size_t)(len - sent), MSG_NOSIGNAL);
         if (n < 0) {
             if (errno == EINTR) continue;
             return -1;
@@ -41,24 +49,57 @@ int net_recv_all(int fd, void *buf, int len) {
     return 0;
 }
 
+int net_discard(int fd, uint32_t len) {
+    char buf[512];
+    while (len > 0) {
+        int n = (len < sizeof(buf)) ? (int)len : (int)sizeof(buf);
+        if (net_recv_all(fd, buf, n) != 0) return -1;
+        len -= (uint32_t)n;
+    }
+    return 0;
+}
+
 int net_send_msg(int fd, uint16_t type, const void *payload, uint32_t len) {
-    MsgHeader h;
-    h.type = htons(type);
-    h.len  = htonl(len);
+    MsgHeader hdr = { type, len };
+    uint8_t h[WIRE_SIZE(msg_header)];
+    (void)msg_header_encode(&hdr, h);
 
-    if (net_send_all(fd, &h, (int)sizeof(h)) != 0) return -1;
-    if (len > 0 && payload != NULL) {
-        if (net_send_all(fd, payload, (int)len) != 0) return -1;
+    /* Header and payload go out in one call: two small writes would let
+     * Nagle hold the second until the peer's delayed ACK. */
+    struct iovec iov[2];
+    iov[0].iov_base = h;
+    iov[0].iov_len = sizeof(h);
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = (len > 0 && payload != NULL) ? len : 0;
+    int cnt = (iov[1].iov_len > 0) ? 2 : 1;
+
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = (size_t)cnt;
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &mh, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+
+    size_t total = iov[0].iov_len + iov[1].iov_len;
+    if ((size_t)n == total) return 0;
+    /* Short write: finish whatever is left the slow way. */
+    if ((size_t)n < sizeof(h)) {
+        if (net_send_all(fd, h + n, (int)(sizeof(h) - (size_t)n)) != 0) return -1;
+        n = (ssize_t)sizeof(h);
     }
-    return 0;
+    size_t done = (size_t)n - sizeof(h);
+    return net_send_all(fd, (const char *)payload + done, (int)(iov[1].iov_len - done));
 }
 
 int net_recv_header(int fd, uint16_t *type, uint32_t *len) {
-    MsgHeader h;
-    if (net_recv_all(fd, &h, (int)sizeof(h)) != 0) return -1;
+    uint8_t buf[WIRE_SIZE(msg_header)];
+    if (net_recv_all(fd, buf, (int)sizeof(buf)) != 0) return -1;
 
-    *type = ntohs(h.type);
-    *len  = ntohl(h.len);
+    *type = msg_header_type(buf);
+    *len  = msg_header_len(buf);
     return 0;
 }
 
@@ -89,27 +130,295 @@ int net_connect_tcp(const char *host, int port) {
     return -1;
 }
 
-int net_listen_tcp(int port) {
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (fd < 0) return -1;
-
-    int yes = 1;
-    (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
-
+static int bind_any(int fd, int family, int port) {
+    if (family == AF_INET6) {
+        struct sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr   = in6addr_any;
+        addr.sin6_port   = htons((uint16_t)port);
+        return bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family      = AF_INET;
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
     addr.sin_port        = htons((uint16_t)port);
+    return bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+}
 
-    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+/* Options every listener gets before bind(); closes fd on failure. */
+static int prepare_listener(int fd, int family, int flags) {
+    int yes = 1, no = 0;
+    if (family != AF_UNIX) (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (family == AF_INET6) (void)setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no));
+    if (flags & NET_LISTEN_REUSEPORT) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) != 0) {
+            close(fd);
+            return -1;
+        }
+#else
         close(fd);
+        errno = ENOPROTOOPT;
         return -1;
+#endif
     }
-    if (listen(fd, 16) != 0) {
+    if (flags & NET_LISTEN_NONBLOCK) {
+        int fl = fcntl(fd, F_GETFL, 0);
+        if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static int listen_family(int family, int port, int backlog, int flags) {
+    int fd = socket(family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (prepare_listener(fd, family, flags) < 0) return -1;
+
+    if (bind_any(fd, family, port) != 0 || listen(fd, backlog) != 0) {
         close(fd);
         return -1;
     }
     return fd;
 }
 
+int net_listen_tcp_opts(int port, int backlog, int flags) {
+    if (backlog <= 0) backlog = NET_DEFAULT_BACKLOG;
+    int fd = listen_family(AF_INET6, port, backlog, flags);
+    if (fd < 0 && (errno == EAFNOSUPPORT || errno == EADDRNOTAVAIL)) {
+        fd = listen_family(AF_INET, port, backlog, flags);
+    }
+    return fd;
+}
+
+int net_listen_tcp(int port) {
+    return net_listen_tcp_opts(port, NET_DEFAULT_BACKLOG, 0);
+}
+
+int net_accept_batch(int listen_fd, int *fds, int max) {
+    int n = 0;
+    while (n < max) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            fds[n++] = fd;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        /* The peer gave up while queued; keep draining the rest. */
+        if (errno == ECONNABORTED || errno == EPROTO) continue;
+        return (n > 0) ? n : -1;
+    }
+    return n;
+}
+
+static bool parse_num(const char *s, size_t n, long lo, long hi, long *out) {
+    if (n == 0 || n > 10) return false;
+    long v = 0;
+    for (size_t i=0;i<n;i++) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        v = v * 10 + (s[i] - '0');
+    }
+    if (v < lo || v > hi) return false;
+    *out = v;
+    return true;
+}
+
+bool net_addr_parse(const char *s, int default_port, NetAddr *a) {
+    memset(a, 0, sizeof(*a));
+    a->kind = NET_TCP;
+    a->port = default_port;
+    a->fd = -1;
+    if (!s) return false;
+
+    if (strncmp(s, "unix:", 5) == 0) {
+        size_t n = strlen(s + 5);
+        if (n == 0 || n >= sizeof(a->path)) return false;
+        a->kind = NET_UNIX;
+        memcpy(a->path, s + 5, n + 1);
+        return true;
+    }
+    if (strncmp(s, "pair:", 5) == 0) {
+        long fd;
+        if (!parse_num(s + 5, strlen(s + 5), 0, 1 << 30, &fd)) return false;
+        a->kind = NET_PAIR;
+        a->fd = (int)fd;
+        return true;
+    }
+    if (strncmp(s, "tcp:", 4) == 0) s += 4;
+
+    /* "[v6]:port", "host:port", a bare host (v6 included) or a bare port. */
+    const char *host = s;
+    const char *port = NULL;
+    size_t hlen;
+    if (*s == '[') {
+        const char *e = strchr(s, ']');
+        if (!e) return false;
+        host = s + 1;
+        hlen = (size_t)(e - host);
+        if (e[1] == ':') port = e + 2;
+        else if (e[1] != 0) return false;
+    } else {
+        const char *c = strchr(s, ':');
+        if (c && strchr(c + 1, ':') == NULL) {
+            hlen = (size_t)(c - s);
+            port = c + 1;
+        } else {
+            hlen = strlen(s);
+        }
+    }
+    long v;
+    if (!port && parse_num(host, hlen, 1, 65535, &v)) {
+        a->port = (int)v;
+        return true;
+    }
+    if (hlen >= sizeof(a->host)) return false;
+    memcpy(a->host, host, hlen);
+    a->host[hlen] = 0;
+    if (port) {
+        if (!parse_num(port, strlen(port), 1, 65535, &v)) return false;
+        a->port = (int)v;
+    }
+    return a->port > 0 && a->port <= 65535;
+}
+
+void net_addr_format(const NetAddr *a, char *buf, size_t cap) {
+    switch (a->kind) {
+        case NET_UNIX: (void)snprintf(buf, cap, "unix:%s", a->path); break;
+        case NET_PAIR: (void)snprintf(buf, cap, "pair:%d", a->fd); break;
+        default:
+            if (a->host[0] == 0) (void)snprintf(buf, cap, "tcp:%d", a->port);
+            else if (strchr(a->host, ':')) (void)snprintf(buf, cap, "tcp:[%s]:%d", a->host, a->port);
+            else (void)snprintf(buf, cap, "tcp:%s:%d", a->host, a->port);
+            break;
+    }
+}
+
+/* A leading '@' names a socket in the abstract namespace, which needs no
+ * file and vanishes with its last fd. */
+static bool unix_sockaddr(const char *path, struct sockaddr_un *sun, socklen_t *len) {
+    size_t n = strlen(path);
+    if (n == 0 || n >= sizeof(sun->sun_path)) return false;
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    memcpy(sun->sun_path, path, n);
+    if (path[0] == '@') {
+        sun->sun_path[0] = 0;
+        *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + n);
+    } else {
+        *len = (socklen_t)sizeof(*sun);
+    }
+    return true;
+}
+
+static int connect_unix(const char *path) {
+    struct sockaddr_un sun;
+    socklen_t len;
+    if (!unix_sockaddr(path, &sun, &len)) {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int rc;
+    do {
+        rc = connect(fd, (struct sockaddr *)&sun, len);
+    } while (rc != 0 && errno == EINTR);
+    if (rc != 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    return fd;
+}
+
+/* A socket file nobody answers on is left over from a crashed server. */
+static void remove_stale_socket(const char *path) {
+    struct stat st;
+    if (path[0] == '@' || stat(path, &st) != 0 || !S_ISSOCK(st.st_mode)) return;
+    int fd = connect_unix(path);
+    if (fd >= 0) {
+        close(fd);
+        return;
+    }
+    if (errno == ECONNREFUSED) (void)unlink(path);
+}
+
+static int listen_unix(const char *path, int backlog, int flags) {
+    struct sockaddr_un sun;
+    socklen_t len;
+    if (!unix_sockaddr(path, &sun, &len)) {
+        errno = EINVAL;
+        return -1;
+    }
+    remove_stale_socket(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (prepare_listener(fd, AF_UNIX, flags & ~NET_LISTEN_REUSEPORT) < 0) return -1;
+    if (bind(fd, (struct sockaddr *)&sun, len) != 0 || listen(fd, backlog) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_tcp_host(const char *host, int port, int backlog, int flags) {
+    char portstr[16];
+    snprintf(portstr, sizeof(portstr), "%d", port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(host, portstr, &hints, &res) != 0) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *p = res; p && fd < 0; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (prepare_listener(fd, p->ai_family, flags) < 0) {
+            fd = -1;
+            continue;
+        }
+        if (bind(fd, p->ai_addr, p->ai_addrlen) != 0 || listen(fd, backlog) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int net_connect(const NetAddr *a) {
+    switch (a->kind) {
+        case NET_UNIX: return connect_unix(a->path);
+        case NET_PAIR: return (fcntl(a->fd, F_GETFD) < 0) ? -1 : a->fd;
+        default: return net_connect_tcp(a->host[0] ? a->host : NULL, a->port);
+    }
+}
+
+int net_listen(const NetAddr *a, int backlog, int flags) {
+    if (backlog <= 0) backlog = NET_DEFAULT_BACKLOG;
+    switch (a->kind) {
+        case NET_UNIX: return listen_unix(a->path, backlog, flags);
+        case NET_PAIR: errno = EINVAL; return -1;
+        default:
+            if (a->host[0] == 0) return net_listen_tcp_opts(a->port, backlog, flags);
+            return listen_tcp_host(a->host, a->port, backlog, flags);
+    }
+}
+
+void net_unlisten(const NetAddr *a, int fd) {
+    if (fd >= 0) close(fd);
+    if (a->kind == NET_UNIX && a->path[0] != '@') (void)unlink(a->path);
+}
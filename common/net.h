@@ -1,11 +1,67 @@
 #pragma once
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 int net_send_all(int fd, const void *buf, int len);
 int net_recv_all(int fd, void *buf, int len);
+/* Reads and drops len bytes through a small stack buffer. */
+int net_discard(int fd, uint32_t len);
 
 int net_send_msg(int fd, uint16_t type, const void *payload, uint32_t len);
 int net_recv_header(int fd, uint16_t *type, uint32_t *len);
 
 int net_connect_tcp(const char *host, int port);
 int net_listen_tcp(int port);
+
+#define NET_DEFAULT_BACKLOG 1024
+
+enum {
+    NET_LISTEN_REUSEPORT = 0x01,    /* share the port with other listeners */
+    NET_LISTEN_NONBLOCK = 0x02
+};
+
+/* Dual-stack (IPv6 with v4-mapped addresses) when the host supports it,
+ * IPv4 otherwise. The kernel caps backlog at net.core.somaxconn. */
+int net_listen_tcp_opts(int port, int backlog, int flags);
+
+/* Accepts until the queue is empty or max fds are taken; the listening
+ * socket must be non-blocking. Returns the count, or -1 on a hard error. */
+int net_accept_batch(int listen_fd, int *fds, int max);
+
+/* Stream transports, picked by address syntax:
+ *   [tcp:]host:port, [tcp:][v6]:port, [tcp:]port   TCP (no host = any/loopback)
+ *   unix:/path, unix:@name                         Unix-domain stream socket;
+ *                                                  @ is the abstract namespace
+ *   pair:fd                                        an inherited, already
+ *                                                  connected socketpair end
+ * Every transport yields an ordinary stream fd, so the send/recv helpers
+ * above work on all of them. */
+typedef enum {
+    NET_TCP,
+    NET_UNIX,
+    NET_PAIR
+} NetTransport;
+
+#define NET_HOST_MAX 256
+#define NET_PATH_MAX 108            /* sizeof(sockaddr_un.sun_path) */
+
+typedef struct {
+    NetTransport kind;
+    int port;                       /* NET_TCP */
+    int fd;                         /* NET_PAIR */
+    char host[NET_HOST_MAX];        /* NET_TCP, "" when none was given */
+    char path[NET_PATH_MAX];        /* NET_UNIX, leading '@' for abstract */
+} NetAddr;
+
+/* A bare host takes default_port. Returns false on a malformed address. */
+bool net_addr_parse(const char *s, int default_port, NetAddr *a);
+void net_addr_format(const NetAddr *a, char *buf, size_t cap);
+
+/* NET_PAIR hands back the inherited fd itself. */
+int net_connect(const NetAddr *a);
+/* NET_TCP honours the flags and binds the host when one was given. A stale
+ * Unix socket file is replaced. NET_PAIR cannot listen (EINVAL). */
+int net_listen(const NetAddr *a, int backlog, int flags);
+/* Closes a listener and removes its socket file, if it has one. */
+void net_unlisten(const NetAddr *a, int fd);
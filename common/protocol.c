@@ -0,0 +1,143 @@
+#include "protocol.h"
+
+static const int8_t body_dx[4] = { 0, 1, 0, -1 };
+static const int8_t body_dy[4] = { -1, 0, 1, 0 };
+
+static Cell body_step(Cell c, int dir, int32_t w, int32_t h) {
+    c.x += body_dx[dir];
+    c.y += body_dy[dir];
+    if (c.x < 0) c.x += w; else if (c.x >= w) c.x -= w;
+    if (c.y < 0) c.y += h; else if (c.y >= h) c.y -= h;
+    return c;
+}
+
+void body_begin(BodyWriter *bw, uint8_t *out, uint32_t w, uint32_t h) {
+    memset(bw, 0, sizeof(*bw));
+    bw->out = out;
+    bw->off = 2;
+    bw->w = (int32_t)w;
+    bw->h = (int32_t)h;
+}
+
+void body_break(BodyWriter *bw) {
+    if (!bw->open) return;
+    if (bw->steps & 3) bw->out[bw->off++] = bw->bits;
+    bw->bits = 0;
+    wire_put_u16(bw->out + bw->run_at, bw->steps);
+    bw->open = false;
+}
+
+/* The direction that takes a to b, or -1 when b is not one step away.
+ * Both must be on the board, so a wrapped step decodes back to b. */
+static int body_dir(Cell a, Cell b, int32_t w, int32_t h) {
+    if ((uint32_t)a.x >= (uint32_t)w || (uint32_t)a.y >= (uint32_t)h ||
+        (uint32_t)b.x >= (uint32_t)w || (uint32_t)b.y >= (uint32_t)h) return -1;
+    int32_t dx = b.x - a.x;
+    int32_t dy = b.y - a.y;
+    if (dx != 0) {
+        if (dy != 0) return -1;
+        if (dx == 1 || dx == 1 - w) return 1;
+        if (dx == -1 || dx == w - 1) return 3;
+        return -1;
+    }
+    if (dy == 1 || dy == 1 - h) return 2;
+    if (dy == -1 || dy == h - 1) return 0;
+    return -1;
+}
+
+static inline void body_push_cell(BodyWriter *bw, Cell c) {
+    int d = (bw->open && bw->steps < UINT16_MAX) ? body_dir(bw->prev, c, bw->w, bw->h) : -1;
+    if (d >= 0) {
+        bw->bits |= (uint8_t)(d << ((bw->steps & 3) * 2));
+        if ((++bw->steps & 3) == 0) {
+            bw->out[bw->off++] = bw->bits;
+            bw->bits = 0;
+        }
+        bw->prev = c;
+        return;
+    }
+    body_break(bw);
+    cell_encode(c, bw->out + bw->off);
+    bw->run_at = bw->off + WIRE_LEN_CELL;
+    bw->off = bw->run_at + 2;
+    bw->steps = 0;
+    bw->runs++;
+    bw->open = true;
+    bw->prev = c;
+}
+
+void body_push(BodyWriter *bw, Cell c) {
+    body_push_cell(bw, c);
+}
+
+size_t body_end(BodyWriter *bw) {
+    body_break(bw);
+    wire_put_u16(bw->out, bw->runs);
+    return bw->off;
+}
+
+size_t body_encode(const Cell *cells, int n, uint32_t w, uint32_t h, uint8_t *out) {
+    BodyWriter bw;
+    body_begin(&bw, out, w, h);
+    for (int k=0;k<n;k++) body_push_cell(&bw, cells[k]);
+    return body_end(&bw);
+}
+
+size_t body_decode(const uint8_t *in, size_t len, uint32_t w, uint32_t h,
+                   Cell *out, int max, int *count) {
+    if (len < 2) return 0;
+    int runs = wire_get_u16(in);
+    size_t off = 2;
+    int n = 0;
+    for (int r=0;r<runs;r++) {
+        if (len - off < WIRE_LEN_CELL + 2) return 0;
+        Cell c = cell_decode(in + off);
+        int steps = wire_get_u16(in + off + WIRE_LEN_CELL);
+        off += WIRE_LEN_CELL + 2;
+        size_t packed = ((size_t)steps + 3) / 4;
+        if (len - off < packed) return 0;
+        if (n < max) out[n] = c;
+        n++;
+        for (int k=0;k<steps;k++) {
+            c = body_step(c, (in[off + k / 4] >> ((k & 3) * 2)) & 3, (int32_t)w, (int32_t)h);
+            if (n < max) out[n] = c;
+            n++;
+        }
+        off += packed;
+    }
+    *count = n;
+    return off;
+}
+
+size_t msg_state_encode(const MsgState *st, uint8_t *out) {
+    size_t off = msg_state_header_encode(st, out);
+    for (int i=0;i<MAX_PLAYERS;i++) {
+        const PlayerState *ps = &st->players[i];
+        off += player_state_encode(ps, out + off);
+        int len = (ps->len < MAX_SEGMENTS) ? ps->len : MAX_SEGMENTS;
+        off += body_encode(ps->body, len, st->w, st->h, out + off);
+    }
+    int nf = (st->num_fruits < MAX_FRUITS) ? st->num_fruits : MAX_FRUITS;
+    for (int i=0;i<nf;i++) off += fruit_state_encode(&st->fruits[i], out + off);
+    return off;
+}
+
+bool msg_state_decode(MsgState *st, const uint8_t *in, size_t len) {
+    if (!msg_state_header_decode(st, in, len)) return false;
+    size_t off = WIRE_SIZE(msg_state_header);
+    for (int i=0;i<MAX_PLAYERS;i++) {
+        PlayerState *ps = &st->players[i];
+        if (!player_state_decode(ps, in + off, len - off)) return false;
+        off += WIRE_SIZE(player_state);
+        int n;
+        size_t used = body_decode(in + off, len - off, st->w, st->h, ps->body, MAX_SEGMENTS, &n);
+        if (used == 0 || n != (int)ps->len) return false;
+        off += used;
+    }
+    if (st->num_fruits > MAX_FRUITS) return false;
+    for (int i=0;i<(int)st->num_fruits;i++) {
+        if (!fruit_state_decode(&st->fruits[i], in + off, len - off)) return false;
+        off += WIRE_SIZE(fruit_state);
+    }
+    return off == len;
+}
@@ -1,11 +1,30 @@
 #pragma once
 #include <stdint.h>
 
-#define MAX_PLAYERS 4
+#include "wire.h"
+
+#define MAX_PLAYERS 32
 #define MAX_FRUITS 4
 #define MAX_SEGMENTS 64
 #define SNAKE_NAME_MAX 32
 
+#define VIEW_MAX_W 256
+#define VIEW_MAX_H 128
+#define MINIMAP_MAX_W 32
+#define MINIMAP_MAX_H 12
+#define VIEW_MAX_SEGMENTS 1024
+
+#define RESUME_TOKEN_LEN 16
+#define CONFIG_HASH_LEN 8
+
+#define MINIMAP_FRUIT 0x01
+#define MINIMAP_SNAKE 0x02
+#define MINIMAP_SELF  0x04
+
+/* Sent in MSG_HELLO, MSG_RESUME and MSG_WELCOME; a peer speaking another
+ * version is answered with MSG_BYE. Bump it whenever a schema changes. */
+#define PROTOCOL_VERSION 6
+
 enum {
     MSG_HELLO = 1,
     MSG_WELCOME = 2,
@@ -14,73 +33,247 @@ enum {
     MSG_STATE = 5,
     MSG_PAUSE_TOGGLE = 6,
     MSG_LEAVE = 7,
-    MSG_BYE = 8
+    MSG_BYE = 8,
+    MSG_VIEWPORT = 9,
+    MSG_STATE_VIEW = 10,
+    MSG_RESUME = 11,
+    MSG_CONFIG_REQUEST = 12,
+    MSG_CONFIG_CHANGED = 13,
+    MSG_PING = 14,
+    MSG_PONG = 15
 };
 
-#pragma pack(push, 1)
+/* Every message is described once below (see wire.h); the structs are
+ * host-order and the generated encoders do all byte swapping. */
 
 typedef struct {
-    int16_t x;
-    int16_t y;
+    int32_t x;
+    int32_t y;
 } Cell;
 
-typedef struct {
-    uint16_t type;
-    uint32_t len;
-} MsgHeader;
+#define WIRE_CLASS_CELL CELL
+#define WIRE_LEN_CELL 8
+#define WIRE_DECL_CELL(n, len) Cell n
+#define WIRE_PUT_CELL(p, v, len) (wire_put_u32((p), (uint32_t)(v).x), wire_put_u32((p) + 4, (uint32_t)(v).y))
+#define WIRE_GET_CELL(d, p, len) ((d).x = (int32_t)wire_get_u32(p), (d).y = (int32_t)wire_get_u32((p) + 4))
+#define WIRE_RET_CELL Cell
+#define WIRE_VIEW_CELL(p, len) ((Cell){ (int32_t)wire_get_u32(p), (int32_t)wire_get_u32((p) + 4) })
 
-typedef struct {
-    char name[SNAKE_NAME_MAX];
-} MsgHello;
+static inline void cell_encode(Cell c, uint8_t *out) { WIRE_PUT_CELL(out, c, 8); }
+static inline Cell cell_decode(const uint8_t *in) { return WIRE_VIEW_CELL(in, 8); }
 
-typedef struct {
-    uint32_t player_id;
-} MsgWelcome;
+/* Snake bodies travel as runs of adjacent cells: a U16 run count, then per
+ * run its first Cell, a U16 step count and the steps packed four to a byte,
+ * low bits first, as directions in dir_delta order (0 up, 1 right, 2 down,
+ * 3 left). A step off one edge lands on the opposite one. Any cell that is
+ * not one step from the previous starts a new run, so clipped bodies and
+ * the odd spawn that sits off the board still round-trip exactly. */
+#define BODY_MAX_LEN(n) (2 + (size_t)(n) * (WIRE_LEN_CELL + 2))
 
 typedef struct {
-    uint16_t w;
-    uint16_t h;
-    uint8_t mode;
-    uint8_t world;
-    uint16_t time_limit_sec;
-    uint32_t map_len;
-} MsgConfig;
+    uint8_t *out;
+    size_t off;
+    size_t run_at;
+    uint16_t runs;
+    uint16_t steps;
+    uint8_t bits;
+    bool open;
+    Cell prev;
+    int32_t w, h;
+} BodyWriter;
 
-typedef struct {
-    uint8_t dir;
-} MsgInput;
+void body_begin(BodyWriter *bw, uint8_t *out, uint32_t w, uint32_t h);
+void body_push(BodyWriter *bw, Cell c);
+/* Ends the current run; the next cell starts a new one. */
+void body_break(BodyWriter *bw);
+/* Returns the encoded size. */
+size_t body_end(BodyWriter *bw);
+
+size_t body_encode(const Cell *cells, int n, uint32_t w, uint32_t h, uint8_t *out);
+/* Decodes one body, keeping the first max cells in out and the full cell
+ * count in *count. Returns the bytes consumed, or 0 when malformed. */
+size_t body_decode(const uint8_t *in, size_t len, uint32_t w, uint32_t h,
+                   Cell *out, int max, int *count);
+
+#define WIRE_CLASS_NAME CHARS
+#define WIRE_LEN_NAME SNAKE_NAME_MAX
+#define WIRE_CLASS_TOKEN BYTES
+#define WIRE_LEN_TOKEN RESUME_TOKEN_LEN
+#define WIRE_CLASS_HASH BYTES
+#define WIRE_LEN_HASH CONFIG_HASH_LEN
+
+#define MSG_HEADER_FIELDS(X, R) \
+    X(R, U16, type) \
+    X(R, U32, len)
+WIRE_RECORD(MsgHeader, msg_header, MSG_HEADER_FIELDS)
+
+#define MSG_HELLO_FIELDS(X, R) \
+    X(R, U16, version) \
+    X(R, NAME, name)
+WIRE_RECORD(MsgHello, msg_hello, MSG_HELLO_FIELDS)
+
+/* The token lets the holder reclaim this slot with MSG_RESUME after a
+ * disconnect. Unless the client resumed with a config_hash equal to this
+ * one, it answers with MSG_CONFIG_REQUEST and gets MSG_CONFIG back;
+ * map_hash names the wall data so a cached copy can be used. */
+#define MSG_WELCOME_FIELDS(X, R) \
+    X(R, U16, version) \
+    X(R, U32, player_id) \
+    X(R, TOKEN, token) \
+    X(R, HASH, config_hash) \
+    X(R, HASH, map_hash)
+WIRE_RECORD(MsgWelcome, msg_welcome, MSG_WELCOME_FIELDS)
+
+/* Sent instead of MSG_HELLO; an unknown token is answered with MSG_BYE. */
+#define MSG_RESUME_FIELDS(X, R) \
+    X(R, U16, version) \
+    X(R, TOKEN, token) \
+    X(R, HASH, config_hash)
+WIRE_RECORD(MsgResume, msg_resume, MSG_RESUME_FIELDS)
+
+/* MSG_CONFIG payload: MsgConfig, then map_len bytes holding num_chunks
+ * wall chunk records (see world_encode); chunks not listed are open. When
+ * the client already has the map, map_len is 0 and no records follow. */
+#define MSG_CONFIG_FIELDS(X, R) \
+    X(R, U32, w) \
+    X(R, U32, h) \
+    X(R, U8, mode) \
+    X(R, U8, world) \
+    X(R, U16, time_limit_sec) \
+    X(R, U32, num_chunks) \
+    X(R, U32, map_len)
+WIRE_RECORD(MsgConfig, msg_config, MSG_CONFIG_FIELDS)
+
+#define MSG_CONFIG_REQUEST_FIELDS(X, R) \
+    X(R, U8, want_map)
+WIRE_RECORD(MsgConfigRequest, msg_config_request, MSG_CONFIG_REQUEST_FIELDS)
+
+/* Pushed after a hot reload; the client answers with MSG_CONFIG_REQUEST and
+ * the new MSG_CONFIG arrives among the following states. */
+#define MSG_CONFIG_CHANGED_FIELDS(X, R) \
+    X(R, HASH, config_hash) \
+    X(R, HASH, map_hash)
+WIRE_RECORD(MsgConfigChanged, msg_config_changed, MSG_CONFIG_CHANGED_FIELDS)
+
+/* seq counts up from 1 per connection and client_ms is the sender's clock;
+ * the server queues a few presses and applies one turn per tick, echoing
+ * the last consumed pair as input_seq/input_ms in the player's state.
+ * tick is that of the state on screen when the key was pressed (0 when
+ * none yet); a turn arriving after the next tick has already run can be
+ * applied there retroactively, see server/lagcomp.h. */
+#define MSG_INPUT_FIELDS(X, R) \
+    X(R, U8, dir) \
+    X(R, U32, seq) \
+    X(R, U32, client_ms) \
+    X(R, U32, tick)
+WIRE_RECORD(MsgInput, msg_input, MSG_INPUT_FIELDS)
+
+/* MSG_PING is answered at once with a MSG_PONG carrying the same bytes. */
+#define MSG_PING_FIELDS(X, R) \
+    X(R, U32, client_ms)
+WIRE_RECORD(MsgPing, msg_ping, MSG_PING_FIELDS)
+
+#define MSG_VIEWPORT_FIELDS(X, R) \
+    X(R, U16, view_w) \
+    X(R, U16, view_h)
+WIRE_RECORD(MsgViewport, msg_viewport, MSG_VIEWPORT_FIELDS)
+
+#define FRUIT_STATE_FIELDS(X, R) \
+    X(R, CELL, pos) \
+    X(R, U32, visited_mask)
+WIRE_RECORD(FruitState, fruit_state, FRUIT_STATE_FIELDS)
+
+/* MSG_STATE payload: the header fields, then MAX_PLAYERS x (PlayerState
+ * fields + a body of len cells), then num_fruits x FruitState. */
+#define PLAYER_STATE_FIELDS(X, R) \
+    X(R, U8, player_id) \
+    X(R, U8, connected) \
+    X(R, U8, active) \
+    X(R, U8, alive) \
+    X(R, U8, paused) \
+    X(R, U16, score) \
+    X(R, U16, time_sec) \
+    X(R, U8, dir) \
+    X(R, U16, len) \
+    X(R, U32, input_seq) \
+    X(R, U32, input_ms)
 
 typedef struct {
-    uint8_t player_id;
-    uint8_t connected;
-    uint8_t active;
-    uint8_t alive;
-    uint8_t paused;
-    uint16_t score;
-    uint16_t time_sec;
-    uint8_t dir;
-    uint16_t len;
+    PLAYER_STATE_FIELDS(WIRE_F_DECL, player_state)
     Cell body[MAX_SEGMENTS];
 } PlayerState;
+WIRE_LAYOUT(player_state, PLAYER_STATE_FIELDS)
+WIRE_CODEC(PlayerState, player_state, PLAYER_STATE_FIELDS)
 
-typedef struct {
-    Cell pos;
-    uint32_t visited_mask;
-} FruitState;
+#define MSG_STATE_FIELDS(X, R) \
+    X(R, U32, tick) /* ticks simulated so far */ \
+    X(R, U32, tick_ms) \
+    X(R, U8, game_over) \
+    X(R, U8, mode) \
+    X(R, U32, w) \
+    X(R, U32, h) \
+    X(R, U16, time_left_sec) \
+    X(R, U16, elapsed_sec) \
+    X(R, U16, global_freeze_ms) \
+    X(R, U16, lobby_sec) /* next match starts in, 0 = no next match */ \
+    X(R, U8, num_players) \
+    X(R, U8, num_fruits)
 
 typedef struct {
-    uint32_t tick_ms;
-    uint8_t game_over;
-    uint8_t mode;
-    uint16_t w;
-    uint16_t h;
-    uint16_t time_left_sec;
-    uint16_t elapsed_sec;
-    uint16_t global_freeze_ms;
-    uint8_t num_players;
+    MSG_STATE_FIELDS(WIRE_F_DECL, msg_state_header)
     PlayerState players[MAX_PLAYERS];
-    uint8_t num_fruits;
     FruitState fruits[MAX_FRUITS];
 } MsgState;
+WIRE_LAYOUT(msg_state_header, MSG_STATE_FIELDS)
+WIRE_CODEC(MsgState, msg_state_header, MSG_STATE_FIELDS)
+
+#define MSG_STATE_MAX_LEN (WIRE_SIZE(msg_state_header) + \
+    MAX_PLAYERS * (WIRE_SIZE(player_state) + BODY_MAX_LEN(MAX_SEGMENTS)) + \
+    MAX_FRUITS * WIRE_SIZE(fruit_state))
+
+size_t msg_state_encode(const MsgState *st, uint8_t *out);
+bool msg_state_decode(MsgState *st, const uint8_t *in, size_t len);
+
+/* MSG_STATE_VIEW payload: MsgStateView, then num_players x (PlayerView +
+ * a body of the seg_count visible cells), then num_fruits x FruitState, then minimap_w*minimap_h
+ * bytes of MINIMAP_* flags covering the whole board. */
+#define MSG_STATE_VIEW_FIELDS(X, R) \
+    X(R, U32, tick) \
+    X(R, U32, tick_ms) \
+    X(R, U8, game_over) \
+    X(R, U8, mode) \
+    X(R, U32, w) \
+    X(R, U32, h) \
+    X(R, U16, time_left_sec) \
+    X(R, U16, elapsed_sec) \
+    X(R, U16, global_freeze_ms) \
+    X(R, U32, view_x) \
+    X(R, U32, view_y) \
+    X(R, U16, view_w) \
+    X(R, U16, view_h) \
+    X(R, U8, minimap_w) \
+    X(R, U8, minimap_h) \
+    X(R, U8, num_players) \
+    X(R, U8, num_fruits)
+WIRE_RECORD(MsgStateView, msg_state_view, MSG_STATE_VIEW_FIELDS)
+
+#define PLAYER_VIEW_FIELDS(X, R) \
+    X(R, U8, player_id) \
+    X(R, U8, connected) \
+    X(R, U8, active) \
+    X(R, U8, alive) \
+    X(R, U8, paused) \
+    X(R, U16, score) \
+    X(R, U16, time_sec) \
+    X(R, U8, dir) \
+    X(R, U16, len) \
+    X(R, U32, input_seq) \
+    X(R, U32, input_ms) \
+    X(R, U8, head_in_view) \
+    X(R, U16, seg_count)
+WIRE_RECORD(PlayerView, player_view, PLAYER_VIEW_FIELDS)
 
-#pragma pack(pop)
+/* Largest MSG_STATE_VIEW payload: every segment of every snake visible. */
+#define STATE_VIEW_MAX_LEN (WIRE_SIZE(msg_state_view) + \
+    MAX_PLAYERS * (WIRE_SIZE(player_view) + BODY_MAX_LEN(VIEW_MAX_SEGMENTS)) + \
+    MAX_FRUITS * WIRE_SIZE(fruit_state) + MINIMAP_MAX_W * MINIMAP_MAX_H)
@@ -0,0 +1,400 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "recording.h"
+#include "protocol.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define REC_MAGIC "SNKREC"
+#define REC_INDEX_MAGIC "SNKRIDX"
+#define REC_VERSION 1
+#define REC_HDR_LEN (8 + 4 + 4 + 4 + 4)
+#define REC_RECORD_LEN (1 + 4 + 4)
+#define REC_FOOTER_LEN (8 + 8)
+#define REC_CONFIG_MAX (64u << 20)
+
+/* A literal run only ends at this many equal bytes, so scattered single
+ * byte matches do not each cost an op header. */
+#define DELTA_MIN_SAME 8
+
+static void put_u64(uint8_t *p, uint64_t v) {
+    wire_put_u32(p, (uint32_t)(v >> 32));
+    wire_put_u32(p + 4, (uint32_t)v);
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return ((uint64_t)wire_get_u32(p) << 32) | wire_get_u32(p + 4);
+}
+
+/* Encodes cur against prev into out; 0 when the delta would not be
+ * smaller than cur itself. */
+static uint32_t delta_encode(const uint8_t *prev, uint32_t plen, const uint8_t *cur, uint32_t n, uint8_t *out) {
+    uint32_t o = 4;
+    uint32_t i = 0;
+    wire_put_u32(out, n);
+    while (i < n) {
+        uint32_t same = 0;
+        while (i < n && i < plen && cur[i] == prev[i] && same < 0xFFFF) { i++; same++; }
+        uint32_t j = i;
+        while (j < n && j - i < 0xFFFF) {
+            if (j + DELTA_MIN_SAME <= plen && j + DELTA_MIN_SAME <= n &&
+                memcmp(cur + j, prev + j, DELTA_MIN_SAME) == 0) break;
+            j++;
+        }
+        uint32_t lit = j - i;
+        if (o + 4 + lit >= n) return 0;
+        wire_put_u16(out + o, (uint16_t)same);
+        wire_put_u16(out + o + 2, (uint16_t)lit);
+        memcpy(out + o + 4, cur + i, lit);
+        o += 4 + lit;
+        i = j;
+    }
+    return o;
+}
+
+static bool delta_apply(const uint8_t *prev, uint32_t plen, const uint8_t *d, uint32_t dlen,
+                        uint8_t *out, uint32_t cap, uint32_t *out_len) {
+    if (dlen < 4) return false;
+    uint32_t n = wire_get_u32(d);
+    if (n > cap) return false;
+    uint32_t o = 4;
+    uint32_t i = 0;
+    while (i < n) {
+        if (dlen - o < 4) return false;
+        uint32_t same = wire_get_u16(d + o);
+        uint32_t lit = wire_get_u16(d + o + 2);
+        o += 4;
+        if (same > n - i || i + same > plen) return false;
+        memcpy(out + i, prev + i, same);
+        i += same;
+        if (lit > n - i || lit > dlen - o) return false;
+        memcpy(out + i, d + o, lit);
+        i += lit;
+        o += lit;
+    }
+    if (o != dlen) return false;
+    *out_len = n;
+    return true;
+}
+
+static void write_record(RecWriter *w, uint8_t kind, uint32_t frame, const uint8_t *data, uint32_t len) {
+    uint8_t h[REC_RECORD_LEN];
+    h[0] = kind;
+    wire_put_u32(h + 1, frame);
+    wire_put_u32(h + 5, len);
+    if (fwrite(h, 1, sizeof(h), w->f) != sizeof(h)) w->failed = true;
+    if (len > 0 && fwrite(data, 1, len, w->f) != len) w->failed = true;
+    w->off += sizeof(h) + len;
+}
+
+bool rec_writer_open(RecWriter *w, const char *path, uint32_t tick_ms, uint32_t keyframe_every,
+                     const uint8_t *config, uint32_t config_len) {
+    memset(w, 0, sizeof(*w));
+    w->every = keyframe_every ? keyframe_every : REC_DEFAULT_KEYFRAME_EVERY;
+    w->prev = (uint8_t*)malloc(MSG_STATE_MAX_LEN);
+    w->delta = (uint8_t*)malloc(MSG_STATE_MAX_LEN);
+    w->f = fopen(path, "wb");
+    if (!w->prev || !w->delta || !w->f) {
+        if (w->f) fclose(w->f);
+        free(w->prev);
+        free(w->delta);
+        memset(w, 0, sizeof(*w));
+        return false;
+    }
+    /* Frames are small and come one per tick; let stdio batch them. */
+    (void)setvbuf(w->f, NULL, _IOFBF, 1 << 16);
+
+    uint8_t h[REC_HDR_LEN];
+    memset(h, 0, 8);
+    memcpy(h, REC_MAGIC, sizeof(REC_MAGIC));
+    wire_put_u32(h + 8, REC_VERSION);
+    wire_put_u32(h + 12, PROTOCOL_VERSION);
+    wire_put_u32(h + 16, tick_ms);
+    wire_put_u32(h + 20, w->every);
+    if (fwrite(h, 1, sizeof(h), w->f) != sizeof(h)) w->failed = true;
+    w->off = sizeof(h);
+    return rec_writer_config(w, config, config_len);
+}
+
+bool rec_writer_config(RecWriter *w, const uint8_t *config, uint32_t config_len) {
+    w->config_off = w->off;
+    write_record(w, REC_CONFIG, w->frames, config, config_len);
+    return !w->failed;
+}
+
+bool rec_writer_frame(RecWriter *w, const uint8_t *state, uint32_t len) {
+    if (w->failed || len > MSG_STATE_MAX_LEN) return false;
+    uint32_t frame = w->frames;
+    if (frame % w->every == 0) {
+        /* A crash then loses at most the span since the last keyframe. */
+        if (fflush(w->f) != 0) w->failed = true;
+        if (w->nindex == w->cap) {
+            uint32_t cap = w->cap ? w->cap * 2 : 256;
+            RecIndexEntry *p = (RecIndexEntry*)realloc(w->index, cap * sizeof(*p));
+            if (!p) {
+                w->failed = true;
+                return false;
+            }
+            w->index = p;
+            w->cap = cap;
+        }
+        w->index[w->nindex].offset = w->off;
+        w->index[w->nindex].config_offset = w->config_off;
+        w->nindex++;
+        write_record(w, REC_KEY, frame, state, len);
+    } else {
+        uint32_t dl = delta_encode(w->prev, w->prev_len, state, len, w->delta);
+        if (dl > 0) write_record(w, REC_DELTA, frame, w->delta, dl);
+        else write_record(w, REC_FULL, frame, state, len);
+    }
+    memcpy(w->prev, state, len);
+    w->prev_len = len;
+    w->frames++;
+    return !w->failed;
+}
+
+bool rec_writer_close(RecWriter *w) {
+    if (!w->f) return false;
+    uint64_t index_off = w->off;
+    uint32_t len = 4 + w->nindex * 16;
+    uint8_t *buf = (uint8_t*)malloc(len > REC_FOOTER_LEN ? len : REC_FOOTER_LEN);
+    if (buf) {
+        wire_put_u32(buf, w->frames);
+        for (uint32_t i=0;i<w->nindex;i++) {
+            put_u64(buf + 4 + i * 16, w->index[i].offset);
+            put_u64(buf + 4 + i * 16 + 8, w->index[i].config_offset);
+        }
+        write_record(w, REC_INDEX, w->frames, buf, len);
+        put_u64(buf, index_off);
+        memset(buf + 8, 0, 8);
+        memcpy(buf + 8, REC_INDEX_MAGIC, sizeof(REC_INDEX_MAGIC));
+        if (fwrite(buf, 1, REC_FOOTER_LEN, w->f) != REC_FOOTER_LEN) w->failed = true;
+        free(buf);
+    } else {
+        w->failed = true;
+    }
+    if (fclose(w->f) != 0) w->failed = true;
+    bool ok = !w->failed;
+    free(w->prev);
+    free(w->delta);
+    free(w->index);
+    memset(w, 0, sizeof(*w));
+    return ok;
+}
+
+static bool read_record_header(FILE *f, uint8_t *kind, uint32_t *frame, uint32_t *len) {
+    uint8_t h[REC_RECORD_LEN];
+    if (fread(h, 1, sizeof(h), f) != sizeof(h)) return false;
+    *kind = h[0];
+    *frame = wire_get_u32(h + 1);
+    *len = wire_get_u32(h + 5);
+    return true;
+}
+
+static bool read_trailing_index(RecReader *r) {
+    uint8_t foot[REC_FOOTER_LEN];
+    if (fseeko(r->f, -(off_t)REC_FOOTER_LEN, SEEK_END) != 0) return false;
+    if (fread(foot, 1, sizeof(foot), r->f) != sizeof(foot)) return false;
+    if (memcmp(foot + 8, REC_INDEX_MAGIC, sizeof(REC_INDEX_MAGIC)) != 0) return false;
+    if (fseeko(r->f, (off_t)get_u64(foot), SEEK_SET) != 0) return false;
+
+    uint8_t kind;
+    uint32_t frames, len;
+    if (!read_record_header(r->f, &kind, &frames, &len)) return false;
+    if (kind != REC_INDEX || len < 4 || (len - 4) % 16 != 0) return false;
+    uint8_t *buf = (uint8_t*)malloc(len);
+    if (!buf) return false;
+    bool ok = fread(buf, 1, len, r->f) == len;
+    uint32_t n = (len - 4) / 16;
+    r->index = ok ? (RecIndexEntry*)calloc(n ? n : 1, sizeof(RecIndexEntry)) : NULL;
+    if (r->index) {
+        r->frames = wire_get_u32(buf);
+        r->nindex = n;
+        for (uint32_t i=0;i<n;i++) {
+            r->index[i].offset = get_u64(buf + 4 + i * 16);
+            r->index[i].config_offset = get_u64(buf + 4 + i * 16 + 8);
+        }
+    }
+    free(buf);
+    return r->index != NULL;
+}
+
+/* For a recording whose writer never got to close it. */
+static bool rebuild_index(RecReader *r) {
+    if (fseeko(r->f, REC_HDR_LEN, SEEK_SET) != 0) return false;
+    uint32_t cap = 0;
+    uint64_t off = REC_HDR_LEN;
+    uint64_t config_off = 0;
+    bool have_config = false;
+    for (;;) {
+        uint8_t kind;
+        uint32_t frame, len;
+        if (!read_record_header(r->f, &kind, &frame, &len)) break;
+        uint64_t next = off + REC_RECORD_LEN + len;
+        if (kind == REC_CONFIG) {
+            config_off = off;
+            have_config = true;
+        } else if (kind == REC_KEY) {
+            if (!have_config || frame != r->nindex * r->every) break;
+            if (r->nindex == cap) {
+                cap = cap ? cap * 2 : 256;
+                RecIndexEntry *p = (RecIndexEntry*)realloc(r->index, cap * sizeof(*p));
+                if (!p) return false;
+                r->index = p;
+            }
+            r->index[r->nindex].offset = off;
+            r->index[r->nindex].config_offset = config_off;
+            r->nindex++;
+        } else if (kind != REC_FULL && kind != REC_DELTA) {
+            break;
+        }
+        if (kind != REC_CONFIG) r->frames = frame + 1;
+        if (fseeko(r->f, (off_t)next, SEEK_SET) != 0) break;
+        off = next;
+    }
+    /* A torn last record is found by rec_next; everything before it plays. */
+    return r->nindex > 0;
+}
+
+static bool load_config(RecReader *r, uint64_t off) {
+    if (r->config && r->config_off == off) return true;
+    uint8_t kind;
+    uint32_t frame, len;
+    if (fseeko(r->f, (off_t)off, SEEK_SET) != 0) return false;
+    if (!read_record_header(r->f, &kind, &frame, &len) || kind != REC_CONFIG || len > REC_CONFIG_MAX) return false;
+    uint8_t *p = (uint8_t*)malloc(len ? len : 1);
+    if (!p) return false;
+    if (fread(p, 1, len, r->f) != len) {
+        free(p);
+        return false;
+    }
+    free(r->config);
+    r->config = p;
+    r->config_len = len;
+    r->config_off = off;
+    r->config_gen++;
+    return true;
+}
+
+static bool seek_keyframe(RecReader *r, uint32_t k) {
+    if (!load_config(r, r->index[k].config_offset)) return false;
+    if (fseeko(r->f, (off_t)r->index[k].offset, SEEK_SET) != 0) return false;
+    r->frame = UINT32_MAX;
+    return true;
+}
+
+static void set_err(char *err, size_t errlen, const char *msg) {
+    if (err && errlen) (void)snprintf(err, errlen, "%s", msg);
+}
+
+bool rec_open(RecReader *r, const char *path, char *err, size_t errlen) {
+    memset(r, 0, sizeof(*r));
+    r->frame = UINT32_MAX;
+    r->f = fopen(path, "rb");
+    if (!r->f) {
+        set_err(err, errlen, "cannot open the file");
+        return false;
+    }
+    uint8_t h[REC_HDR_LEN];
+    if (fread(h, 1, sizeof(h), r->f) != sizeof(h) || memcmp(h, REC_MAGIC, sizeof(REC_MAGIC)) != 0 ||
+        wire_get_u32(h + 8) != REC_VERSION) {
+        set_err(err, errlen, "not a recording");
+        rec_close(r);
+        return false;
+    }
+    if (wire_get_u32(h + 12) != PROTOCOL_VERSION) {
+        set_err(err, errlen, "recorded with another protocol version");
+        rec_close(r);
+        return false;
+    }
+    r->tick_ms = wire_get_u32(h + 16);
+    r->every = wire_get_u32(h + 20);
+    r->state = (uint8_t*)malloc(MSG_STATE_MAX_LEN);
+    r->spare = (uint8_t*)malloc(MSG_STATE_MAX_LEN);
+    r->scratch = (uint8_t*)malloc(MSG_STATE_MAX_LEN);
+    if (r->every == 0 || !r->state || !r->spare || !r->scratch) {
+        set_err(err, errlen, "out of memory");
+        rec_close(r);
+        return false;
+    }
+    if (!read_trailing_index(r)) {
+        free(r->index);
+        r->index = NULL;
+        r->nindex = 0;
+        r->frames = 0;
+        if (!rebuild_index(r)) {
+            set_err(err, errlen, "no frames");
+            rec_close(r);
+            return false;
+        }
+    }
+    if (r->nindex == 0 || !seek_keyframe(r, 0)) {
+        set_err(err, errlen, "damaged recording");
+        rec_close(r);
+        return false;
+    }
+    return true;
+}
+
+void rec_close(RecReader *r) {
+    if (r->f) fclose(r->f);
+    free(r->index);
+    free(r->config);
+    free(r->state);
+    free(r->spare);
+    free(r->scratch);
+    memset(r, 0, sizeof(*r));
+}
+
+bool rec_next(RecReader *r) {
+    for (;;) {
+        uint8_t kind;
+        uint32_t frame, len;
+        off_t at = ftello(r->f);
+        if (at < 0 || !read_record_header(r->f, &kind, &frame, &len)) return false;
+        if (kind == REC_CONFIG) {
+            /* Already loaded when a seek landed right behind it. */
+            if ((uint64_t)at == r->config_off) {
+                if (fseeko(r->f, (off_t)len, SEEK_CUR) != 0) return false;
+                continue;
+            }
+            if (!load_config(r, (uint64_t)at)) return false;
+            continue;
+        }
+        if (len > MSG_STATE_MAX_LEN) return false;
+        if (kind == REC_KEY || kind == REC_FULL) {
+            if (kind == REC_FULL && frame != r->frame + 1) return false;
+            if (fread(r->state, 1, len, r->f) != len) return false;
+            r->state_len = len;
+        } else if (kind == REC_DELTA) {
+            if (frame != r->frame + 1) return false;
+            if (fread(r->scratch, 1, len, r->f) != len) return false;
+            uint32_t n;
+            if (!delta_apply(r->state, r->state_len, r->scratch, len, r->spare, MSG_STATE_MAX_LEN, &n)) return false;
+            uint8_t *t = r->state;
+            r->state = r->spare;
+            r->spare = t;
+            r->state_len = n;
+        } else {
+            return false;
+        }
+        r->frame = frame;
+        return true;
+    }
+}
+
+bool rec_seek(RecReader *r, uint32_t frame) {
+    if (r->frames == 0) return false;
+    if (frame >= r->frames) frame = r->frames - 1;
+    uint32_t k = frame / r->every;
+    if (k >= r->nindex) k = r->nindex - 1;
+    /* Stepping forward inside the current keyframe's span needs no jump. */
+    bool ahead = r->frame != UINT32_MAX && r->frame <= frame && r->frame >= k * r->every;
+    if (!ahead && !seek_keyframe(r, k)) return false;
+    while (r->frame == UINT32_MAX || r->frame < frame) {
+        if (!rec_next(r)) return r->frame != UINT32_MAX;
+    }
+    return true;
+}
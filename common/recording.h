@@ -0,0 +1,92 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Match recordings: the MSG_STATE stream the server broadcasts, one frame
+ * per tick, with every Nth frame stored whole as a keyframe and the rest
+ * as byte deltas against the frame before. The MSG_CONFIG payload (board
+ * and walls) is written up front and again whenever a reload changes it.
+ * A trailing index maps keyframe k, which is frame k * N, to its offset
+ * and to the config in force there, so a seek is one index lookup and at
+ * most N - 1 deltas. A recording cut short by a crash has no index; the
+ * reader then rebuilds it with one pass over the frames.
+ *
+ * File layout, all integers big-endian:
+ *   magic[8] "SNKREC\0\0", u32 version, u32 protocol_version, u32 tick_ms,
+ *   u32 keyframe_every,
+ *   records of u8 kind, u32 frame, u32 len, len bytes:
+ *     REC_CONFIG  MSG_CONFIG payload, in force from this frame on
+ *     REC_KEY     a whole MSG_STATE payload, frame % keyframe_every == 0
+ *     REC_FULL    a whole MSG_STATE payload where a delta would not pay
+ *     REC_DELTA   u32 state_len, then ops of u16 same, u16 lit, lit bytes:
+ *                 copy `same` bytes from the previous frame, take `lit`
+ *     REC_INDEX   u32 frames, then per keyframe u64 offset, u64 config offset
+ *   u64 offset of the REC_INDEX record, magic[8] "SNKRIDX\0". */
+
+enum {
+    REC_CONFIG = 'C',
+    REC_KEY = 'K',
+    REC_FULL = 'F',
+    REC_DELTA = 'D',
+    REC_INDEX = 'I'
+};
+
+#define REC_DEFAULT_KEYFRAME_EVERY 50
+
+typedef struct {
+    uint64_t offset;            /* of the REC_KEY record */
+    uint64_t config_offset;     /* of the REC_CONFIG record in force */
+} RecIndexEntry;
+
+typedef struct {
+    FILE *f;
+    uint32_t every;
+    uint32_t frames;
+    uint64_t off;
+    uint64_t config_off;
+    uint8_t *prev;
+    uint32_t prev_len;
+    uint8_t *delta;
+    RecIndexEntry *index;
+    uint32_t nindex;
+    uint32_t cap;
+    bool failed;
+} RecWriter;
+
+bool rec_writer_open(RecWriter *w, const char *path, uint32_t tick_ms, uint32_t keyframe_every,
+                     const uint8_t *config, uint32_t config_len);
+/* A new MSG_CONFIG payload for the frames that follow. */
+bool rec_writer_config(RecWriter *w, const uint8_t *config, uint32_t config_len);
+bool rec_writer_frame(RecWriter *w, const uint8_t *state, uint32_t len);
+/* Writes the index and closes the file; false if any write failed. */
+bool rec_writer_close(RecWriter *w);
+
+typedef struct {
+    FILE *f;
+    uint32_t tick_ms;
+    uint32_t every;
+    uint32_t frames;            /* state frames in the recording */
+    RecIndexEntry *index;
+    uint32_t nindex;
+    /* The config in force for the current frame; config_gen changes
+     * whenever it is replaced. */
+    uint8_t *config;
+    uint32_t config_len;
+    uint64_t config_off;
+    uint32_t config_gen;
+    /* The current frame, a whole MSG_STATE payload. */
+    uint8_t *state;
+    uint32_t state_len;
+    uint32_t frame;             /* UINT32_MAX before the first rec_next */
+    uint8_t *spare;             /* the next frame while a delta applies */
+    uint8_t *scratch;           /* a delta record as read */
+} RecReader;
+
+bool rec_open(RecReader *r, const char *path, char *err, size_t errlen);
+void rec_close(RecReader *r);
+/* Steps to the next frame; false at the end or on a damaged record. */
+bool rec_next(RecReader *r);
+/* Positions on frame (clamped to the last one) through its keyframe. */
+bool rec_seek(RecReader *r, uint32_t frame);
@@ -0,0 +1,216 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "shm.h"
+#include "protocol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_ALIGN 64u
+
+static size_t align_up(size_t n) {
+    return (n + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+}
+
+static uint64_t mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static void shm_name(char *out, size_t cap, const char *name) {
+    (void)snprintf(out, cap, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+static void fail(char *err, size_t cap, const char *what) {
+    if (err && cap) (void)snprintf(err, cap, "%s: %s", what, strerror(errno));
+}
+
+/* Word-wise copies in and out of a section; the tail word is padded. */
+static void copy_in(uint64_t *dst, const uint8_t *src, uint32_t len) {
+    uint32_t words = (len + 7) / 8;
+    for (uint32_t i=0;i<words;i++) {
+        uint64_t v = 0;
+        uint32_t n = (len - i * 8 < 8) ? len - i * 8 : 8;
+        memcpy(&v, src + (size_t)i * 8, n);
+        __atomic_store_n(&dst[i], v, __ATOMIC_RELAXED);
+    }
+}
+
+static void copy_out(uint8_t *dst, const uint64_t *src, uint32_t len) {
+    uint32_t words = (len + 7) / 8;
+    for (uint32_t i=0;i<words;i++) {
+        uint64_t v = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        uint32_t n = (len - i * 8 < 8) ? len - i * 8 : 8;
+        memcpy(dst + (size_t)i * 8, &v, n);
+    }
+}
+
+bool shm_writer_open(ShmWriter *w, const char *name, uint32_t config_len, char *err, size_t cap) {
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    shm_name(w->name, sizeof(w->name), name);
+
+    size_t config_cap = align_up(config_len > SHM_CONFIG_MIN_CAP / 2 ? (size_t)config_len * 2 : SHM_CONFIG_MIN_CAP);
+    size_t state_cap = align_up(MSG_STATE_MAX_LEN);
+    size_t config_off = align_up(sizeof(ShmHeader));
+    size_t state_off = config_off + config_cap;
+    w->size = state_off + state_cap;
+
+    /* A fresh object rather than truncating the old one under its readers. */
+    (void)shm_unlink(w->name);
+    w->fd = shm_open(w->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (w->fd < 0) {
+        fail(err, cap, "shm_open");
+        return false;
+    }
+    if (ftruncate(w->fd, (off_t)w->size) != 0) {
+        fail(err, cap, "ftruncate");
+        shm_writer_close(w);
+        return false;
+    }
+    void *base = mmap(NULL, w->size, PROT_READ | PROT_WRITE, MAP_SHARED, w->fd, 0);
+    if (base == MAP_FAILED) {
+        fail(err, cap, "mmap");
+        shm_writer_close(w);
+        return false;
+    }
+    w->base = (uint8_t*)base;
+
+    ShmHeader *h = (ShmHeader*)w->base;
+    memcpy(h->magic, SHM_MAGIC, sizeof(h->magic));
+    h->header_size = (uint32_t)sizeof(ShmHeader);
+    h->protocol_version = PROTOCOL_VERSION;
+    h->pid = (uint32_t)getpid();
+    h->config.offset = config_off;
+    h->config.cap = config_cap;
+    h->state.offset = state_off;
+    h->state.cap = state_cap;
+    /* Last, so a reader that sees the version sees the layout. */
+    __atomic_store_n(&h->version, SHM_VERSION, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void publish(ShmWriter *w, ShmSection *s, uint64_t stamp, const uint8_t *buf, uint32_t len) {
+    uint32_t seq = s->seq;
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&s->len, len, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->stamp, stamp, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->ms, mono_ms(), __ATOMIC_RELAXED);
+    copy_in((uint64_t*)(w->base + s->offset), buf, len);
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void shm_writer_state(ShmWriter *w, uint32_t tick, const uint8_t *buf, uint32_t len) {
+    if (!w->base) return;
+    ShmHeader *h = (ShmHeader*)w->base;
+    if (len > h->state.cap) return;
+    publish(w, &h->state, tick, buf, len);
+    w->published++;
+}
+
+void shm_writer_config(ShmWriter *w, uint32_t gen, const uint8_t *buf, uint32_t len) {
+    if (!w->base) return;
+    ShmHeader *h = (ShmHeader*)w->base;
+    publish(w, &h->config, gen, buf, (len <= h->config.cap) ? len : 0);
+}
+
+void shm_writer_close(ShmWriter *w) {
+    if (w->base) {
+        __atomic_store_n(&((ShmHeader*)w->base)->closed, 1, __ATOMIC_RELEASE);
+        (void)munmap(w->base, w->size);
+    }
+    if (w->fd >= 0) {
+        close(w->fd);
+        (void)shm_unlink(w->name);
+    }
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+}
+
+bool shm_reader_open(ShmReader *r, const char *name, char *err, size_t cap) {
+    memset(r, 0, sizeof(*r));
+    char path[64];
+    shm_name(path, sizeof(path), name);
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        fail(err, cap, "shm_open");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmHeader)) {
+        if (err && cap) (void)snprintf(err, cap, "not a snake segment");
+        close(fd);
+        return false;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fail(err, cap, "mmap");
+        return false;
+    }
+    r->base = (const uint8_t*)base;
+    r->size = (size_t)st.st_size;
+    r->hdr = (const ShmHeader*)base;
+
+    const ShmHeader *h = r->hdr;
+    uint32_t version = __atomic_load_n(&h->version, __ATOMIC_ACQUIRE);
+    const char *why = NULL;
+    if (memcmp(h->magic, SHM_MAGIC, sizeof(h->magic)) != 0) why = "not a snake segment";
+    else if (version != SHM_VERSION) why = "unsupported segment version";
+    else if (h->header_size < sizeof(ShmHeader) || h->config.offset + h->config.cap > r->size ||
+             h->state.offset + h->state.cap > r->size) why = "bad segment layout";
+    if (why) {
+        if (err && cap) (void)snprintf(err, cap, "%s", why);
+        shm_reader_close(r);
+        return false;
+    }
+    return true;
+}
+
+void shm_reader_close(ShmReader *r) {
+    if (r->base) (void)munmap((void*)r->base, r->size);
+    memset(r, 0, sizeof(*r));
+}
+
+bool shm_reader_closed(const ShmReader *r) {
+    return __atomic_load_n(&r->hdr->closed, __ATOMIC_ACQUIRE) != 0;
+}
+
+static ShmResult read_section(const ShmReader *r, const ShmSection *s, uint8_t *buf, uint32_t cap, uint32_t *len,
+                              uint64_t *stamp, uint64_t *ms) {
+    const uint64_t *src = (const uint64_t*)(r->base + s->offset);
+    for (int tries=0;tries<SHM_READ_TRIES;tries++) {
+        uint32_t s1 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (s1 == 0) return SHM_EMPTY;
+        if (s1 & 1) continue;
+        uint32_t n = __atomic_load_n(&s->len, __ATOMIC_RELAXED);
+        uint64_t st = __atomic_load_n(&s->stamp, __ATOMIC_RELAXED);
+        uint64_t t = __atomic_load_n(&s->ms, __ATOMIC_RELAXED);
+        bool fits = n <= cap && n <= s->cap;
+        if (fits) copy_out(buf, src, n);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != s1) continue;
+        *len = n;
+        if (stamp) *stamp = st;
+        if (ms) *ms = t;
+        return fits ? SHM_OK : SHM_TOO_SMALL;
+    }
+    return SHM_BUSY;
+}
+
+ShmResult shm_read_state(const ShmReader *r, uint8_t *buf, uint32_t cap, uint32_t *len, uint64_t *stamp,
+                         uint64_t *ms) {
+    return read_section(r, &r->hdr->state, buf, cap, len, stamp, ms);
+}
+
+ShmResult shm_read_config(const ShmReader *r, uint8_t *buf, uint32_t cap, uint32_t *len, uint64_t *stamp) {
+    return read_section(r, &r->hdr->config, buf, cap, len, stamp, NULL);
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The live game published in a POSIX shared-memory segment, for tools on
+ * the same host that should not take a player slot: the MSG_STATE payload
+ * of every tick and the MSG_CONFIG payload (board and walls) in force.
+ * The server writes; any number of readers map the segment read-only and
+ * copy out a consistent snapshot without a syscall or a lock, so a slow
+ * or stuck reader cannot hold up the tick.
+ *
+ * Each section is guarded by a seqlock: the writer makes seq odd, writes
+ * the payload, then makes seq even again. A reader copies the payload
+ * between two reads of seq and keeps the copy only when both saw the same
+ * even value; otherwise the tick was mid-write and it tries again. The
+ * payload is copied a word at a time with atomic loads and stores, so the
+ * race a reader loses is well defined.
+ *
+ * Layout, native byte order: ShmHeader at offset 0, the config payload at
+ * config.offset and the state payload at state.offset, each section cap
+ * bytes long. A config larger than its section is published with len 0
+ * and a new stamp. On a clean exit the server sets closed and unlinks the
+ * name; a server that died just stops moving state.ms. Either way a
+ * reader that wants the next server reopens the name. */
+
+#define SHM_MAGIC "SNKSHM\0"
+#define SHM_VERSION 1
+/* Room for the config, unless the board in it needs more at startup. */
+#define SHM_CONFIG_MIN_CAP (1u << 20)
+/* Attempts at a consistent copy before shm_read gives up for now. */
+#define SHM_READ_TRIES 64
+
+typedef struct {
+    uint32_t seq;             /* odd while the writer is in the payload */
+    uint32_t len;             /* payload bytes */
+    uint64_t stamp;           /* state: the tick; config: its generation */
+    uint64_t ms;              /* CLOCK_MONOTONIC when published */
+    uint64_t offset;          /* of the payload, from the segment start */
+    uint64_t cap;
+} ShmSection;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t protocol_version;
+    uint32_t pid;             /* of the server */
+    uint32_t closed;          /* set when the server exits */
+    uint32_t pad;
+    ShmSection config;
+    ShmSection state;
+} ShmHeader;
+
+typedef struct {
+    char name[64];
+    int fd;
+    uint8_t *base;
+    size_t size;
+    uint64_t published;       /* state payloads written */
+} ShmWriter;
+
+/* Creates name (a leading '/' is added when missing), replacing any
+ * segment a previous server left; readers of that one keep their copy. */
+bool shm_writer_open(ShmWriter *w, const char *name, uint32_t config_len, char *err, size_t cap);
+void shm_writer_state(ShmWriter *w, uint32_t tick, const uint8_t *buf, uint32_t len);
+void shm_writer_config(ShmWriter *w, uint32_t gen, const uint8_t *buf, uint32_t len);
+/* Marks the segment closed and unlinks it. */
+void shm_writer_close(ShmWriter *w);
+
+typedef struct {
+    const uint8_t *base;
+    size_t size;
+    const ShmHeader *hdr;
+} ShmReader;
+
+typedef enum {
+    SHM_OK = 0,
+    SHM_BUSY,                 /* the writer kept getting in the way; retry */
+    SHM_EMPTY,                /* nothing published yet */
+    SHM_TOO_SMALL             /* buf is shorter than the payload; *len says how long */
+} ShmResult;
+
+bool shm_reader_open(ShmReader *r, const char *name, char *err, size_t cap);
+void shm_reader_close(ShmReader *r);
+/* The server has exited; what it published last can still be read. */
+bool shm_reader_closed(const ShmReader *r);
+/* Copies out a consistent payload; *stamp and *ms may be NULL. */
+ShmResult shm_read_state(const ShmReader *r, uint8_t *buf, uint32_t cap, uint32_t *len, uint64_t *stamp,
+                         uint64_t *ms);
+ShmResult shm_read_config(const ShmReader *r, uint8_t *buf, uint32_t cap, uint32_t *len, uint64_t *stamp);
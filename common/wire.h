@@ -0,0 +1,134 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Wire records generated from X-macro schemas. A schema lists the fields
+ * of one record in wire order:
+ *
+ *     #define MSG_INPUT_FIELDS(X, R) \
+ *         X(R, U8, dir)
+ *     WIRE_RECORD(MsgInput, msg_input, MSG_INPUT_FIELDS)
+ *
+ * which gives
+ *   MsgInput               host struct: natural alignment, host byte order
+ *   struct msg_input_wire  the byte layout; WIRE_SIZE(msg_input) is its size
+ *   msg_input_encode()     host struct -> big-endian bytes, returns the size
+ *   msg_input_decode()     bytes -> host struct, false when too short
+ *   msg_input_at()         bounds check for reading in place: the buffer,
+ *                          or NULL when it cannot hold the record
+ *   msg_input_dir()        one field read straight from a checked buffer.
+ *
+ * Field kinds are U8, U16, U32 and I32, plus any kind that names a class
+ * with WIRE_CLASS_<kind> and a byte length with WIRE_LEN_<kind>; the BYTES
+ * and CHARS classes cover fixed-size arrays. Records followed by variable
+ * parts use WIRE_LAYOUT and WIRE_CODEC on a hand-written host struct. */
+
+#define WIRE_CAT_(a, b) a##b
+#define WIRE_CAT(a, b) WIRE_CAT_(a, b)
+
+#define WIRE_SIZE(R) sizeof(struct R##_wire)
+
+static inline void wire_put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline void wire_put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static inline uint16_t wire_get_u16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t wire_get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Each class provides DECL (host member), PUT, GET, RET (accessor return
+ * type) and VIEW (accessor body). */
+#define WIRE_CLASS_U8 U8
+#define WIRE_LEN_U8 1
+#define WIRE_DECL_U8(n, len) uint8_t n
+#define WIRE_PUT_U8(p, v, len) ((p)[0] = (v))
+#define WIRE_GET_U8(d, p, len) ((d) = (p)[0])
+#define WIRE_RET_U8 uint8_t
+#define WIRE_VIEW_U8(p, len) ((p)[0])
+
+#define WIRE_CLASS_U16 U16
+#define WIRE_LEN_U16 2
+#define WIRE_DECL_U16(n, len) uint16_t n
+#define WIRE_PUT_U16(p, v, len) wire_put_u16((p), (v))
+#define WIRE_GET_U16(d, p, len) ((d) = wire_get_u16(p))
+#define WIRE_RET_U16 uint16_t
+#define WIRE_VIEW_U16(p, len) wire_get_u16(p)
+
+#define WIRE_CLASS_U32 U32
+#define WIRE_LEN_U32 4
+#define WIRE_DECL_U32(n, len) uint32_t n
+#define WIRE_PUT_U32(p, v, len) wire_put_u32((p), (v))
+#define WIRE_GET_U32(d, p, len) ((d) = wire_get_u32(p))
+#define WIRE_RET_U32 uint32_t
+#define WIRE_VIEW_U32(p, len) wire_get_u32(p)
+
+#define WIRE_CLASS_I32 I32
+#define WIRE_LEN_I32 4
+#define WIRE_DECL_I32(n, len) int32_t n
+#define WIRE_PUT_I32(p, v, len) wire_put_u32((p), (uint32_t)(v))
+#define WIRE_GET_I32(d, p, len) ((d) = (int32_t)wire_get_u32(p))
+#define WIRE_RET_I32 int32_t
+#define WIRE_VIEW_I32(p, len) ((int32_t)wire_get_u32(p))
+
+#define WIRE_DECL_BYTES(n, len) uint8_t n[len]
+#define WIRE_PUT_BYTES(p, v, len) memcpy((p), (v), (len))
+#define WIRE_GET_BYTES(d, p, len) memcpy((d), (p), (len))
+#define WIRE_RET_BYTES const uint8_t *
+#define WIRE_VIEW_BYTES(p, len) (p)
+
+#define WIRE_DECL_CHARS(n, len) char n[len]
+#define WIRE_PUT_CHARS(p, v, len) memcpy((p), (v), (len))
+#define WIRE_GET_CHARS(d, p, len) memcpy((d), (p), (len))
+#define WIRE_RET_CHARS const char *
+#define WIRE_VIEW_CHARS(p, len) ((const char *)(p))
+
+/* Per-field expansions; R is the record prefix. */
+#define WIRE_F_DECL(R, kind, name) \
+    WIRE_CAT(WIRE_DECL_, WIRE_CLASS_##kind)(name, WIRE_LEN_##kind);
+#define WIRE_F_LAYOUT(R, kind, name) \
+    uint8_t name[WIRE_LEN_##kind];
+#define WIRE_F_PUT(R, kind, name) \
+    WIRE_CAT(WIRE_PUT_, WIRE_CLASS_##kind)(out + offsetof(struct R##_wire, name), m->name, WIRE_LEN_##kind);
+#define WIRE_F_GET(R, kind, name) \
+    WIRE_CAT(WIRE_GET_, WIRE_CLASS_##kind)(m->name, in + offsetof(struct R##_wire, name), WIRE_LEN_##kind);
+#define WIRE_F_VIEW(R, kind, name) \
+    static inline WIRE_CAT(WIRE_RET_, WIRE_CLASS_##kind) R##_##name(const uint8_t *v) { \
+        return WIRE_CAT(WIRE_VIEW_, WIRE_CLASS_##kind)(v + offsetof(struct R##_wire, name), WIRE_LEN_##kind); \
+    }
+
+#define WIRE_LAYOUT(R, FIELDS) \
+    struct R##_wire { FIELDS(WIRE_F_LAYOUT, R) };
+
+#define WIRE_CODEC(Type, R, FIELDS) \
+    static inline size_t R##_encode(const Type *m, uint8_t *out) { \
+        FIELDS(WIRE_F_PUT, R) \
+        return WIRE_SIZE(R); \
+    } \
+    static inline bool R##_decode(Type *m, const uint8_t *in, size_t len) { \
+        if (len < WIRE_SIZE(R)) return false; \
+        FIELDS(WIRE_F_GET, R) \
+        return true; \
+    } \
+    static inline const uint8_t *R##_at(const uint8_t *in, size_t len) { \
+        return (len >= WIRE_SIZE(R)) ? in : NULL; \
+    } \
+    FIELDS(WIRE_F_VIEW, R)
+
+#define WIRE_RECORD(Type, R, FIELDS) \
+    typedef struct { FIELDS(WIRE_F_DECL, R) } Type; \
+    WIRE_LAYOUT(R, FIELDS) \
+    WIRE_CODEC(Type, R, FIELDS)
@@ -0,0 +1,370 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "world.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool world_init(World *wd, int32_t w, int32_t h) {
+    static uint32_t next_id;
+    memset(wd, 0, sizeof(*wd));
+    wd->id = __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+    if (w <= 0 || h <= 0 || w > WORLD_MAX_DIM || h > WORLD_MAX_DIM) return false;
+    wd->w = w;
+    wd->h = h;
+    wd->cw = (w + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    wd->ch = (h + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    wd->rw = (wd->cw + REGION_SIZE - 1) >> REGION_SHIFT;
+    wd->rh = (wd->ch + REGION_SIZE - 1) >> REGION_SHIFT;
+    wd->regions = (Chunk***)calloc((size_t)wd->rw * (size_t)wd->rh, sizeof(Chunk**));
+    return wd->regions != NULL;
+}
+
+static void *chunk_alloc(World *wd) {
+    Chunk *c = (Chunk*)block_pool_get(&wd->chunk_pool);
+    return c ? c : calloc(1, sizeof(Chunk));
+}
+
+static void *layer_alloc(World *wd) {
+    uint64_t *l = (uint64_t*)block_pool_get(&wd->layer_pool);
+    return l ? l : calloc(CHUNK_CELLS, sizeof(uint64_t));
+}
+
+static void chunk_release(World *wd, Chunk *c) {
+    if (block_pool_owns(&wd->chunk_pool, c)) block_pool_put(&wd->chunk_pool, c);
+    else free(c);
+}
+
+static void layer_release(World *wd, uint64_t *l) {
+    if (!l) return;
+    if (block_pool_owns(&wd->layer_pool, l)) block_pool_put(&wd->layer_pool, l);
+    else free(l);
+}
+
+static void chunk_free(World *wd, Chunk *c) {
+    for (int l=0;l<WORLD_LAYERS;l++) layer_release(wd, c->layer[l]);
+    chunk_release(wd, c);
+}
+
+void world_free(World *wd) {
+    if (wd->regions) {
+        size_t nreg = (size_t)wd->rw * (size_t)wd->rh;
+        for (size_t r=0;r<nreg;r++) {
+            Chunk **t = wd->regions[r];
+            if (!t) continue;
+            for (int i=0;i<REGION_CHUNKS;i++) if (t[i]) chunk_free(wd, t[i]);
+            free(t);
+        }
+        free(wd->regions);
+    }
+    block_pool_free(&wd->chunk_pool);
+    block_pool_free(&wd->layer_pool);
+    memset(wd, 0, sizeof(*wd));
+}
+
+static Chunk ***region_ptr(const World *wd, int32_t cx, int32_t cy) {
+    size_t r = (size_t)(cy >> REGION_SHIFT) * (size_t)wd->rw + (size_t)(cx >> REGION_SHIFT);
+    return &wd->regions[r];
+}
+
+static size_t region_index(int32_t cx, int32_t cy) {
+    return ((size_t)(cy & (REGION_SIZE - 1)) << REGION_SHIFT) | (size_t)(cx & (REGION_SIZE - 1));
+}
+
+Chunk *world_chunk(const World *wd, int32_t cx, int32_t cy) {
+    if (cx < 0 || cy < 0 || cx >= wd->cw || cy >= wd->ch) return NULL;
+    Chunk **t = __atomic_load_n(region_ptr(wd, cx, cy), __ATOMIC_ACQUIRE);
+    return t ? __atomic_load_n(&t[region_index(cx, cy)], __ATOMIC_ACQUIRE) : NULL;
+}
+
+/* Lock-free create: losers of a race free their copy and use the winner's. */
+Chunk *world_chunk_create(World *wd, int32_t cx, int32_t cy) {
+    if (cx < 0 || cy < 0 || cx >= wd->cw || cy >= wd->ch) return NULL;
+    Chunk ***tp = region_ptr(wd, cx, cy);
+    Chunk **t = __atomic_load_n(tp, __ATOMIC_ACQUIRE);
+    if (!t) {
+        Chunk **fresh = (Chunk**)calloc(REGION_CHUNKS, sizeof(Chunk*));
+        if (!fresh) return NULL;
+        if (__atomic_compare_exchange_n(tp, &t, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_fetch_add(&wd->table_count, 1, __ATOMIC_RELAXED);
+            t = fresh;
+        } else {
+            free(fresh);
+        }
+    }
+
+    Chunk **slot = &t[region_index(cx, cy)];
+    Chunk *c = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (c) return c;
+    Chunk *fresh = (Chunk*)chunk_alloc(wd);
+    if (!fresh) return NULL;
+    fresh->cx = cx;
+    fresh->cy = cy;
+    if (__atomic_compare_exchange_n(slot, &c, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        __atomic_fetch_add(&wd->chunk_count, 1, __ATOMIC_RELAXED);
+        return fresh;
+    }
+    chunk_release(wd, fresh);
+    return c;
+}
+
+/* Walks every allocated chunk; *cursor starts at 0. */
+Chunk *world_next_chunk(const World *wd, size_t *cursor) {
+    size_t total = (size_t)wd->rw * (size_t)wd->rh * REGION_CHUNKS;
+    while (*cursor < total) {
+        size_t r = *cursor / REGION_CHUNKS;
+        Chunk **t = wd->regions[r];
+        if (!t) { *cursor = (r + 1) * REGION_CHUNKS; continue; }
+        Chunk *c = t[*cursor % REGION_CHUNKS];
+        (*cursor)++;
+        if (c) return c;
+    }
+    return NULL;
+}
+
+bool world_is_wall(const World *wd, int32_t x, int32_t y) {
+    if (x < 0 || y < 0 || x >= wd->w || y >= wd->h) return false;
+    const Chunk *c = world_chunk(wd, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    if (!c) return false;
+    if (c->wall_count == CHUNK_CELLS) return true;
+    int b = world_cell_index(x, y);
+    return (c->walls[b >> 3] >> (b & 7)) & 1;
+}
+
+void world_set_wall(World *wd, int32_t x, int32_t y, bool wall) {
+    if (x < 0 || y < 0 || x >= wd->w || y >= wd->h) return;
+    Chunk *c = wall ? world_chunk_create(wd, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT)
+                    : world_chunk(wd, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    if (!c) return;
+    int b = world_cell_index(x, y);
+    uint8_t bit = (uint8_t)(1u << (b & 7));
+    bool was = (c->walls[b >> 3] & bit) != 0;
+    if (was == wall) return;
+    if (wall) { c->walls[b >> 3] |= bit; c->wall_count++; }
+    else { c->walls[b >> 3] &= (uint8_t)~bit; c->wall_count--; }
+}
+
+/* Inclusive rectangle; chunks it covers entirely are filled in one step. */
+void world_fill(World *wd, int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= wd->w) x1 = wd->w - 1;
+    if (y1 >= wd->h) y1 = wd->h - 1;
+    if (x0 > x1 || y0 > y1) return;
+
+    for (int32_t cy = y0 >> CHUNK_SHIFT; cy <= (y1 >> CHUNK_SHIFT); cy++) {
+        for (int32_t cx = x0 >> CHUNK_SHIFT; cx <= (x1 >> CHUNK_SHIFT); cx++) {
+            int32_t bx0 = cx << CHUNK_SHIFT, by0 = cy << CHUNK_SHIFT;
+            int32_t bx1 = bx0 + CHUNK_MASK, by1 = by0 + CHUNK_MASK;
+            if (x0 <= bx0 && y0 <= by0 && x1 >= bx1 && y1 >= by1) {
+                Chunk *c = world_chunk_create(wd, cx, cy);
+                if (!c) continue;
+                memset(c->walls, 0xFF, sizeof(c->walls));
+                c->wall_count = CHUNK_CELLS;
+                continue;
+            }
+            int32_t ax0 = (x0 > bx0) ? x0 : bx0, ay0 = (y0 > by0) ? y0 : by0;
+            int32_t ax1 = (x1 < bx1) ? x1 : bx1, ay1 = (y1 < by1) ? y1 : by1;
+            for (int32_t y=ay0;y<=ay1;y++) for (int32_t x=ax0;x<=ax1;x++) world_set_wall(wd, x, y, true);
+        }
+    }
+}
+
+bool world_chunk_full(const World *wd, int32_t x, int32_t y) {
+    const Chunk *c = world_chunk(wd, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    return c && c->wall_count == CHUNK_CELLS;
+}
+
+#if CHUNK_SIZE != 64
+#error "world_load_bits maps one 64-bit word to one chunk row"
+#endif
+
+bool world_load_bits(World *wd, const uint64_t *rows) {
+    size_t stride = (size_t)wd->cw;
+    for (int32_t cy=0;cy<wd->ch;cy++) {
+        int32_t y0 = cy << CHUNK_SHIFT;
+        int32_t ny = (wd->h - y0 < CHUNK_SIZE) ? wd->h - y0 : CHUNK_SIZE;
+        for (int32_t cx=0;cx<wd->cw;cx++) {
+            const uint64_t *src = rows + (size_t)y0 * stride + (size_t)cx;
+            uint32_t count = 0;
+            for (int32_t r=0;r<ny;r++) count += (uint32_t)__builtin_popcountll(src[(size_t)r * stride]);
+            if (count == 0) continue;
+            Chunk *c = world_chunk_create(wd, cx, cy);
+            if (!c) return false;
+            memset(c->walls, 0, sizeof(c->walls));
+            for (int32_t r=0;r<ny;r++) {
+                uint64_t v = src[(size_t)r * stride];
+                for (int b=0;b<8;b++) c->walls[r * 8 + b] = (uint8_t)(v >> (8 * b));
+            }
+            c->wall_count = count;
+        }
+    }
+    return true;
+}
+
+void world_copy_walls(const World *wd, uint8_t *dense) {
+    memset(dense, 0, (size_t)wd->w * (size_t)wd->h);
+    size_t cur = 0;
+    for (Chunk *c = world_next_chunk(wd, &cur); c; c = world_next_chunk(wd, &cur)) {
+        if (c->wall_count == 0) continue;
+        int32_t bx = c->cx << CHUNK_SHIFT, by = c->cy << CHUNK_SHIFT;
+        for (int b=0;b<CHUNK_CELLS;b++) {
+            if (!((c->walls[b >> 3] >> (b & 7)) & 1)) continue;
+            int32_t x = bx + (b & CHUNK_MASK), y = by + (b >> CHUNK_SHIFT);
+            if (x < wd->w && y < wd->h) dense[(size_t)y * (size_t)wd->w + (size_t)x] = 1;
+        }
+    }
+}
+
+uint64_t *world_chunk_layer(World *wd, int32_t cx, int32_t cy, int layer, uint32_t gen) {
+    Chunk *c = world_chunk_create(wd, cx, cy);
+    if (!c) return NULL;
+    uint64_t *l = __atomic_load_n(&c->layer[layer], __ATOMIC_ACQUIRE);
+    if (!l) {
+        uint64_t *fresh = (uint64_t*)layer_alloc(wd);
+        if (!fresh) return NULL;
+        uint64_t *expected = NULL;
+        if (__atomic_compare_exchange_n(&c->layer[layer], &expected, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_fetch_add(&wd->layer_count, 1, __ATOMIC_RELAXED);
+            l = fresh;
+        } else {
+            layer_release(wd, fresh);
+            l = expected;
+        }
+    }
+    if (__atomic_load_n(&c->layer_gen, __ATOMIC_RELAXED) != gen) __atomic_store_n(&c->layer_gen, gen, __ATOMIC_RELAXED);
+    return l;
+}
+
+uint64_t *world_layer(World *wd, int32_t x, int32_t y, int layer, uint32_t gen) {
+    uint64_t *l = world_chunk_layer(wd, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT, layer, gen);
+    return l ? &l[world_cell_index(x, y)] : NULL;
+}
+
+uint64_t world_layer_peek(const World *wd, int32_t x, int32_t y, int layer) {
+    const Chunk *c = world_chunk(wd, x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    if (!c) return 0;
+    const uint64_t *l = __atomic_load_n(&c->layer[layer], __ATOMIC_ACQUIRE);
+    return l ? __atomic_load_n(&l[world_cell_index(x, y)], __ATOMIC_RELAXED) : 0;
+}
+
+void world_clear_layers(World *wd) {
+    size_t cur = 0;
+    for (Chunk *c = world_next_chunk(wd, &cur); c; c = world_next_chunk(wd, &cur)) {
+        for (int l=0;l<WORLD_LAYERS;l++) if (c->layer[l]) memset(c->layer[l], 0, CHUNK_CELLS * sizeof(uint64_t));
+    }
+}
+
+bool world_reserve(World *wd, uint32_t chunks, uint32_t layers) {
+    if (wd->chunk_pool.arena.base || wd->layer_pool.arena.base) return true;
+    if (!block_pool_init(&wd->chunk_pool, sizeof(Chunk), chunks)) return false;
+    if (!block_pool_init(&wd->layer_pool, CHUNK_CELLS * sizeof(uint64_t), layers)) {
+        block_pool_free(&wd->chunk_pool);
+        return false;
+    }
+    return true;
+}
+
+/* Drops entity layers nobody has stamped for max_age generations, and then
+ * any chunk left with neither walls nor layers. Single-threaded only. */
+void world_sweep_layers(World *wd, uint32_t gen, uint32_t max_age) {
+    size_t nreg = (size_t)wd->rw * (size_t)wd->rh;
+    for (size_t r=0;r<nreg;r++) {
+        Chunk **t = wd->regions[r];
+        if (!t) continue;
+        for (int i=0;i<REGION_CHUNKS;i++) {
+            Chunk *c = t[i];
+            if (!c) continue;
+            bool has_layer = false;
+            for (int l=0;l<WORLD_LAYERS;l++) if (c->layer[l]) has_layer = true;
+            if (has_layer && gen - c->layer_gen > max_age) {
+                for (int l=0;l<WORLD_LAYERS;l++) {
+                    if (!c->layer[l]) continue;
+                    layer_release(wd, c->layer[l]);
+                    c->layer[l] = NULL;
+                    wd->layer_count--;
+                }
+                has_layer = false;
+            }
+            if (!has_layer && c->wall_count == 0) {
+                chunk_release(wd, c);
+                t[i] = NULL;
+                wd->chunk_count--;
+            }
+        }
+    }
+}
+
+size_t world_memory(const World *wd) {
+    size_t nreg = (size_t)wd->rw * (size_t)wd->rh;
+    size_t bytes = nreg * sizeof(Chunk**);
+    bytes += wd->table_count * REGION_CHUNKS * sizeof(Chunk*);
+    bytes += wd->chunk_count * sizeof(Chunk);
+    bytes += wd->layer_count * CHUNK_CELLS * sizeof(uint64_t);
+    return bytes;
+}
+
+size_t world_encoded_size(const World *wd, uint32_t *num_chunks) {
+    size_t bytes = 0;
+    uint32_t n = 0;
+    size_t cur = 0;
+    for (Chunk *c = world_next_chunk(wd, &cur); c; c = world_next_chunk(wd, &cur)) {
+        if (c->wall_count == 0) continue;
+        bytes += WORLD_CHUNK_HDR;
+        if (c->wall_count != CHUNK_CELLS) bytes += CHUNK_BITMAP_BYTES;
+        n++;
+    }
+    if (num_chunks) *num_chunks = n;
+    return bytes;
+}
+
+size_t world_encode(const World *wd, uint8_t *buf, size_t cap) {
+    size_t off = 0;
+    size_t cur = 0;
+    for (Chunk *c = world_next_chunk(wd, &cur); c; c = world_next_chunk(wd, &cur)) {
+        if (c->wall_count == 0) continue;
+        bool solid = (c->wall_count == CHUNK_CELLS);
+        size_t need = WORLD_CHUNK_HDR + (solid ? 0 : CHUNK_BITMAP_BYTES);
+        if (cap - off < need) return 0;
+        uint32_t cx = htonl((uint32_t)c->cx), cy = htonl((uint32_t)c->cy);
+        memcpy(buf + off, &cx, 4);
+        memcpy(buf + off + 4, &cy, 4);
+        buf[off + 8] = solid ? 1 : 0;
+        off += WORLD_CHUNK_HDR;
+        if (!solid) {
+            memcpy(buf + off, c->walls, CHUNK_BITMAP_BYTES);
+            off += CHUNK_BITMAP_BYTES;
+        }
+    }
+    return off;
+}
+
+bool world_decode(World *wd, const uint8_t *buf, size_t len, uint32_t num_chunks) {
+    size_t off = 0;
+    for (uint32_t i=0;i<num_chunks;i++) {
+        if (len - off < WORLD_CHUNK_HDR) return false;
+        uint32_t cx, cy;
+        memcpy(&cx, buf + off, 4);
+        memcpy(&cy, buf + off + 4, 4);
+        cx = ntohl(cx);
+        cy = ntohl(cy);
+        bool solid = buf[off + 8] != 0;
+        off += WORLD_CHUNK_HDR;
+        if (cx >= (uint32_t)wd->cw || cy >= (uint32_t)wd->ch) return false;
+
+        Chunk *c = world_chunk_create(wd, (int32_t)cx, (int32_t)cy);
+        if (!c) return false;
+        if (solid) {
+            memset(c->walls, 0xFF, CHUNK_BITMAP_BYTES);
+            c->wall_count = CHUNK_CELLS;
+            continue;
+        }
+        if (len - off < CHUNK_BITMAP_BYTES) return false;
+        memcpy(c->walls, buf + off, CHUNK_BITMAP_BYTES);
+        off += CHUNK_BITMAP_BYTES;
+        c->wall_count = 0;
+        for (int b=0;b<CHUNK_BITMAP_BYTES;b++) c->wall_count += (uint32_t)__builtin_popcount(c->walls[b]);
+    }
+    return off == len;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "arena.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sparse board storage. The board is cut into CHUNK_SIZE x CHUNK_SIZE
+ * chunks that exist only where there is a wall or an entity layer; a
+ * missing chunk is open floor. Chunks hang off a two-level directory of
+ * REGION_SIZE x REGION_SIZE chunk tables, so even the directory grows with
+ * content rather than with area. */
+
+#define CHUNK_SHIFT 6
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+#define CHUNK_CELLS (CHUNK_SIZE * CHUNK_SIZE)
+#define CHUNK_BITMAP_BYTES (CHUNK_CELLS / 8)
+
+#define REGION_SHIFT 5
+#define REGION_SIZE (1 << REGION_SHIFT)
+#define REGION_CHUNKS (REGION_SIZE * REGION_SIZE)
+
+#define WORLD_MAX_DIM 1000000
+#define WORLD_LAYERS 2
+
+typedef struct {
+    int32_t cx, cy;
+    uint32_t wall_count;                    /* CHUNK_CELLS means solid */
+    uint8_t walls[CHUNK_BITMAP_BYTES];      /* bit (x + y*CHUNK_SIZE), LSB first */
+    uint64_t *layer[WORLD_LAYERS];          /* CHUNK_CELLS entries each, on demand */
+    uint32_t layer_gen;                     /* last generation that touched a layer */
+} Chunk;
+
+typedef struct {
+    int32_t w, h;
+    uint32_t id;                            /* unique per world_init, for caches of its walls */
+    int32_t cw, ch;                         /* chunks across and down */
+    int32_t rw, rh;                         /* regions across and down */
+    Chunk ***regions;
+    size_t table_count;
+    size_t chunk_count;
+    size_t layer_count;
+    /* Optional pools for the chunks and layers entities come and go in;
+     * anything past what was reserved falls back to the heap. */
+    BlockPool chunk_pool;
+    BlockPool layer_pool;
+} World;
+
+static inline int world_cell_index(int32_t x, int32_t y) {
+    return ((y & CHUNK_MASK) << CHUNK_SHIFT) | (x & CHUNK_MASK);
+}
+
+bool world_init(World *wd, int32_t w, int32_t h);
+void world_free(World *wd);
+
+Chunk *world_chunk(const World *wd, int32_t cx, int32_t cy);
+Chunk *world_chunk_create(World *wd, int32_t cx, int32_t cy);
+Chunk *world_next_chunk(const World *wd, size_t *cursor);
+
+bool world_is_wall(const World *wd, int32_t x, int32_t y);
+void world_set_wall(World *wd, int32_t x, int32_t y, bool wall);
+void world_fill(World *wd, int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+bool world_chunk_full(const World *wd, int32_t x, int32_t y);
+
+/* Walls from a dense bit grid: one row per y of cw words, bit x & 63 of
+ * word x >> 6, LSB first, which is exactly one chunk row per word. Only
+ * chunks with a wall in them are created. */
+bool world_load_bits(World *wd, const uint64_t *rows);
+
+/* Dense wall copy for boards small enough to hold one byte per cell. */
+void world_copy_walls(const World *wd, uint8_t *dense);
+
+/* Entity layers are generation-stamped uint64 cells; creation is safe to
+ * race from several threads. */
+uint64_t *world_chunk_layer(World *wd, int32_t cx, int32_t cy, int layer, uint32_t gen);
+uint64_t *world_layer(World *wd, int32_t x, int32_t y, int layer, uint32_t gen);
+uint64_t world_layer_peek(const World *wd, int32_t x, int32_t y, int layer);
+void world_clear_layers(World *wd);
+/* Reserves room for this many chunks and entity layers up front, so the
+ * tick recycles them instead of going to the heap. */
+bool world_reserve(World *wd, uint32_t chunks, uint32_t layers);
+void world_sweep_layers(World *wd, uint32_t gen, uint32_t max_age);
+
+size_t world_memory(const World *wd);
+
+/* Wire form of the walls: a list of chunk records, each { uint32 cx, uint32
+ * cy, uint8 solid } in network order, followed by the bitmap unless solid. */
+#define WORLD_CHUNK_HDR 9
+size_t world_encoded_size(const World *wd, uint32_t *num_chunks);
+size_t world_encode(const World *wd, uint8_t *buf, size_t cap);
+bool world_decode(World *wd, const uint8_t *buf, size_t len, uint32_t num_chunks);
@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/* Each game's episodes get seeds of their own, whatever order the
+ * workers reach them in. */
+static uint64_t episode_seed(const Batch *b, int i) {
+    return splitmix64(b->spec.seed ^ splitmix64((uint64_t)i << 32 | b->episode[i]));
+}
+
+static bool start_episode(Batch *b, int i) {
+    const BatchSpec *s = &b->spec;
+    Game *g = &b->games[i];
+    uint64_t seed = episode_seed(b, i);
+    if (s->walls) {
+        MapGenSpec gen = s->gen;
+        gen.seed = seed | 1;
+        if (!gen_map_seeded(g, s->w, s->h, &gen)) return false;
+        uint8_t *wl = b->walls + (size_t)i * (size_t)s->w * (size_t)s->h;
+        for (int y=0;y<s->h;y++) for (int x=0;x<s->w;x++) {
+            wl[(size_t)y * (size_t)s->w + (size_t)x] = world_is_wall(&g->map, x, y) ? BATCH_CELL_WALL : BATCH_CELL_EMPTY;
+        }
+    }
+    g->rng = splitmix64(seed) | 1;
+    g->tick = 0;
+    g->num_fruits = 0;
+    for (int k=0;k<s->snakes;k++) g->players[k].alive = false;
+    for (int k=0;k<s->snakes;k++) {
+        init_player(&g->players[k], find_free_cell(g), 0);
+        g->players[k].connected = false;
+    }
+    ensure_fruits_count(g);
+    return true;
+}
+
+static void observe(Batch *b, int i, const uint16_t *prev_score, const bool *prev_alive) {
+    const BatchSpec *s = &b->spec;
+    Game *g = &b->games[i];
+    int16_t *o = b->snake_obs + (size_t)i * (size_t)s->snakes * BATCH_SNAKE_FIELDS;
+    for (int k=0;k<s->snakes;k++, o+=BATCH_SNAKE_FIELDS) {
+        const Player *p = &g->players[k];
+        o[BATCH_ALIVE] = p->alive;
+        o[BATCH_HEAD_X] = (int16_t)p->body[0].x;
+        o[BATCH_HEAD_Y] = (int16_t)p->body[0].y;
+        o[BATCH_DIR] = p->dir;
+        o[BATCH_LEN] = (int16_t)p->len;
+        o[BATCH_SCORE] = (int16_t)p->score;
+        o[BATCH_ATE] = prev_score && p->score != prev_score[k];
+        o[BATCH_DIED] = prev_alive && prev_alive[k] && !p->alive;
+    }
+    int16_t *fo = b->fruit_obs + (size_t)i * MAX_FRUITS * 2;
+    for (int f=0;f<MAX_FRUITS;f++) {
+        bool there = f < g->num_fruits;
+        fo[2 * f] = there ? (int16_t)g->fruits[f].pos.x : -1;
+        fo[2 * f + 1] = there ? (int16_t)g->fruits[f].pos.y : -1;
+    }
+    b->tick[i] = g->tick;
+    if (!b->grid) return;
+
+    size_t cells = (size_t)s->w * (size_t)s->h;
+    uint8_t *gr = b->grid + (size_t)i * cells;
+    if (s->walls) memcpy(gr, b->walls + (size_t)i * cells, cells);
+    else memset(gr, BATCH_CELL_EMPTY, cells);
+    for (int f=0;f<g->num_fruits;f++) {
+        Cell c = g->fruits[f].pos;
+        if (in_bounds(g, c.x, c.y)) gr[(size_t)c.y * (size_t)s->w + (size_t)c.x] = BATCH_CELL_FRUIT;
+    }
+    for (int k=0;k<s->snakes;k++) {
+        const Player *p = &g->players[k];
+        if (!p->alive) continue;
+        for (int j=0;j<(int)p->len;j++) {
+            Cell c = p->body[j];
+            if (in_bounds(g, c.x, c.y)) gr[(size_t)c.y * (size_t)s->w + (size_t)c.x] = (uint8_t)(BATCH_CELL_BODY + k);
+        }
+    }
+}
+
+static void step_games(void *ctx, int begin, int end) {
+    Batch *b = (Batch*)ctx;
+    const BatchSpec *s = &b->spec;
+    uint16_t prev_score[MAX_PLAYERS];
+    bool prev_alive[MAX_PLAYERS];
+    uint64_t ticks = 0, episodes = 0, episode_ticks = 0, failed = 0;
+    for (int i=begin;i<end;i++) {
+        Game *g = &b->games[i];
+        if (b->done[i]) {
+            b->episode[i]++;
+            if (!start_episode(b, i)) {
+                /* Half built: leave it done, untouched, for the next step. */
+                b->done[i] = BATCH_DONE_FAILED;
+                failed++;
+                continue;
+            }
+            b->done[i] = 0;
+            observe(b, i, NULL, NULL);
+            continue;
+        }
+        const uint8_t *act = b->actions + (size_t)i * (size_t)s->snakes;
+        for (int k=0;k<s->snakes;k++) {
+            Player *p = &g->players[k];
+            prev_score[k] = p->score;
+            prev_alive[k] = p->alive;
+            if (act[k] <= 3 && p->alive) p->pending_dir = act[k];
+        }
+        tick_game(g, g->tick_ms);
+        ticks++;
+        if (count_active_alive(g) == 0 || (s->max_ticks > 0 && g->tick >= s->max_ticks)) {
+            b->done[i] = 1;
+            episodes++;
+            episode_ticks += g->tick;
+        }
+        observe(b, i, prev_score, prev_alive);
+    }
+    __atomic_fetch_add(&b->ticks, ticks, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&b->episodes, episodes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&b->episode_ticks, episode_ticks, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&b->failed, failed, __ATOMIC_RELAXED);
+}
+
+static void *alloc_array(size_t n, size_t size) {
+    return (n > 0) ? calloc(n, size) : NULL;
+}
+
+bool batch_init(Batch *b, const BatchSpec *spec) {
+    memset(b, 0, sizeof(*b));
+    b->spec = *spec;
+    BatchSpec *s = &b->spec;
+    /* Heads and fruit travel as int16, and snakes fill the board at 3
+     * cells each when they spawn. */
+    if (s->games < 1 || s->snakes < 1 || s->snakes > MAX_PLAYERS || s->w < 8 || s->h < 8 ||
+        s->w > INT16_MAX || s->h > INT16_MAX || (int64_t)s->snakes * 3 * 4 > (int64_t)s->w * s->h) {
+        return false;
+    }
+    if (s->threads <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        s->threads = (ncpu > 0) ? (int)ncpu : 1;
+    }
+
+    size_t n = (size_t)s->games;
+    size_t cells = (size_t)s->w * (size_t)s->h;
+    b->games = (Game*)alloc_array(n, sizeof(Game));
+    b->episode = (uint32_t*)alloc_array(n, sizeof(uint32_t));
+    b->snake_obs = (int16_t*)alloc_array(n * (size_t)s->snakes * BATCH_SNAKE_FIELDS, sizeof(int16_t));
+    b->fruit_obs = (int16_t*)alloc_array(n * MAX_FRUITS * 2, sizeof(int16_t));
+    b->tick = (uint32_t*)alloc_array(n, sizeof(uint32_t));
+    b->done = (uint8_t*)alloc_array(n, sizeof(uint8_t));
+    if (s->walls) b->walls = (uint8_t*)alloc_array(n * cells, 1);
+    if (s->grid) b->grid = (uint8_t*)alloc_array(n * cells, 1);
+    if (!b->games || !b->episode || !b->snake_obs || !b->fruit_obs || !b->tick || !b->done ||
+        (s->walls && !b->walls) || (s->grid && !b->grid)) {
+        batch_free(b);
+        return false;
+    }
+
+    for (int i=0;i<s->games;i++) {
+        Game *g = &b->games[i];
+        if (!game_init(g, s->snakes)) {
+            batch_free(b);
+            return false;
+        }
+        g->world = s->walls ? 1 : 0;
+        g->tick_ms = 120;
+        if (!s->walls) gen_map(g, s->w, s->h, 0);
+        if (!start_episode(b, i)) {
+            batch_free(b);
+            return false;
+        }
+        observe(b, i, NULL, NULL);
+    }
+    b->pool = (s->threads > 1) ? pool_create(s->threads) : NULL;
+    return true;
+}
+
+void batch_free(Batch *b) {
+    if (b->games) {
+        for (int i=0;i<b->spec.games;i++) game_free(&b->games[i]);
+    }
+    pool_destroy(b->pool);
+    free(b->games);
+    free(b->episode);
+    free(b->walls);
+    free(b->snake_obs);
+    free(b->fruit_obs);
+    free(b->tick);
+    free(b->done);
+    free(b->grid);
+    memset(b, 0, sizeof(*b));
+}
+
+bool batch_step(Batch *b, const uint8_t *actions) {
+    uint64_t failed = b->failed;
+    b->actions = actions;
+    pool_run(b->pool, step_games, b, b->spec.games);
+    b->actions = NULL;
+    return b->failed == failed;
+}
@@ -0,0 +1,95 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "game.h"
+#include "mapgen.h"
+#include "pool.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Many independent games stepped in lockstep as fast as they go, for bot
+ * training and balance sweeps. Every game is a Game of its own run by
+ * tick_game, so the rules are the server's; there is no clock, no
+ * network and no respawn. The games are split across a worker pool, one
+ * game per worker at a time.
+ *
+ * Actions go in and observations come out as flat arrays indexed by
+ * game, then snake. A game is done once no snake is alive or max_ticks
+ * have run; its observations then show the end, and the next step starts
+ * it over with a fresh seed instead of ticking it. Everything follows
+ * from seed, so a batch replays the same whatever the thread count. */
+
+/* Per snake, BATCH_SNAKE_FIELDS values in snake_obs. */
+enum {
+    BATCH_ALIVE = 0,
+    BATCH_HEAD_X,
+    BATCH_HEAD_Y,
+    BATCH_DIR,
+    BATCH_LEN,
+    BATCH_SCORE,
+    BATCH_ATE,                /* ate on the last tick */
+    BATCH_DIED,               /* died on the last tick */
+    BATCH_SNAKE_FIELDS
+};
+
+/* grid cells: anything >= BATCH_CELL_BODY is snake (cell - BATCH_CELL_BODY). */
+enum {
+    BATCH_CELL_EMPTY = 0,
+    BATCH_CELL_WALL,
+    BATCH_CELL_FRUIT,
+    BATCH_CELL_BODY
+};
+
+/* done: a game whose next episode could not be set up stays done with
+ * this instead of 1, its observations those of the last end. */
+#define BATCH_DONE_FAILED 2
+
+/* Actions: a direction, or this to keep the heading. */
+#define BATCH_KEEP 255
+
+typedef struct {
+    int games;
+    int snakes;               /* per game */
+    int w, h;
+    bool walls;               /* a mapgen board per episode; else open and wrapping */
+    MapGenSpec gen;           /* style and density when walls; the seed is ignored */
+    uint32_t max_ticks;       /* 0 = until every snake is dead */
+    uint64_t seed;
+    int threads;              /* 0 = one per CPU */
+    bool grid;                /* fill grid every step */
+} BatchSpec;
+
+typedef struct {
+    BatchSpec spec;
+    Game *games;
+    uint32_t *episode;        /* per game, episodes started */
+    uint8_t *walls;           /* per game w * h, the board when walls */
+    WorkerPool *pool;
+    const uint8_t *actions;   /* for the step in progress */
+
+    /* Observations, rewritten by every step. */
+    int16_t *snake_obs;       /* games * snakes * BATCH_SNAKE_FIELDS */
+    int16_t *fruit_obs;       /* games * MAX_FRUITS * 2, x y or -1 -1 */
+    uint32_t *tick;           /* per game, ticks into the episode */
+    uint8_t *done;            /* per game */
+    uint8_t *grid;            /* games * w * h BATCH_CELL_*, NULL unless grid */
+
+    uint64_t ticks;           /* game ticks simulated */
+    uint64_t episodes;        /* episodes finished */
+    uint64_t episode_ticks;   /* their total length */
+    uint64_t failed;          /* episodes that could not be started */
+} Batch;
+
+/* Sets up every game at the start of its first episode. False when the
+ * spec is out of range or memory runs out. */
+bool batch_init(Batch *b, const BatchSpec *spec);
+void batch_free(Batch *b);
+
+/* One tick of every game, or a fresh start for the ones done. actions
+ * holds games * snakes directions or BATCH_KEEP; a dead snake's is
+ * ignored. False when a done game could not start over; it is marked
+ * BATCH_DONE_FAILED and tried again by the next step. */
+bool batch_step(Batch *b, const uint8_t *actions);
+
+#endif
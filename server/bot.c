@@ -0,0 +1,409 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "bot.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+bool bot_planner_init(BotPlanner *bp, int w, int h, int max_players, uint32_t budget_us) {
+    memset(bp, 0, sizeof(*bp));
+    size_t cells = (size_t)w * (size_t)h;
+    if (cells > BOT_MAX_CELLS) return false;
+    bp->w = w;
+    bp->h = h;
+    bp->max_players = max_players;
+    bp->budget_us = budget_us;
+    bp->job_field = -1;
+    bp->blocked = (uint8_t*)malloc(cells);
+    bp->next = (uint16_t*)malloc(cells * sizeof(uint16_t));
+    bp->queue = (uint32_t*)malloc(cells * sizeof(uint32_t));
+    bp->marked = (uint32_t*)malloc((size_t)max_players * MAX_BODY * sizeof(uint32_t));
+    bp->head_dist = (uint16_t (*)[MAX_FRUITS])malloc((size_t)max_players * sizeof(*bp->head_dist));
+    bool ok = bp->blocked && bp->next && bp->queue && bp->marked && bp->head_dist;
+    for (int f=0;f<MAX_FRUITS && ok;f++) {
+        bp->dist[f] = (uint16_t*)malloc(cells * sizeof(uint16_t));
+        if (!bp->dist[f]) ok = false;
+    }
+    if (!ok) bot_planner_free(bp);
+    return ok;
+}
+
+void bot_planner_free(BotPlanner *bp) {
+    free(bp->blocked);
+    free(bp->next);
+    free(bp->queue);
+    free(bp->marked);
+    free(bp->head_dist);
+    for (int f=0;f<MAX_FRUITS;f++) free(bp->dist[f]);
+    memset(bp, 0, sizeof(*bp));
+    bp->job_field = -1;
+}
+
+/* Adds up to n bot players in free slots; returns how many were added. */
+int bot_spawn(Game *g, int n) {
+    int added = 0;
+    for (int k=0;k<n;k++) {
+        int slot = alloc_slot(g);
+        if (slot < 0) break;
+        char name[SNAKE_NAME_MAX];
+        (void)snprintf(name, sizeof(name), "bot%d", slot);
+        init_player(&g->players[slot], find_free_cell(g), 0);
+        init_player_meta(&g->meta[slot], name);
+        g->players[slot].bot = true;
+        added++;
+    }
+    ensure_fruits_count(g);
+    return added;
+}
+
+int bot_despawn(Game *g) {
+    int removed = 0;
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        if (!p->used || !p->bot) continue;
+        p->used = false;
+        p->active = false;
+        p->alive = false;
+        p->bot = false;
+        g->meta[i].name[0] = '\0';
+        clear_fruit_visits_for_slot(g, i);
+        removed++;
+    }
+    return removed;
+}
+
+/* Neighbour of cell i in direction dir, or -1 when it leaves a walled board. */
+static int step_cell(const Game *g, int i, uint8_t dir) {
+    int x = i % g->w;
+    int y = i / g->w;
+    int dx, dy;
+    dir_delta(dir, &dx, &dy);
+    x += dx;
+    y += dy;
+    if (g->world == 0) {
+        if (x < 0) x = g->w - 1;
+        if (x >= g->w) x = 0;
+        if (y < 0) y = g->h - 1;
+        if (y >= g->h) y = 0;
+    } else if (x < 0 || x >= g->w || y < 0 || y >= g->h) {
+        return -1;
+    }
+    return y * g->w + x;
+}
+
+static void build_blocked(BotPlanner *bp, Game *g) {
+    if (bp->walls_id == 0 || bp->walls_id != g->map.id) {
+        if (g->world == 0) memset(bp->blocked, 0, (size_t)g->w * (size_t)g->h);
+        else world_copy_walls(&g->map, bp->blocked);
+        bp->walls_id = g->map.id;
+        bp->num_marked = 0;
+    }
+    for (uint32_t i=0;i<bp->num_marked;i++) bp->blocked[bp->marked[i]] = 0;
+    bp->num_marked = 0;
+
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        if (!p->used || !p->active || !p->alive) continue;
+        for (int k=0;k<(int)p->len;k++) {
+            if (!in_bounds(g, p->body[k].x, p->body[k].y)) continue;
+            uint32_t c = (uint32_t)(p->body[k].y * g->w + p->body[k].x);
+            if (bp->blocked[c] != 0) continue;
+            bp->blocked[c] = BOT_CELL_BODY;
+            bp->marked[bp->num_marked++] = c;
+        }
+    }
+
+    bp->heads = 0;
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        if (!p->used || !p->active || !p->alive) continue;
+        uint8_t *c = &bp->blocked[p->body[0].y * g->w + p->body[0].x];
+        if (*c != BOT_CELL_BODY) continue;
+        *c = BOT_CELL_HEAD;
+        bp->heads++;
+    }
+}
+
+static bool same_cell(Cell a, Cell b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+static bool budget_spent(const BotPlanner *bp, uint64_t t0) {
+    /* A fifth is kept back for choosing targets and steering. */
+    return now_us() - t0 >= bp->budget_us - bp->budget_us / 5;
+}
+
+static void start_field(BotPlanner *bp, int f, Cell src) {
+    bp->job_field = f;
+    bp->job_src = src;
+    bp->job_fill = 0;
+    bp->job_head = bp->job_tail = 0;
+    bp->job_seen = 0;
+    bp->job_stop = BOT_UNREACHED;
+}
+
+/* Carries the search in progress towards completion: breadth-first
+ * distances from job_src over free cells, into next. Returns false when the
+ * budget runs out first; the search then resumes from its queue on the next
+ * call. It stops one level after the last live head has been touched:
+ * nothing further out can change any snake's choice. */
+static bool bfs_resume(BotPlanner *bp, Game *g, uint64_t t0) {
+    const int w = g->w, h = g->h;
+    const bool wrap = (g->world == 0);
+    const size_t cells = (size_t)w * (size_t)h;
+    const uint8_t *blocked = bp->blocked;
+    uint16_t *dist = bp->next;
+    uint32_t *queue = bp->queue;
+
+    /* Resetting a large board's field is itself worth slicing. */
+    while (bp->job_fill < cells) {
+        size_t n = cells - bp->job_fill;
+        if (n > (size_t)BOT_BFS_SLICE * 64u) n = (size_t)BOT_BFS_SLICE * 64u;
+        for (size_t i=0;i<n;i++) dist[bp->job_fill + i] = BOT_UNREACHED;
+        bp->job_fill += n;
+        if (bp->job_fill == cells) {
+            int s = bp->job_src.y * w + bp->job_src.x;
+            dist[s] = 0;
+            queue[bp->job_tail++] = (uint32_t)s;
+        }
+        if (budget_spent(bp, t0)) return false;
+    }
+
+    uint32_t head = bp->job_head, tail = bp->job_tail;
+    uint32_t seen = bp->job_seen, stop = bp->job_stop;
+    uint32_t slice = 0;
+    bool done = true;
+    while (head < tail) {
+        if (++slice == BOT_BFS_SLICE) {
+            slice = 0;
+            if (budget_spent(bp, t0)) {
+                done = false;
+                break;
+            }
+        }
+        int c = (int)queue[head++];
+        uint16_t d = dist[c];
+        if (d > stop || d + 1u >= BOT_UNREACHED) break;
+        uint16_t nd = (uint16_t)(d + 1);
+        int y = c / w;
+        int x = c - y * w;
+
+        int nb[4];
+        nb[0] = (y > 0) ? c - w : (wrap ? c + (h - 1) * w : -1);
+        nb[1] = (x < w - 1) ? c + 1 : (wrap ? c - (w - 1) : -1);
+        nb[2] = (y < h - 1) ? c + w : (wrap ? c - (h - 1) * w : -1);
+        nb[3] = (x > 0) ? c - 1 : (wrap ? c + (w - 1) : -1);
+        for (int k=0;k<4;k++) {
+            int n = nb[k];
+            if (n < 0 || dist[n] != BOT_UNREACHED) continue;
+            if (!blocked[n]) {
+                dist[n] = nd;
+                queue[tail++] = (uint32_t)n;
+            } else {
+                dist[n] = BOT_BLOCKED;
+                if (blocked[n] == BOT_CELL_HEAD && ++seen == bp->heads) stop = (uint32_t)d + 1u;
+            }
+        }
+    }
+    bp->job_head = head;
+    bp->job_tail = tail;
+    bp->job_seen = seen;
+    bp->job_stop = stop;
+    return done;
+}
+
+/* The field to refresh next: one that is missing or whose fruit has moved,
+ * else the next in rotation. */
+static int next_field(const BotPlanner *bp, const Game *g) {
+    int nf = (int)g->num_fruits;
+    for (int k=0;k<nf;k++) {
+        int f = (bp->cursor + k) % nf;
+        if (!bp->field_valid[f] || !same_cell(bp->field_src[f], g->fruits[f].pos)) return f;
+    }
+    return bp->cursor % nf;
+}
+
+/* Best distance a snake whose head is at cell h can reach fruit f with. */
+static uint16_t head_dist(const BotPlanner *bp, const Game *g, int f, int h) {
+    uint16_t best = BOT_UNREACHED;
+    for (uint8_t dir=0;dir<4;dir++) {
+        int n = step_cell(g, h, dir);
+        if (n >= 0 && bp->dist[f][n] < best) best = bp->dist[f][n];
+    }
+    return best;
+}
+
+static int free_neighbours(const BotPlanner *bp, const Game *g, int c) {
+    int n = 0;
+    for (uint8_t dir=0;dir<4;dir++) {
+        int m = step_cell(g, c, dir);
+        if (m >= 0 && !bp->blocked[m]) n++;
+    }
+    return n;
+}
+
+static bool next_to_other_head(const Game *g, int slot, int c) {
+    int x = c % g->w;
+    int y = c / g->w;
+    for (int i=0;i<g->max_players;i++) {
+        const Player *p = &g->players[i];
+        if (i == slot || !p->used || !p->active || !p->alive) continue;
+        int dx = abs(p->body[0].x - x);
+        int dy = abs(p->body[0].y - y);
+        if (g->world == 0) {
+            if (dx > g->w / 2) dx = g->w - dx;
+            if (dy > g->h / 2) dy = g->h - dy;
+        }
+        if (dx + dy == 1) return true;
+    }
+    return false;
+}
+
+static int pick_target(const BotPlanner *bp, const Game *g, int slot) {
+    uint16_t (*hd)[MAX_FRUITS] = bp->head_dist;
+    int best = -1, fallback = -1;
+    for (int f=0;f<(int)g->num_fruits;f++) {
+        if (!bp->field_valid[f] || hd[slot][f] == BOT_UNREACHED) continue;
+        if (fallback < 0 || hd[slot][f] < hd[slot][fallback]) fallback = f;
+
+        bool beaten = false;
+        for (int i=0;i<g->max_players && !beaten;i++) {
+            const Player *p = &g->players[i];
+            if (i == slot || !p->used || !p->active || !p->alive) continue;
+            if (hd[i][f] < hd[slot][f]) beaten = true;
+        }
+        if (!beaten && (best < 0 || hd[slot][f] < hd[slot][best])) best = f;
+    }
+    return (best >= 0) ? best : fallback;
+}
+
+static void steer(const BotPlanner *bp, Game *g, int slot, int target) {
+    Player *p = &g->players[slot];
+    int h = p->body[0].y * g->w + p->body[0].x;
+
+    int best_dir = -1;
+    long best_score = 0;
+    for (uint8_t dir=0;dir<4;dir++) {
+        if (dir_is_opposite(p->dir, dir)) continue;
+        int n = step_cell(g, h, dir);
+        if (n < 0 || bp->blocked[n]) continue;
+
+        /* Lower is better: stay off cells a rival head can also take, then
+         * follow the distance field, then keep room to manoeuvre. */
+        long score = next_to_other_head(g, slot, n) ? 1L << 40 : 0;
+        uint16_t d = (target >= 0) ? bp->dist[target][n] : BOT_UNREACHED;
+        score += (long)d << 4;
+        score += 4 - free_neighbours(bp, g, n);
+        if (best_dir < 0 || score < best_score || (score == best_score && dir == p->dir)) {
+            best_dir = dir;
+            best_score = score;
+        }
+    }
+    if (best_dir >= 0) p->pending_dir = (uint8_t)best_dir;
+}
+
+static void respawn_dead_bots(Game *g) {
+    uint64_t now = now_ms();
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        if (!p->used || !p->bot || p->alive) continue;
+        if (now < p->spawn_ms + p->time_ms_final + BOT_RESPAWN_MS) continue;
+        init_player(p, find_free_cell(g), p->score);
+        p->bot = true;
+        clear_fruit_visits_for_slot(g, i);
+    }
+}
+
+bool bots_think(BotPlanner *bp, Game *g) {
+    int nbots = 0;
+    for (int i=0;i<g->max_players;i++) if (g->players[i].used && g->players[i].bot) nbots++;
+    if (nbots == 0) return true;
+
+    uint64_t t0 = now_us();
+    respawn_dead_bots(g);
+    ensure_fruits_count(g);
+
+    if (bp->w != g->w || bp->h != g->h || bp->max_players != g->max_players) {
+        uint32_t budget = bp->budget_us;
+        bot_planner_free(bp);
+        if (!bot_planner_init(bp, g->w, g->h, g->max_players, budget)) {
+            bp->budget_us = budget;
+            return false;
+        }
+    }
+
+    build_blocked(bp, g);
+
+    /* At most one refresh per fruit a tick, the search left over from the
+     * last tick first unless its fruit has gone. */
+    int nf = (int)g->num_fruits;
+    if (bp->job_field >= nf || (bp->job_field >= 0 && !same_cell(bp->job_src, g->fruits[bp->job_field].pos))) {
+        bp->job_field = -1;
+    }
+    for (int k=0;k<nf;k++) {
+        if (bp->job_field < 0) {
+            int f = next_field(bp, g);
+            start_field(bp, f, g->fruits[f].pos);
+        }
+        if (!bfs_resume(bp, g, t0)) break;
+        int f = bp->job_field;
+        uint16_t *t = bp->dist[f];
+        bp->dist[f] = bp->next;
+        bp->next = t;
+        bp->field_src[f] = bp->job_src;
+        bp->field_valid[f] = true;
+        bp->cursor = f + 1;
+        bp->job_field = -1;
+    }
+    for (int f=0;f<nf;f++) {
+        if (bp->field_valid[f] && !same_cell(bp->field_src[f], g->fruits[f].pos)) {
+            bp->field_valid[f] = false;
+            bp->stale_fields++;
+        }
+    }
+    for (int f=nf;f<MAX_FRUITS;f++) bp->field_valid[f] = false;
+
+    uint16_t (*hd)[MAX_FRUITS] = bp->head_dist;
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        for (int f=0;f<MAX_FRUITS;f++) hd[i][f] = BOT_UNREACHED;
+        if (!p->used || !p->active || !p->alive) continue;
+        int h = p->body[0].y * g->w + p->body[0].x;
+        for (int f=0;f<nf;f++) if (bp->field_valid[f]) hd[i][f] = head_dist(bp, g, f, h);
+    }
+
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        if (!p->used || !p->bot || !p->active || !p->alive || p->paused) continue;
+        steer(bp, g, i, pick_target(bp, g, i));
+    }
+
+    uint64_t dt = now_us() - t0;
+    bp->ticks++;
+    bp->total_us += dt;
+    if (dt > bp->max_us) bp->max_us = (uint32_t)dt;
+    if (dt > bp->budget_us) bp->over_budget++;
+    return true;
+}
+
+void bot_stats_report(BotPlanner *bp, FILE *out) {
+    if (bp->ticks == 0) return;
+    fprintf(out, "bots: %llu ticks, avg %llu us, max %u us, budget %u us, over %llu, stale fields %llu\n",
+            (unsigned long long)bp->ticks,
+            (unsigned long long)(bp->total_us / bp->ticks),
+            bp->max_us, bp->budget_us,
+            (unsigned long long)bp->over_budget,
+            (unsigned long long)bp->stale_fields);
+    bp->ticks = 0;
+    bp->total_us = 0;
+    bp->max_us = 0;
+    bp->over_budget = 0;
+    bp->stale_fields = 0;
+}
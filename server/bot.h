@@ -0,0 +1,76 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "game.h"
+
+#include <stdio.h>
+
+/* Distance-field sentinels; anything >= BOT_UNREACHED is not a distance. */
+#define BOT_UNREACHED 0xFFFDu
+#define BOT_BLOCKED   0xFFFFu
+/* blocked[] cell values; 0 is free. */
+#define BOT_CELL_WALL 1
+#define BOT_CELL_BODY 2
+#define BOT_CELL_HEAD 3
+#define BOT_RESPAWN_MS 3000
+/* Cells a search expands between looks at the clock. */
+#define BOT_BFS_SLICE 1024u
+
+/* The planner keeps dense per-cell grids, so bots are refused on boards
+ * larger than this rather than allocating gigabytes. */
+#define BOT_MAX_CELLS (16u * 1024u * 1024u)
+
+/* Shared pathfinding state for every bot in a game. Each tick it updates a
+ * blocked-cell grid and refreshes the BFS distance field of each fruit; all
+ * bots then read the same fields, so the cost is per fruit, not per bot.
+ * The walls are copied in once per board; a tick only clears the body cells
+ * it marked last time and marks the new ones.
+ *
+ * Refreshing stops when the tick's budget is spent. A search cut short is
+ * kept in next and carries on the following tick against that tick's
+ * blocked grid; only a completed search replaces a field. A field whose
+ * fruit has since moved is dropped rather than followed. */
+typedef struct {
+    int w, h;
+    int max_players;
+    uint8_t *blocked;       /* BOT_CELL_* */
+    uint32_t walls_id;      /* World.id the walls in blocked came from, 0 = none */
+    uint32_t *marked;       /* body cells set in blocked, max_players * MAX_BODY */
+    uint32_t num_marked;
+    uint32_t heads;
+    uint16_t *dist[MAX_FRUITS];
+    Cell field_src[MAX_FRUITS];
+    bool field_valid[MAX_FRUITS];
+    int cursor;             /* where the rotation over fields resumes */
+
+    /* The search in progress, if job_field >= 0. */
+    uint16_t *next;
+    uint32_t *queue;
+    int job_field;
+    Cell job_src;
+    size_t job_fill;        /* cells of next reset so far */
+    uint32_t job_head, job_tail;
+    uint32_t job_seen, job_stop;
+
+    uint16_t (*head_dist)[MAX_FRUITS];
+
+    uint32_t budget_us;
+    uint64_t ticks;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint64_t over_budget;
+    uint64_t stale_fields;  /* dropped because their fruit moved */
+} BotPlanner;
+
+bool bot_planner_init(BotPlanner *bp, int w, int h, int max_players, uint32_t budget_us);
+void bot_planner_free(BotPlanner *bp);
+
+int bot_spawn(Game *g, int n);
+/* Frees every bot's slot; returns how many there were. */
+int bot_despawn(Game *g);
+/* Returns false when the board changed to one the planner cannot be sized
+ * for; the bots then stand still until the caller removes them. */
+bool bots_think(BotPlanner *bp, Game *g);
+void bot_stats_report(BotPlanner *bp, FILE *out);
+
+#endif
@@ -0,0 +1,363 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "checkpoint.h"
+#include "../common/hash.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* File layout, all integers big-endian:
+ *   magic[8] "SNKCKPT\0", u32 version, u32 state_len, u32 config_len,
+ *   u8 checksum[8] (hash64 of state then config),
+ *   state_len bytes of state, config_len bytes of MSG_CONFIG payload.
+ * State: u32 tick_ms, u8 mode, u8 world, u16 time_limit_sec,
+ *   u16 path_len + map_path, u64 elapsed_ms, u16 global_freeze_ms,
+ *   u64 no_players_age_ms (0 = players present), u8 num_fruits x
+ *   { i32 x, i32 y, u32 visited_mask }, u8 num_players x
+ *   { u8 slot, u8 flags, name[SNAKE_NAME_MAX], u8 dir, u8 pending_dir,
+ *     u16 score, u32 age_ms, u32 time_ms_final, token if CKPT_TOKEN,
+ *     u16 len, len x { i32 x, i32 y } }. */
+
+#define CKPT_MAGIC "SNKCKPT"
+#define CKPT_VERSION 1
+#define CKPT_HDR_LEN (8 + 4 + 4 + 4 + 8)
+
+enum {
+    CKPT_ACTIVE = 0x01,
+    CKPT_ALIVE = 0x02,
+    CKPT_PAUSED = 0x04,
+    CKPT_BOT = 0x08,
+    CKPT_TOKEN = 0x10
+};
+
+void checkpoint_buf_free(CheckpointBuf *b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+static bool buf_reserve(CheckpointBuf *b, size_t n) {
+    if (b->len + n <= b->cap) return true;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + n) cap *= 2;
+    uint8_t *p = (uint8_t*)realloc(b->data, cap);
+    if (!p) return false;
+    b->data = p;
+    b->cap = cap;
+    return true;
+}
+
+static void put_bytes(CheckpointBuf *b, const void *src, size_t n) {
+    memcpy(b->data + b->len, src, n);
+    b->len += n;
+}
+
+static void put_u8(CheckpointBuf *b, uint8_t v) { b->data[b->len++] = v; }
+
+static void put_u16(CheckpointBuf *b, uint16_t v) {
+    put_u8(b, (uint8_t)(v >> 8));
+    put_u8(b, (uint8_t)v);
+}
+
+static void put_u32(CheckpointBuf *b, uint32_t v) {
+    put_u16(b, (uint16_t)(v >> 16));
+    put_u16(b, (uint16_t)v);
+}
+
+static void put_u64(CheckpointBuf *b, uint64_t v) {
+    put_u32(b, (uint32_t)(v >> 32));
+    put_u32(b, (uint32_t)v);
+}
+
+static uint32_t age32(uint64_t now, uint64_t then) {
+    uint64_t d = (now > then) ? (now - then) : 0;
+    return (d > 0xFFFFFFFFULL) ? 0xFFFFFFFFu : (uint32_t)d;
+}
+
+bool checkpoint_capture(const Game *g, const SessionTable *st, uint64_t now, CheckpointBuf *out) {
+    out->len = 0;
+    size_t path_len = strnlen(g->map_path, sizeof(g->map_path));
+    size_t worst = 64 + path_len + MAX_FRUITS * 12 +
+                   (size_t)g->max_players * (48 + SNAKE_NAME_MAX + RESUME_TOKEN_LEN + MAX_BODY * 8);
+    if (!buf_reserve(out, worst)) return false;
+
+    put_u32(out, g->tick_ms);
+    put_u8(out, g->mode);
+    put_u8(out, g->world);
+    put_u16(out, g->time_limit_sec);
+    put_u16(out, (uint16_t)path_len);
+    put_bytes(out, g->map_path, path_len);
+    put_u64(out, (now > g->start_ms) ? now - g->start_ms : 0);
+    put_u16(out, g->global_freeze_ms);
+    put_u64(out, g->last_no_players_ms ? (uint64_t)age32(now, g->last_no_players_ms) + 1 : 0);
+
+    put_u8(out, g->num_fruits);
+    for (int i=0;i<(int)g->num_fruits;i++) {
+        put_u32(out, (uint32_t)g->fruits[i].pos.x);
+        put_u32(out, (uint32_t)g->fruits[i].pos.y);
+        put_u32(out, g->fruits[i].visited_mask);
+    }
+
+    size_t count_at = out->len;
+    put_u8(out, 0);
+    uint8_t np = 0;
+    for (int i=0;i<g->max_players;i++) {
+        const Player *p = &g->players[i];
+        if (!p->used) continue;
+        uint8_t token[RESUME_TOKEN_LEN];
+        bool has_token = session_token(st, i, token);
+        uint8_t flags = (uint8_t)((p->active ? CKPT_ACTIVE : 0) | (p->alive ? CKPT_ALIVE : 0) |
+                                  (p->paused ? CKPT_PAUSED : 0) | (p->bot ? CKPT_BOT : 0) |
+                                  (has_token ? CKPT_TOKEN : 0));
+        put_u8(out, (uint8_t)i);
+        put_u8(out, flags);
+        put_bytes(out, g->meta[i].name, SNAKE_NAME_MAX);
+        put_u8(out, p->dir);
+        put_u8(out, p->pending_dir);
+        put_u16(out, p->score);
+        put_u32(out, age32(now, p->spawn_ms));
+        put_u32(out, p->time_ms_final);
+        if (has_token) put_bytes(out, token, RESUME_TOKEN_LEN);
+        put_u16(out, p->len);
+        for (int k=0;k<(int)p->len;k++) {
+            put_u32(out, (uint32_t)p->body[k].x);
+            put_u32(out, (uint32_t)p->body[k].y);
+        }
+        np++;
+    }
+    out->data[count_at] = np;
+    return true;
+}
+
+static bool write_all(int fd, const uint8_t *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w <= 0) return false;
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+bool checkpoint_write(const char *path, const CheckpointBuf *state,
+                      const uint8_t *config, uint32_t config_len) {
+    uint64_t h = hash64_update(hash64(state->data, state->len), config, config_len);
+
+    CheckpointBuf hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    if (!buf_reserve(&hdr, CKPT_HDR_LEN)) return false;
+    put_bytes(&hdr, CKPT_MAGIC, 8);
+    put_u32(&hdr, CKPT_VERSION);
+    put_u32(&hdr, (uint32_t)state->len);
+    put_u32(&hdr, config_len);
+    hash64_bytes(h, hdr.data + hdr.len);
+    hdr.len += 8;
+
+    char tmp[512];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        checkpoint_buf_free(&hdr);
+        return false;
+    }
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        checkpoint_buf_free(&hdr);
+        return false;
+    }
+    bool ok = write_all(fd, hdr.data, hdr.len) &&
+              write_all(fd, state->data, state->len) &&
+              write_all(fd, config, config_len) &&
+              fsync(fd) == 0;
+    ok = (close(fd) == 0) && ok;
+    checkpoint_buf_free(&hdr);
+    if (ok) ok = rename(tmp, path) == 0;
+    if (!ok) (void)unlink(tmp);
+    return ok;
+}
+
+typedef struct {
+    const uint8_t *p;
+    size_t left;
+    bool ok;
+} Reader;
+
+static const uint8_t *get_bytes(Reader *r, size_t n) {
+    if (!r->ok || r->left < n) {
+        r->ok = false;
+        return NULL;
+    }
+    const uint8_t *p = r->p;
+    r->p += n;
+    r->left -= n;
+    return p;
+}
+
+static uint8_t get_u8(Reader *r) {
+    const uint8_t *p = get_bytes(r, 1);
+    return p ? p[0] : 0;
+}
+
+static uint16_t get_u16(Reader *r) {
+    const uint8_t *p = get_bytes(r, 2);
+    return p ? (uint16_t)((p[0] << 8) | p[1]) : 0;
+}
+
+static uint32_t get_u32(Reader *r) {
+    uint32_t hi = get_u16(r);
+    return (hi << 16) | get_u16(r);
+}
+
+static uint64_t get_u64(Reader *r) {
+    uint64_t hi = get_u32(r);
+    return (hi << 32) | get_u32(r);
+}
+
+static bool cell_ok(const Game *g, Cell c) {
+    return c.x >= 0 && c.y >= 0 && c.x < g->w && c.y < g->h;
+}
+
+static bool load_config(Game *g, const uint8_t *buf, uint32_t len) {
+    MsgConfig cfg;
+    if (!msg_config_decode(&cfg, buf, len)) return false;
+    uint32_t w = cfg.w;
+    uint32_t h = cfg.h;
+    if (WIRE_SIZE(msg_config) + cfg.map_len != len) return false;
+    if (w < 1 || h < 1 || w > WORLD_MAX_DIM || h > WORLD_MAX_DIM) return false;
+    if (!world_init(&g->map, (int32_t)w, (int32_t)h) ||
+        !world_decode(&g->map, buf + WIRE_SIZE(msg_config), cfg.map_len, cfg.num_chunks)) {
+        world_free(&g->map);
+        return false;
+    }
+    g->w = (int)w;
+    g->h = (int)h;
+    return true;
+}
+
+static bool load_state(Game *g, SessionTable *st, uint64_t now, Reader *r) {
+    g->tick_ms = get_u32(r);
+    g->mode = get_u8(r);
+    g->world = get_u8(r);
+    g->time_limit_sec = get_u16(r);
+    uint16_t path_len = get_u16(r);
+    const uint8_t *path = get_bytes(r, path_len);
+    if (!r->ok || path_len >= sizeof(g->map_path)) return false;
+    memcpy(g->map_path, path, path_len);
+    g->map_path[path_len] = 0;
+    uint64_t elapsed = get_u64(r);
+    g->start_ms = (now > elapsed) ? now - elapsed : 0;
+    g->global_freeze_ms = get_u16(r);
+    uint64_t no_players = get_u64(r);
+    g->last_no_players_ms = (no_players && now >= no_players) ? now - (no_players - 1) : 0;
+    if (g->tick_ms < 1 || g->mode > 1 || g->world > 1) return false;
+
+    g->num_fruits = get_u8(r);
+    if (g->num_fruits > MAX_FRUITS) return false;
+    for (int i=0;i<(int)g->num_fruits;i++) {
+        g->fruits[i].pos.x = (int32_t)get_u32(r);
+        g->fruits[i].pos.y = (int32_t)get_u32(r);
+        g->fruits[i].visited_mask = get_u32(r);
+        if (!cell_ok(g, g->fruits[i].pos)) return false;
+    }
+
+    int np = get_u8(r);
+    for (int n=0;n<np && r->ok;n++) {
+        int slot = get_u8(r);
+        uint8_t flags = get_u8(r);
+        const uint8_t *name = get_bytes(r, SNAKE_NAME_MAX);
+        if (!r->ok || slot >= g->max_players || g->players[slot].used) return false;
+
+        Player *p = &g->players[slot];
+        PlayerMeta *m = &g->meta[slot];
+        Cell *body = p->body;
+        memset(p, 0, sizeof(*p));
+        p->body = body;
+        init_player_meta(m, NULL);
+        memcpy(m->name, name, SNAKE_NAME_MAX);
+        m->name[SNAKE_NAME_MAX-1] = 0;
+        p->used = true;
+        p->active = (flags & CKPT_ACTIVE) != 0;
+        p->alive = (flags & CKPT_ALIVE) != 0;
+        p->paused = (flags & CKPT_PAUSED) != 0;
+        p->bot = (flags & CKPT_BOT) != 0;
+        p->connected = p->bot;
+        p->dir = get_u8(r);
+        p->pending_dir = get_u8(r);
+        p->score = get_u16(r);
+        uint32_t age = get_u32(r);
+        p->spawn_ms = (now > age) ? now - age : 0;
+        p->time_ms_final = get_u32(r);
+        if (flags & CKPT_TOKEN) {
+            const uint8_t *token = get_bytes(r, RESUME_TOKEN_LEN);
+            if (!token || !session_restore(st, slot, token)) return false;
+        }
+        p->len = get_u16(r);
+        if (p->dir > 3 || p->len > MAX_BODY) return false;
+        for (int k=0;k<(int)p->len;k++) {
+            p->body[k].x = (int32_t)get_u32(r);
+            p->body[k].y = (int32_t)get_u32(r);
+            if (r->ok && !cell_ok(g, p->body[k])) return false;
+        }
+    }
+    return r->ok && r->left == 0;
+}
+
+bool checkpoint_load(const char *path, Game *g, SessionTable *st, uint64_t now, char *err, size_t errlen) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        (void)snprintf(err, errlen, "cannot open %s", path);
+        return false;
+    }
+    uint8_t *data = NULL;
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+    if (size >= CKPT_HDR_LEN && fseek(f, 0, SEEK_SET) == 0) {
+        data = (uint8_t*)malloc((size_t)size);
+        if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    if (!data) {
+        (void)snprintf(err, errlen, "cannot read %s", path);
+        return false;
+    }
+
+    Reader r = { data, (size_t)size, true };
+    const uint8_t *magic = get_bytes(&r, 8);
+    uint32_t version = get_u32(&r);
+    uint32_t state_len = get_u32(&r);
+    uint32_t config_len = get_u32(&r);
+    const uint8_t *sum = get_bytes(&r, 8);
+    bool ok = memcmp(magic, CKPT_MAGIC, 8) == 0 && version == CKPT_VERSION &&
+              (uint64_t)state_len + config_len == r.left;
+    if (!ok) {
+        (void)snprintf(err, errlen, "%s is not a version %d checkpoint", path, CKPT_VERSION);
+        free(data);
+        return false;
+    }
+    uint8_t check[8];
+    hash64_bytes(hash64(r.p, r.left), check);
+    if (memcmp(check, sum, 8) != 0) {
+        (void)snprintf(err, errlen, "%s is corrupt", path);
+        free(data);
+        return false;
+    }
+
+    Reader state = { r.p, state_len, true };
+    ok = load_config(g, r.p + state_len, config_len);
+    if (!ok) (void)snprintf(err, errlen, "bad map in %s", path);
+    if (ok && !load_state(g, st, now, &state)) {
+        (void)snprintf(err, errlen, "bad game state in %s", path);
+        world_free(&g->map);
+        for (int i=0;i<g->max_players;i++) {
+            g->players[i].used = false;
+            session_revoke(st, i);
+        }
+        g->num_fruits = 0;
+        ok = false;
+    }
+    free(data);
+    return ok;
+}
@@ -0,0 +1,37 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "game.h"
+#include "session.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Checkpoints of a running match. Capturing serialises players, fruits,
+ * timers and resume tokens into a buffer of a few KiB under the game
+ * mutex; writing it out happens on another thread. The walls are not
+ * re-encoded: the file embeds the MSG_CONFIG payload the server already
+ * keeps for joining clients. Timers are stored as ages, so a restored game
+ * continues from where it stood regardless of the clock it comes back on. */
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} CheckpointBuf;
+
+void checkpoint_buf_free(CheckpointBuf *b);
+
+bool checkpoint_capture(const Game *g, const SessionTable *st, uint64_t now, CheckpointBuf *out);
+
+/* Writes to path.tmp, syncs and renames, so a crash mid-write leaves the
+ * previous checkpoint in place. */
+bool checkpoint_write(const char *path, const CheckpointBuf *state,
+                      const uint8_t *config, uint32_t config_len);
+
+/* Loads a checkpoint into a game fresh from game_init and an empty session
+ * table. Players come back disconnected and take their slots back with
+ * MSG_RESUME; bots come back as they were. */
+bool checkpoint_load(const char *path, Game *g, SessionTable *st, uint64_t now, char *err, size_t errlen);
+
+#endif
@@ -0,0 +1,408 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "eventlog.h"
+#include "../common/wire.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EVLOG_MAGIC "SNKEVLOG"
+#define EVLOG_BLOCK_MAGIC "EVBK"
+#define EVLOG_VERSION 1
+#define EVLOG_HDR_LEN (8 + 4 + 4 + 8 + 8)
+#define EVLOG_BLOCK_HDR_LEN (4 + 4 + 8)
+#define EVLOG_EVENT_LEN (4 + 1 + 1 + 2 + 4 + 4 + 4)
+
+/* A block is written once it is full or its oldest event is this old, so
+ * a quiet server still gets its events to disk within about a second. */
+#define FLUSH_US 1000000ULL
+#define IDLE_SLEEP_MS 10
+
+/* One ring cell. seq says whose turn it is: pos while free for the
+ * producer claiming pos, pos + 1 once filled, pos + size after the
+ * consumer has taken it (Vyukov's bounded queue). */
+typedef struct {
+    uint64_t seq;
+    uint64_t us;
+    uint8_t type;
+    uint8_t slot;
+    uint16_t arg;
+    uint32_t a, b, c;
+} RingCell;
+
+typedef struct {
+    /* Producers share tail; the rest belongs to the drain thread. */
+    _Alignas(64) uint64_t tail;
+    _Alignas(64) uint64_t dropped;
+    int live;
+    int inflight;
+    _Alignas(64) RingCell *ring;
+    uint64_t mask;
+    uint64_t head;
+    uint64_t dropped_seen;
+    volatile int stop;
+    pthread_t tid;
+
+    FILE *f;
+    char path[512];
+    uint64_t rotate_bytes;
+    uint64_t file_bytes;
+    uint32_t next_index;
+
+    /* the block being filled, as host-order columns */
+    uint32_t count;
+    uint64_t us[EVENT_BLOCK_MAX];
+    uint8_t type[EVENT_BLOCK_MAX];
+    uint8_t slot[EVENT_BLOCK_MAX];
+    uint16_t arg[EVENT_BLOCK_MAX];
+    uint32_t a[EVENT_BLOCK_MAX], b[EVENT_BLOCK_MAX], c[EVENT_BLOCK_MAX];
+    uint8_t raw[EVLOG_BLOCK_HDR_LEN + EVENT_BLOCK_MAX * EVLOG_EVENT_LEN];
+
+    EventLogStats stats;
+} EventLog;
+
+/* Static, so an emitter racing eventlog_close never touches freed
+ * memory; only the ring comes from the heap. */
+static EventLog g_log;
+
+static uint64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+    wire_put_u32(p, (uint32_t)(v >> 32));
+    wire_put_u32(p + 4, (uint32_t)v);
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return ((uint64_t)wire_get_u32(p) << 32) | wire_get_u32(p + 4);
+}
+
+void eventlog_emit(uint8_t type, int slot, uint16_t arg, uint32_t a, uint32_t b, uint32_t c) {
+    eventlog_emit_at(0, type, slot, arg, a, b, c);
+}
+
+void eventlog_emit_at(uint64_t us, uint8_t type, int slot, uint16_t arg, uint32_t a, uint32_t b, uint32_t c) {
+    EventLog *lg = &g_log;
+    if (!__atomic_load_n(&lg->live, __ATOMIC_RELAXED)) return;
+    /* inflight lets eventlog_close wait out emitters that got past the
+     * check before it cleared live. */
+    __atomic_add_fetch(&lg->inflight, 1, __ATOMIC_ACQ_REL);
+    if (!__atomic_load_n(&lg->live, __ATOMIC_ACQUIRE)) {
+        __atomic_sub_fetch(&lg->inflight, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    if (us == 0) us = mono_us();
+    uint64_t pos = __atomic_load_n(&lg->tail, __ATOMIC_RELAXED);
+    RingCell *e;
+    for (;;) {
+        e = &lg->ring[pos & lg->mask];
+        int64_t dif = (int64_t)(__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&lg->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (dif < 0) {
+            /* Full: the drain thread is behind, and waiting for it
+             * would put its I/O on our path. */
+            __atomic_add_fetch(&lg->dropped, 1, __ATOMIC_RELAXED);
+            __atomic_sub_fetch(&lg->inflight, 1, __ATOMIC_RELEASE);
+            return;
+        } else {
+            pos = __atomic_load_n(&lg->tail, __ATOMIC_RELAXED);
+        }
+    }
+    e->us = us;
+    e->type = type;
+    e->slot = (slot >= 0 && slot < EVENT_NO_SLOT) ? (uint8_t)slot : EVENT_NO_SLOT;
+    e->arg = arg;
+    e->a = a;
+    e->b = b;
+    e->c = c;
+    __atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&lg->inflight, 1, __ATOMIC_RELEASE);
+}
+
+/* ---- the drain thread ---- */
+
+static bool write_header(EventLog *lg) {
+    uint8_t hdr[EVLOG_HDR_LEN];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    memcpy(hdr, EVLOG_MAGIC, 8);
+    wire_put_u32(hdr + 8, EVLOG_VERSION);
+    wire_put_u32(hdr + 12, EVENT_BLOCK_MAX);
+    put_u64(hdr + 16, (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL);
+    put_u64(hdr + 24, mono_us());
+    if (fwrite(hdr, 1, sizeof(hdr), lg->f) != sizeof(hdr)) return false;
+    lg->file_bytes = sizeof(hdr);
+    lg->stats.files++;
+    return true;
+}
+
+/* Moves the file at lg->path out of the way as path.N. */
+static bool rotate_out(EventLog *lg) {
+    char name[sizeof(lg->path) + 16];
+    for (;;) {
+        (void)snprintf(name, sizeof(name), "%s.%u", lg->path, (unsigned)lg->next_index++);
+        if (access(name, F_OK) != 0) break;
+    }
+    return rename(lg->path, name) == 0;
+}
+
+static bool start_file(EventLog *lg) {
+    if (access(lg->path, F_OK) == 0 && !rotate_out(lg)) return false;
+    lg->f = fopen(lg->path, "wb");
+    if (!lg->f) return false;
+    if (write_header(lg)) return true;
+    fclose(lg->f);
+    lg->f = NULL;
+    return false;
+}
+
+static void fail(EventLog *lg) {
+    lg->stats.failed = true;
+    if (lg->f) fclose(lg->f);
+    lg->f = NULL;
+}
+
+static void write_block(EventLog *lg) {
+    uint32_t n = lg->count;
+    if (n == 0) return;
+    lg->count = 0;
+    if (!lg->f) return;
+
+    /* Producers stamp before they claim a cell, so the ring is only
+     * nearly in time order; offsets count from the earliest. */
+    uint64_t base = lg->us[0];
+    for (uint32_t i=1;i<n;i++) if (lg->us[i] < base) base = lg->us[i];
+
+    uint8_t *p = lg->raw;
+    memcpy(p, EVLOG_BLOCK_MAGIC, 4);
+    wire_put_u32(p + 4, n);
+    put_u64(p + 8, base);
+    p += EVLOG_BLOCK_HDR_LEN;
+    for (uint32_t i=0;i<n;i++, p+=4) {
+        uint64_t d = lg->us[i] - base;
+        wire_put_u32(p, d > 0xFFFFFFFFULL ? 0xFFFFFFFFu : (uint32_t)d);
+    }
+    memcpy(p, lg->type, n); p += n;
+    memcpy(p, lg->slot, n); p += n;
+    for (uint32_t i=0;i<n;i++, p+=2) wire_put_u16(p, lg->arg[i]);
+    for (uint32_t i=0;i<n;i++, p+=4) wire_put_u32(p, lg->a[i]);
+    for (uint32_t i=0;i<n;i++, p+=4) wire_put_u32(p, lg->b[i]);
+    for (uint32_t i=0;i<n;i++, p+=4) wire_put_u32(p, lg->c[i]);
+
+    size_t len = (size_t)(p - lg->raw);
+    if (fwrite(lg->raw, 1, len, lg->f) != len || fflush(lg->f) != 0) {
+        fail(lg);
+        return;
+    }
+    lg->file_bytes += len;
+    lg->stats.written += n;
+
+    if (lg->rotate_bytes > 0 && lg->file_bytes >= lg->rotate_bytes) {
+        bool ok = fclose(lg->f) == 0;
+        lg->f = NULL;
+        if (!ok || !start_file(lg)) fail(lg);
+    }
+}
+
+static void block_add(EventLog *lg, uint64_t us, uint8_t type, uint8_t slot, uint16_t arg,
+                      uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t i = lg->count++;
+    lg->us[i] = us;
+    lg->type[i] = type;
+    lg->slot[i] = slot;
+    lg->arg[i] = arg;
+    lg->a[i] = a;
+    lg->b[i] = b;
+    lg->c[i] = c;
+    if (lg->count == EVENT_BLOCK_MAX) write_block(lg);
+}
+
+/* Takes everything published so far; returns how many events. */
+static size_t drain(EventLog *lg) {
+    size_t n = 0;
+    for (;;) {
+        RingCell *e = &lg->ring[lg->head & lg->mask];
+        if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != lg->head + 1) break;
+        block_add(lg, e->us, e->type, e->slot, e->arg, e->a, e->b, e->c);
+        __atomic_store_n(&e->seq, lg->head + lg->mask + 1, __ATOMIC_RELEASE);
+        lg->head++;
+        n++;
+    }
+    uint64_t dropped = __atomic_load_n(&lg->dropped, __ATOMIC_RELAXED);
+    if (dropped != lg->dropped_seen) {
+        uint64_t d = dropped - lg->dropped_seen;
+        lg->dropped_seen = dropped;
+        block_add(lg, mono_us(), EV_DROPPED, EVENT_NO_SLOT, 0, d > 0xFFFFFFFFULL ? 0xFFFFFFFFu : (uint32_t)d, 0, 0);
+    }
+    return n;
+}
+
+static void *drain_main(void *arg) {
+    EventLog *lg = (EventLog*)arg;
+    while (!lg->stop) {
+        size_t n = drain(lg);
+        if (lg->count > 0 && mono_us() - lg->us[0] >= FLUSH_US) write_block(lg);
+        if (n == 0) {
+            struct timespec ts = { 0, IDLE_SLEEP_MS * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+    return NULL;
+}
+
+bool eventlog_open(const char *path, uint64_t rotate_bytes, uint32_t ring_events) {
+    EventLog *lg = &g_log;
+    if (__atomic_load_n(&lg->live, __ATOMIC_ACQUIRE) || strlen(path) >= sizeof(lg->path)) return false;
+    uint64_t size = 1024;
+    while (size < ring_events && size < (1ULL << 24)) size <<= 1;
+    RingCell *ring = (RingCell*)malloc((size_t)size * sizeof(RingCell));
+    if (!ring) return false;
+    for (uint64_t i=0;i<size;i++) ring[i].seq = i;
+
+    /* Emitters only touch inflight while the log is closed. */
+    lg->tail = 0;
+    lg->dropped = 0;
+    lg->ring = ring;
+    lg->mask = size - 1;
+    lg->head = 0;
+    lg->dropped_seen = 0;
+    lg->stop = 0;
+    lg->f = NULL;
+    (void)snprintf(lg->path, sizeof(lg->path), "%s", path);
+    lg->rotate_bytes = rotate_bytes;
+    lg->file_bytes = 0;
+    lg->next_index = 1;
+    lg->count = 0;
+    memset(&lg->stats, 0, sizeof(lg->stats));
+    if (!start_file(lg) || pthread_create(&lg->tid, NULL, drain_main, lg) != 0) {
+        if (lg->f) fclose(lg->f);
+        lg->f = NULL;
+        free(ring);
+        lg->ring = NULL;
+        return false;
+    }
+    __atomic_store_n(&lg->live, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void eventlog_close(EventLogStats *stats) {
+    EventLog *lg = &g_log;
+    if (!lg->ring) {
+        if (stats) memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    __atomic_store_n(&lg->live, 0, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&lg->inflight, __ATOMIC_ACQUIRE) > 0) sched_yield();
+    lg->stop = 1;
+    pthread_join(lg->tid, NULL);
+    (void)drain(lg);
+    write_block(lg);
+    if (lg->f && fclose(lg->f) != 0) lg->stats.failed = true;
+    lg->f = NULL;
+    lg->stats.dropped = lg->dropped;
+    if (stats) *stats = lg->stats;
+    free(lg->ring);
+    lg->ring = NULL;
+}
+
+/* ---- reading ---- */
+
+static void set_err(char *err, size_t errlen, const char *msg) {
+    if (err && errlen > 0) (void)snprintf(err, errlen, "%s", msg);
+}
+
+bool event_reader_open(EventReader *r, const char *path, char *err, size_t errlen) {
+    memset(r, 0, sizeof(*r));
+    r->f = fopen(path, "rb");
+    if (!r->f) {
+        set_err(err, errlen, "cannot open");
+        return false;
+    }
+    uint8_t hdr[EVLOG_HDR_LEN];
+    if (fread(hdr, 1, sizeof(hdr), r->f) != sizeof(hdr) || memcmp(hdr, EVLOG_MAGIC, 8) != 0) {
+        set_err(err, errlen, "not an event log");
+        event_reader_close(r);
+        return false;
+    }
+    if (wire_get_u32(hdr + 8) != EVLOG_VERSION) {
+        set_err(err, errlen, "unsupported event log version");
+        event_reader_close(r);
+        return false;
+    }
+    r->block_max = wire_get_u32(hdr + 12);
+    r->wall_ms = get_u64(hdr + 16);
+    r->mono_us = get_u64(hdr + 24);
+    if (r->block_max == 0 || r->block_max > (1u << 20)) {
+        set_err(err, errlen, "bad block size");
+        event_reader_close(r);
+        return false;
+    }
+    size_t n = r->block_max;
+    r->dt_us = (uint32_t*)malloc(n * sizeof(uint32_t));
+    r->type = (uint8_t*)malloc(n);
+    r->slot = (uint8_t*)malloc(n);
+    r->arg = (uint16_t*)malloc(n * sizeof(uint16_t));
+    r->a = (uint32_t*)malloc(n * sizeof(uint32_t));
+    r->b = (uint32_t*)malloc(n * sizeof(uint32_t));
+    r->c = (uint32_t*)malloc(n * sizeof(uint32_t));
+    r->raw = (uint8_t*)malloc(n * EVLOG_EVENT_LEN);
+    if (!r->dt_us || !r->type || !r->slot || !r->arg || !r->a || !r->b || !r->c || !r->raw) {
+        set_err(err, errlen, "out of memory");
+        event_reader_close(r);
+        return false;
+    }
+    return true;
+}
+
+bool event_reader_next(EventReader *r) {
+    uint8_t hdr[EVLOG_BLOCK_HDR_LEN];
+    size_t got = fread(hdr, 1, sizeof(hdr), r->f);
+    if (got == 0) return false;
+    uint32_t n = (got == sizeof(hdr)) ? wire_get_u32(hdr + 4) : 0;
+    if (got != sizeof(hdr) || memcmp(hdr, EVLOG_BLOCK_MAGIC, 4) != 0 || n == 0 || n > r->block_max ||
+        fread(r->raw, EVLOG_EVENT_LEN, n, r->f) != n) {
+        r->truncated = true;
+        return false;
+    }
+    r->count = n;
+    r->base_us = get_u64(hdr + 8);
+    const uint8_t *p = r->raw;
+    for (uint32_t i=0;i<n;i++, p+=4) r->dt_us[i] = wire_get_u32(p);
+    memcpy(r->type, p, n); p += n;
+    memcpy(r->slot, p, n); p += n;
+    for (uint32_t i=0;i<n;i++, p+=2) r->arg[i] = wire_get_u16(p);
+    for (uint32_t i=0;i<n;i++, p+=4) r->a[i] = wire_get_u32(p);
+    for (uint32_t i=0;i<n;i++, p+=4) r->b[i] = wire_get_u32(p);
+    for (uint32_t i=0;i<n;i++, p+=4) r->c[i] = wire_get_u32(p);
+    return true;
+}
+
+void event_reader_close(EventReader *r) {
+    if (r->f) fclose(r->f);
+    free(r->dt_us);
+    free(r->type);
+    free(r->slot);
+    free(r->arg);
+    free(r->a);
+    free(r->b);
+    free(r->c);
+    free(r->raw);
+    memset(r, 0, sizeof(*r));
+}
+
+const char *event_type_name(uint8_t type) {
+    static const char *names[EV_TYPES] = {
+        "?", "join", "resume", "leave", "pause", "death", "fruit",
+        "match_start", "match_end", "result", "dropped"
+    };
+    return (type < EV_TYPES) ? names[type] : "?";
+}
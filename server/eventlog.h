@@ -0,0 +1,101 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Typed, timestamped game events for offline analysis (--event-log).
+ *
+ * Any thread may emit. An event goes into a preallocated ring with one
+ * compare-and-swap and no lock, allocation or I/O; when the ring is full
+ * it is counted and dropped rather than waited for. A background thread
+ * drains the ring into column blocks and writes them out, rotating the
+ * file once it passes the size limit.
+ *
+ * File: a header, then blocks of up to EVENT_BLOCK_MAX events. A block
+ * holds each field as its own column, big-endian:
+ *   "SNKEVLOG" u32 version u32 block_max u64 wall_ms u64 mono_us
+ *   "EVBK" u32 count u64 base_us
+ *     u32 dt_us[count]      offset from base_us
+ *     u8 type[count] u8 slot[count] u16 arg[count]
+ *     u32 a[count] u32 b[count] u32 c[count]
+ * Times are CLOCK_MONOTONIC; the header pairs one reading with the wall
+ * clock. A block cut short by a crash ends the file. */
+typedef enum {
+    EV_JOIN = 1,            /* arg: 1 for a bot */
+    EV_RESUME,
+    EV_LEAVE,               /* arg: EV_LEAVE_*; a: 1 if the slot is kept for a resume */
+    EV_PAUSE,               /* arg: 1 paused, 0 resumed */
+    EV_DEATH,               /* arg: DIE_*; a, b: head cell; c: score */
+    EV_FRUIT,               /* arg: fruit; a, b: cell; c: score after */
+    EV_MATCH_START,         /* a: match number; b: players */
+    EV_MATCH_END,           /* a: match number; b: length in ms */
+    EV_RESULT,              /* arg: 1 for a bot; a: score; b: ms alive */
+    EV_DROPPED,             /* a: events lost to a full ring before this one */
+    EV_TYPES
+} EventType;
+
+enum {
+    EV_LEAVE_QUIT = 0,      /* MSG_LEAVE or MSG_BYE */
+    EV_LEAVE_LOST,          /* the connection dropped */
+    EV_LEAVE_HANDSHAKE,     /* timed out, see --handshake-sec */
+    EV_LEAVE_IDLE,
+    EV_LEAVE_SEND_STALL
+};
+
+#define EVENT_NO_SLOT 255
+#define EVENT_BLOCK_MAX 4096
+#define EVENT_RING_DEFAULT 65536
+
+/* ---- writing ---- */
+
+/* Starts the log and its drain thread. ring_events is rounded up to a
+ * power of two; rotate_bytes 0 never rotates. Rotated files are renamed
+ * path.1, path.2, ... continuing after any already there. */
+bool eventlog_open(const char *path, uint64_t rotate_bytes, uint32_t ring_events);
+
+/* Lock-free and safe from any thread; a no-op while no log is open. */
+void eventlog_emit(uint8_t type, int slot, uint16_t arg, uint32_t a, uint32_t b, uint32_t c);
+/* The same, stamped us (CLOCK_MONOTONIC) instead of now, for events only
+ * settled some time after they happened; 0 = now. */
+void eventlog_emit_at(uint64_t us, uint8_t type, int slot, uint16_t arg, uint32_t a, uint32_t b, uint32_t c);
+
+typedef struct {
+    uint64_t written;
+    uint64_t dropped;
+    uint32_t files;
+    bool failed;            /* a write failed and logging stopped */
+} EventLogStats;
+
+/* Drains what is queued, stops the thread and closes the file. */
+void eventlog_close(EventLogStats *stats);
+
+/* ---- reading ---- */
+
+typedef struct {
+    FILE *f;
+    uint64_t wall_ms;       /* from the header */
+    uint64_t mono_us;
+    uint32_t block_max;
+    bool truncated;         /* the last block was cut short */
+    /* The block just read, one array per column; us is absolute. */
+    uint32_t count;
+    uint64_t base_us;
+    uint32_t *dt_us;
+    uint8_t *type;
+    uint8_t *slot;
+    uint16_t *arg;
+    uint32_t *a, *b, *c;
+    uint8_t *raw;
+} EventReader;
+
+bool event_reader_open(EventReader *r, const char *path, char *err, size_t errlen);
+/* Reads the next block into the columns; false at the end of the file. */
+bool event_reader_next(EventReader *r);
+void event_reader_close(EventReader *r);
+
+const char *event_type_name(uint8_t type);
+
+#endif
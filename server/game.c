@@ -0,0 +1,575 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "game.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+bool game_init(Game *g, int max_players) {
+    memset(g, 0, sizeof(*g));
+    size_t n = (size_t)max_players;
+    /* Bodies go last: a short snake only ever touches the first pages of
+     * its slice, and the untouched rest costs no resident memory. */
+    size_t bytes = n * (sizeof(Player) + sizeof(PlayerMeta) + sizeof(TickMove)) +
+                   n * MAX_BODY * (sizeof(Cell) + 2 * sizeof(int32_t)) + 6 * 16;
+    if (!arena_init(&g->arena, bytes)) return false;
+    g->players = (Player*)arena_alloc(&g->arena, n * sizeof(Player));
+    g->meta = (PlayerMeta*)arena_alloc(&g->arena, n * sizeof(PlayerMeta));
+    g->moves = (TickMove*)arena_alloc(&g->arena, n * sizeof(TickMove));
+    Cell *bodies = (Cell*)arena_alloc(&g->arena, n * MAX_BODY * sizeof(Cell));
+    g->segs.x = (int32_t*)arena_alloc(&g->arena, n * MAX_BODY * sizeof(int32_t));
+    g->segs.y = (int32_t*)arena_alloc(&g->arena, n * MAX_BODY * sizeof(int32_t));
+    g->segs.cap = (uint32_t)(n * MAX_BODY);
+    if (!g->players || !g->meta || !g->moves || !bodies || !g->segs.x || !g->segs.y) {
+        game_free(g);
+        return false;
+    }
+    for (size_t i=0;i<n;i++) {
+        g->players[i].body = bodies + i * MAX_BODY;
+        g->meta[i].fd = -1;
+    }
+    g->max_players = max_players;
+    return true;
+}
+
+void game_free(Game *g) {
+    arena_free(&g->arena);
+    world_free(&g->map);
+    g->players = NULL;
+    g->meta = NULL;
+    g->moves = NULL;
+    g->max_players = 0;
+}
+
+uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+bool in_bounds(Game *g, int x, int y) {
+    return x >= 0 && x < g->w && y >= 0 && y < g->h;
+}
+
+bool is_obstacle(Game *g, int x, int y) {
+    if (!in_bounds(g, x, y)) return true;
+    if (g->world == 0) return false;
+    return world_is_wall(&g->map, x, y);
+}
+
+void dir_delta(uint8_t dir, int *dx, int *dy) {
+    *dx = 0; *dy = 0;
+    switch (dir) {
+        case 0: *dy = -1; break;
+        case 1: *dx =  1; break;
+        case 2: *dy =  1; break;
+        case 3: *dx = -1; break;
+        default: break;
+    }
+}
+
+bool dir_is_opposite(uint8_t a, uint8_t b) {
+    return (a==0 && b==2) || (a==2 && b==0) || (a==1 && b==3) || (a==3 && b==1);
+}
+
+bool occupied_by_snake(Game *g, int x, int y) {
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        if (!p->used || !p->active || !p->alive) continue;
+        for (int k=0;k<(int)p->len;k++) {
+            if (p->body[k].x == x && p->body[k].y == y) return true;
+        }
+    }
+    return false;
+}
+
+bool occupied_by_fruit(Game *g, int x, int y) {
+    for (int i=0;i<(int)g->num_fruits;i++) {
+        if (g->fruits[i].pos.x == x && g->fruits[i].pos.y == y) return true;
+    }
+    return false;
+}
+
+void pack_bodies(Game *g) {
+    SegTable *t = &g->segs;
+    uint32_t n = 0;
+    for (int i=0;i<g->max_players;i++) {
+        const Player *p = &g->players[i];
+        if (!p->used || !p->active || !p->alive) continue;
+        for (int k=0;k<(int)p->len && n<t->cap;k++) {
+            t->x[n] = p->body[k].x;
+            t->y[n] = p->body[k].y;
+            n++;
+        }
+    }
+    t->count = n;
+}
+
+/* The first probe walks the bodies in place; once a probe lands on a snake
+ * the board is crowded, and packing pays for itself over the probes still
+ * to come. */
+static bool probe_snake(Game *g, int x, int y, bool *packed) {
+    if (*packed) return seg_find(&g->segs, x, y) >= 0;
+    if (!occupied_by_snake(g, x, y)) return false;
+    if (g->segs.x) {
+        pack_bodies(g);
+        *packed = true;
+    }
+    return true;
+}
+
+/* xorshift64*; the game's own stream, so re-running a tick respawns fruit
+ * where it went the first time. Seeded from rand() on first use, so a
+ * srand() before the first spawn still picks the whole game. */
+static uint32_t game_rand(Game *g) {
+    if (g->rng == 0) g->rng = ((uint64_t)(uint32_t)rand() << 32 | (uint32_t)rand()) | 1;
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return (uint32_t)((g->rng * 0x2545F4914F6CDD1DULL) >> 33);
+}
+
+Cell find_free_cell(Game *g) {
+    bool packed = false;
+    for (int tries=0;tries<10000;tries++) {
+        int x = (int)(game_rand(g) % (uint32_t)g->w);
+        int y = (int)(game_rand(g) % (uint32_t)g->h);
+        if (is_obstacle(g, x, y)) continue;
+        if (probe_snake(g, x, y, &packed)) continue;
+        if (occupied_by_fruit(g, x, y)) continue;
+        return (Cell){x,y};
+    }
+    /* Exhaustive fallback, a chunk at a time so solid rock is skipped whole. */
+    for (int cy=0;cy<g->map.ch;cy++) for (int cx=0;cx<g->map.cw;cx++) {
+        int bx = cx << CHUNK_SHIFT, by = cy << CHUNK_SHIFT;
+        if (g->world != 0 && world_chunk_full(&g->map, bx, by)) continue;
+        for (int y=by;y<by+CHUNK_SIZE && y<g->h;y++) for (int x=bx;x<bx+CHUNK_SIZE && x<g->w;x++) {
+            if (is_obstacle(g, x, y)) continue;
+            if (probe_snake(g, x, y, &packed)) continue;
+            if (occupied_by_fruit(g, x, y)) continue;
+            return (Cell){x,y};
+        }
+    }
+    return (Cell){1,1};
+}
+
+int count_active_alive(Game *g) {
+    int c=0;
+    for (int i=0;i<g->max_players;i++) {
+        Player *p=&g->players[i];
+        if (p->used && p->active && p->alive) c++;
+    }
+    return c;
+}
+
+void ensure_fruits_count(Game *g) {
+    int needed = count_active_alive(g);
+    if (needed < 0) needed = 0;
+    if (needed > MAX_FRUITS) needed = MAX_FRUITS;
+
+    while (g->num_fruits < (uint8_t)needed) {
+        Fruit *f = &g->fruits[g->num_fruits++];
+        f->pos = find_free_cell(g);
+        f->visited_mask = 0;
+    }
+    while (g->num_fruits > (uint8_t)needed) {
+        g->num_fruits--;
+    }
+}
+
+void gen_map(Game *g, int w, int h, int with_obstacles) {
+    g->w = w;
+    g->h = h;
+
+    world_free(&g->map);
+    if (!world_init(&g->map, w, h)) return;
+
+    world_fill(&g->map, 0, 0, w - 1, 0);
+    world_fill(&g->map, 0, h - 1, w - 1, h - 1);
+    world_fill(&g->map, 0, 0, 0, h - 1);
+    world_fill(&g->map, w - 1, 0, w - 1, h - 1);
+
+    if (!with_obstacles) {
+        return;
+    }
+
+    int cx = w / 2;
+    int cy = h / 2;
+
+    world_fill(&g->map, cx - 10 > 1 ? cx - 10 : 1, cy - 4 > 1 ? cy - 4 : 1,
+               cx - 5 < w - 2 ? cx - 5 : w - 2, cy - 2 < h - 2 ? cy - 2 : h - 2);
+    world_fill(&g->map, cx + 5 > 1 ? cx + 5 : 1, cy + 2 > 1 ? cy + 2 : 1,
+               cx + 10 < w - 2 ? cx + 10 : w - 2, cy + 4 < h - 2 ? cy + 4 : h - 2);
+}
+
+bool gen_map_seeded(Game *g, int w, int h, const MapGenSpec *spec) {
+    world_free(&g->map);
+    if (!mapgen_build(&g->map, w, h, spec, NULL)) return false;
+    g->w = w;
+    g->h = h;
+    return true;
+}
+
+void clear_fruit_visits_for_slot(Game *g, int slot) {
+    /* visited_mask has one bit for each of the first 32 slots. */
+    if (slot < 0 || slot >= 32) return;
+    uint32_t mask = ~(1u << (uint32_t)slot);
+    for (int i = 0; i < g->num_fruits; i++) {
+        g->fruits[i].visited_mask &= mask;
+    }
+}
+
+void kill_player(Player *p, uint64_t now) {
+    p->alive = false;
+    if (p->time_ms_final == 0 && p->spawn_ms != 0) {
+    uint64_t d = (now > p->spawn_ms) ? (now - p->spawn_ms) : 0;
+    if (d > 0xFFFFFFFFULL) d = 0xFFFFFFFFULL;
+    p->time_ms_final = (uint32_t)d;
+}
+}
+
+/* Simultaneous-move tick. Every snake's next head is planned against the
+ * bodies as they stand at the start of the tick, so the outcome does not
+ * depend on slot order and each phase can run on the worker pool:
+ *   stamp   - write every live body into the occupancy grid
+ *   plan    - turn, step, walls and fruit for each mover
+ *   collide - head-to-body against stamped bodies (minus vacating tails)
+ *             and head-to-head through an atomically claimed grid
+ *   resolve - deaths, scores and eaten fruit, serially in slot order
+ *   apply   - shift the surviving bodies
+ * Fruit respawns last, once every snake has reached its new cells. */
+
+static uint64_t occ_pack(uint32_t gen, int slot) {
+    return ((uint64_t)gen << 32) | (uint32_t)slot;
+}
+
+static bool occ_live(const Game *g, uint64_t v) {
+    return (uint32_t)(v >> 32) == g->tick_gen;
+}
+
+/* Entity layers a chunk has not stamped for this many ticks are freed, so
+ * snakes roaming a huge board do not leave scratch behind them. */
+#define LAYER_SWEEP_TICKS 256u
+
+enum { LAYER_OCC = 0, LAYER_CLAIM = 1 };
+
+/* Sized once per map: a full-length snake keeps at most its body plus a
+ * sweep window of trail stamped, and no more chunks exist than the board
+ * has. Past that, layers come from the heap as before. */
+static void reserve_layers(Game *g) {
+    if (g->map.layer_pool.arena.base || !g->map.regions) return;
+    uint64_t board = (uint64_t)g->map.cw * (uint64_t)g->map.ch;
+    uint64_t roam = (uint64_t)g->max_players * ((MAX_BODY + LAYER_SWEEP_TICKS) / CHUNK_SIZE + 2);
+    uint32_t chunks = (uint32_t)(board < roam ? board : roam);
+    (void)world_reserve(&g->map, chunks, chunks * WORLD_LAYERS);
+}
+
+static void next_tick_gen(Game *g) {
+    reserve_layers(g);
+    if (++g->tick_gen == 0) {
+        world_clear_layers(&g->map);
+        g->tick_gen = 1;
+    }
+    if ((g->tick_gen % LAYER_SWEEP_TICKS) == 0) world_sweep_layers(&g->map, g->tick_gen, LAYER_SWEEP_TICKS);
+}
+
+static void phase_stamp(void *ctx, int begin, int end) {
+    Game *g = (Game*)ctx;
+    for (int i=begin;i<end;i++) {
+        Player *p = &g->players[i];
+        if (!p->used || !p->active || !p->alive) continue;
+        uint64_t v = occ_pack(g->tick_gen, i);
+        /* Consecutive segments nearly always share a chunk. */
+        int32_t lcx = -1, lcy = -1;
+        uint64_t *layer = NULL;
+        for (int k=0;k<(int)p->len;k++) {
+            int32_t x = p->body[k].x, y = p->body[k].y;
+            if (!in_bounds(g, x, y)) continue;
+            if ((x >> CHUNK_SHIFT) != lcx || (y >> CHUNK_SHIFT) != lcy) {
+                lcx = x >> CHUNK_SHIFT;
+                lcy = y >> CHUNK_SHIFT;
+                layer = world_chunk_layer(&g->map, lcx, lcy, LAYER_OCC, g->tick_gen);
+            }
+            if (layer) __atomic_store_n(&layer[world_cell_index(x, y)], v, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void phase_plan(void *ctx, int begin, int end) {
+    Game *g = (Game*)ctx;
+    for (int i=begin;i<end;i++) {
+        Player *p = &g->players[i];
+        TickMove *m = &g->moves[i];
+        m->flags = 0;
+        m->die = 0;
+        if (!p->used || !p->active || !p->alive || p->paused) continue;
+
+        /* One real turn per tick: presses that would not change the
+         * heading are consumed without costing the tick. */
+        bool turned = false;
+        while (p->input_count > 0 && !turned) {
+            InputCmd *in = &p->inputs[p->input_head];
+            p->input_head = (uint8_t)((p->input_head + 1) % INPUT_QUEUE_LEN);
+            p->input_count--;
+            p->applied_seq = in->seq;
+            p->applied_ms = in->client_ms;
+            if (in->dir != p->dir && !dir_is_opposite(p->dir, in->dir)) {
+                p->dir = in->dir;
+                turned = true;
+            }
+        }
+        if (p->pending_dir != 255) {
+            if (!turned && !dir_is_opposite(p->dir, p->pending_dir)) p->dir = p->pending_dir;
+            p->pending_dir = 255;
+        }
+
+        int dx,dy; dir_delta(p->dir, &dx, &dy);
+        int nx = p->body[0].x + dx;
+        int ny = p->body[0].y + dy;
+        m->flags = MOVE_ACTIVE;
+
+        if (g->world == 0) {
+            if (nx < 0) nx = g->w - 1;
+            if (nx >= g->w) nx = 0;
+            if (ny < 0) ny = g->h - 1;
+            if (ny >= g->h) ny = 0;
+        } else if (!in_bounds(g, nx, ny) || is_obstacle(g, nx, ny)) {
+            m->die = DIE_WALL;
+            continue;
+        }
+        m->next = (Cell){nx,ny};
+
+        for (int f=0;f<(int)g->num_fruits;f++) {
+            if (g->fruits[f].pos.x == nx && g->fruits[f].pos.y == ny) {
+                m->flags |= MOVE_GROW;
+                m->fruit = (uint8_t)f;
+                break;
+            }
+        }
+    }
+}
+
+static bool tail_vacates(const Game *g, int slot, Cell c) {
+    const Player *p = &g->players[slot];
+    const TickMove *m = &g->moves[slot];
+    if (!(m->flags & MOVE_ACTIVE) || (m->flags & MOVE_GROW)) return false;
+    const Cell *t = &p->body[p->len - 1];
+    return t->x == c.x && t->y == c.y;
+}
+
+static void phase_collide(void *ctx, int begin, int end) {
+    Game *g = (Game*)ctx;
+    for (int i=begin;i<end;i++) {
+        TickMove *m = &g->moves[i];
+        if (!(m->flags & MOVE_ACTIVE) || m->die) continue;
+        Cell c = m->next;
+
+        uint64_t o = world_layer_peek(&g->map, c.x, c.y, LAYER_OCC);
+        if (occ_live(g, o) && !tail_vacates(g, (int)(uint32_t)o, c)) {
+            __atomic_store_n(&m->die, DIE_BODY, __ATOMIC_RELAXED);
+        }
+
+        uint64_t *claim = world_layer(&g->map, c.x, c.y, LAYER_CLAIM, g->tick_gen);
+        if (!claim) continue;
+        uint64_t mine = occ_pack(g->tick_gen, i);
+        uint64_t cur = __atomic_load_n(claim, __ATOMIC_RELAXED);
+        for (;;) {
+            if (occ_live(g, cur)) {
+                __atomic_store_n(&m->die, DIE_HEAD_ON, __ATOMIC_RELAXED);
+                __atomic_store_n(&g->moves[(uint32_t)cur].die, DIE_HEAD_ON, __ATOMIC_RELAXED);
+                break;
+            }
+            if (__atomic_compare_exchange_n(claim, &cur, mine, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        }
+    }
+}
+
+static void phase_apply(void *ctx, int begin, int end) {
+    Game *g = (Game*)ctx;
+    for (int i=begin;i<end;i++) {
+        Player *p = &g->players[i];
+        TickMove *m = &g->moves[i];
+        if (!(m->flags & MOVE_ACTIVE) || m->die) continue;
+
+        uint16_t new_len = p->len;
+        if ((m->flags & MOVE_GROW) && new_len < (uint16_t)MAX_BODY) new_len++;
+        memmove(&p->body[1], &p->body[0], (size_t)(new_len - 1) * sizeof(Cell));
+        p->body[0] = m->next;
+        p->len = new_len;
+    }
+}
+
+void tick_game(Game *g, uint32_t dt_ms) {
+    if (g->global_freeze_ms > 0) {
+        if (dt_ms >= g->global_freeze_ms) g->global_freeze_ms = 0;
+        else g->global_freeze_ms -= dt_ms;
+        return;
+    }
+    next_tick_gen(g);
+    g->tick++;
+
+    int n = g->max_players;
+    pool_run(g->pool, phase_stamp, g, n);
+    pool_run(g->pool, phase_plan, g, n);
+    pool_run(g->pool, phase_collide, g, n);
+
+    /* A re-run tick dies when it did the first time. */
+    uint64_t now = g->replay_ms ? g->replay_ms : now_ms();
+    bool eaten[MAX_FRUITS] = {false};
+    for (int i=0;i<n;i++) {
+        TickMove *m = &g->moves[i];
+        if (!(m->flags & MOVE_ACTIVE)) continue;
+        if (m->die) {
+            kill_player(&g->players[i], now);
+        } else if (m->flags & MOVE_GROW) {
+            g->players[i].score++;
+            eaten[m->fruit] = true;
+        }
+    }
+
+    pool_run(g->pool, phase_apply, g, n);
+
+    for (int f=0;f<(int)g->num_fruits;f++) {
+        if (!eaten[f]) continue;
+        g->fruits[f].pos = find_free_cell(g);
+        g->fruits[f].visited_mask = 0;
+    }
+    ensure_fruits_count(g);
+}
+
+bool load_map_file(const char *path, Game *g) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    char *lines[2048];
+    int line_count = 0;
+    int max_w = 0;
+
+    char buf[4096];
+    while (fgets(buf, sizeof(buf), f)) {
+        size_t n = strlen(buf);
+        while (n>0 && (buf[n-1]=='\n' || buf[n-1]=='\r')) buf[--n] = 0;
+        if (n == 0) continue;
+
+        if (line_count >= (int)(sizeof(lines)/sizeof(lines[0]))) break;
+
+        lines[line_count] = strdup(buf);
+        if (!lines[line_count]) break;
+
+        if ((int)n > max_w) max_w = (int)n;
+        line_count++;
+    }
+    fclose(f);
+
+    if (line_count <= 0 || max_w <= 0) {
+        for (int i=0;i<line_count;i++) free(lines[i]);
+        return false;
+    }
+
+    g->w = max_w;
+    g->h = line_count;
+
+    world_free(&g->map);
+    if (!world_init(&g->map, g->w, g->h)) {
+        for (int i=0;i<line_count;i++) free(lines[i]);
+        return false;
+    }
+
+    for (int y=0;y<g->h;y++) {
+        char *ln = lines[y];
+        int lw = (int)strlen(ln);
+        for (int x=0;x<lw;x++) {
+            if (ln[x] == '#') world_set_wall(&g->map, x, y, true);
+        }
+        free(lines[y]);
+    }
+
+    return true;
+}
+
+void init_player(Player *p, Cell spawn, uint16_t keep_score) {
+    Cell *body = p->body;
+    memset(p, 0, sizeof(*p));
+    p->body = body;
+    p->spawn_ms = now_ms();
+    p->time_ms_final = 0;
+    p->used = true;
+    p->connected = true;
+    p->active = true;
+    p->alive = true;
+    p->paused = false;
+    p->dir = 1;
+    p->pending_dir = 255;
+    p->score = keep_score;
+    p->len = 3;
+    p->body[0] = spawn;
+    p->body[1] = (Cell){spawn.x-1, spawn.y};
+    p->body[2] = (Cell){spawn.x-2, spawn.y};
+}
+
+void init_player_meta(PlayerMeta *m, const char *name) {
+    memset(m, 0, sizeof(*m));
+    m->ready = false;
+    m->fd = -1;
+    (void)snprintf(m->name, sizeof(m->name), "%s", (name && name[0]) ? name : "player");
+}
+
+void queue_input(Player *p, uint8_t dir, uint32_t seq, uint32_t client_ms) {
+    if (dir > 3 || (int32_t)(seq - p->input_seq) <= 0) return;
+    p->input_seq = seq;
+    int at;
+    if (p->input_count < INPUT_QUEUE_LEN) {
+        at = (p->input_head + p->input_count) % INPUT_QUEUE_LEN;
+        p->input_count++;
+    } else {
+        at = (p->input_head + INPUT_QUEUE_LEN - 1) % INPUT_QUEUE_LEN;
+    }
+    p->inputs[at] = (InputCmd){ dir, seq, client_ms };
+}
+
+void reset_input(Player *p) {
+    p->input_head = 0;
+    p->input_count = 0;
+    p->input_seq = 0;
+    p->applied_seq = 0;
+    p->applied_ms = 0;
+}
+
+int alloc_slot(Game *g) {
+    for (int i=0;i<g->max_players;i++) if (!g->players[i].used) return i;
+    return -1;
+}
+
+void reset_match(Game *g, uint64_t now) {
+    /* Clear the board first, so nobody spawns around last match's bodies. */
+    for (int i=0;i<g->max_players;i++) g->players[i].alive = false;
+    g->num_fruits = 0;
+    for (int i=0;i<g->max_players;i++) {
+        Player *p = &g->players[i];
+        if (!p->used) continue;
+        bool connected = p->connected;
+        bool bot = p->bot;
+        init_player(p, find_free_cell(g), 0);
+        p->connected = connected;
+        p->bot = bot;
+        p->spawn_ms = now;
+    }
+    ensure_fruits_count(g);
+    g->game_over = false;
+    g->global_freeze_ms = 0;
+    g->start_ms = now;
+    g->end_ms = 0;
+    g->lobby_until_ms = 0;
+    g->last_no_players_ms = 0;
+}
+
+bool any_connected_active_alive(Game *g) {
+    for (int i=0;i<g->max_players;i++) {
+        Player *p=&g->players[i];
+        if (p->used && p->connected && p->active && p->alive) return true;
+    }
+    return false;
+}
@@ -0,0 +1,169 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include "../common/arena.h"
+#include "../common/protocol.h"
+#include "../common/world.h"
+#include "mapgen.h"
+#include "pool.h"
+#include "segs.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_BODY 1024
+#define INPUT_QUEUE_LEN 4
+
+/* One MSG_INPUT waiting for its tick; seq and client_ms are echoed back
+ * in the state once it has been applied. */
+typedef struct {
+    uint8_t dir;
+    uint32_t seq;
+    uint32_t client_ms;
+} InputCmd;
+
+/* Everything the tick and the bots touch. Bodies live in the game arena,
+ * so a room's players pack into a few cache lines. */
+typedef struct {
+    bool used;
+    bool connected;
+    bool active;
+    bool alive;
+    bool paused;
+    bool bot;
+    uint8_t dir;
+    uint8_t pending_dir;      /* bot steering, used when no input is queued */
+    uint16_t score;
+    uint16_t len;
+    uint8_t input_head;
+    uint8_t input_count;
+    uint32_t input_seq;       /* newest seq accepted from the client */
+    uint32_t applied_seq;     /* newest seq a tick has consumed */
+    uint32_t applied_ms;
+    InputCmd inputs[INPUT_QUEUE_LEN];
+    uint64_t spawn_ms;
+    uint32_t time_ms_final;
+    Cell *body;               /* MAX_BODY cells */
+} Player;
+
+/* Connection metadata, read by the network threads and the broadcast but
+ * never by the tick. It survives respawns. */
+typedef struct {
+    bool ready;
+    int fd;
+    uint16_t view_w;
+    uint16_t view_h;
+    uint32_t config_gen;      /* config generation this client last saw */
+    char name[SNAKE_NAME_MAX];
+} PlayerMeta;
+
+typedef struct {
+    Cell pos;
+    uint32_t visited_mask;
+} Fruit;
+
+enum {
+    MOVE_ACTIVE = 0x01,
+    MOVE_GROW = 0x02
+};
+
+/* Why a planned move ended the snake, kept in TickMove.die. */
+enum {
+    DIE_NONE = 0,
+    DIE_WALL,                 /* off the board or into an obstacle */
+    DIE_BODY,                 /* into a snake's body, its own included */
+    DIE_HEAD_ON               /* two heads claimed the same cell */
+};
+
+/* Per-slot scratch for the simultaneous-move tick. */
+typedef struct {
+    Cell next;
+    uint8_t flags;
+    uint8_t fruit;
+    uint8_t die;              /* DIE_* */
+} TickMove;
+
+typedef struct {
+    /* Read every tick. */
+    int w, h;
+    uint8_t world;
+    bool game_over;
+    uint16_t global_freeze_ms;
+    uint32_t tick;            /* ticks simulated; frozen ones do not count */
+    uint32_t tick_gen;
+    uint64_t rng;             /* spawn cells; part of the state a rewind restores */
+    int max_players;
+    Player *players;
+    /* Tick scratch: occupancy and head claims live in the map's entity
+     * layers, stamped with tick_gen so they never need clearing; pool may
+     * be NULL for a single thread. */
+    TickMove *moves;
+    WorkerPool *pool;
+    Fruit fruits[MAX_FRUITS];
+    uint8_t num_fruits;
+    World map;
+    SegTable segs;            /* packed bodies for find_free_cell */
+    pthread_mutex_t mtx;
+
+    /* Rules, clocks and bookkeeping. */
+    uint8_t mode;
+    uint16_t time_limit_sec;
+    uint32_t tick_ms;
+    uint64_t start_ms;
+    uint64_t end_ms;          /* when game_over was set */
+    uint64_t replay_ms;       /* while a tick is re-run: when it first ran, else 0 */
+    uint64_t lobby_until_ms;  /* next match starts, 0 = there is none */
+    uint32_t match;           /* matches started by this process */
+    uint64_t last_tick_ms;
+    uint64_t last_no_players_ms;
+    PlayerMeta *meta;
+    /* players, meta, moves and bodies, sized by game_init and freed in
+     * one step by game_free. */
+    Arena arena;
+    char map_path[256];
+} Game;
+
+bool game_init(Game *g, int max_players);
+void game_free(Game *g);
+
+uint64_t now_ms(void);
+
+bool in_bounds(Game *g, int x, int y);
+bool is_obstacle(Game *g, int x, int y);
+void dir_delta(uint8_t dir, int *dx, int *dy);
+bool dir_is_opposite(uint8_t a, uint8_t b);
+bool occupied_by_snake(Game *g, int x, int y);
+/* Packs every live segment into g->segs for the vector hit test. */
+void pack_bodies(Game *g);
+bool occupied_by_fruit(Game *g, int x, int y);
+Cell find_free_cell(Game *g);
+int count_active_alive(Game *g);
+bool any_connected_active_alive(Game *g);
+void ensure_fruits_count(Game *g);
+void clear_fruit_visits_for_slot(Game *g, int slot);
+
+void gen_map(Game *g, int w, int h, int with_obstacles);
+/* A procedural board, see mapgen.h; map_path is left to the caller. */
+bool gen_map_seeded(Game *g, int w, int h, const MapGenSpec *spec);
+bool load_map_file(const char *path, Game *g);
+
+/* Spawns a snake in p, keeping only its body storage. */
+void init_player(Player *p, Cell spawn, uint16_t keep_score);
+/* Resets a slot's connection metadata for a new occupant. */
+void init_player_meta(PlayerMeta *m, const char *name);
+/* Queues one client input; stale sequence numbers are dropped and a full
+ * queue keeps the newest press in its last entry. */
+void queue_input(Player *p, uint8_t dir, uint32_t seq, uint32_t client_ms);
+/* Forgets queued input and sequence state when a connection attaches. */
+void reset_input(Player *p);
+/* Stamps time_ms_final as of now (CLOCK_MONOTONIC ms). */
+void kill_player(Player *p, uint64_t now);
+int alloc_slot(Game *g);
+/* Starts the next match on the same board: every used slot respawns with
+ * a zero score, keeping its connection, and the fruit is re-laid. */
+void reset_match(Game *g, uint64_t now);
+
+void tick_game(Game *g, uint32_t dt_ms);
+
+#endif
@@ -0,0 +1,307 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "lagcomp.h"
+
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+bool lag_init(LagComp *lc, int max_players, int depth) {
+    memset(lc, 0, sizeof(*lc));
+    if (depth <= 0) return true;
+    if (depth > LAG_MAX_TICKS) depth = LAG_MAX_TICKS;
+    size_t n = (size_t)max_players;
+    size_t bodies = n * MAX_BODY * sizeof(Cell);
+    size_t frame = n * (sizeof(Player) + 2 + sizeof(LagOutcome)) + bodies + 5 * 16;
+    size_t rest = n * (sizeof(uint64_t) + LAG_LATE_MAX * sizeof(LateInput) + 1 + sizeof(Player) + 1) + bodies + 6 * 16;
+    /* Bodies are sized for full-length snakes; pages short ones never
+     * reach stay untouched. */
+    if (!arena_init(&lc->arena, (size_t)depth * frame + rest)) return false;
+    for (int k=0;k<depth;k++) {
+        LagFrame *f = &lc->frames[k];
+        f->players = (Player*)arena_alloc(&lc->arena, n * sizeof(Player));
+        f->cells = (Cell*)arena_alloc(&lc->arena, bodies);
+        f->dir_after = (uint8_t*)arena_alloc(&lc->arena, n);
+        f->external = (bool*)arena_alloc(&lc->arena, n);
+        f->outcome = (LagOutcome*)arena_alloc(&lc->arena, n * sizeof(LagOutcome));
+        if (!f->players || !f->cells || !f->dir_after || !f->external || !f->outcome) {
+            lag_free(lc);
+            return false;
+        }
+    }
+    lc->digest = (uint64_t*)arena_alloc(&lc->arena, n * sizeof(uint64_t));
+    lc->late = (LateInput*)arena_alloc(&lc->arena, n * LAG_LATE_MAX * sizeof(LateInput));
+    lc->late_count = (uint8_t*)arena_alloc(&lc->arena, n);
+    lc->saved = (Player*)arena_alloc(&lc->arena, n * sizeof(Player));
+    lc->saved_cells = (Cell*)arena_alloc(&lc->arena, bodies);
+    lc->keep = (bool*)arena_alloc(&lc->arena, n);
+    if (!lc->digest || !lc->late || !lc->late_count || !lc->saved || !lc->saved_cells || !lc->keep) {
+        lag_free(lc);
+        return false;
+    }
+    lc->depth = depth;
+    lc->max_players = max_players;
+    return true;
+}
+
+void lag_free(LagComp *lc) {
+    arena_free(&lc->arena);
+    memset(lc, 0, sizeof(*lc));
+}
+
+/* Passes the held frames to on_final, oldest first, and lets them go. */
+static void retire_all(LagComp *lc) {
+    if (lc->on_final) {
+        for (uint32_t t=lc->newest-lc->count+1;lc->count>0 && t<=lc->newest;t++) {
+            lc->on_final(lc->final_ctx, &lc->frames[t % (uint32_t)lc->depth], lc->max_players);
+        }
+    }
+    lc->count = 0;
+}
+
+void lag_reset(LagComp *lc) {
+    if (lc->depth == 0) return;
+    retire_all(lc);
+    lc->have_after = false;
+    lc->rewind_from = 0;
+    memset(lc->late_count, 0, (size_t)lc->max_players);
+}
+
+/* What an outside change to a player would show in: joins, leaves,
+ * respawns and pauses. Headings are left out; turns are the tick's. */
+static uint64_t player_digest(const Player *p) {
+    uint64_t h = (uint64_t)p->used | (uint64_t)p->active << 1 | (uint64_t)p->alive << 2 |
+                 (uint64_t)p->paused << 3 | (uint64_t)p->len << 8 | (uint64_t)p->score << 24;
+    h ^= p->spawn_ms * 0x9E3779B97F4A7C15ULL;
+    if (p->len > 0) {
+        h ^= ((uint64_t)(uint32_t)p->body[0].x << 32 | (uint32_t)p->body[0].y) * 0xBF58476D1CE4E5B9ULL;
+        h ^= ((uint64_t)(uint32_t)p->body[p->len - 1].x << 32 | (uint32_t)p->body[p->len - 1].y) * 0x94D049BB133111EBULL;
+    }
+    return h;
+}
+
+static bool fruits_equal(const Fruit *a, uint8_t na, const Fruit *b, uint8_t nb) {
+    if (na != nb) return false;
+    for (int f=0;f<na;f++) {
+        if (a[f].pos.x != b[f].pos.x || a[f].pos.y != b[f].pos.y) return false;
+    }
+    return true;
+}
+
+/* Copies a player keeping dst's own body storage. */
+static void copy_player(Player *dst, Cell *dst_cells, const Player *src, const Cell *src_cells) {
+    *dst = *src;
+    dst->body = dst_cells;
+    if (src->used) memcpy(dst_cells, src_cells, (size_t)src->len * sizeof(Cell));
+}
+
+static void save_state(LagFrame *f, const Game *g) {
+    for (int i=0;i<g->max_players;i++) {
+        const Player *p = &g->players[i];
+        copy_player(&f->players[i], f->cells + (size_t)i * MAX_BODY, p, p->body);
+    }
+    memcpy(f->fruits, g->fruits, sizeof(f->fruits));
+    f->num_fruits = g->num_fruits;
+    f->rng = g->rng;
+}
+
+/* Reads the tick's move scratch into f once tick_game is done with it. */
+static void note_outcome(LagFrame *f, const Game *g) {
+    for (int i=0;i<g->max_players;i++) {
+        const TickMove *m = &g->moves[i];
+        const Player *p = &g->players[i];
+        LagOutcome *o = &f->outcome[i];
+        memset(o, 0, sizeof(*o));
+        if (!(m->flags & MOVE_ACTIVE)) continue;
+        o->die = m->die;
+        o->ate = !m->die && (m->flags & MOVE_GROW);
+        o->fruit = m->fruit;
+        o->at = m->die ? p->body[0] : m->next;
+        o->score = p->score;
+    }
+}
+
+static void note_after(LagComp *lc, const Game *g) {
+    for (int i=0;i<g->max_players;i++) lc->digest[i] = player_digest(&g->players[i]);
+    memcpy(lc->fruits_after, g->fruits, sizeof(lc->fruits_after));
+    lc->num_fruits_after = g->num_fruits;
+    lc->have_after = true;
+}
+
+void lag_tick(LagComp *lc, Game *g, uint32_t dt_ms) {
+    /* tick_game does nothing else while the game is frozen. */
+    if (lc->depth == 0 || g->global_freeze_ms > 0) {
+        tick_game(g, dt_ms);
+        return;
+    }
+    uint64_t t0 = now_us();
+    uint32_t t = g->tick + 1;
+    LagFrame *f = &lc->frames[t % (uint32_t)lc->depth];
+    if (lc->count > 0 && lc->newest != t - 1) retire_all(lc);
+    /* The tick this frame held leaves the window: its result stands. */
+    if (lc->count == (uint32_t)lc->depth && lc->on_final) lc->on_final(lc->final_ctx, f, lc->max_players);
+    for (int i=0;i<g->max_players;i++) {
+        f->external[i] = !lc->have_after || player_digest(&g->players[i]) != lc->digest[i];
+    }
+    f->fruits_external = !lc->have_after ||
+                         !fruits_equal(g->fruits, g->num_fruits, lc->fruits_after, lc->num_fruits_after);
+    save_state(f, g);
+    f->tick = t;
+    f->ms = now_ms();
+    lc->newest = t;
+    if (lc->count < (uint32_t)lc->depth) lc->count++;
+    lc->stats.frames++;
+    lc->stats.frame_us += now_us() - t0;
+
+    tick_game(g, dt_ms);
+    for (int i=0;i<g->max_players;i++) f->dir_after[i] = g->players[i].dir;
+    note_outcome(f, g);
+    note_after(lc, g);
+}
+
+bool lag_input(LagComp *lc, Game *g, int slot, uint8_t dir, uint32_t seq, uint32_t client_ms, uint32_t seen_tick) {
+    if (lc->depth == 0 || seen_tick == 0 || lc->count == 0) return false;
+    uint32_t target = seen_tick + 1;
+    /* On time, or a stamp from the future. */
+    if (target > g->tick) return false;
+    Player *p = &g->players[slot];
+    /* Turns already queued keep their order behind this one. */
+    if (dir > 3 || p->input_count > 0 || (int32_t)(seq - p->input_seq) <= 0) return false;
+
+    uint32_t oldest = lc->newest - lc->count + 1;
+    bool clamped = target < oldest;
+    if (clamped) target = oldest;
+    LateInput *q = &lc->late[(size_t)slot * LAG_LATE_MAX];
+    uint8_t n = lc->late_count[slot];
+    if (n > 0 && target <= q[n - 1].tick) target = q[n - 1].tick + 1;
+    if (n == LAG_LATE_MAX || target > lc->newest) return false;
+
+    const Player *then = &lc->frames[target % (uint32_t)lc->depth].players[slot];
+    if (!then->used || !then->active || !then->alive || then->paused) return false;
+    /* A pause or respawn since would be replayed over the turn. */
+    for (uint32_t t=target+1;t<=lc->newest;t++) {
+        if (lc->frames[t % (uint32_t)lc->depth].external[slot]) return false;
+    }
+
+    p->input_seq = seq;
+    q[n] = (LateInput){ target, dir, seq, client_ms };
+    lc->late_count[slot] = (uint8_t)(n + 1);
+    if (lc->rewind_from == 0 || target < lc->rewind_from) lc->rewind_from = target;
+    lc->stats.late++;
+    if (clamped) lc->stats.clamped++;
+    return true;
+}
+
+void lag_rewind(LagComp *lc, Game *g) {
+    if (lc->rewind_from == 0) return;
+    uint64_t t0 = now_us();
+    uint32_t from = lc->rewind_from, to = lc->newest;
+    lc->rewind_from = 0;
+    int n = g->max_players;
+    const uint32_t depth = (uint32_t)lc->depth;
+
+    /* Keep the present: inputs always, and whole players changed from
+     * outside since the last tick. */
+    bool keep_fruits = !fruits_equal(g->fruits, g->num_fruits, lc->fruits_after, lc->num_fruits_after);
+    Fruit fruits[MAX_FRUITS];
+    uint8_t num_fruits = g->num_fruits;
+    memcpy(fruits, g->fruits, sizeof(fruits));
+    for (int i=0;i<n;i++) {
+        const Player *p = &g->players[i];
+        lc->keep[i] = player_digest(p) != lc->digest[i];
+        copy_player(&lc->saved[i], lc->saved_cells + (size_t)i * MAX_BODY, p, p->body);
+    }
+    uint16_t freeze = g->global_freeze_ms;
+    g->global_freeze_ms = 0;
+
+    const LagFrame *start = &lc->frames[from % depth];
+    for (int i=0;i<n;i++) {
+        copy_player(&g->players[i], g->players[i].body, &start->players[i], start->cells + (size_t)i * MAX_BODY);
+    }
+    memcpy(g->fruits, start->fruits, sizeof(g->fruits));
+    g->num_fruits = start->num_fruits;
+    g->rng = start->rng;
+    g->tick = from - 1;
+
+    for (uint32_t t=from;t<=to;t++) {
+        LagFrame *f = &lc->frames[t % depth];
+        /* Outside changes happened before this tick the first time too;
+         * replay them from the frame before it is overwritten. */
+        for (int i=0;i<n;i++) {
+            Player *p = &g->players[i];
+            uint8_t turn = (f->dir_after[i] != f->players[i].dir) ? f->dir_after[i] : 255;
+            if (t > from && f->external[i]) copy_player(p, p->body, &f->players[i], f->cells + (size_t)i * MAX_BODY);
+            p->input_count = 0;
+            p->pending_dir = turn;
+            LateInput *q = &lc->late[(size_t)i * LAG_LATE_MAX];
+            if (lc->late_count[i] > 0 && q[0].tick <= t) {
+                p->pending_dir = q[0].dir;
+                p->applied_seq = q[0].seq;
+                p->applied_ms = q[0].client_ms;
+                memmove(q, q + 1, (size_t)(--lc->late_count[i]) * sizeof(LateInput));
+            }
+        }
+        if (t > from && f->fruits_external) {
+            memcpy(g->fruits, f->fruits, sizeof(g->fruits));
+            g->num_fruits = f->num_fruits;
+        }
+        save_state(f, g);
+        g->replay_ms = f->ms;
+        tick_game(g, g->tick_ms);
+        for (int i=0;i<n;i++) f->dir_after[i] = g->players[i].dir;
+        note_outcome(f, g);
+        lc->stats.ticks++;
+    }
+    g->replay_ms = 0;
+    note_after(lc, g);
+
+    for (int i=0;i<n;i++) {
+        Player *p = &g->players[i];
+        const Player *s = &lc->saved[i];
+        if (lc->keep[i]) {
+            copy_player(p, p->body, s, lc->saved_cells + (size_t)i * MAX_BODY);
+            continue;
+        }
+        uint32_t applied_seq = p->applied_seq, applied_ms = p->applied_ms;
+        memcpy(p->inputs, s->inputs, sizeof(p->inputs));
+        p->input_head = s->input_head;
+        p->input_count = s->input_count;
+        p->input_seq = s->input_seq;
+        p->pending_dir = s->pending_dir;
+        p->connected = s->connected;
+        p->bot = s->bot;
+        if ((int32_t)(applied_seq - s->applied_seq) < 0) {
+            applied_seq = s->applied_seq;
+            applied_ms = s->applied_ms;
+        }
+        p->applied_seq = applied_seq;
+        p->applied_ms = applied_ms;
+    }
+    if (keep_fruits) {
+        memcpy(g->fruits, fruits, sizeof(g->fruits));
+        g->num_fruits = num_fruits;
+    }
+    g->global_freeze_ms = freeze;
+
+    uint64_t us = now_us() - t0;
+    lc->stats.rewinds++;
+    lc->stats.total_us += us;
+    if (us > lc->stats.max_us) lc->stats.max_us = us;
+}
+
+void lag_stats_report(LagComp *lc, FILE *out) {
+    LagStats *st = &lc->stats;
+    if (st->late == 0 && st->rewinds == 0) return;
+    fprintf(out, "lag: %llu late turns (%llu past the window), %llu rewinds of %.1f ticks, avg %llu us, max %llu us; "
+            "frames %.1f us\n",
+            (unsigned long long)st->late, (unsigned long long)st->clamped, (unsigned long long)st->rewinds,
+            st->rewinds ? (double)st->ticks / (double)st->rewinds : 0.0,
+            (unsigned long long)(st->rewinds ? st->total_us / st->rewinds : 0), (unsigned long long)st->max_us,
+            st->frames ? (double)st->frame_us / (double)st->frames : 0.0);
+    memset(st, 0, sizeof(*st));
+}
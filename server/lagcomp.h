@@ -0,0 +1,132 @@
+#ifndef LAGCOMP_H
+#define LAGCOMP_H
+
+#include "game.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Lag compensation for turns. A client stamps each MSG_INPUT with the
+ * tick of the state it was looking at; the turn was meant for the tick
+ * after that. When that tick has already run, the turn is late: it is
+ * parked here and, before the next tick, the game is rewound to the
+ * state it was in before the meant tick and the ticks since are run
+ * again with the turn applied there.
+ *
+ * Each tick leaves a frame: the state going into it (bodies, fruit, the
+ * spawn RNG) and the heading every snake left it with, so re-running a
+ * tick repeats every other snake's turns and collisions are settled by
+ * the same tick code as before. Anything changed between two ticks from
+ * outside (a join, a respawn, a pause) is flagged in the following frame
+ * and replayed from it as it happened; changes since the last tick are
+ * carried over the rewind untouched.
+ *
+ * A late turn can save a snake the tick without it killed, so turns from
+ * snakes dead now are taken too, judged by the frame they were meant
+ * for. Turns a saved snake's player sent while it lay dead were dropped;
+ * it keeps its heading until the next one.
+ *
+ * The window is bounded by depth: a turn older than that is applied at
+ * the oldest frame still held, so at most depth ticks are re-run, once
+ * per game tick however many turns came in late. Callers hold the game
+ * mutex throughout.
+ *
+ * What a tick did to each snake (a death, a fruit) is kept in its frame
+ * and rewritten when the tick is re-run, so it is only final once the
+ * frame leaves the window; on_final hears of it then, oldest first. */
+
+#define LAG_MAX_TICKS 16
+#define LAG_LATE_MAX INPUT_QUEUE_LEN
+
+/* What a tick did to one snake. */
+typedef struct {
+    uint8_t die;              /* DIE_*, DIE_NONE if it lived */
+    bool ate;
+    uint8_t fruit;
+    Cell at;                  /* the head it died with, or the fruit's cell */
+    uint16_t score;           /* after the tick */
+} LagOutcome;
+
+typedef struct {
+    uint32_t tick;            /* the tick this state went into */
+    uint64_t ms;              /* when that tick first ran, for the deaths in it */
+    uint64_t rng;
+    uint8_t num_fruits;
+    bool fruits_external;
+    Fruit fruits[MAX_FRUITS];
+    Player *players;          /* copies; their body pointers are unused */
+    Cell *cells;              /* player i's body at i * MAX_BODY */
+    uint8_t *dir_after;       /* heading each snake left the tick with */
+    bool *external;           /* changed from outside since the tick before */
+    LagOutcome *outcome;      /* what the tick did, per snake */
+} LagFrame;
+
+/* A tick no rewind can reach any more; n outcomes in f. */
+typedef void (*LagFinalFn)(void *ctx, const LagFrame *f, int n);
+
+typedef struct {
+    uint32_t tick;            /* applied at */
+    uint8_t dir;
+    uint32_t seq;
+    uint32_t client_ms;
+} LateInput;
+
+typedef struct {
+    uint64_t late;            /* turns applied in the past */
+    uint64_t clamped;         /* older than the window, applied at its start */
+    uint64_t rewinds;
+    uint64_t ticks;           /* ticks re-run */
+    uint64_t total_us;        /* in rewinds */
+    uint64_t max_us;
+    uint64_t frames;          /* frames kept, and the time spent copying them */
+    uint64_t frame_us;
+} LagStats;
+
+typedef struct {
+    int depth;                /* 0 = off */
+    int max_players;
+    LagFrame frames[LAG_MAX_TICKS];
+    uint32_t count;           /* frames held, ending at newest */
+    uint32_t newest;
+    /* The state the last tick left, to spot outside changes. */
+    uint64_t *digest;
+    Fruit fruits_after[MAX_FRUITS];
+    uint8_t num_fruits_after;
+    bool have_after;
+    LateInput *late;          /* LAG_LATE_MAX per slot, oldest first */
+    uint8_t *late_count;
+    uint32_t rewind_from;     /* earliest tick a late turn lands on, 0 = none */
+    /* The present, kept through a rewind. */
+    Player *saved;
+    Cell *saved_cells;
+    bool *keep;
+    LagFinalFn on_final;      /* NULL = nobody listening */
+    void *final_ctx;
+    LagStats stats;
+    Arena arena;              /* everything above that is a pointer */
+} LagComp;
+
+/* depth 0 leaves compensation off and lag_tick a plain tick_game. */
+bool lag_init(LagComp *lc, int max_players, int depth);
+void lag_free(LagComp *lc);
+
+/* Hands on_final every tick still held, since nothing will rewind them,
+ * then forgets the history and any parked turns: for when the game ends
+ * or is replaced wholesale by a reload, a new match or a restore. */
+void lag_reset(LagComp *lc);
+
+/* Takes a turn seen_tick says is late and returns true, or returns false
+ * for the caller to queue it as usual (or drop it, for a dead snake). */
+bool lag_input(LagComp *lc, Game *g, int slot, uint8_t dir, uint32_t seq, uint32_t client_ms, uint32_t seen_tick);
+
+/* Re-runs history for the turns taken since the last call, if any. */
+void lag_rewind(LagComp *lc, Game *g);
+
+/* tick_game, keeping a frame of the tick. */
+void lag_tick(LagComp *lc, Game *g, uint32_t dt_ms);
+
+/* Prints and clears the stats, when there is anything to say. */
+void lag_stats_report(LagComp *lc, FILE *out);
+
+#endif
@@ -0,0 +1,5 @@
+#include "server.h"
+
+int main(int argc, char **argv) {
+    return run_server(argc, argv, -1);
+}
@@ -0,0 +1,479 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mapgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CAVE_STEPS 4
+#define MAX_ATTEMPTS 8
+#define ROOM_TILE_W 16
+#define ROOM_TILE_H 10
+
+static const char *const style_names[] = { "open", "caves", "rooms", "scatter" };
+static const int default_density[] = { 0, 45, 15, 12 };
+
+/* Walls are 1 bits. Bits past w in a row's last word are kept as wall
+ * while the board is built, so the edges need no special cases. */
+typedef struct {
+    uint64_t *bits;
+    int w, h;
+    size_t stride;              /* words per row */
+} Grid;
+
+static uint64_t splitmix(uint64_t *s) {
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint32_t below(uint64_t *s, uint32_t n) {
+    return (uint32_t)(((splitmix(s) >> 32) * (uint64_t)n) >> 32);
+}
+
+static uint64_t *grid_row(const Grid *g, int y) {
+    return g->bits + (size_t)y * g->stride;
+}
+
+static uint64_t tail_mask(const Grid *g) {
+    int r = g->w & 63;
+    return r ? (~0ULL << r) : 0;
+}
+
+static void set_tail(Grid *g, bool wall) {
+    uint64_t m = tail_mask(g);
+    if (!m) return;
+    for (int y=0;y<g->h;y++) {
+        uint64_t *r = grid_row(g, y);
+        if (wall) r[g->stride - 1] |= m;
+        else r[g->stride - 1] &= ~m;
+    }
+}
+
+/* Inclusive rectangle, clipped to the board. */
+static void fill_rect(Grid *g, int x0, int y0, int x1, int y1, bool wall) {
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= g->w) x1 = g->w - 1;
+    if (y1 >= g->h) y1 = g->h - 1;
+    if (x0 > x1 || y0 > y1) return;
+    for (int y=y0;y<=y1;y++) {
+        uint64_t *r = grid_row(g, y);
+        for (int k=x0>>6;k<=(x1>>6);k++) {
+            int lo = (x0 > k * 64) ? x0 - k * 64 : 0;
+            int hi = (x1 < k * 64 + 63) ? x1 - k * 64 : 63;
+            uint64_t m = (~0ULL << lo) & (~0ULL >> (63 - hi));
+            if (wall) r[k] |= m;
+            else r[k] &= ~m;
+        }
+    }
+}
+
+static void border(Grid *g) {
+    fill_rect(g, 0, 0, g->w - 1, 0, true);
+    fill_rect(g, 0, g->h - 1, g->w - 1, g->h - 1, true);
+    fill_rect(g, 0, 0, 0, g->h - 1, true);
+    fill_rect(g, g->w - 1, 0, g->w - 1, g->h - 1, true);
+}
+
+/* ---- caves ---- */
+
+/* Each bit is a wall with probability p/256: walking p's bits from the
+ * bottom, a 1 ORs in a fresh random word and a 0 ANDs one in. */
+static void random_fill(Grid *g, int percent, uint64_t *rng) {
+    uint32_t p = (uint32_t)(percent * 256 / 100);
+    if (p < 1) p = 1;
+    if (p > 255) p = 255;
+    size_t n = g->stride * (size_t)g->h;
+    for (size_t i=0;i<n;i++) {
+        uint64_t v = 0;
+        for (int b=0;b<8;b++) v = ((p >> b) & 1) ? (v | splitmix(rng)) : (v & splitmix(rng));
+        g->bits[i] = v;
+    }
+    set_tail(g, true);
+    border(g);
+}
+
+/* A cell and its left and right neighbours summed as two bit planes. */
+static inline void row_sum3(const uint64_t *r, size_t k, size_t stride, uint64_t *ones, uint64_t *twos) {
+    uint64_t c = r[k];
+    uint64_t l = (c << 1) | ((k > 0) ? (r[k - 1] >> 63) : 1);
+    uint64_t rt = (c >> 1) | ((k + 1 < stride) ? (r[k + 1] << 63) : (1ULL << 63));
+    *ones = l ^ c ^ rt;
+    *twos = (l & c) | (rt & (l ^ c));
+}
+
+/* One smoothing step, 64 cells at a time: a cell becomes wall when five
+ * or more of the nine cells around it (itself included) are. The nine
+ * bits are added with bit-sliced full adders; off the board counts as
+ * wall. */
+static void cave_step(const Grid *src, Grid *dst, const uint64_t *solid) {
+    for (int y=0;y<src->h;y++) {
+        const uint64_t *up = (y > 0) ? grid_row(src, y - 1) : solid;
+        const uint64_t *mid = grid_row(src, y);
+        const uint64_t *dn = (y + 1 < src->h) ? grid_row(src, y + 1) : solid;
+        uint64_t *out = grid_row(dst, y);
+        for (size_t k=0;k<src->stride;k++) {
+            uint64_t oa, ta, ob, tb, oc, tc;
+            row_sum3(up, k, src->stride, &oa, &ta);
+            row_sum3(mid, k, src->stride, &ob, &tb);
+            row_sum3(dn, k, src->stride, &oc, &tc);
+            uint64_t s0 = oa ^ ob ^ oc;
+            uint64_t c1 = (oa & ob) | (oc & (oa ^ ob));
+            uint64_t t0 = ta ^ tb ^ tc;
+            uint64_t t1 = (ta & tb) | (tc & (ta ^ tb));
+            uint64_t s1 = t0 ^ c1;
+            uint64_t u1 = t0 & c1;
+            uint64_t s2 = t1 ^ u1;
+            uint64_t s3 = t1 & u1;
+            out[k] = s3 | (s2 & (s1 | s0));
+        }
+    }
+}
+
+static bool gen_caves(Grid *g, int density, uint64_t *rng) {
+    random_fill(g, density, rng);
+    Grid tmp = *g;
+    tmp.bits = (uint64_t*)malloc(g->stride * (size_t)g->h * sizeof(uint64_t));
+    uint64_t *solid = (uint64_t*)malloc(g->stride * sizeof(uint64_t));
+    if (!tmp.bits || !solid) {
+        free(tmp.bits);
+        free(solid);
+        return false;
+    }
+    memset(solid, 0xFF, g->stride * sizeof(uint64_t));
+    for (int i=0;i<CAVE_STEPS;i++) {
+        cave_step(g, &tmp, solid);
+        uint64_t *t = g->bits;
+        g->bits = tmp.bits;
+        tmp.bits = t;
+        set_tail(g, true);
+        border(g);
+    }
+    free(tmp.bits);
+    free(solid);
+    return true;
+}
+
+/* ---- rooms ---- */
+
+typedef struct {
+    int cx, cy;
+} Room;
+
+static uint32_t uf_find(uint32_t *parent, uint32_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/* Returns false when a and b were already joined. */
+static bool uf_union(uint32_t *parent, uint32_t a, uint32_t b) {
+    a = uf_find(parent, a);
+    b = uf_find(parent, b);
+    if (a == b) return false;
+    if (a < b) parent[b] = a;
+    else parent[a] = b;
+    return true;
+}
+
+static void corridor(Grid *g, const Room *a, const Room *b, uint64_t *rng) {
+    if (splitmix(rng) & 1) {
+        fill_rect(g, (a->cx < b->cx) ? a->cx : b->cx, a->cy, (a->cx < b->cx) ? b->cx : a->cx, a->cy, false);
+        fill_rect(g, b->cx, (a->cy < b->cy) ? a->cy : b->cy, b->cx, (a->cy < b->cy) ? b->cy : a->cy, false);
+    } else {
+        fill_rect(g, a->cx, (a->cy < b->cy) ? a->cy : b->cy, a->cx, (a->cy < b->cy) ? b->cy : a->cy, false);
+        fill_rect(g, (a->cx < b->cx) ? a->cx : b->cx, b->cy, (a->cx < b->cx) ? b->cx : a->cx, b->cy, false);
+    }
+}
+
+/* One room per tile of a grid, a random spanning tree of corridors
+ * between neighbouring tiles (so every room is reachable), and density %
+ * of the remaining neighbour pairs joined as well for loops. */
+static bool gen_rooms(Grid *g, int density, uint64_t *rng) {
+    memset(g->bits, 0xFF, g->stride * (size_t)g->h * sizeof(uint64_t));
+    int iw = g->w - 2, ih = g->h - 2;
+    int nx = (iw / ROOM_TILE_W > 0) ? iw / ROOM_TILE_W : 1;
+    int ny = (ih / ROOM_TILE_H > 0) ? ih / ROOM_TILE_H : 1;
+    size_t tiles = (size_t)nx * (size_t)ny;
+    Room *rooms = (Room*)malloc(tiles * sizeof(Room));
+    uint32_t *parent = (uint32_t*)malloc(tiles * sizeof(uint32_t));
+    uint32_t *edges = (uint32_t*)malloc(tiles * 2 * sizeof(uint32_t));
+    if (!rooms || !parent || !edges) {
+        free(rooms);
+        free(parent);
+        free(edges);
+        return false;
+    }
+
+    for (int ty=0;ty<ny;ty++) {
+        int y0 = 1 + (int)((int64_t)ty * ih / ny), y1 = (int)((int64_t)(ty + 1) * ih / ny);
+        for (int tx=0;tx<nx;tx++) {
+            int x0 = 1 + (int)((int64_t)tx * iw / nx), x1 = (int)((int64_t)(tx + 1) * iw / nx);
+            int aw = x1 - x0 + 1, ah = y1 - y0 + 1;
+            /* Leave a wall between this room and the next tile's. */
+            int mw = (aw > 4) ? aw - 1 : aw, mh = (ah > 4) ? ah - 1 : ah;
+            int lw = (mw < 3) ? mw : 3, lh = (mh < 3) ? mh : 3;
+            int rw = lw + (int)below(rng, (uint32_t)(mw - lw + 1));
+            int rh = lh + (int)below(rng, (uint32_t)(mh - lh + 1));
+            int rx = x0 + (int)below(rng, (uint32_t)(mw - rw + 1));
+            int ry = y0 + (int)below(rng, (uint32_t)(mh - rh + 1));
+            fill_rect(g, rx, ry, rx + rw - 1, ry + rh - 1, false);
+            size_t i = (size_t)ty * (size_t)nx + (size_t)tx;
+            rooms[i].cx = rx + (int)below(rng, (uint32_t)rw);
+            rooms[i].cy = ry + (int)below(rng, (uint32_t)rh);
+            parent[i] = (uint32_t)i;
+        }
+    }
+
+    /* Edge e joins tile e/2 to its right (even e) or lower (odd e)
+     * neighbour; Kruskal over a shuffled list gives a random tree. */
+    size_t ne = 0;
+    for (size_t i=0;i<tiles;i++) {
+        if ((int)(i % (size_t)nx) + 1 < nx) edges[ne++] = (uint32_t)(i * 2);
+        if ((int)(i / (size_t)nx) + 1 < ny) edges[ne++] = (uint32_t)(i * 2 + 1);
+    }
+    for (size_t i=ne;i>1;i--) {
+        size_t j = below(rng, (uint32_t)i);
+        uint32_t t = edges[i - 1];
+        edges[i - 1] = edges[j];
+        edges[j] = t;
+    }
+    for (size_t e=0;e<ne;e++) {
+        uint32_t a = edges[e] / 2;
+        uint32_t b = (edges[e] & 1) ? a + (uint32_t)nx : a + 1;
+        bool tree = uf_union(parent, a, b);
+        if (tree || (int)below(rng, 100) < density) corridor(g, &rooms[a], &rooms[b], rng);
+    }
+
+    free(rooms);
+    free(parent);
+    free(edges);
+    set_tail(g, true);
+    border(g);
+    return true;
+}
+
+/* ---- scatter ---- */
+
+static void gen_scatter(Grid *g, int density, uint64_t *rng) {
+    memset(g->bits, 0, g->stride * (size_t)g->h * sizeof(uint64_t));
+    set_tail(g, true);
+    border(g);
+    /* Blocks of 1..5 x 1..5 cells, nine on average. */
+    uint64_t area = (uint64_t)(g->w - 2) * (uint64_t)(g->h - 2);
+    uint64_t blocks = area * (uint64_t)density / 100u / 9u;
+    for (uint64_t i=0;i<blocks;i++) {
+        int bw = 1 + (int)below(rng, 5), bh = 1 + (int)below(rng, 5);
+        int x = 1 + (int)below(rng, (uint32_t)(g->w - 2));
+        int y = 1 + (int)below(rng, (uint32_t)(g->h - 2));
+        fill_rect(g, x, y, x + bw - 1, y + bh - 1, true);
+    }
+}
+
+/* ---- reachability ---- */
+
+typedef struct {
+    uint32_t *x0;
+    uint32_t *x1;
+    uint32_t *parent;
+    size_t n, cap;
+} Runs;
+
+static void runs_free(Runs *r) {
+    free(r->x0);
+    free(r->x1);
+    free(r->parent);
+}
+
+static bool runs_push(Runs *r, uint32_t x0, uint32_t x1) {
+    if (r->n == r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 4096;
+        uint32_t *a = (uint32_t*)realloc(r->x0, cap * sizeof(uint32_t));
+        if (a) r->x0 = a;
+        uint32_t *b = (uint32_t*)realloc(r->x1, cap * sizeof(uint32_t));
+        if (b) r->x1 = b;
+        uint32_t *c = (uint32_t*)realloc(r->parent, cap * sizeof(uint32_t));
+        if (c) r->parent = c;
+        if (!a || !b || !c) return false;
+        r->cap = cap;
+    }
+    r->x0[r->n] = x0;
+    r->x1[r->n] = x1;
+    r->parent[r->n] = (uint32_t)r->n;
+    r->n++;
+    return true;
+}
+
+/* First cell at or after x that is open (want_open) or wall, else w. */
+static int next_cell(const Grid *g, const uint64_t *r, int x, bool want_open) {
+    size_t k = (size_t)x >> 6;
+    uint64_t v = (want_open ? ~r[k] : r[k]) & (~0ULL << (x & 63));
+    while (!v) {
+        if (++k >= g->stride) return g->w;
+        v = want_open ? ~r[k] : r[k];
+    }
+    int at = (int)(k * 64) + __builtin_ctzll(v);
+    return (at < g->w) ? at : g->w;
+}
+
+/* Walls up every open region but the largest; returns the open cells
+ * left, or -1 when out of memory. */
+static int64_t seal_pockets(Grid *g, MapGenStats *st) {
+    Runs runs;
+    memset(&runs, 0, sizeof(runs));
+    uint32_t *first = (uint32_t*)malloc(((size_t)g->h + 1) * sizeof(uint32_t));
+    if (!first) return -1;
+
+    bool ok = true;
+    for (int y=0;y<g->h && ok;y++) {
+        const uint64_t *r = grid_row(g, y);
+        first[y] = (uint32_t)runs.n;
+        for (int x=next_cell(g, r, 0, true);x<g->w && ok;) {
+            int e = next_cell(g, r, x, false);
+            ok = runs_push(&runs, (uint32_t)x, (uint32_t)(e - 1));
+            x = (e < g->w) ? next_cell(g, r, e, true) : g->w;
+        }
+        if (!ok || y == 0) continue;
+        /* Runs in two rows touch when their spans overlap. */
+        size_t i = first[y - 1], j = first[y];
+        size_t ie = first[y], je = runs.n;
+        while (i < ie && j < je) {
+            if (runs.x1[i] < runs.x0[j]) { i++; continue; }
+            if (runs.x1[j] < runs.x0[i]) { j++; continue; }
+            (void)uf_union(runs.parent, (uint32_t)i, (uint32_t)j);
+            if (runs.x1[i] < runs.x1[j]) i++;
+            else j++;
+        }
+    }
+    first[g->h] = (uint32_t)runs.n;
+
+    uint64_t *size = ok ? (uint64_t*)calloc(runs.n ? runs.n : 1, sizeof(uint64_t)) : NULL;
+    if (!size) {
+        runs_free(&runs);
+        free(first);
+        return -1;
+    }
+    uint32_t best = 0;
+    uint32_t regions = 0;
+    for (size_t i=0;i<runs.n;i++) {
+        uint32_t root = uf_find(runs.parent, (uint32_t)i);
+        if (root == i) regions++;
+        size[root] += runs.x1[i] - runs.x0[i] + 1;
+        if (size[root] > size[best]) best = root;
+    }
+    int64_t open = runs.n ? (int64_t)size[best] : 0;
+    uint64_t sealed = 0;
+    for (int y=0;y<g->h;y++) {
+        for (uint32_t i=first[y];i<first[y + 1];i++) {
+            if (uf_find(runs.parent, i) == best) continue;
+            fill_rect(g, (int)runs.x0[i], y, (int)runs.x1[i], y, true);
+            sealed += runs.x1[i] - runs.x0[i] + 1;
+        }
+    }
+    st->runs = (uint32_t)runs.n;
+    st->sealed_regions = regions ? regions - 1 : 0;
+    st->sealed_cells = sealed;
+    st->open_cells = (uint64_t)open;
+
+    free(size);
+    runs_free(&runs);
+    free(first);
+    return open;
+}
+
+/* ---- entry points ---- */
+
+bool mapgen_parse(const char *s, MapGenSpec *spec) {
+    if (strncmp(s, "gen:", 4) != 0) return false;
+    s += 4;
+    memset(spec, 0, sizeof(*spec));
+    size_t n = strcspn(s, ":");
+    int style = -1;
+    for (int i=0;i<(int)(sizeof(style_names)/sizeof(style_names[0]));i++) {
+        if (strlen(style_names[i]) == n && strncmp(s, style_names[i], n) == 0) style = i;
+    }
+    if (style < 0) return false;
+    spec->style = (MapGenStyle)style;
+    s += n;
+    if (*s == ':') {
+        char *end;
+        spec->seed = strtoull(s + 1, &end, 10);
+        if (end == s + 1) return false;
+        s = end;
+    }
+    if (*s == ':') {
+        char *end;
+        long d = strtol(s + 1, &end, 10);
+        if (end == s + 1 || d < 0 || d > 100) return false;
+        spec->density = (int)d;
+        s = end;
+    }
+    return *s == 0;
+}
+
+void mapgen_format(const MapGenSpec *spec, char *buf, size_t cap) {
+    int n = snprintf(buf, cap, "gen:%s:%llu", style_names[spec->style], (unsigned long long)spec->seed);
+    if (spec->density > 0 && n > 0 && (size_t)n < cap) (void)snprintf(buf + n, cap - (size_t)n, ":%d", spec->density);
+}
+
+uint64_t mapgen_random_seed(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t s = ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec ^ ((uint64_t)getpid() << 16);
+    uint64_t seed = splitmix(&s) % 1000000000ULL;
+    return seed ? seed : 1;
+}
+
+bool mapgen_build(World *wd, int w, int h, const MapGenSpec *spec, MapGenStats *stats) {
+    MapGenStats local;
+    MapGenStats *st = stats ? stats : &local;
+    memset(st, 0, sizeof(*st));
+    if (w < 5 || h < 5 || (uint64_t)w * (uint64_t)h > MAPGEN_MAX_CELLS) return false;
+
+    Grid g;
+    g.w = w;
+    g.h = h;
+    g.stride = ((size_t)w + 63) / 64;
+    g.bits = (uint64_t*)malloc(g.stride * (size_t)h * sizeof(uint64_t));
+    if (!g.bits) return false;
+
+    int density = spec->density ? spec->density : default_density[spec->style];
+    uint64_t rng = spec->seed;
+    /* A seed whose largest region is under an eighth of the board (dense
+     * caves can crumble into pockets) moves on to a derived one. */
+    uint64_t want = (uint64_t)(w - 2) * (uint64_t)(h - 2) / 8u;
+    bool ok = false;
+    for (uint32_t attempt=1;attempt<=MAX_ATTEMPTS && !ok;attempt++) {
+        st->attempts = attempt;
+        bool built = true;
+        switch (spec->style) {
+            case MAPGEN_CAVES: built = gen_caves(&g, density, &rng); break;
+            case MAPGEN_ROOMS: built = gen_rooms(&g, density, &rng); break;
+            case MAPGEN_SCATTER: gen_scatter(&g, density, &rng); break;
+            default:
+                memset(g.bits, 0, g.stride * (size_t)h * sizeof(uint64_t));
+                set_tail(&g, true);
+                border(&g);
+                break;
+        }
+        if (!built) break;
+        int64_t open = seal_pockets(&g, st);
+        if (open < 0) break;
+        ok = open > 0 && ((uint64_t)open >= want || attempt == MAX_ATTEMPTS);
+    }
+
+    if (ok) {
+        set_tail(&g, false);
+        ok = world_init(wd, w, h) && world_load_bits(wd, g.bits);
+        if (!ok) world_free(wd);
+    }
+    free(g.bits);
+    return ok;
+}
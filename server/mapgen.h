@@ -0,0 +1,50 @@
+#ifndef MAPGEN_H
+#define MAPGEN_H
+
+#include "../common/world.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Seeded procedural boards, named on the command line or in a reload file
+ * as "gen:STYLE[:SEED[:DENSITY]]", e.g. gen:caves:42 or gen:scatter:7:20.
+ * The same style, seed, density and size always give the same board.
+ *
+ * The board is built as a bit grid, 64 cells to a word, with a wall
+ * border. Afterwards one union-find pass over the runs of open cells in
+ * each row finds the 4-connected regions; every region but the largest
+ * is walled up, so a snake can reach any open cell from any other. */
+typedef enum {
+    MAPGEN_OPEN,        /* border only */
+    MAPGEN_CAVES,       /* cellular-automaton caves; density = initial fill % */
+    MAPGEN_ROOMS,       /* rooms on a jittered grid joined by corridors */
+    MAPGEN_SCATTER      /* open floor with small blocks; density = % covered */
+} MapGenStyle;
+
+typedef struct {
+    MapGenStyle style;
+    uint64_t seed;      /* 0 until one is picked */
+    int density;        /* percent; 0 picks the style's default */
+} MapGenSpec;
+
+typedef struct {
+    uint64_t open_cells;
+    uint64_t sealed_cells;      /* open cells walled up as unreachable */
+    uint32_t sealed_regions;
+    uint32_t runs;
+    uint32_t attempts;          /* seeds tried before the floor was big enough */
+} MapGenStats;
+
+/* Keeps the bit grid and the run tables within a few hundred MiB. */
+#define MAPGEN_MAX_CELLS (8192ULL * 8192ULL)
+
+/* Accepts "gen:..." only; false for anything else or a malformed spec. */
+bool mapgen_parse(const char *s, MapGenSpec *spec);
+void mapgen_format(const MapGenSpec *spec, char *buf, size_t cap);
+uint64_t mapgen_random_seed(void);
+
+/* Initialises wd as a w x h board. stats may be NULL. */
+bool mapgen_build(World *wd, int w, int h, const MapGenSpec *spec, MapGenStats *stats);
+
+#endif
@@ -0,0 +1,130 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Chunks per thread: enough to even out uneven snakes, few enough that the
+ * shared counter is not contended. */
+#define POOL_CHUNKS_PER_THREAD 8
+
+struct WorkerPool {
+    int threads;
+    pthread_t *tids;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    bool stop;
+    unsigned long generation;
+    int busy;
+
+    pool_fn fn;
+    void *ctx;
+    int n;
+    int chunk;
+    atomic_int next;
+};
+
+static void run_chunks(WorkerPool *pool) {
+    for (;;) {
+        int begin = atomic_fetch_add(&pool->next, pool->chunk);
+        if (begin >= pool->n) break;
+        int end = begin + pool->chunk;
+        if (end > pool->n) end = pool->n;
+        pool->fn(pool->ctx, begin, end);
+    }
+}
+
+static void *worker_main(void *arg) {
+    WorkerPool *pool = (WorkerPool*)arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->mtx);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen) pthread_cond_wait(&pool->work_cv, &pool->mtx);
+        if (pool->stop) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->mtx);
+
+        run_chunks(pool);
+
+        pthread_mutex_lock(&pool->mtx);
+        if (--pool->busy == 0) pthread_cond_signal(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->mtx);
+    return NULL;
+}
+
+WorkerPool *pool_create(int threads) {
+    if (threads < 1) threads = 1;
+    WorkerPool *pool = (WorkerPool*)calloc(1, sizeof(WorkerPool));
+    if (!pool) return NULL;
+
+    /* The caller of pool_run() works too, so only threads-1 are spawned. */
+    pool->threads = threads;
+    pool->tids = (pthread_t*)calloc((size_t)threads, sizeof(pthread_t));
+    if (!pool->tids) { free(pool); return NULL; }
+    pthread_mutex_init(&pool->mtx, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+    atomic_init(&pool->next, 0);
+
+    for (int i=1;i<threads;i++) {
+        if (pthread_create(&pool->tids[i], NULL, worker_main, pool) != 0) {
+            pool->threads = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+void pool_destroy(WorkerPool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->mtx);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->mtx);
+    for (int i=1;i<pool->threads;i++) pthread_join(pool->tids[i], NULL);
+
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_cond_destroy(&pool->done_cv);
+    pthread_mutex_destroy(&pool->mtx);
+    free(pool->tids);
+    free(pool);
+}
+
+int pool_threads(const WorkerPool *pool) {
+    return pool ? pool->threads : 1;
+}
+
+void pool_run(WorkerPool *pool, pool_fn fn, void *ctx, int n) {
+    if (n <= 0) return;
+    if (!pool || pool->threads == 1) {
+        fn(ctx, 0, n);
+        return;
+    }
+
+    int chunks = pool->threads * POOL_CHUNKS_PER_THREAD;
+    int chunk = (n + chunks - 1) / chunks;
+
+    pthread_mutex_lock(&pool->mtx);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->n = n;
+    pool->chunk = (chunk < 1) ? 1 : chunk;
+    atomic_store(&pool->next, 0);
+    pool->busy = pool->threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->mtx);
+
+    run_chunks(pool);
+
+    pthread_mutex_lock(&pool->mtx);
+    while (pool->busy > 0) pthread_cond_wait(&pool->done_cv, &pool->mtx);
+    pthread_mutex_unlock(&pool->mtx);
+}
@@ -0,0 +1,19 @@
+#ifndef POOL_H
+#define POOL_H
+
+/* Fixed-size pool of worker threads for data-parallel loops. pool_run()
+ * splits [0, n) into chunks that the workers and the calling thread claim
+ * until none are left, and returns once every chunk has finished. */
+
+typedef void (*pool_fn)(void *ctx, int begin, int end);
+
+typedef struct WorkerPool WorkerPool;
+
+WorkerPool *pool_create(int threads);
+void pool_destroy(WorkerPool *pool);
+int pool_threads(const WorkerPool *pool);
+
+/* A NULL pool runs fn(ctx, 0, n) on the caller. */
+void pool_run(WorkerPool *pool, pool_fn fn, void *ctx, int n);
+
+#endif
@@ -0,0 +1,118 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "reload.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int clampi(int v, int lo, int hi) {
+    if (v < lo) return lo;
+    if (v > hi) return hi;
+    return v;
+}
+
+void reload_spec_from_game(const Game *g, ReloadSpec *rs) {
+    memset(rs, 0, sizeof(*rs));
+    if (strncmp(g->map_path, "generated:", 10) == 0) (void)snprintf(rs->map, sizeof(rs->map), "-");
+    else (void)snprintf(rs->map, sizeof(rs->map), "%s", g->map_path);
+    rs->mode = g->mode;
+    rs->world = g->world;
+    rs->time_limit = g->time_limit_sec;
+    rs->tick_ms = (int)g->tick_ms;
+    rs->w = g->w;
+    rs->h = g->h;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    size_t n = strlen(s);
+    while (n > 0 && isspace((unsigned char)s[n-1])) s[--n] = 0;
+    return s;
+}
+
+bool reload_spec_read(const char *path, ReloadSpec *rs, char *err, size_t errlen) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        (void)snprintf(err, errlen, "cannot open %s", path);
+        return false;
+    }
+
+    char line[512];
+    int lineno = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *s = trim(line);
+        if (s[0] == 0 || s[0] == '#') continue;
+        char *eq = strchr(s, '=');
+        if (!eq) {
+            (void)snprintf(err, errlen, "%s:%d: expected key = value", path, lineno);
+            ok = false;
+            break;
+        }
+        *eq = 0;
+        char *key = trim(s);
+        char *val = trim(eq + 1);
+
+        if (strcmp(key, "map") == 0) (void)snprintf(rs->map, sizeof(rs->map), "%s", val);
+        else if (strcmp(key, "mode") == 0) rs->mode = atoi(val);
+        else if (strcmp(key, "world") == 0) rs->world = atoi(val);
+        else if (strcmp(key, "time_limit") == 0) rs->time_limit = atoi(val);
+        else if (strcmp(key, "tick_ms") == 0) rs->tick_ms = atoi(val);
+        else if (strcmp(key, "w") == 0) rs->w = atoi(val);
+        else if (strcmp(key, "h") == 0) rs->h = atoi(val);
+        else {
+            (void)snprintf(err, errlen, "%s:%d: unknown key '%s'", path, lineno, key);
+            ok = false;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+bool reload_build(const ReloadSpec *rs, Game *scratch, char *err, size_t errlen) {
+    scratch->mode = (rs->mode == 1) ? 1 : 0;
+    scratch->world = (rs->world == 0) ? 0 : 1;
+    scratch->time_limit_sec = (uint16_t)clampi(rs->time_limit, 5, 3600);
+    scratch->tick_ms = (uint32_t)clampi(rs->tick_ms, 20, 1000);
+
+    if (strcmp(rs->map, "-") == 0) {
+        int w = clampi(rs->w, 10, WORLD_MAX_DIM);
+        int h = clampi(rs->h, 10, WORLD_MAX_DIM);
+        gen_map(scratch, w, h, scratch->world == 1);
+        if (!scratch->map.regions) {
+            (void)snprintf(err, errlen, "cannot allocate a %dx%d board", w, h);
+            return false;
+        }
+        (void)snprintf(scratch->map_path, sizeof(scratch->map_path), "generated:%dx%d", w, h);
+        return true;
+    }
+
+    MapGenSpec spec;
+    if (mapgen_parse(rs->map, &spec)) {
+        int w = clampi(rs->w, 10, WORLD_MAX_DIM);
+        int h = clampi(rs->h, 10, WORLD_MAX_DIM);
+        if ((uint64_t)w * (uint64_t)h > MAPGEN_MAX_CELLS) {
+            (void)snprintf(err, errlen, "%dx%d is too large for a generated map", w, h);
+            return false;
+        }
+        if (spec.seed == 0) spec.seed = mapgen_random_seed();
+        /* Procedural boards have walls, so they never wrap. */
+        scratch->world = 1;
+        if (!gen_map_seeded(scratch, w, h, &spec)) {
+            (void)snprintf(err, errlen, "cannot generate a %dx%d board", w, h);
+            return false;
+        }
+        mapgen_format(&spec, scratch->map_path, sizeof(scratch->map_path));
+        return true;
+    }
+
+    if (!load_map_file(rs->map, scratch)) {
+        (void)snprintf(err, errlen, "failed to load map %s", rs->map);
+        return false;
+    }
+    (void)snprintf(scratch->map_path, sizeof(scratch->map_path), "%s", rs->map);
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include "game.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* What a hot reload may change. A reload file holds "key = value" lines
+ * for any of map, mode, world, time_limit, tick_ms, w and h; keys it does
+ * not mention keep their current values. map "-" means a generated board
+ * of w x h, and a "gen:" spec a procedural one (see mapgen.h). */
+typedef struct {
+    char map[256];
+    int mode;
+    int world;
+    int time_limit;
+    int tick_ms;
+    int w, h;
+} ReloadSpec;
+
+void reload_spec_from_game(const Game *g, ReloadSpec *rs);
+bool reload_spec_read(const char *path, ReloadSpec *rs, char *err, size_t errlen);
+
+/* Builds the board and parameters into a zeroed scratch Game, off the
+ * game mutex; only map, w, h, mode, world, time_limit_sec, tick_ms and
+ * map_path are filled in. */
+bool reload_build(const ReloadSpec *rs, Game *scratch, char *err, size_t errlen);
+
+#endif
@@ -0,0 +1,100 @@
+#include "segs.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEGS_X86 1
+#endif
+
+long seg_find_scalar(const int32_t *xs, const int32_t *ys, size_t n, int32_t x, int32_t y) {
+    for (size_t i=0;i<n;i++) {
+        if (xs[i] == x && ys[i] == y) return (long)i;
+    }
+    return -1;
+}
+
+#ifdef SEGS_X86
+
+/* Both kernels compare a block of x and a block of y against the query,
+ * AND the masks and stop at the first lane that matched both. */
+
+__attribute__((target("sse2")))
+static long seg_find_sse2(const int32_t *xs, const int32_t *ys, size_t n, int32_t x, int32_t y) {
+    __m128i qx = _mm_set1_epi32(x);
+    __m128i qy = _mm_set1_epi32(y);
+    size_t i = 0;
+    for (;i + 4 <= n;i += 4) {
+        __m128i ex = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(xs + i)), qx);
+        __m128i ey = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(ys + i)), qy);
+        int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(ex, ey)));
+        if (m) return (long)(i + (size_t)__builtin_ctz((unsigned)m));
+    }
+    long r = seg_find_scalar(xs + i, ys + i, n - i, x, y);
+    return (r < 0) ? -1 : (long)i + r;
+}
+
+__attribute__((target("avx2")))
+static long seg_find_avx2(const int32_t *xs, const int32_t *ys, size_t n, int32_t x, int32_t y) {
+    __m256i qx = _mm256_set1_epi32(x);
+    __m256i qy = _mm256_set1_epi32(y);
+    size_t i = 0;
+    /* Two blocks per pass keeps both load ports busy on long tables. */
+    for (;i + 16 <= n;i += 16) {
+        __m256i a = _mm256_and_si256(
+            _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(xs + i)), qx),
+            _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(ys + i)), qy));
+        __m256i b = _mm256_and_si256(
+            _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(xs + i + 8)), qx),
+            _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(ys + i + 8)), qy));
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) {
+            int ma = _mm256_movemask_ps(_mm256_castsi256_ps(a));
+            if (ma) return (long)(i + (size_t)__builtin_ctz((unsigned)ma));
+            int mb = _mm256_movemask_ps(_mm256_castsi256_ps(b));
+            return (long)(i + 8 + (size_t)__builtin_ctz((unsigned)mb));
+        }
+    }
+    for (;i + 8 <= n;i += 8) {
+        __m256i a = _mm256_and_si256(
+            _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(xs + i)), qx),
+            _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(ys + i)), qy));
+        int m = _mm256_movemask_ps(_mm256_castsi256_ps(a));
+        if (m) return (long)(i + (size_t)__builtin_ctz((unsigned)m));
+    }
+    long r = seg_find_scalar(xs + i, ys + i, n - i, x, y);
+    return (r < 0) ? -1 : (long)i + r;
+}
+
+seg_find_fn seg_kernel_sse2(void) {
+    return __builtin_cpu_supports("sse2") ? seg_find_sse2 : NULL;
+}
+
+seg_find_fn seg_kernel_avx2(void) {
+    return __builtin_cpu_supports("avx2") ? seg_find_avx2 : NULL;
+}
+
+#else
+
+seg_find_fn seg_kernel_sse2(void) { return NULL; }
+seg_find_fn seg_kernel_avx2(void) { return NULL; }
+
+#endif
+
+static seg_find_fn g_kernel;
+static const char *g_kernel_name = "scalar";
+
+/* Racing first calls all pick the same kernel, so the stores are benign. */
+seg_find_fn seg_kernel(void) {
+    seg_find_fn k = __atomic_load_n(&g_kernel, __ATOMIC_RELAXED);
+    if (k) return k;
+    const char *name = "scalar";
+    k = seg_find_scalar;
+    if (seg_kernel_avx2()) { k = seg_kernel_avx2(); name = "avx2"; }
+    else if (seg_kernel_sse2()) { k = seg_kernel_sse2(); name = "sse2"; }
+    __atomic_store_n(&g_kernel_name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_kernel, k, __ATOMIC_RELAXED);
+    return k;
+}
+
+const char *seg_kernel_name(void) {
+    (void)seg_kernel();
+    return __atomic_load_n(&g_kernel_name, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,33 @@
+#ifndef SEGS_H
+#define SEGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Every live segment's coordinates packed into two parallel arrays, so a
+ * point test is a straight scan the vector kernels below can chew through
+ * eight cells at a time. Built from the bodies on demand; see game.c. */
+typedef struct {
+    int32_t *x;
+    int32_t *y;
+    uint32_t count;
+    uint32_t cap;
+} SegTable;
+
+/* Index of the first segment at (x, y), or -1. */
+typedef long (*seg_find_fn)(const int32_t *xs, const int32_t *ys, size_t n, int32_t x, int32_t y);
+
+long seg_find_scalar(const int32_t *xs, const int32_t *ys, size_t n, int32_t x, int32_t y);
+/* NULL when the build or the CPU lacks the instruction set. */
+seg_find_fn seg_kernel_sse2(void);
+seg_find_fn seg_kernel_avx2(void);
+
+/* The widest kernel this CPU runs, picked on first use. */
+seg_find_fn seg_kernel(void);
+const char *seg_kernel_name(void);
+
+static inline long seg_find(const SegTable *t, int32_t x, int32_t y) {
+    return seg_kernel()(t->x, t->y, t->count, x, y);
+}
+
+#endif
@@ -1,32 +1,45 @@
 #define _POSIX_C_SOURCE 200809L
 
+#include "../common/hash.h"
 #include "../common/net.h"
 #include "../common/protocol.h"
+#include "../common/recording.h"
+#include "../common/shm.h"
 
-#include <arpa/inet.h>
+#include <errno.h>
 #include <pthread.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#include "bot.h"
+#include "checkpoint.h"
+#include "eventlog.h"
+#include "game.h"
+#include "lagcomp.h"
 #include "server.h"
+#include "reload.h"
+#include "session.h"
+#include "timer.h"
+#include "uring.h"
 
 #define DEFAULT_PORT 5555
+#define MAX_LISTEN_ADDRS 8
 
 static volatile sig_atomic_t g_running = 1;
 
-void on_sigint(int sig) { (void)sig; g_running = 0; }
+static void on_sigint(int sig) { (void)sig; g_running = 0; }
 
-static uint64_t now_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
-}
+static volatile sig_atomic_t g_reload_requested = 0;
+
+static void on_sighup(int sig) { (void)sig; g_reload_requested = 1; }
 
 static void sleep_ms(long ms) {
     struct timespec ts;
@@ -43,569 +56,1392 @@ static int clampi(int v, int lo, int hi) {
 
 static uint16_t u16min(uint16_t a, uint16_t b) { return (a < b) ? a : b; }
 
-typedef struct {
-    bool used;
-    bool connected;
-    bool active;
-    bool alive;
-    bool paused;
-    bool ready;
-    int fd;
-    char name[SNAKE_NAME_MAX];
-    uint8_t dir;
-    uint8_t pending_dir;
-    uint16_t score;
-    uint16_t len;
-    Cell body[1024];
-    uint64_t spawn_ms;        
-    uint32_t time_ms_final; 
-} Player;
-
-typedef struct {
-    Cell pos;
-    uint32_t visited_mask;
-} Fruit;
-
-typedef struct {
-    int w, h;
-    uint8_t mode;
-    uint8_t world;
-    uint16_t time_limit_sec;
-    char map_path[256];
-    uint8_t *map;
-
-    uint32_t tick_ms;
-    uint64_t start_ms;
-    uint64_t last_tick_ms;
-
-    uint16_t global_freeze_ms;
-    uint64_t last_no_players_ms;
-
-    Player players[MAX_PLAYERS];
-    Fruit fruits[MAX_FRUITS];
-    uint8_t num_fruits;
+static void build_config_payload(Game *g, uint8_t **out, uint32_t *out_len) {
+    uint32_t num_chunks = 0;
+    size_t map_len = world_encoded_size(&g->map, &num_chunks);
+    size_t total = WIRE_SIZE(msg_config) + map_len;
+    if (total > 0xFFFFFFFFu) { *out=NULL; *out_len=0; return; }
 
-    bool game_over;
-    pthread_mutex_t mtx;
-} Game;
+    uint8_t *buf = (uint8_t*)malloc(total);
+    if (!buf) { *out=NULL; *out_len=0; return; }
 
-static int idx(Game *g, int x, int y) { return y * g->w + x; }
+    MsgConfig cfg;
+    cfg.w = (uint32_t)g->w;
+    cfg.h = (uint32_t)g->h;
+    cfg.mode = g->mode;
+    cfg.world = g->world;
+    cfg.time_limit_sec = g->time_limit_sec;
+    cfg.num_chunks = num_chunks;
+    cfg.map_len = (uint32_t)map_len;
 
-static bool in_bounds(Game *g, int x, int y) {
-    return x >= 0 && x < g->w && y >= 0 && y < g->h;
-}
+    size_t off = msg_config_encode(&cfg, buf);
+    (void)world_encode(&g->map, buf + off, map_len);
 
-static bool is_obstacle(Game *g, int x, int y) {
-    if (!in_bounds(g, x, y)) return true;
-    if (g->world == 0) return false;
-    return g->map[y * g->w + x] != 0;
+    *out = buf;
+    *out_len = (uint32_t)total;
 }
 
-static void dir_delta(uint8_t dir, int *dx, int *dy) {
-    *dx = 0; *dy = 0;
-    switch (dir) {
-        case 0: *dy = -1; break;
-        case 1: *dx =  1; break;
-        case 2: *dy =  1; break;
-        case 3: *dx = -1; break;
-        default: break;
+static void build_state(Game *g, MsgState *st) {
+    memset(st, 0, sizeof(*st));
+    st->tick = g->tick;
+    st->tick_ms = g->tick_ms;
+    st->game_over = g->game_over ? 1 : 0;
+    st->mode = g->mode;
+    st->w = (uint32_t)g->w;
+    st->h = (uint32_t)g->h;
+    st->global_freeze_ms = g->global_freeze_ms;
+    uint64_t now = now_ms();
+    if (g->game_over && g->lobby_until_ms > now) {
+        st->lobby_sec = (uint16_t)clampi((int)((g->lobby_until_ms - now + 999) / 1000ULL), 1, 65535);
     }
-}
+    /* The clock stops with the match, so the results stay put. */
+    uint64_t elapsed_ms = ((g->game_over && g->end_ms) ? g->end_ms : now) - g->start_ms;
+    st->elapsed_sec = (uint16_t)clampi((int)(elapsed_ms / 1000ULL), 0, 65535);
 
-static bool dir_is_opposite(uint8_t a, uint8_t b) {
-    return (a==0 && b==2) || (a==2 && b==0) || (a==1 && b==3) || (a==3 && b==1);
-}
+    if (g->mode == 1) {
+        uint32_t elapsed_sec = (uint32_t)(elapsed_ms / 1000ULL);
+        uint32_t left = (g->time_limit_sec > elapsed_sec) ? (g->time_limit_sec - elapsed_sec) : 0;
+        st->time_left_sec = (uint16_t)clampi((int)left, 0, 65535);
+    } else {
+        st->time_left_sec = 0;
+    }
 
-static bool occupied_by_snake(Game *g, int x, int y) {
+    uint8_t np = 0;
     for (int i=0;i<MAX_PLAYERS;i++) {
         Player *p = &g->players[i];
-        if (!p->used || !p->active || !p->alive) continue;
-        for (int k=0;k<(int)p->len;k++) {
-            if (p->body[k].x == x && p->body[k].y == y) return true;
+        PlayerState *ps = &st->players[i];
+        ps->player_id = (uint8_t)i;
+        ps->connected = p->connected ? 1 : 0;
+        ps->active = p->active ? 1 : 0;
+        ps->alive = p->alive ? 1 : 0;
+        ps->paused = p->paused ? 1 : 0;
+        ps->dir = p->dir;
+        ps->score = p->score;
+        ps->input_seq = p->applied_seq;
+        ps->input_ms = p->applied_ms;
+
+        uint64_t tms;
+        if (p->alive) {
+          uint64_t now = now_ms();
+          tms = (now > p->spawn_ms) ? (now - p->spawn_ms) : 0;
+        } else {
+          tms = (uint64_t)p->time_ms_final;
         }
+
+ps->time_sec = (uint16_t)clampi((int)(tms / 1000ULL), 0, 65535);
+
+        uint16_t send_len = u16min(p->len, (uint16_t)MAX_SEGMENTS);
+        ps->len = send_len;
+        for (int k=0;k<(int)send_len;k++) ps->body[k] = p->body[k];
+
+        if (p->used) np++;
     }
-    return false;
-}
+    st->num_players = np;
 
-static bool occupied_by_fruit(Game *g, int x, int y) {
+    st->num_fruits = g->num_fruits;
     for (int i=0;i<(int)g->num_fruits;i++) {
-        if (g->fruits[i].pos.x == x && g->fruits[i].pos.y == y) return true;
+        st->fruits[i].pos = g->fruits[i].pos;
+        st->fruits[i].visited_mask = g->fruits[i].visited_mask;
     }
-    return false;
 }
 
-static Cell find_free_cell(Game *g) {
-    for (int tries=0;tries<10000;tries++) {
-        int x = rand() % g->w;
-        int y = rand() % g->h;
-        if (is_obstacle(g, x, y)) continue;
-        if (occupied_by_snake(g, x, y)) continue;
-        if (occupied_by_fruit(g, x, y)) continue;
-        return (Cell){(int16_t)x,(int16_t)y};
-    }
-    for (int y=0;y<g->h;y++) for (int x=0;x<g->w;x++) {
-        if (is_obstacle(g, x, y)) continue;
-        if (occupied_by_snake(g, x, y)) continue;
-        if (occupied_by_fruit(g, x, y)) continue;
-        return (Cell){(int16_t)x,(int16_t)y};
-    }
-    return (Cell){1,1};
+typedef struct {
+    int x, y, w, h;
+    int W, H;
+    bool wrap;
+} ViewWin;
+
+static int view_origin(int head, int view, int size, bool wrap) {
+    int o = head - view / 2;
+    if (wrap) return ((o % size) + size) % size;
+    return clampi(o, 0, size - view);
 }
 
-static int count_active_alive(Game *g) {
-    int c=0;
-    for (int i=0;i<MAX_PLAYERS;i++) {
-        Player *p=&g->players[i];
-        if (p->used && p->active && p->alive) c++;
-    }
-    return c;
+static bool view_axis_contains(int v, int origin, int view, int size, bool wrap) {
+    int d = v - origin;
+    if (wrap && d < 0) d += size;
+    return d >= 0 && d < view;
 }
 
-static void ensure_fruits_count(Game *g) {
-    int needed = count_active_alive(g);
-    if (needed < 0) needed = 0;
-    if (needed > MAX_FRUITS) needed = MAX_FRUITS;
-
-    while (g->num_fruits < (uint8_t)needed) {
-        Fruit *f = &g->fruits[g->num_fruits++];
-        f->pos = find_free_cell(g);
-        f->visited_mask = 0;
-    }
-    while (g->num_fruits > (uint8_t)needed) {
-        g->num_fruits--;
-    }
+static bool view_contains(const ViewWin *v, int x, int y) {
+    return view_axis_contains(x, v->x, v->w, v->W, v->wrap) &&
+           view_axis_contains(y, v->y, v->h, v->H, v->wrap);
 }
 
-static void gen_map(Game *g, int w, int h, int with_obstacles) {
-    g->w = w;
-    g->h = h;
+static void view_for_player(Game *g, int slot, ViewWin *v) {
+    const Player *p = &g->players[slot];
+    const PlayerMeta *m = &g->meta[slot];
+    v->W = g->w;
+    v->H = g->h;
+    v->wrap = (g->world == 0);
+    v->w = (m->view_w < g->w) ? m->view_w : g->w;
+    v->h = (m->view_h < g->h) ? m->view_h : g->h;
+    v->x = view_origin(p->body[0].x, v->w, g->w, v->wrap);
+    v->y = view_origin(p->body[0].y, v->h, g->h, v->wrap);
+}
 
-    free(g->map);
-    g->map = (uint8_t*)calloc((size_t)w * (size_t)h, 1);
+/* Area-of-interest snapshot for one client: only snakes and fruits inside a
+ * window centred on its head, plus a coarse minimap of the whole board. The
+ * payload is bounded by the viewport, not by board size or player count. */
+static uint32_t build_state_view(Game *g, int slot, uint8_t *buf) {
+    ViewWin v;
+    view_for_player(g, slot, &v);
 
-    for (int x = 0; x < w; x++) {
-        g->map[0 * w + x] = 1;
-        g->map[(h - 1) * w + x] = 1;
-    }
-    for (int y = 0; y < h; y++) {
-        g->map[y * w + 0] = 1;
-        g->map[y * w + (w - 1)] = 1;
-    }
-
-    if (!with_obstacles) {
-        return;
+    uint64_t now = now_ms();
+    /* Stopped with the match, as in build_state. */
+    uint64_t elapsed_ms = ((g->game_over && g->end_ms) ? g->end_ms : now) - g->start_ms;
+    MsgStateView hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.tick = g->tick;
+    hdr.tick_ms = g->tick_ms;
+    hdr.game_over = g->game_over ? 1 : 0;
+    hdr.mode = g->mode;
+    hdr.w = (uint32_t)g->w;
+    hdr.h = (uint32_t)g->h;
+    hdr.global_freeze_ms = g->global_freeze_ms;
+    hdr.elapsed_sec = (uint16_t)clampi((int)(elapsed_ms / 1000ULL), 0, 65535);
+    if (g->mode == 1) {
+        uint32_t elapsed_sec = (uint32_t)(elapsed_ms / 1000ULL);
+        uint32_t left = (g->time_limit_sec > elapsed_sec) ? (g->time_limit_sec - elapsed_sec) : 0;
+        hdr.time_left_sec = (uint16_t)clampi((int)left, 0, 65535);
     }
+    hdr.view_x = (uint32_t)v.x;
+    hdr.view_y = (uint32_t)v.y;
+    hdr.view_w = (uint16_t)v.w;
+    hdr.view_h = (uint16_t)v.h;
+
+    int mm_w = (g->w < MINIMAP_MAX_W) ? g->w : MINIMAP_MAX_W;
+    int mm_h = (g->h < MINIMAP_MAX_H) ? g->h : MINIMAP_MAX_H;
+    uint8_t minimap[MINIMAP_MAX_W * MINIMAP_MAX_H];
+    memset(minimap, 0, sizeof(minimap));
+    hdr.minimap_w = (uint8_t)mm_w;
+    hdr.minimap_h = (uint8_t)mm_h;
+
+    uint32_t off = (uint32_t)WIRE_SIZE(msg_state_view);
+    uint8_t np = 0;
+    for (int i=0;i<MAX_PLAYERS;i++) {
+        Player *p = &g->players[i];
+        if (!p->used) continue;
 
-    int cx = w / 2;
-    int cy = h / 2;
+        if (p->active && p->alive) {
+            int mx = (int)((int64_t)p->body[0].x * mm_w / g->w);
+            int my = (int)((int64_t)p->body[0].y * mm_h / g->h);
+            minimap[my * mm_w + mx] |= (i == slot) ? MINIMAP_SELF : MINIMAP_SNAKE;
+        }
 
-    for (int y = cy - 4; y <= cy - 2; y++) {
-        for (int x = cx - 10; x <= cx - 5; x++) {
-            if (x > 0 && x < w-1 && y > 0 && y < h-1) g->map[y*w + x] = 1;
+        PlayerView pv;
+        memset(&pv, 0, sizeof(pv));
+        uint32_t rec = off;
+        off += (uint32_t)WIRE_SIZE(player_view);
+        uint16_t segs = 0;
+        BodyWriter bw;
+        body_begin(&bw, buf + off, (uint32_t)g->w, (uint32_t)g->h);
+        if (p->active && p->alive) {
+            for (int k=0;k<(int)p->len && segs<VIEW_MAX_SEGMENTS;k++) {
+                if (!view_contains(&v, p->body[k].x, p->body[k].y)) {
+                    body_break(&bw);
+                    continue;
+                }
+                body_push(&bw, p->body[k]);
+                if (k == 0) pv.head_in_view = 1;
+                segs++;
+            }
         }
-    }
-    for (int y = cy + 2; y <= cy + 4; y++) {
-        for (int x = cx + 5; x <= cx + 10; x++) {
-            if (x > 0 && x < w-1 && y > 0 && y < h-1) g->map[y*w + x] = 1;
+        off += (uint32_t)body_end(&bw);
+        if (segs == 0 && i != slot) {
+            off = rec;
+            continue;
         }
+
+        uint64_t tms = p->alive ? ((now > p->spawn_ms) ? (now - p->spawn_ms) : 0)
+                                : (uint64_t)p->time_ms_final;
+        pv.player_id = (uint8_t)i;
+        pv.connected = p->connected ? 1 : 0;
+        pv.active = p->active ? 1 : 0;
+        pv.alive = p->alive ? 1 : 0;
+        pv.paused = p->paused ? 1 : 0;
+        pv.score = p->score;
+        pv.time_sec = (uint16_t)clampi((int)(tms / 1000ULL), 0, 65535);
+        pv.dir = p->dir;
+        pv.len = p->len;
+        pv.input_seq = p->applied_seq;
+        pv.input_ms = p->applied_ms;
+        pv.seg_count = segs;
+        (void)player_view_encode(&pv, buf + rec);
+        np++;
     }
-}
+    hdr.num_players = np;
 
-static void clear_fruit_visits_for_slot(Game *g, int slot) {
-    if (slot < 0 || slot >= MAX_PLAYERS) return;
-    uint32_t mask = ~(1u << (uint32_t)slot);
-    for (int i = 0; i < g->num_fruits; i++) {
-        g->fruits[i].visited_mask &= mask;
+    uint8_t nf = 0;
+    for (int i=0;i<(int)g->num_fruits;i++) {
+        Fruit *f = &g->fruits[i];
+        minimap[(int)((int64_t)f->pos.y * mm_h / g->h) * mm_w + (int)((int64_t)f->pos.x * mm_w / g->w)] |= MINIMAP_FRUIT;
+        if (!view_contains(&v, f->pos.x, f->pos.y)) continue;
+        FruitState fs;
+        fs.pos = f->pos;
+        fs.visited_mask = f->visited_mask;
+        off += (uint32_t)fruit_state_encode(&fs, buf + off);
+        nf++;
     }
+    hdr.num_fruits = nf;
+
+    memcpy(buf + off, minimap, (size_t)(mm_w * mm_h));
+    off += (uint32_t)(mm_w * mm_h);
+
+    (void)msg_state_view_encode(&hdr, buf);
+    return off;
 }
 
-static void fruit_visit(Game *g, int slot, int x, int y, bool *grew) {
-    for (int i = 0; i < (int)g->num_fruits; i++) {
-        Fruit *f = &g->fruits[i];
-        if (f->pos.x == x && f->pos.y == y) {
-            *grew = true;
-            g->players[slot].score++;
+/* The largest client message read whole; anything longer is skipped. */
+#define CONN_MSG_MAX (WIRE_SIZE(msg_hello) > WIRE_SIZE(msg_resume) ? WIRE_SIZE(msg_hello) : WIRE_SIZE(msg_resume))
+/* One tick's send, a config-changed notice and a snapshot, or a ring reply. */
+#define CONN_TX_MAX (2 * WIRE_SIZE(msg_header) + WIRE_SIZE(msg_config_changed) + \
+    (MSG_STATE_MAX_LEN > STATE_VIEW_MAX_LEN ? MSG_STATE_MAX_LEN : STATE_VIEW_MAX_LEN))
+/* Pings answered together in one send; more behind a slow send drop. */
+#define CONN_PONGS 8
+
+struct ConfigBlob;
+
+/* One connection, alive as long as its client thread, or with --io uring
+ * until the ring is done with it. rx carries the handshake deadline and
+ * then the idle one, which is re-armed lazily from last_rx_ms when it
+ * fires rather than on every message; tx is armed around each blocking
+ * send, or each ring send. An expired timer shuts the socket down, which
+ * wakes the thread out of recv or send, or fails the ring's, to clean up. */
+typedef struct ClientCtx {
+    int fd;
+    int slot;
+    Timer rx;
+    Timer tx;
+    bool ready;                 /* past the handshake; under g_timer_mtx */
+    uint8_t expired;            /* CONN_* that timed out, or 0 */
+    bool fresh;                 /* joined rather than resumed */
+    bool quit;                  /* left with MSG_LEAVE or MSG_BYE */
+    uint64_t last_rx_ms;        /* atomic */
+
+    /* Ring state, touched by the game loop only once on_ring is set. */
+    struct ClientCtx *next;     /* waiting to be adopted */
+    bool on_ring;
+    bool rx_armed;              /* the multishot receive is live */
+    bool closing;
+    bool tx_busy;               /* one send in flight at a time */
+    uint8_t rx_buf[WIRE_SIZE(msg_header) + CONN_MSG_MAX];
+    uint32_t rx_len;
+    uint32_t rx_skip;           /* bytes left of a message too long to keep */
+    uint16_t rx_skip_type;
+    uint32_t rx_skip_len;
+    uint8_t *tx_buf;            /* CONN_TX_MAX */
+    /* Thread backend: the part of the last tick's send in tx_buf that
+     * the socket would not take without blocking; under g_send_mtx. */
+    uint32_t tx_off, tx_len;
+    bool tx_stalled;            /* the send-stall timer runs for it */
+    struct iovec tx_iov[2];
+    struct msghdr tx_msg;
+    struct ConfigBlob *tx_cfg;  /* held while its map is being sent */
+    /* Replies waiting for the send in flight. */
+    uint8_t pongs;
+    uint8_t pong[CONN_PONGS][WIRE_SIZE(msg_ping)];
+    struct ConfigBlob *cfg_due;
+    bool cfg_due_map;
+} ClientCtx;
 
-            f->pos = find_free_cell(g);
-            f->visited_mask = 0;
+enum {
+    CONN_HANDSHAKE = 1,
+    CONN_IDLE,
+    CONN_SEND_STALL
+};
 
-            return;
-        }
+#define TIMER_TICK_MS 10
+
+static Game g_game;
+
+static SessionTable g_sessions;
+
+/* A built MSG_CONFIG payload with its fingerprints. g_config points at the
+ * current one (read under the game mutex); a handshake holds a reference
+ * while it sends, so a hot reload can swap in a new one at any time. */
+typedef struct ConfigBlob {
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t gen;
+    uint8_t config_hash[CONFIG_HASH_LEN];
+    uint8_t map_hash[CONFIG_HASH_LEN];
+    int refs;
+} ConfigBlob;
+
+static ConfigBlob *g_config;
+static uint32_t g_config_gen;
+
+/* Held while a client thread writes a config to its socket; the broadcast
+ * only try-locks it and skips that client for the tick instead of waiting. */
+static pthread_mutex_t g_send_mtx[MAX_PLAYERS];
+
+/* --lobby-sec turns the server into a daemon: a finished match leaves
+ * everyone connected and the next one starts on the same board and
+ * sockets after the countdown, which MSG_STATE carries as lobby_sec. */
+static uint32_t g_lobby_ms;
+
+/* Connection deadlines, 0 when off. The wheel and every Timer in it are
+ * guarded by g_timer_mtx, taken after the game mutex when both are held. */
+static uint32_t g_handshake_ms = 10000;
+static uint32_t g_idle_ms = 30000;
+static uint32_t g_send_stall_ms = 2000;
+static TimerWheel g_timers;
+static pthread_mutex_t g_timer_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_timeouts[CONN_SEND_STALL + 1];
+
+/* The connection serving each slot, under the game mutex. */
+static ClientCtx *g_conns[MAX_PLAYERS];
+
+/* --event-log is open; see eventlog.h. */
+static bool g_event_log;
+
+/* Late turns and the tick history they rewind; under the game mutex. */
+static LagComp g_lag;
+
+/* --io uring: once past the handshake a client thread hands its
+ * connection to g_adopt and exits, and the game loop serves it from one
+ * ring: every snapshot of a tick goes out in one submission and inputs
+ * arrive through multishot receives. The ring is the game loop's alone.
+ * Completions carry the ClientCtx with the operation in its low bits. */
+static Uring g_ring;
+static bool g_uring;
+static ClientCtx *g_adopt;
+static pthread_mutex_t g_adopt_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_ring_ticks;
+
+#define RING_RECV 1
+#define RING_SEND 2
+#define RING_TAGS 3
+
+static ConfigBlob *config_blob_build(Game *g) {
+    ConfigBlob *b = (ConfigBlob*)calloc(1, sizeof(ConfigBlob));
+    if (!b) return NULL;
+    build_config_payload(g, &b->buf, &b->len);
+    if (!b->buf) {
+        free(b);
+        return NULL;
     }
+    hash64_bytes(hash64(b->buf, b->len), b->config_hash);
+    hash64_bytes(hash64(b->buf + WIRE_SIZE(msg_config), b->len - WIRE_SIZE(msg_config)), b->map_hash);
+    b->refs = 1;
+    return b;
 }
 
-static void kill_player(Player *p) {
-    p->alive = false;
-    if (p->time_ms_final == 0 && p->spawn_ms != 0) {
-    uint64_t now = now_ms();
-    uint64_t d = (now > p->spawn_ms) ? (now - p->spawn_ms) : 0;
-    if (d > 0xFFFFFFFFULL) d = 0xFFFFFFFFULL;
-    p->time_ms_final = (uint32_t)d;
+static ConfigBlob *config_ref(ConfigBlob *b) {
+    __atomic_fetch_add(&b->refs, 1, __ATOMIC_RELAXED);
+    return b;
 }
-}
-
-static void move_snake(Game *g, int slot) {
-    Player *p = &g->players[slot];
-    if (!p->used || !p->active || !p->alive) return;
-    if (p->paused) return;
 
-    if (p->pending_dir != 255) {
-        if (!dir_is_opposite(p->dir, p->pending_dir)) p->dir = p->pending_dir;
-        p->pending_dir = 255;
-    }
+static void config_unref(ConfigBlob *b) {
+    if (!b || __atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    free(b->buf);
+    free(b);
+}
 
-    int dx,dy; dir_delta(p->dir, &dx, &dy);
-    int nx = p->body[0].x + dx;
-    int ny = p->body[0].y + dy;
+static void conn_expire(ClientCtx *c, uint8_t why) {
+    if (c->expired) return;
+    c->expired = why;
+    g_timeouts[why]++;
+    shutdown(c->fd, SHUT_RDWR);
+}
 
-    if (g->world == 0) {
-        if (nx < 0) nx = g->w - 1;
-        if (nx >= g->w) nx = 0;
-        if (ny < 0) ny = g->h - 1;
-        if (ny >= g->h) ny = 0;
+/* Timer callbacks, run under g_timer_mtx with the current time as arg. */
+static void on_rx_timer(Timer *t, void *arg) {
+    ClientCtx *c = (ClientCtx*)t->data;
+    if (c->ready) {
+        uint64_t deadline = __atomic_load_n(&c->last_rx_ms, __ATOMIC_RELAXED) + g_idle_ms;
+        if (deadline > *(const uint64_t*)arg) {
+            timer_arm(&g_timers, t, deadline);
+            return;
+        }
+        conn_expire(c, CONN_IDLE);
     } else {
-        if (!in_bounds(g, nx, ny)) { kill_player(p); return; }
+        conn_expire(c, CONN_HANDSHAKE);
     }
+}
 
-    if (is_obstacle(g, nx, ny)) { kill_player(p); return; }
-    if (occupied_by_snake(g, nx, ny)) { kill_player(p); return; }
+static void on_tx_timer(Timer *t, void *arg) {
+    (void)arg;
+    conn_expire((ClientCtx*)t->data, CONN_SEND_STALL);
+}
 
-    bool grew = false;
-    fruit_visit(g, slot, nx, ny, &grew);
+/* The handshake is over: from here rx is the idle deadline. */
+static void conn_ready(ClientCtx *c) {
+    uint64_t now = now_ms();
+    __atomic_store_n(&c->last_rx_ms, now, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&g_timer_mtx);
+    c->ready = true;
+    if (g_idle_ms > 0) timer_arm(&g_timers, &c->rx, now + g_idle_ms);
+    else timer_cancel(&g_timers, &c->rx);
+    pthread_mutex_unlock(&g_timer_mtx);
+}
 
-    uint16_t new_len = p->len;
-    if (grew) {
-        if (new_len < (uint16_t)(sizeof(p->body)/sizeof(p->body[0]))) new_len++;
+/* Blocking send from a client thread, holding g_send_mtx: whatever the
+ * broadcast left unsent goes first, so messages never interleave. */
+static int conn_send(ClientCtx *c, uint16_t type, const void *payload, uint32_t len) {
+    if (g_send_stall_ms > 0) {
+        pthread_mutex_lock(&g_timer_mtx);
+        timer_arm(&g_timers, &c->tx, now_ms() + g_send_stall_ms);
+        pthread_mutex_unlock(&g_timer_mtx);
     }
+    int rc = 0;
+    if (c->tx_off < c->tx_len) rc = net_send_all(c->fd, c->tx_buf + c->tx_off, (int)(c->tx_len - c->tx_off));
+    c->tx_off = c->tx_len = 0;
+    c->tx_stalled = false;
+    if (rc == 0) rc = net_send_msg(c->fd, type, payload, len);
+    if (g_send_stall_ms > 0) {
+        pthread_mutex_lock(&g_timer_mtx);
+        timer_cancel(&g_timers, &c->tx);
+        pthread_mutex_unlock(&g_timer_mtx);
+    }
+    return rc;
+}
 
-    for (int i=(int)new_len-1; i>0; i--) p->body[i] = p->body[i-1];
-    p->body[0] = (Cell){(int16_t)nx,(int16_t)ny};
-    p->len = new_len;
+/* Broadcast send on the thread backend, holding g_send_mtx: writes what
+ * the socket takes now and leaves the rest in tx_buf for the next tick, so
+ * the game loop never waits on a peer. The send-stall timer runs from the
+ * first short write until the backlog is gone. */
+static void conn_push(ClientCtx *c) {
+    while (c->tx_off < c->tx_len) {
+        ssize_t n = send(c->fd, c->tx_buf + c->tx_off, c->tx_len - c->tx_off, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        /* A dead socket: the client thread finds out on its next read. */
+        if (n <= 0) c->tx_off = c->tx_len;
+        else c->tx_off += (uint32_t)n;
+    }
+    bool left = c->tx_off < c->tx_len;
+    if (!left) c->tx_off = c->tx_len = 0;
+    if (g_send_stall_ms > 0 && left != c->tx_stalled) {
+        pthread_mutex_lock(&g_timer_mtx);
+        if (left) timer_arm(&g_timers, &c->tx, now_ms() + g_send_stall_ms);
+        else timer_cancel(&g_timers, &c->tx);
+        pthread_mutex_unlock(&g_timer_mtx);
+    }
+    c->tx_stalled = left;
 }
 
-static void tick_game(Game *g, uint32_t dt_ms) {
-    if (g->global_freeze_ms > 0) {
-        if (dt_ms >= g->global_freeze_ms) g->global_freeze_ms = 0;
-        else g->global_freeze_ms -= dt_ms;
-        return;
+static void *timer_main(void *arg) {
+    (void)arg;
+    while (g_running) {
+        sleep_ms(TIMER_TICK_MS);
+        uint64_t now = now_ms();
+        pthread_mutex_lock(&g_timer_mtx);
+        (void)timer_wheel_advance(&g_timers, now, &now);
+        pthread_mutex_unlock(&g_timer_mtx);
     }
-    for (int i=0;i<MAX_PLAYERS;i++) move_snake(g, i);
-    ensure_fruits_count(g);
+    return NULL;
 }
 
-static bool load_map_file(const char *path, Game *g) {
-    FILE *f = fopen(path, "r");
-    if (!f) return false;
+/* Sends the config, leaving the map out when the client has a copy with
+ * the advertised hash. */
+static int send_config(ClientCtx *c, const ConfigBlob *b, bool want_map) {
+    if (want_map) return conn_send(c, MSG_CONFIG, b->buf, b->len);
 
-    char *lines[2048];
-    int line_count = 0;
-    int max_w = 0;
+    MsgConfig cfg;
+    uint8_t out[WIRE_SIZE(msg_config)];
+    if (!msg_config_decode(&cfg, b->buf, b->len)) return -1;
+    cfg.map_len = 0;
+    return conn_send(c, MSG_CONFIG, out, (uint32_t)msg_config_encode(&cfg, out));
+}
 
-    char buf[4096];
-    while (fgets(buf, sizeof(buf), f)) {
-        size_t n = strlen(buf);
-        while (n>0 && (buf[n-1]=='\n' || buf[n-1]=='\r')) buf[--n] = 0;
-        if (n == 0) continue;
+static int recv_config_request(int fd, bool *want_map) {
+    uint16_t t=0; uint32_t l=0;
+    uint8_t buf[WIRE_SIZE(msg_config_request)];
+    if (net_recv_header(fd, &t, &l) != 0 || t != MSG_CONFIG_REQUEST || l != sizeof(buf)) return -1;
+    if (net_recv_all(fd, buf, (int)sizeof(buf)) != 0) return -1;
+    *want_map = msg_config_request_want_map(buf) != 0;
+    return 0;
+}
 
-        if (line_count >= (int)(sizeof(lines)/sizeof(lines[0]))) break;
+/* Puts a returning player back into its slot; a dead snake respawns with
+ * its score kept. Caller holds the game mutex. */
+static void rejoin_slot(int slot, int fd) {
+    Player *p = &g_game.players[slot];
+    PlayerMeta *m = &g_game.meta[slot];
+    p->connected = true;
+    p->active = true;
+    m->fd = fd;
+    m->view_w = 0;
+    m->view_h = 0;
+    if (!p->alive) {
+        init_player(p, find_free_cell(&g_game), p->score);
+        clear_fruit_visits_for_slot(&g_game, slot);
+    }
+    g_game.global_freeze_ms = 3000;
+}
 
-        lines[line_count] = strdup(buf);
-        if (!lines[line_count]) break;
+/* Ring sends. Each connection has at most one in flight, from tx_buf and
+ * optionally a config blob after it; a short send is resubmitted for the
+ * rest, and the send-stall timer runs from submission to completion. */
+static void ring_close(ClientCtx *c);
 
-        if ((int)n > max_w) max_w = (int)n;
-        line_count++;
+static void ring_submit_send(ClientCtx *c) {
+    struct io_uring_sqe *sqe = uring_sqe(&g_ring);
+    if (!sqe) {
+        ring_close(c);
+        return;
     }
-    fclose(f);
-
-    if (line_count <= 0 || max_w <= 0) {
-        for (int i=0;i<line_count;i++) free(lines[i]);
-        return false;
+    uring_prep_sendmsg(sqe, c->fd, &c->tx_msg, (uint64_t)(uintptr_t)c | RING_SEND);
+    c->tx_busy = true;
+    if (g_send_stall_ms > 0) {
+        pthread_mutex_lock(&g_timer_mtx);
+        timer_arm(&g_timers, &c->tx, now_ms() + g_send_stall_ms);
+        pthread_mutex_unlock(&g_timer_mtx);
     }
+}
 
-    g->w = max_w;
-    g->h = line_count;
+static void ring_send(ClientCtx *c, uint32_t len, const void *tail, uint32_t tail_len) {
+    c->tx_iov[0].iov_base = c->tx_buf;
+    c->tx_iov[0].iov_len = len;
+    c->tx_iov[1].iov_base = (void*)tail;
+    c->tx_iov[1].iov_len = tail_len;
+    memset(&c->tx_msg, 0, sizeof(c->tx_msg));
+    c->tx_msg.msg_iov = c->tx_iov;
+    c->tx_msg.msg_iovlen = (tail_len > 0) ? 2 : 1;
+    ring_submit_send(c);
+}
 
-    g->map = (uint8_t*)calloc((size_t)g->w * (size_t)g->h, 1);
-    if (!g->map) {
-        for (int i=0;i<line_count;i++) free(lines[i]);
-        return false;
-    }
+static uint32_t put_header(uint8_t *p, uint16_t type, uint32_t len) {
+    MsgHeader hdr = { type, len };
+    return (uint32_t)msg_header_encode(&hdr, p);
+}
 
-    for (int y=0;y<g->h;y++) {
-        char *ln = lines[y];
-        int lw = (int)strlen(ln);
-        for (int x=0;x<g->w;x++) {
-            char c = (x < lw) ? ln[x] : ' ';
-            g->map[idx(g, x, y)] = (c == '#') ? 1 : 0;
+/* Sends a queued reply, if any, once the ring is free. */
+static void ring_send_due(ClientCtx *c) {
+    if (c->tx_busy || c->closing) return;
+    if (c->pongs > 0) {
+        uint32_t off = 0;
+        for (int i=0;i<c->pongs;i++) {
+            off += put_header(c->tx_buf + off, MSG_PONG, sizeof(c->pong[i]));
+            memcpy(c->tx_buf + off, c->pong[i], sizeof(c->pong[i]));
+            off += (uint32_t)sizeof(c->pong[i]);
+        }
+        c->pongs = 0;
+        ring_send(c, off, NULL, 0);
+    } else if (c->cfg_due) {
+        ConfigBlob *b = c->cfg_due;
+        c->cfg_due = NULL;
+        c->tx_cfg = b;
+        if (c->cfg_due_map) {
+            ring_send(c, put_header(c->tx_buf, MSG_CONFIG, b->len), b->buf, b->len);
+            return;
+        }
+        MsgConfig cfg;
+        uint8_t *out = c->tx_buf + WIRE_SIZE(msg_header);
+        uint32_t len = 0;
+        if (msg_config_decode(&cfg, b->buf, b->len)) {
+            cfg.map_len = 0;
+            len = (uint32_t)msg_config_encode(&cfg, out);
         }
-        free(lines[y]);
+        (void)put_header(c->tx_buf, MSG_CONFIG, len);
+        ring_send(c, (uint32_t)WIRE_SIZE(msg_header) + len, NULL, 0);
     }
-
-    return true;
 }
 
-static void init_player(Player *p, const char *name, Cell spawn, uint16_t keep_score) {
-    memset(p, 0, sizeof(*p));
-    p->spawn_ms = now_ms();
-    p->time_ms_final = 0;
-    p->used = true;
-    p->connected = true;
-    p->active = true;
-    p->alive = true;
-    p->paused = false;
-    p->ready = false;
-    p->fd = -1;
-    p->dir = 1;
-    p->pending_dir = 255;
-    p->score = keep_score;
-    (void)snprintf(p->name, sizeof(p->name), "%s", (name && name[0]) ? name : "player");
-    p->len = 3;
-    p->body[0] = spawn;
-    p->body[1] = (Cell){(int16_t)(spawn.x-1), spawn.y};
-    p->body[2] = (Cell){(int16_t)(spawn.x-2), spawn.y};
-}
-
-static int find_player_by_name(Game *g, const char *name) {
-    for (int i=0;i<MAX_PLAYERS;i++) {
-        if (g->players[i].used && strncmp(g->players[i].name, name, SNAKE_NAME_MAX) == 0) return i;
+/* Lays out the tick's send for slot in tx_buf: the snapshot, after a
+ * config-changed notice when the client's config is stale. Returns its
+ * length; the caller holds the game mutex. */
+static uint32_t put_tick(ClientCtx *c, int slot, const uint8_t *state_buf, uint32_t state_len) {
+    PlayerMeta *m = &g_game.meta[slot];
+    uint8_t *p = c->tx_buf;
+    uint32_t off = 0;
+    if (m->config_gen != g_config->gen) {
+        MsgConfigChanged cc;
+        memcpy(cc.config_hash, g_config->config_hash, CONFIG_HASH_LEN);
+        memcpy(cc.map_hash, g_config->map_hash, CONFIG_HASH_LEN);
+        off += put_header(p + off, MSG_CONFIG_CHANGED, (uint32_t)WIRE_SIZE(msg_config_changed));
+        off += (uint32_t)msg_config_changed_encode(&cc, p + off);
+        m->config_gen = g_config->gen;
+    }
+    const uint32_t hl = (uint32_t)WIRE_SIZE(msg_header);
+    if (m->view_w > 0 && m->view_h > 0 && !g_game.game_over) {
+        uint32_t vlen = build_state_view(&g_game, slot, p + off + hl);
+        off += put_header(p + off, MSG_STATE_VIEW, vlen) + vlen;
+    } else {
+        memcpy(p + off + hl, state_buf, state_len);
+        off += put_header(p + off, MSG_STATE, state_len) + state_len;
     }
-    return -1;
+    return off;
 }
 
-static int alloc_slot(Game *g) {
-    for (int i=0;i<MAX_PLAYERS;i++) if (!g->players[i].used) return i;
-    return -1;
+static void ring_on_send(ClientCtx *c, int res) {
+    if (res > 0) {
+        size_t n = (size_t)res;
+        while (c->tx_msg.msg_iovlen > 0 && n >= c->tx_msg.msg_iov[0].iov_len) {
+            n -= c->tx_msg.msg_iov[0].iov_len;
+            c->tx_msg.msg_iov++;
+            c->tx_msg.msg_iovlen--;
+        }
+        if (c->tx_msg.msg_iovlen > 0 && !c->closing) {
+            c->tx_msg.msg_iov[0].iov_base = (uint8_t*)c->tx_msg.msg_iov[0].iov_base + n;
+            c->tx_msg.msg_iov[0].iov_len -= n;
+            ring_submit_send(c);
+            return;
+        }
+    }
+    c->tx_busy = false;
+    if (g_send_stall_ms > 0) {
+        pthread_mutex_lock(&g_timer_mtx);
+        timer_cancel(&g_timers, &c->tx);
+        pthread_mutex_unlock(&g_timer_mtx);
+    }
+    config_unref(c->tx_cfg);
+    c->tx_cfg = NULL;
+    if (res <= 0) ring_close(c);
+    else ring_send_due(c);
 }
 
-static void build_config_payload(Game *g, uint8_t **out, uint32_t *out_len) {
-    uint32_t map_len = (uint32_t)(g->w * g->h);
-    uint32_t total = (uint32_t)sizeof(MsgConfig) + map_len;
+/* Gives up the slot (or keeps it for a resume), then the socket. */
+static void conn_finish(ClientCtx *c) {
+    pthread_mutex_lock(&g_timer_mtx);
+    timer_cancel(&g_timers, &c->rx);
+    timer_cancel(&g_timers, &c->tx);
+    bool expired = c->expired != 0;
+    pthread_mutex_unlock(&g_timer_mtx);
 
-    uint8_t *buf = (uint8_t*)malloc(total);
-    if (!buf) { *out=NULL; *out_len=0; return; }
-
-    MsgConfig cfg;
-    cfg.w = htons((uint16_t)g->w);
-    cfg.h = htons((uint16_t)g->h);
-    cfg.mode = g->mode;
-    cfg.world = g->world;
-    cfg.time_limit_sec = htons(g->time_limit_sec);
-    cfg.map_len = htonl(map_len);
+    pthread_mutex_lock(&g_game.mtx);
+    for (int i=0;i<MAX_PLAYERS;i++) {
+        if (g_game.players[i].used && g_game.meta[i].fd == c->fd) {
+            g_game.players[i].connected = false;
+            g_game.meta[i].ready = false;
+            g_game.meta[i].fd = -1;
+            /* A join that never finished its handshake leaves nothing
+             * worth resuming, and a timed-out peer is taken as gone: its
+             * slot is freed rather than held for a resume. */
+            if ((c->fresh && !c->ready) || expired) {
+              g_game.players[i].active = false;
+              g_game.players[i].alive = false;
+            }
+            if (!g_game.players[i].active) {
+              g_game.players[i].used = false;
+              g_game.meta[i].name[0] = '\0';
+              session_revoke(&g_sessions, i);
+            }
+            uint16_t why = expired ? (uint16_t)(EV_LEAVE_HANDSHAKE + c->expired - CONN_HANDSHAKE)
+                                   : (c->quit ? EV_LEAVE_QUIT : EV_LEAVE_LOST);
+            eventlog_emit(EV_LEAVE, i, why, g_game.players[i].used ? 1u : 0u, 0, 0);
 
-    memcpy(buf, &cfg, sizeof(cfg));
-    memcpy(buf + sizeof(cfg), g->map, map_len);
+            break;
+        }
+    }
+    for (int i=0;i<MAX_PLAYERS;i++) {
+        if (g_conns[i] == c) g_conns[i] = NULL;
+    }
+    pthread_mutex_unlock(&g_game.mtx);
 
-    *out = buf;
-    *out_len = total;
+    close(c->fd);
+    config_unref(c->tx_cfg);
+    config_unref(c->cfg_due);
+    free(c->tx_buf);
+    free(c);
 }
 
-static void build_state(Game *g, MsgState *st) {
-    memset(st, 0, sizeof(*st));
-    st->tick_ms = htons((uint16_t)g->tick_ms);
-    st->game_over = g->game_over ? 1 : 0;
-    st->mode = g->mode;
-    st->w = htons((uint16_t)g->w);
-    st->h = htons((uint16_t)g->h);
-    st->global_freeze_ms = htons(g->global_freeze_ms);
-    uint64_t elapsed_ms = now_ms() - g->start_ms;
-    st->elapsed_sec = htons((uint16_t)clampi((int)(elapsed_ms / 1000ULL), 0, 65535));
 
-    if (g->mode == 1) {
-        uint32_t elapsed_sec = (uint32_t)(elapsed_ms / 1000ULL);
-        uint32_t left = (g->time_limit_sec > elapsed_sec) ? (g->time_limit_sec - elapsed_sec) : 0;
-        st->time_left_sec = htons((uint16_t)clampi((int)left, 0, 65535));
-    } else {
-        st->time_left_sec = htons(0);
-    }
-
-    uint8_t np = 0;
-    for (int i=0;i<MAX_PLAYERS;i++) {
-        Player *p = &g->players[i];
-        PlayerState *ps = &st->players[i];
-        ps->player_id = (uint8_t)i;
-        ps->connected = p->connected ? 1 : 0;
-        ps->active = p->active ? 1 : 0;
-        ps->alive = p->alive ? 1 : 0;
-        ps->paused = p->paused ? 1 : 0;
-        ps->dir = p->dir;
-        ps->score = htons(p->score);
-
-        uint64_t tms;
-        if (p->alive) {
-          uint64_t now = now_ms();
-          tms = (now > p->spawn_ms) ? (now - p->spawn_ms) : 0;
-        } else {
-          tms = (uint64_t)p->time_ms_final;
+/* Handles one client message after the handshake; in is NULL for one
+ * too long to keep. Returns false when the connection is done. */
+static bool conn_message(ClientCtx *c, uint16_t t, const uint8_t *in, uint32_t l) {
+    int slot = c->slot;
+    if (t == MSG_INPUT && l == WIRE_SIZE(msg_input)) {
+        pthread_mutex_lock(&g_game.mtx);
+        /* A late turn can still save a snake the tick it missed
+         * killed, so lag_input sees turns from the dead too. */
+        if (slot >= 0 && g_game.players[slot].used && g_game.players[slot].active &&
+            !lag_input(&g_lag, &g_game, slot, msg_input_dir(in), msg_input_seq(in), msg_input_client_ms(in),
+                       msg_input_tick(in)) &&
+            g_game.players[slot].alive) {
+            queue_input(&g_game.players[slot], msg_input_dir(in), msg_input_seq(in), msg_input_client_ms(in));
         }
+        pthread_mutex_unlock(&g_game.mtx);
+    } else if (t == MSG_PING && l == WIRE_SIZE(msg_ping)) {
+        if (c->on_ring) {
+            if (c->pongs < CONN_PONGS) memcpy(c->pong[c->pongs++], in, l);
+            ring_send_due(c);
+            return true;
+        }
+        pthread_mutex_lock(&g_send_mtx[slot]);
+        int rc = conn_send(c, MSG_PONG, in, l);
+        pthread_mutex_unlock(&g_send_mtx[slot]);
+        if (rc != 0) return false;
+    } else if (t == MSG_VIEWPORT && l == WIRE_SIZE(msg_viewport)) {
+        pthread_mutex_lock(&g_game.mtx);
+        if (slot >= 0 && g_game.players[slot].used) {
+            uint16_t vw = msg_viewport_view_w(in);
+            uint16_t vh = msg_viewport_view_h(in);
+            g_game.meta[slot].view_w = (vw == 0) ? 0 : (uint16_t)clampi(vw, 10, VIEW_MAX_W);
+            g_game.meta[slot].view_h = (vh == 0) ? 0 : (uint16_t)clampi(vh, 10, VIEW_MAX_H);
+        }
+        pthread_mutex_unlock(&g_game.mtx);
+    } else if (t == MSG_CONFIG_REQUEST && l == WIRE_SIZE(msg_config_request)) {
+        pthread_mutex_lock(&g_game.mtx);
+        ConfigBlob *cur = config_ref(g_config);
+        pthread_mutex_unlock(&g_game.mtx);
+        if (c->on_ring) {
+            config_unref(c->cfg_due);
+            c->cfg_due = cur;
+            c->cfg_due_map = msg_config_request_want_map(in) != 0;
+            ring_send_due(c);
+            return true;
+        }
+        pthread_mutex_lock(&g_send_mtx[slot]);
+        int rc = send_config(c, cur, msg_config_request_want_map(in) != 0);
+        pthread_mutex_unlock(&g_send_mtx[slot]);
+        config_unref(cur);
+        if (rc != 0) return false;
+    } else if (t == MSG_PAUSE_TOGGLE && l == 0) {
+        pthread_mutex_lock(&g_game.mtx);
+        if (slot >= 0 && g_game.players[slot].used && g_game.players[slot].active) {
+            bool was = g_game.players[slot].paused;
+            g_game.players[slot].paused = !was;
+            if (was) g_game.global_freeze_ms = 3000;
+            eventlog_emit(EV_PAUSE, slot, was ? 0 : 1, 0, 0, 0);
+        }
+        pthread_mutex_unlock(&g_game.mtx);
+    } else if (t == MSG_LEAVE && l == 0) {
+        pthread_mutex_lock(&g_game.mtx);
+        if (slot >= 0 && g_game.players[slot].used) {
+            g_game.players[slot].active = false;
+            g_game.players[slot].alive = false;
+        }
+        ensure_fruits_count(&g_game);
+        pthread_mutex_unlock(&g_game.mtx);
+        c->quit = true;
+        return false;
+    } else if (t == MSG_BYE) {
+        c->quit = true;
+        return false;
+    }
+    return true;
+}
 
-ps->time_sec = htons((uint16_t)clampi((int)(tms / 1000ULL), 0, 65535));
-
-        uint16_t send_len = u16min(p->len, (uint16_t)MAX_SEGMENTS);
-        ps->len = htons(send_len);
-        for (int k=0;k<(int)send_len;k++) ps->body[k] = p->body[k];
+/* The ring's side of a connection: adoption from its client thread, the
+ * multishot receive and its reassembly into messages, and the close,
+ * which waits for the receive and any send to finish before the socket
+ * goes. All of it runs on the game loop. */
+static void ring_close(ClientCtx *c) {
+    if (c->closing) return;
+    c->closing = true;
+    if (c->rx_armed) {
+        struct io_uring_sqe *sqe = uring_sqe(&g_ring);
+        if (sqe) uring_prep_cancel(sqe, (uint64_t)(uintptr_t)c | RING_RECV, 0);
+        else shutdown(c->fd, SHUT_RDWR);
+    }
+}
 
-        if (p->used) np++;
+static void ring_arm_recv(ClientCtx *c) {
+    struct io_uring_sqe *sqe = uring_sqe(&g_ring);
+    if (!sqe) {
+        ring_close(c);
+        return;
     }
-    st->num_players = np;
+    uring_prep_recv_multishot(sqe, c->fd, (uint64_t)(uintptr_t)c | RING_RECV);
+    c->rx_armed = true;
+}
 
-    st->num_fruits = g->num_fruits;
-    for (int i=0;i<(int)g->num_fruits;i++) {
-        st->fruits[i].pos = g->fruits[i].pos;
-        st->fruits[i].visited_mask = htonl(g->fruits[i].visited_mask);
+static void ring_adopt(void) {
+    pthread_mutex_lock(&g_adopt_mtx);
+    ClientCtx *c = g_adopt;
+    g_adopt = NULL;
+    pthread_mutex_unlock(&g_adopt_mtx);
+    while (c) {
+        ClientCtx *next = c->next;
+        c->on_ring = true;
+        ring_arm_recv(c);
+        if (!c->rx_armed) conn_finish(c);
+        c = next;
     }
 }
 
-static bool any_connected_active_alive(Game *g) {
-    for (int i=0;i<MAX_PLAYERS;i++) {
-        Player *p=&g->players[i];
-        if (p->used && p->connected && p->active && p->alive) return true;
+/* Splits received bytes into messages; false once the connection is done. */
+static bool ring_feed(ClientCtx *c, const uint8_t *p, uint32_t n) {
+    const uint32_t hl = (uint32_t)WIRE_SIZE(msg_header);
+    __atomic_store_n(&c->last_rx_ms, now_ms(), __ATOMIC_RELAXED);
+    while (n > 0) {
+        if (c->rx_skip > 0) {
+            uint32_t k = (n < c->rx_skip) ? n : c->rx_skip;
+            c->rx_skip -= k;
+            p += k;
+            n -= k;
+            if (c->rx_skip == 0 && !conn_message(c, c->rx_skip_type, NULL, c->rx_skip_len)) return false;
+            continue;
+        }
+        uint32_t want = (c->rx_len < hl) ? hl : hl + msg_header_len(c->rx_buf);
+        uint32_t k = (n < want - c->rx_len) ? n : want - c->rx_len;
+        memcpy(c->rx_buf + c->rx_len, p, k);
+        c->rx_len += k;
+        p += k;
+        n -= k;
+        if (c->rx_len < hl) continue;
+        uint16_t t = msg_header_type(c->rx_buf);
+        uint32_t l = msg_header_len(c->rx_buf);
+        if (l > CONN_MSG_MAX) {
+            c->rx_skip = l;
+            c->rx_skip_type = t;
+            c->rx_skip_len = l;
+            c->rx_len = 0;
+            continue;
+        }
+        if (c->rx_len < hl + l) continue;
+        c->rx_len = 0;
+        if (!conn_message(c, t, c->rx_buf + hl, l)) return false;
     }
-    return false;
+    return true;
 }
 
-typedef struct {
-    int fd;
-} ClientCtx;
+static void ring_on_recv(ClientCtx *c, const struct io_uring_cqe *cqe) {
+    if (cqe->res > 0) {
+        bool ok = c->closing || ring_feed(c, uring_buf(&g_ring, cqe), (uint32_t)cqe->res);
+        uring_buf_return(&g_ring, cqe);
+        if (!ok) ring_close(c);
+    } else if (cqe->res != -ENOBUFS) {
+        /* End of stream, an error, or the cancel from ring_close. */
+        ring_close(c);
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        c->rx_armed = false;
+        /* Out of buffers, or the kernel ended the receive: go again. */
+        if (!c->closing) ring_arm_recv(c);
+    }
+}
 
-static Game g_game;
+/* Waits up to timeout_ms for ring completions and handles them. */
+static void ring_poll(int timeout_ms) {
+    ring_adopt();
+    if (uring_submit(&g_ring, 1, timeout_ms) != 0) sleep_ms(timeout_ms);
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek(&g_ring)) != NULL) {
+        uint64_t data = cqe->user_data;
+        ClientCtx *c = (ClientCtx*)(uintptr_t)(data & ~(uint64_t)RING_TAGS);
+        if (c) {
+            if (data & RING_RECV) ring_on_recv(c, cqe);
+            else ring_on_send(c, cqe->res);
+            if (c->closing && !c->rx_armed && !c->tx_busy) conn_finish(c);
+        }
+        uring_cqe_seen(&g_ring);
+    }
+}
 
+/* Handshake, then messages until the peer leaves; with --io uring the
+ * messages are the ring's. */
 static void *client_thread(void *arg) {
     ClientCtx *c = (ClientCtx*)arg;
     int fd = c->fd;
-    free(c);
 
     uint16_t type=0; uint32_t len=0;
     if (net_recv_header(fd, &type, &len) != 0) goto done;
-    if (type != MSG_HELLO || len != sizeof(MsgHello)) goto done;
 
     MsgHello h;
-    if (net_recv_all(fd, &h, (int)sizeof(h)) != 0) goto done;
-    h.name[SNAKE_NAME_MAX-1] = 0;
+    MsgResume r;
+    uint8_t in[CONN_MSG_MAX];
+    uint16_t version = 0;
+    if (type == MSG_HELLO && len == WIRE_SIZE(msg_hello)) {
+        if (net_recv_all(fd, in, (int)len) != 0) goto done;
+        (void)msg_hello_decode(&h, in, len);
+        h.name[SNAKE_NAME_MAX-1] = 0;
+        version = h.version;
+    } else if (type == MSG_RESUME && len == WIRE_SIZE(msg_resume)) {
+        if (net_recv_all(fd, in, (int)len) != 0) goto done;
+        (void)msg_resume_decode(&r, in, len);
+        version = r.version;
+    } else {
+        goto done;
+    }
+    if (version != PROTOCOL_VERSION) {
+        (void)net_send_msg(fd, MSG_BYE, NULL, 0);
+        goto done;
+    }
 
     int slot = -1;
+    MsgWelcome w;
+    memset(&w, 0, sizeof(w));
 
     pthread_mutex_lock(&g_game.mtx);
 
-    if (g_game.game_over) { pthread_mutex_unlock(&g_game.mtx); goto done; }
-
-    int ex = find_player_by_name(&g_game, h.name);
-    
-    if (ex >= 0 && g_game.players[ex].connected) {
-      pthread_mutex_unlock(&g_game.mtx);
-      goto done;
-    }
+    if (g_game.game_over && g_lobby_ms == 0) { pthread_mutex_unlock(&g_game.mtx); goto done; }
 
-    if (ex >= 0) {
-        slot = ex;
-        g_game.players[slot].connected = true;
-        g_game.players[slot].active = true;
-        g_game.players[slot].fd = fd;
-        if (!g_game.players[slot].alive) {
-            uint16_t keep = g_game.players[slot].score;
-            Cell sp = find_free_cell(&g_game);
-            init_player(&g_game.players[slot], g_game.players[slot].name, sp, keep);
-            g_game.players[slot].fd = fd;
-            clear_fruit_visits_for_slot(&g_game, slot);
+    if (type == MSG_RESUME) {
+        slot = session_lookup(&g_sessions, r.token);
+        if (slot < 0 || !g_game.players[slot].used) {
+            pthread_mutex_unlock(&g_game.mtx);
+            (void)net_send_msg(fd, MSG_BYE, NULL, 0);
+            goto done;
         }
-        g_game.global_freeze_ms = 3000;
+        /* The token holder wins: a connection the server still thinks is
+         * alive is a stale one the client has already given up on. */
+        if (g_game.players[slot].connected && g_game.meta[slot].fd >= 0) shutdown(g_game.meta[slot].fd, SHUT_RDWR);
+        rejoin_slot(slot, fd);
+        g_conns[slot] = c;
+        memcpy(w.token, r.token, RESUME_TOKEN_LEN);
+        eventlog_emit(EV_RESUME, slot, 0, 0, 0, 0);
     } else {
         int s = alloc_slot(&g_game);
         if (s < 0) { pthread_mutex_unlock(&g_game.mtx); goto done; }
         slot = s;
         Cell sp = find_free_cell(&g_game);
-        init_player(&g_game.players[slot], h.name, sp, 0);
-        g_game.players[slot].fd = fd;
+        init_player(&g_game.players[slot], sp, 0);
+        init_player_meta(&g_game.meta[slot], h.name);
+        g_game.meta[slot].fd = fd;
+        g_conns[slot] = c;
+        c->fresh = true;
+        if (!session_issue(&g_sessions, slot, w.token)) {
+            g_game.players[slot].used = false;
+            pthread_mutex_unlock(&g_game.mtx);
+            goto done;
+        }
+        eventlog_emit(EV_JOIN, slot, 0, 0, 0, 0);
     }
 
     ensure_fruits_count(&g_game);
+    ConfigBlob *cfg = config_ref(g_config);
     pthread_mutex_unlock(&g_game.mtx);
 
-    MsgWelcome w;
-    w.player_id = htonl((uint32_t)slot);
-    if (net_send_msg(fd, MSG_WELCOME, &w, (uint32_t)sizeof(w)) != 0) goto done;
+    w.version = PROTOCOL_VERSION;
+    w.player_id = (uint32_t)slot;
+    memcpy(w.config_hash, cfg->config_hash, CONFIG_HASH_LEN);
+    memcpy(w.map_hash, cfg->map_hash, CONFIG_HASH_LEN);
+    uint8_t out[WIRE_SIZE(msg_welcome)];
+    bool sent = net_send_msg(fd, MSG_WELCOME, out, (uint32_t)msg_welcome_encode(&w, out)) == 0;
+
+    bool have_config = (type == MSG_RESUME) && memcmp(r.config_hash, cfg->config_hash, CONFIG_HASH_LEN) == 0;
+    bool want_map = true;
+    if (sent && !have_config) {
+        sent = recv_config_request(fd, &want_map) == 0 && send_config(c, cfg, want_map) == 0;
+    }
 
-    uint8_t *cfg_buf=NULL; uint32_t cfg_len=0;
+    /* A reload that landed during the handshake shows up as a stale
+     * config_gen, and the next broadcast tells the client. */
     pthread_mutex_lock(&g_game.mtx);
-    build_config_payload(&g_game, &cfg_buf, &cfg_len);
+    if (sent && slot >= 0 && slot < MAX_PLAYERS && g_game.players[slot].used && g_game.meta[slot].fd == fd) {
+        g_game.meta[slot].ready = true;
+        g_game.meta[slot].config_gen = cfg->gen;
+        reset_input(&g_game.players[slot]);
+    }
     pthread_mutex_unlock(&g_game.mtx);
+    config_unref(cfg);
+    if (!sent) goto done;
+    c->slot = slot;
+    conn_ready(c);
+
+    /* From here the ring serves the connection and the thread is done. */
+    if (g_uring) {
+        pthread_mutex_lock(&g_adopt_mtx);
+        c->next = g_adopt;
+        g_adopt = c;
+        pthread_mutex_unlock(&g_adopt_mtx);
+        return NULL;
+    }
+
+    while (g_running) {
+        uint16_t t=0; uint32_t l=0;
+        if (net_recv_header(fd, &t, &l) != 0) break;
+        __atomic_store_n(&c->last_rx_ms, now_ms(), __ATOMIC_RELAXED);
+        bool keep = l <= sizeof(in);
+        if ((keep ? net_recv_all(fd, in, (int)l) : net_discard(fd, l)) != 0) break;
+        if (!conn_message(c, t, keep ? in : NULL, l)) break;
+    }
 
-    if (!cfg_buf) goto done;
-    if (net_send_msg(fd, MSG_CONFIG, cfg_buf, cfg_len) != 0) { free(cfg_buf); goto done; }
-    free(cfg_buf);
+done:
+    conn_finish(c);
+    return NULL;
+}
 
+static void start_client(int cfd) {
+    ClientCtx *ctx = (ClientCtx*)calloc(1, sizeof(ClientCtx));
+    if (!ctx) {
+        close(cfd);
+        return;
+    }
+    ctx->fd = cfd;
+    ctx->tx_buf = (uint8_t*)malloc(CONN_TX_MAX);
+    if (!ctx->tx_buf) {
+        free(ctx);
+        close(cfd);
+        return;
+    }
+    timer_init(&ctx->rx, on_rx_timer, ctx);
+    timer_init(&ctx->tx, on_tx_timer, ctx);
+    if (g_handshake_ms > 0) {
+        pthread_mutex_lock(&g_timer_mtx);
+        timer_arm(&g_timers, &ctx->rx, now_ms() + g_handshake_ms);
+        pthread_mutex_unlock(&g_timer_mtx);
+    }
+    pthread_t th;
+    if (pthread_create(&th, NULL, client_thread, ctx) == 0) {
+        pthread_detach(th);
+    } else {
+        pthread_mutex_lock(&g_timer_mtx);
+        timer_cancel(&g_timers, &ctx->rx);
+        pthread_mutex_unlock(&g_timer_mtx);
+        free(ctx->tx_buf);
+        free(ctx);
+        close(cfd);
+    }
+}
+
+/* Drains every queued connection in one go, so a reconnect storm empties
+ * the backlog at once instead of one client per loop iteration. */
+#define ACCEPT_BATCH 64
+
+static void accept_pending(int listen_fd) {
+    int fds[ACCEPT_BATCH];
+    int n;
+    do {
+        n = net_accept_batch(listen_fd, fds, ACCEPT_BATCH);
+        for (int i=0;i<n;i++) start_client(fds[i]);
+    } while (n == ACCEPT_BATCH);
+}
+
+/* With --acceptors N each thread owns an SO_REUSEPORT socket on the game
+ * port and the kernel spreads incoming connections across them. */
+static void *acceptor_main(void *arg) {
+    int listen_fd = (int)(intptr_t)arg;
+    struct pollfd pfd = { .fd = listen_fd, .events = POLLIN, .revents = 0 };
+    while (g_running) {
+        if (poll(&pfd, 1, 100) > 0) accept_pending(listen_fd);
+    }
+    return NULL;
+}
+
+/* Hot reload: SIGHUP starts a loader thread that re-reads --reload-file
+ * (or the current map when there is none) and builds the new board and
+ * config off the game mutex. The result is parked in g_pending_reload and
+ * swapped in by the game loop between two ticks, so loading never stalls
+ * a tick however large the map is. */
+typedef struct {
+    Game scratch;
+    ConfigBlob *cfg;
+} PendingReload;
+
+static PendingReload *g_pending_reload;
+static int g_reload_busy;
+static const char *g_reload_file;
+/* --fresh-map: a daemon on a "gen:" board moves to the next seed after
+ * every match. The board is built by the reload thread during the lobby,
+ * so the next match starts without a pause. */
+static bool g_fresh_map;
+static int g_reseed;
+
+static void pending_reload_free(PendingReload *pr) {
+    if (!pr) return;
+    world_free(&pr->scratch.map);
+    config_unref(pr->cfg);
+    free(pr);
+}
+
+static void *reload_main(void *arg) {
+    (void)arg;
+    ReloadSpec rs;
+    bool bots = false;
     pthread_mutex_lock(&g_game.mtx);
-    if (slot >= 0 && slot < MAX_PLAYERS && g_game.players[slot].used) g_game.players[slot].ready = true;
+    reload_spec_from_game(&g_game, &rs);
+    for (int i=0;i<g_game.max_players;i++) if (g_game.players[i].used && g_game.players[i].bot) bots = true;
     pthread_mutex_unlock(&g_game.mtx);
 
-    while (g_running) {
-        uint16_t t=0; uint32_t l=0;
-        if (net_recv_header(fd, &t, &l) != 0) break;
+    bool reseed = __atomic_exchange_n(&g_reseed, 0, __ATOMIC_ACQ_REL) != 0;
+    MapGenSpec spec;
+    if (reseed && mapgen_parse(rs.map, &spec)) {
+        spec.seed++;
+        mapgen_format(&spec, rs.map, sizeof(rs.map));
+    }
 
-        if (t == MSG_INPUT && l == sizeof(MsgInput)) {
-            MsgInput in;
-            if (net_recv_all(fd, &in, (int)sizeof(in)) != 0) break;
-            pthread_mutex_lock(&g_game.mtx);
-            if (slot >= 0 && g_game.players[slot].used && g_game.players[slot].active && g_game.players[slot].alive) {
-                if (in.dir <= 3) g_game.players[slot].pending_dir = in.dir;
-            }
-            pthread_mutex_unlock(&g_game.mtx);
-        } else if (t == MSG_PAUSE_TOGGLE && l == 0) {
-            pthread_mutex_lock(&g_game.mtx);
-            if (slot >= 0 && g_game.players[slot].used && g_game.players[slot].active) {
-                bool was = g_game.players[slot].paused;
-                g_game.players[slot].paused = !was;
-                if (was) g_game.global_freeze_ms = 3000;
-            }
-            pthread_mutex_unlock(&g_game.mtx);
-        } else if (t == MSG_LEAVE && l == 0) {
-            pthread_mutex_lock(&g_game.mtx);
-            if (slot >= 0 && g_game.players[slot].used) {
-                g_game.players[slot].active = false;
-                g_game.players[slot].alive = false;
-            }
-            ensure_fruits_count(&g_game);
-            pthread_mutex_unlock(&g_game.mtx);
-            break;
-        } else {
-            if (l > 0) {
-                char *tmp = (char*)malloc(l);
-                if (!tmp) break;
-                if (net_recv_all(fd, tmp, (int)l) != 0) { free(tmp); break; }
-                free(tmp);
-            }
-            if (t == MSG_BYE) break;
+    char err[256] = "out of memory";
+    uint64_t t0 = now_ms();
+    PendingReload *pr = (PendingReload*)calloc(1, sizeof(PendingReload));
+    bool ok = pr != NULL;
+    if (ok && g_reload_file && !reseed) ok = reload_spec_read(g_reload_file, &rs, err, sizeof(err));
+    if (ok) ok = reload_build(&rs, &pr->scratch, err, sizeof(err));
+    /* Rather than a board the running bots could not plan on. */
+    if (ok && bots && (size_t)pr->scratch.w * (size_t)pr->scratch.h > BOT_MAX_CELLS) {
+        (void)snprintf(err, sizeof(err), "%dx%d board is too large for the bots", pr->scratch.w, pr->scratch.h);
+        ok = false;
+    }
+    if (ok) {
+        pr->cfg = config_blob_build(&pr->scratch);
+        ok = pr->cfg != NULL;
+    }
+
+    if (ok) {
+        fprintf(stderr, "Reload: %s loaded in %llu ms\n", pr->scratch.map_path,
+                (unsigned long long)(now_ms() - t0));
+        pending_reload_free(__atomic_exchange_n(&g_pending_reload, pr, __ATOMIC_ACQ_REL));
+    } else {
+        fprintf(stderr, "Reload failed: %s\n", err);
+        pending_reload_free(pr);
+    }
+    __atomic_store_n(&g_reload_busy, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void start_reload(void) {
+    if (__atomic_exchange_n(&g_reload_busy, 1, __ATOMIC_ACQ_REL)) return;
+    pthread_t th;
+    if (pthread_create(&th, NULL, reload_main, NULL) == 0) pthread_detach(th);
+    else __atomic_store_n(&g_reload_busy, 0, __ATOMIC_RELEASE);
+}
+
+/* Swaps a finished reload in and starts a fresh round on the new board:
+ * every active snake respawns with its score kept. Caller holds the game
+ * mutex. */
+static void apply_pending_reload(uint64_t now) {
+    PendingReload *pr = __atomic_exchange_n(&g_pending_reload, NULL, __ATOMIC_ACQ_REL);
+    if (!pr) return;
+
+    world_free(&g_game.map);
+    g_game.map = pr->scratch.map;
+    memset(&pr->scratch.map, 0, sizeof(pr->scratch.map));
+    g_game.w = pr->scratch.w;
+    g_game.h = pr->scratch.h;
+    g_game.mode = pr->scratch.mode;
+    g_game.world = pr->scratch.world;
+    g_game.time_limit_sec = pr->scratch.time_limit_sec;
+    g_game.tick_ms = pr->scratch.tick_ms;
+    memcpy(g_game.map_path, pr->scratch.map_path, sizeof(g_game.map_path));
+    g_game.tick_gen = 0;
+
+    ConfigBlob *old = g_config;
+    g_config = pr->cfg;
+    g_config->gen = ++g_config_gen;
+    pr->cfg = old;
+
+    g_game.num_fruits = 0;
+    for (int i=0;i<g_game.max_players;i++) {
+        Player *p = &g_game.players[i];
+        if (!p->used || !p->active) continue;
+        Player keep = *p;
+        init_player(p, find_free_cell(&g_game), keep.score);
+        p->connected = keep.connected;
+        p->bot = keep.bot;
+    }
+    ensure_fruits_count(&g_game);
+    g_game.start_ms = now;
+    g_game.last_no_players_ms = 0;
+    g_game.global_freeze_ms = 3000;
+    lag_reset(&g_lag);
+
+    printf("Reload applied: %s, %dx%d, mode %d, world %d, tick %u ms\n", g_game.map_path,
+           g_game.w, g_game.h, g_game.mode, g_game.world, g_game.tick_ms);
+    pending_reload_free(pr);
+}
+
+/* Checkpoints: the game loop captures the state between ticks (a copy of
+ * a few KiB) and a writer thread puts it on disk together with the current
+ * config blob, so the tick never waits on the filesystem. */
+typedef struct {
+    CheckpointBuf state;
+    ConfigBlob *cfg;
+} CheckpointJob;
+
+static const char *g_checkpoint_path;
+static int g_checkpoint_busy;
+
+static void *checkpoint_main(void *arg) {
+    CheckpointJob *job = (CheckpointJob*)arg;
+    if (!checkpoint_write(g_checkpoint_path, &job->state, job->cfg->buf, job->cfg->len)) {
+        perror("checkpoint");
+    }
+    checkpoint_buf_free(&job->state);
+    config_unref(job->cfg);
+    free(job);
+    __atomic_store_n(&g_checkpoint_busy, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Caller holds the game mutex. A checkpoint still being written makes this
+ * one a no-op; the next interval catches up. */
+static void start_checkpoint(uint64_t now) {
+    if (__atomic_exchange_n(&g_checkpoint_busy, 1, __ATOMIC_ACQ_REL)) return;
+    CheckpointJob *job = (CheckpointJob*)calloc(1, sizeof(CheckpointJob));
+    if (job && checkpoint_capture(&g_game, &g_sessions, now, &job->state)) {
+        job->cfg = config_ref(g_config);
+        pthread_t th;
+        if (pthread_create(&th, NULL, checkpoint_main, job) == 0) {
+            pthread_detach(th);
+            return;
         }
+        config_unref(job->cfg);
     }
+    if (job) checkpoint_buf_free(&job->state);
+    free(job);
+    __atomic_store_n(&g_checkpoint_busy, 0, __ATOMIC_RELEASE);
+}
 
-done:
-    pthread_mutex_lock(&g_game.mtx);
-    for (int i=0;i<MAX_PLAYERS;i++) {
-        if (g_game.players[i].used && g_game.players[i].fd == fd) {
-            g_game.players[i].connected = false;
-            g_game.players[i].ready = false;
-            g_game.players[i].fd = -1;
-            if (!g_game.players[i].active) {
-              g_game.players[i].used = false;
-              g_game.players[i].name[0] = '\0';
-            }
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
 
-            break;
+/* Called under the game mutex when the rules end a match. */
+static void finish_match(uint64_t now) {
+    g_game.game_over = true;
+    /* Nothing rewinds a finished match: log its last ticks now. */
+    lag_reset(&g_lag);
+    g_game.end_ms = now;
+    if (g_lobby_ms == 0) {
+        g_running = 0;
+        return;
+    }
+    g_game.lobby_until_ms = now + g_lobby_ms;
+    if (g_fresh_map && strncmp(g_game.map_path, "gen:", 4) == 0) {
+        __atomic_store_n(&g_reseed, 1, __ATOMIC_RELEASE);
+        start_reload();
+    }
+}
+
+static void announce_results(void) {
+    printf("Match %u over after %llus:", (unsigned)g_game.match + 1,
+           (unsigned long long)((g_game.end_ms - g_game.start_ms) / 1000ULL));
+    for (int i=0;i<g_game.max_players;i++) {
+        const Player *p = &g_game.players[i];
+        if (p->used) printf(" %s=%u", g_game.meta[i].name, (unsigned)p->score);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static uint32_t players_in_match(void) {
+    uint32_t n = 0;
+    for (int i=0;i<g_game.max_players;i++) if (g_game.players[i].used) n++;
+    return n;
+}
+
+/* Deaths and pickups of a tick that lag compensation can no longer
+ * re-run, stamped with when it first ran. */
+static void log_final_tick(void *ctx, const LagFrame *f, int n) {
+    (void)ctx;
+    for (int i=0;i<n;i++) {
+        const LagOutcome *o = &f->outcome[i];
+        if (o->die) {
+            eventlog_emit_at(f->ms * 1000ULL, EV_DEATH, i, o->die, (uint32_t)o->at.x, (uint32_t)o->at.y, o->score);
+        } else if (o->ate) {
+            eventlog_emit_at(f->ms * 1000ULL, EV_FRUIT, i, o->fruit, (uint32_t)o->at.x, (uint32_t)o->at.y, o->score);
         }
     }
-    pthread_mutex_unlock(&g_game.mtx);
+}
 
-    close(fd);
-    return NULL;
+/* Deaths and pickups of the tick that just ran, read off its scratch;
+ * without lag compensation nothing changes them afterwards. */
+static void log_tick_events(void) {
+    for (int i=0;i<g_game.max_players;i++) {
+        const TickMove *m = &g_game.moves[i];
+        if (!(m->flags & MOVE_ACTIVE)) continue;
+        const Player *p = &g_game.players[i];
+        if (m->die) {
+            eventlog_emit(EV_DEATH, i, m->die, (uint32_t)p->body[0].x, (uint32_t)p->body[0].y, p->score);
+        } else if (m->flags & MOVE_GROW) {
+            eventlog_emit(EV_FRUIT, i, m->fruit, (uint32_t)m->next.x, (uint32_t)m->next.y, p->score);
+        }
+    }
+}
+
+static void log_match_end(void) {
+    uint64_t len = g_game.end_ms - g_game.start_ms;
+    eventlog_emit(EV_MATCH_END, EVENT_NO_SLOT, 0, g_game.match + 1, len > 0xFFFFFFFFULL ? 0xFFFFFFFFu : (uint32_t)len, 0);
+    for (int i=0;i<g_game.max_players;i++) {
+        const Player *p = &g_game.players[i];
+        if (p->used) eventlog_emit(EV_RESULT, i, p->bot ? 1 : 0, p->score, p->time_ms_final, 0);
+    }
+}
+
+static void start_next_match(uint64_t now) {
+    bool humans = false;
+    for (int i=0;i<g_game.max_players;i++) {
+        const Player *p = &g_game.players[i];
+        if (p->used && p->connected && !p->bot) humans = true;
+    }
+    /* Nobody to play with: hold the lobby open until someone joins. */
+    if (!humans) {
+        g_game.lobby_until_ms = now + g_lobby_ms;
+        return;
+    }
+
+    uint64_t t0 = now_us();
+    uint64_t ended = g_game.end_ms;
+    /* Slots kept for a resume are not carried into the next match. */
+    for (int i=0;i<g_game.max_players;i++) {
+        Player *p = &g_game.players[i];
+        if (!p->used || p->connected || p->bot) continue;
+        p->used = false;
+        g_game.meta[i].name[0] = '\0';
+        session_revoke(&g_sessions, i);
+    }
+    reset_match(&g_game, now);
+    lag_reset(&g_lag);
+    g_game.match++;
+    eventlog_emit(EV_MATCH_START, EVENT_NO_SLOT, 0, g_game.match + 1, players_in_match(), 0);
+    printf("Match %u starts %llu ms after the last one (reset took %llu us)\n", (unsigned)g_game.match + 1,
+           (unsigned long long)(now - ended), (unsigned long long)(now_us() - t0));
+    fflush(stdout);
 }
 
-int main(int argc, char **argv) {
+int run_server(int argc, char **argv, int local_fd) {
     srand((unsigned)time(NULL));
     signal(SIGINT, on_sigint);
+    signal(SIGHUP, on_sighup);
+
+    /* Options are "--name value" pairs; they are pulled out of argv so the
+     * positional arguments keep their historical indices. */
+    int bots = 0;
+    int bot_budget_ms = 5;
+    int tick_threads = 1;
+    int backlog = NET_DEFAULT_BACKLOG;
+    int acceptors = 0;
+    int checkpoint_ms = 5000;
+    const char *record_path = NULL;
+    const char *shm_name = NULL;
+    int record_keyframe = REC_DEFAULT_KEYFRAME_EVERY;
+    const char *restore_path = NULL;
+    const char *event_log_path = NULL;
+    int event_log_mb = 64;
+    int lag_ticks = 4;
+    bool want_uring = false;
+    /* addrs[0] is the positional address; --listen adds more. */
+    NetAddr addrs[MAX_LISTEN_ADDRS];
+    int naddrs = 1;
+    int nargc = 1;
+    for (int i=1;i<argc;i++) {
+        if (strncmp(argv[i], "--", 2) == 0 && i + 1 < argc) {
+            const char *opt = argv[i] + 2;
+            const char *val = argv[++i];
+            if (strcmp(opt, "bots") == 0) bots = clampi(atoi(val), 0, MAX_PLAYERS);
+            else if (strcmp(opt, "bot-budget-ms") == 0) bot_budget_ms = clampi(atoi(val), 1, 1000);
+            else if (strcmp(opt, "tick-threads") == 0) tick_threads = clampi(atoi(val), 1, 256);
+            else if (strcmp(opt, "backlog") == 0) backlog = clampi(atoi(val), 1, 65535);
+            else if (strcmp(opt, "acceptors") == 0) acceptors = clampi(atoi(val), 0, 64);
+            else if (strcmp(opt, "reload-file") == 0) g_reload_file = val;
+            else if (strcmp(opt, "checkpoint") == 0) g_checkpoint_path = val;
+            else if (strcmp(opt, "checkpoint-ms") == 0) checkpoint_ms = clampi(atoi(val), 100, 3600000);
+            else if (strcmp(opt, "restore") == 0) restore_path = val;
+            else if (strcmp(opt, "record") == 0) record_path = val;
+            else if (strcmp(opt, "shm") == 0) shm_name = val;
+            else if (strcmp(opt, "io") == 0) {
+                if (strcmp(val, "uring") == 0) want_uring = true;
+                else if (strcmp(val, "threads") != 0) fprintf(stderr, "Unknown --io %s, using threads\n", val);
+            }
+            else if (strcmp(opt, "lag-ticks") == 0) lag_ticks = clampi(atoi(val), 0, LAG_MAX_TICKS);
+            else if (strcmp(opt, "event-log") == 0) event_log_path = val;
+            else if (strcmp(opt, "event-log-mb") == 0) event_log_mb = clampi(atoi(val), 0, 1 << 20);
+            else if (strcmp(opt, "record-keyframe") == 0) record_keyframe = clampi(atoi(val), 1, 100000);
+            else if (strcmp(opt, "handshake-sec") == 0) g_handshake_ms = (uint32_t)clampi(atoi(val), 0, 3600) * 1000u;
+            else if (strcmp(opt, "idle-sec") == 0) g_idle_ms = (uint32_t)clampi(atoi(val), 0, 86400) * 1000u;
+            else if (strcmp(opt, "send-stall-ms") == 0) g_send_stall_ms = (uint32_t)clampi(atoi(val), 0, 600000);
+            else if (strcmp(opt, "fresh-map") == 0) g_fresh_map = atoi(val) != 0;
+            else if (strcmp(opt, "lobby-sec") == 0) g_lobby_ms = (uint32_t)clampi(atoi(val), 0, 3600) * 1000u;
+            else if (strcmp(opt, "listen") == 0) {
+                if (naddrs < MAX_LISTEN_ADDRS && net_addr_parse(val, DEFAULT_PORT, &addrs[naddrs])) naddrs++;
+                else fprintf(stderr, "Ignoring --listen %s\n", val);
+            }
+            else fprintf(stderr, "Unknown option --%s\n", opt);
+            continue;
+        }
+        argv[nargc++] = argv[i];
+    }
+    argc = nargc;
 
-    int port = DEFAULT_PORT;
-    if (argc >= 2) {
-        port = atoi(argv[1]);
-        if (port <= 0 || port > 65535) port = DEFAULT_PORT;
+    if (!net_addr_parse((argc >= 2) ? argv[1] : "", DEFAULT_PORT, &addrs[0])) {
+        fprintf(stderr, "Bad listen address: %s\n", argv[1]);
+        return 1;
     }
 
     int mode = 0;
@@ -620,8 +1456,20 @@ int main(int argc, char **argv) {
     world = (world == 0) ? 0 : 1;
     time_limit = clampi(time_limit, 5, 3600);
 
-    memset(&g_game, 0, sizeof(g_game));
+    if (!game_init(&g_game, MAX_PLAYERS)) {
+        fprintf(stderr, "Failed to allocate game state\n");
+        return 1;
+    }
     (void)pthread_mutex_init(&g_game.mtx, NULL);
+    if (tick_threads > 1) g_game.pool = pool_create(tick_threads);
+    if (!lag_init(&g_lag, g_game.max_players, lag_ticks)) {
+        fprintf(stderr, "Failed to allocate the tick history\n");
+        return 1;
+    }
+    if (!session_init(&g_sessions, g_game.max_players)) {
+        fprintf(stderr, "Failed to allocate the session table\n");
+        return 1;
+    }
 
     g_game.mode = (uint8_t)mode;
     g_game.world = (uint8_t)world;
@@ -632,15 +1480,56 @@ int main(int argc, char **argv) {
     g_game.game_over = false;
 
     const char *map_arg = (argc >= 3) ? argv[2] : "-";
+    MapGenSpec spec;
+
+    /* --restore falls back to the command-line game when the checkpoint is
+     * missing or unreadable, so a deploy script can always pass it. */
+    bool restored = false;
+    if (restore_path) {
+        char err[256];
+        uint64_t t0 = now_ms();
+        restored = checkpoint_load(restore_path, &g_game, &g_sessions, t0, err, sizeof(err));
+        if (restored) {
+            printf("Restored %s in %llu ms\n", restore_path, (unsigned long long)(now_ms() - t0));
+            /* Give reconnecting players the same grace as after a pause. */
+            g_game.global_freeze_ms = 3000;
+        } else {
+            fprintf(stderr, "Not restoring: %s\n", err);
+            g_game.mode = (uint8_t)mode;
+            g_game.world = (uint8_t)world;
+            g_game.time_limit_sec = (uint16_t)time_limit;
+            g_game.tick_ms = 120;
+            g_game.global_freeze_ms = 0;
+            g_game.last_no_players_ms = 0;
+        }
+    }
 
-    if (strcmp(map_arg, "-") == 0) {
+    if (restored) {
+        /* map, board size and parameters come from the checkpoint */
+    } else if (strcmp(map_arg, "-") == 0) {
       int w = (argc >= 7) ? atoi(argv[6]) : 40;
       int h = (argc >= 8) ? atoi(argv[7]) : 20;
-      if (w < 10) w = 10;
-      if (h < 10) h = 10;
+      w = clampi(w, 10, WORLD_MAX_DIM);
+      h = clampi(h, 10, WORLD_MAX_DIM);
 
       gen_map(&g_game, w, h, (world == 1));
       (void)snprintf(g_game.map_path, sizeof(g_game.map_path), "generated:%dx%d", w, h);
+    } else if (mapgen_parse(map_arg, &spec)) {
+      int w = clampi((argc >= 7) ? atoi(argv[6]) : 40, 10, WORLD_MAX_DIM);
+      int h = clampi((argc >= 8) ? atoi(argv[7]) : 20, 10, WORLD_MAX_DIM);
+      if ((uint64_t)w * (uint64_t)h > MAPGEN_MAX_CELLS) {
+        fprintf(stderr, "%dx%d is too large for a generated map\n", w, h);
+        return 1;
+      }
+      if (spec.seed == 0) spec.seed = mapgen_random_seed();
+      g_game.world = 1;
+      uint64_t t0 = now_ms();
+      if (!gen_map_seeded(&g_game, w, h, &spec)) {
+        fprintf(stderr, "Failed to generate a %dx%d map\n", w, h);
+        return 1;
+      }
+      mapgen_format(&spec, g_game.map_path, sizeof(g_game.map_path));
+      printf("Generated %s in %llu ms\n", g_game.map_path, (unsigned long long)(now_ms() - t0));
     } else {
       (void)snprintf(g_game.map_path, sizeof(g_game.map_path), "%s", map_arg);
       if (!load_map_file(map_arg, &g_game)) {
@@ -649,40 +1538,158 @@ int main(int argc, char **argv) {
     }
 }
 
-    int listen_fd = net_listen_tcp(port);
-    if (listen_fd < 0) {
-        perror("net_listen_tcp");
+    printf("World %dx%d: %zu chunks, %zu KiB\n", g_game.w, g_game.h,
+           g_game.map.chunk_count, world_memory(&g_game.map) / 1024);
+
+    g_config = config_blob_build(&g_game);
+    if (!g_config) {
+        fprintf(stderr, "Failed to prepare the session config\n");
         return 1;
     }
+    g_config->gen = ++g_config_gen;
+    for (int i=0;i<MAX_PLAYERS;i++) pthread_mutex_init(&g_send_mtx[i], NULL);
+
+    /* --record keeps every broadcast MSG_STATE; see common/recording.h. */
+    RecWriter rec;
+    bool recording = false;
+    uint32_t rec_config_gen = g_config->gen;
+    if (record_path) {
+        recording = rec_writer_open(&rec, record_path, g_game.tick_ms, (uint32_t)record_keyframe,
+                                    g_config->buf, g_config->len);
+        if (!recording) perror(record_path);
+    }
+
+    /* --shm publishes the same for local readers; see common/shm.h. */
+    ShmWriter shm;
+    bool sharing = false;
+    uint32_t shm_config_gen = g_config->gen;
+    if (shm_name) {
+        char err[128];
+        sharing = shm_writer_open(&shm, shm_name, g_config->len, err, sizeof(err));
+        if (sharing) {
+            shm_writer_config(&shm, g_config->gen, g_config->buf, g_config->len);
+            printf("Publishing snapshots to shared memory %s\n", shm.name);
+        } else {
+            fprintf(stderr, "--shm %s: %s\n", shm_name, err);
+        }
+    }
+
+    if (event_log_path) {
+        g_event_log = eventlog_open(event_log_path, (uint64_t)event_log_mb << 20, EVENT_RING_DEFAULT);
+        if (g_event_log) {
+            printf("Logging events to %s\n", event_log_path);
+            g_lag.on_final = log_final_tick;
+        } else {
+            perror(event_log_path);
+        }
+    }
 
-    g_game.start_ms = now_ms();
-    g_game.last_tick_ms = g_game.start_ms;
+    /* Bots restored from a checkpoint count towards --bots. */
+    int have_bots = 0;
+    for (int i=0;i<g_game.max_players;i++) if (g_game.players[i].used && g_game.players[i].bot) have_bots++;
+
+    BotPlanner planner;
+    memset(&planner, 0, sizeof(planner));
+    if (bots > 0 || have_bots > 0) {
+        if (!bot_planner_init(&planner, g_game.w, g_game.h, g_game.max_players, (uint32_t)bot_budget_ms * 1000u)) {
+            fprintf(stderr, "Bots disabled: board too large for the bot planner\n");
+            bots = 0;
+        } else {
+            bots = have_bots + ((bots > have_bots) ? bot_spawn(&g_game, bots - have_bots) : 0);
+        }
+    }
+    for (int i=0;i<g_game.max_players;i++) {
+        if (g_game.players[i].used && g_game.players[i].bot) eventlog_emit(EV_JOIN, i, 1, 0, 0, 0);
+    }
+    uint64_t last_bot_report_ms = now_ms();
+
+    /* Connection deadlines run on their own thread so a send stalled in
+     * the game loop still gets cut off. */
+    timer_wheel_init(&g_timers, now_ms(), TIMER_TICK_MS);
+    pthread_t timer_tid;
+    if (pthread_create(&timer_tid, NULL, timer_main, NULL) != 0) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    if (want_uring) {
+        char err[128];
+        if (uring_init(&g_ring, 256, 256, 2048, err, sizeof(err))) g_uring = true;
+        else fprintf(stderr, "io_uring unavailable (%s), serving clients from threads\n", err);
+    }
+
+    /* The first `acceptors` sockets belong to acceptor threads, all on
+     * addrs[0]; the game loop polls the rest itself. pair: addresses are
+     * already connected and join like accepted clients. */
+    if (addrs[0].kind == NET_PAIR) acceptors = 0;
+    if (addrs[0].kind == NET_UNIX && acceptors > 1) {
+        fprintf(stderr, "A Unix socket cannot be shared; using one acceptor\n");
+        acceptors = 1;
+    }
+    int nlisten = 0;
+    int listen_fds[64 + MAX_LISTEN_ADDRS];
+    const NetAddr *listen_addrs[64 + MAX_LISTEN_ADDRS];
+    pthread_t acceptor_tids[64];
+    for (int a=0;a<naddrs;a++) {
+        if (addrs[a].kind == NET_PAIR) continue;
+        int socks = (a == 0 && acceptors > 0) ? acceptors : 1;
+        int first = nlisten;
+        char name[NET_HOST_MAX + 16];
+        net_addr_format(&addrs[a], name, sizeof(name));
+        for (int k=0;k<socks;k++) {
+            int flags = NET_LISTEN_NONBLOCK | ((socks > 1) ? NET_LISTEN_REUSEPORT : 0);
+            int fd = net_listen(&addrs[a], backlog, flags);
+            if (fd < 0) {
+                perror(name);
+                /* A local game still has its own player without the port. */
+                if (local_fd < 0) return 1;
+                while (nlisten > first) close(listen_fds[--nlisten]);
+                if (a == 0) acceptors = 0;
+                fprintf(stderr, "%s unavailable, playing locally only\n", name);
+                break;
+            }
+            listen_fds[nlisten] = fd;
+            listen_addrs[nlisten] = &addrs[a];
+            nlisten++;
+        }
+        if (nlisten > first) printf("Listening on %s\n", name);
+    }
+    for (int i=0;i<acceptors;i++) {
+        if (pthread_create(&acceptor_tids[i], NULL, acceptor_main, (void*)(intptr_t)listen_fds[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    struct pollfd polled[MAX_LISTEN_ADDRS];
+    int npolled = 0;
+    for (int i=acceptors;i<nlisten;i++) {
+        polled[npolled].fd = listen_fds[i];
+        polled[npolled].events = POLLIN;
+        polled[npolled].revents = 0;
+        npolled++;
+    }
+    if (local_fd >= 0) start_client(local_fd);
+    for (int a=0;a<naddrs;a++) {
+        if (addrs[a].kind == NET_PAIR) start_client(addrs[a].fd);
+    }
+
+    static uint8_t state_buf[MSG_STATE_MAX_LEN];
+    static MsgState state;
+
+    g_game.last_tick_ms = now_ms();
+    if (!restored) g_game.start_ms = g_game.last_tick_ms;
+    eventlog_emit(EV_MATCH_START, EVENT_NO_SLOT, 0, g_game.match + 1, players_in_match(), 0);
+    uint64_t last_checkpoint_ms = g_game.last_tick_ms;
 
     while (g_running) {
-        fd_set rfds;
-        FD_ZERO(&rfds);
-        FD_SET(listen_fd, &rfds);
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 0;
-
-        int sel = select(listen_fd + 1, &rfds, NULL, NULL, &tv);
-        if (sel > 0 && FD_ISSET(listen_fd, &rfds)) {
-            int cfd = accept(listen_fd, NULL, NULL);
-            if (cfd >= 0) {
-                ClientCtx *ctx = (ClientCtx*)calloc(1, sizeof(ClientCtx));
-                if (ctx) {
-                    ctx->fd = cfd;
-                    pthread_t th;
-                    if (pthread_create(&th, NULL, client_thread, ctx) == 0) {
-                        pthread_detach(th);
-                    } else {
-                        free(ctx);
-                        close(cfd);
-                    }
-                } else {
-                    close(cfd);
-                }
+        if (g_reload_requested) {
+            g_reload_requested = 0;
+            start_reload();
+        }
+
+        if (npolled > 0 && poll(polled, (nfds_t)npolled, 0) > 0) {
+            for (int i=0;i<npolled;i++) {
+                if (polled[i].revents & POLLIN) accept_pending(polled[i].fd);
             }
         }
 
@@ -693,19 +1700,23 @@ int main(int argc, char **argv) {
             bool just_finished = false;
 
             pthread_mutex_lock(&g_game.mtx);
+            apply_pending_reload(now);
 
-            if (g_game.mode == 1) {
+            if (g_game.game_over) {
+                /* Only a daemon gets here: the lobby between two matches. */
+                if (now >= g_game.lobby_until_ms) start_next_match(now);
+            } else if (g_game.mode == 1) {
                 uint64_t elapsed_ms = now - g_game.start_ms;
                 if (elapsed_ms >= (uint64_t)g_game.time_limit_sec * 1000ULL) {
-                    g_game.game_over = true;
-                    g_running = 0;
+                    finish_match(now);
+                    just_finished = true;
                 }
             } else {
                 if (!any_connected_active_alive(&g_game)) {
                     if (g_game.last_no_players_ms == 0) g_game.last_no_players_ms = now;
                     if (now - g_game.last_no_players_ms >= 10000ULL) {
-                        g_game.game_over = true;
-                        g_running = 0;
+                        finish_match(now);
+                        just_finished = true;
                     }
                 } else {
                     g_game.last_no_players_ms = 0;
@@ -722,27 +1733,161 @@ int main(int argc, char **argv) {
                   p->time_ms_final = (uint32_t)d;
         }
     }
+    announce_results();
+    log_match_end();
 }
-            if (g_running) tick_game(&g_game, dt);
+            if (g_running && !g_game.game_over) {
+                lag_rewind(&g_lag, &g_game);
+                if (bots > 0 && g_game.global_freeze_ms == 0 && !bots_think(&planner, &g_game)) {
+                    fprintf(stderr, "Bots removed: the %dx%d board is too large for the bot planner\n", g_game.w,
+                            g_game.h);
+                    for (int i=0;i<g_game.max_players;i++) {
+                        if (!g_game.players[i].used || !g_game.players[i].bot) continue;
+                        eventlog_emit(EV_LEAVE, i, EV_LEAVE_QUIT, 0, 0, 0);
+                    }
+                    bot_despawn(&g_game);
+                    bots = 0;
+                }
+                uint32_t ticks = g_game.tick;
+                lag_tick(&g_lag, &g_game, dt);
+                /* A frozen tick leaves the scratch of the last real one.
+                 * With a lag window, log_final_tick logs the tick later. */
+                if (g_event_log && g_lag.depth == 0 && g_game.tick != ticks) log_tick_events();
+            }
 
-            MsgState st;
-            build_state(&g_game, &st);
+            build_state(&g_game, &state);
+            uint32_t state_len = (uint32_t)msg_state_encode(&state, state_buf);
 
             for (int i=0;i<MAX_PLAYERS;i++) {
                 Player *p = &g_game.players[i];
-                if (!p->used || !p->connected || !p->ready) continue;
-                if (p->fd < 0) continue;
-                (void)net_send_msg(p->fd, MSG_STATE, &st, (uint32_t)sizeof(st));
+                PlayerMeta *m = &g_game.meta[i];
+                if (!p->used || !p->connected || !m->ready) continue;
+                ClientCtx *c = g_conns[i];
+                if (m->fd < 0 || !c) continue;
+                if (c->on_ring) {
+                    /* Still sending the last one: skip a tick, as below. */
+                    if (!c->tx_busy && !c->closing) ring_send(c, put_tick(c, i, state_buf, state_len), NULL, 0);
+                    continue;
+                }
+                if (pthread_mutex_trylock(&g_send_mtx[i]) != 0) continue;
+                /* Whatever of the last tick the socket took since; a client
+                 * still behind skips this one, as on the ring. */
+                conn_push(c);
+                if (c->tx_off == c->tx_len) {
+                    c->tx_len = put_tick(c, i, state_buf, state_len);
+                    c->tx_off = 0;
+                    conn_push(c);
+                }
+                pthread_mutex_unlock(&g_send_mtx[i]);
+            }
+
+            if (g_checkpoint_path && !g_game.game_over && now - last_checkpoint_ms >= (uint64_t)checkpoint_ms) {
+                start_checkpoint(now);
+                last_checkpoint_ms = now;
             }
 
             pthread_mutex_unlock(&g_game.mtx);
             g_game.last_tick_ms = now;
+            if (g_uring) {
+                (void)uring_submit(&g_ring, 0, 0);
+                g_ring_ticks++;
+            }
+
+            /* state_buf and g_config only change on this thread. */
+            if (recording) {
+                if (g_config->gen != rec_config_gen) {
+                    (void)rec_writer_config(&rec, g_config->buf, g_config->len);
+                    rec_config_gen = g_config->gen;
+                }
+                if (!rec_writer_frame(&rec, state_buf, state_len)) {
+                    fprintf(stderr, "Recording to %s failed, stopped\n", record_path);
+                    (void)rec_writer_close(&rec);
+                    recording = false;
+                }
+            }
+            if (sharing) {
+                if (g_config->gen != shm_config_gen) {
+                    shm_writer_config(&shm, g_config->gen, g_config->buf, g_config->len);
+                    shm_config_gen = g_config->gen;
+                }
+                shm_writer_state(&shm, state.tick, state_buf, state_len);
+            }
+
+            if (now - last_bot_report_ms >= 10000ULL) {
+                if (bots > 0) bot_stats_report(&planner, stderr);
+                lag_stats_report(&g_lag, stderr);
+                if (g_uring && g_ring_ticks > 0) {
+                    fprintf(stderr, "uring: %.1f submits and %.1f waits per tick, %llu operations, %llu completions\n",
+                            (double)(g_ring.stats.enters - g_ring.stats.waits) / (double)g_ring_ticks,
+                            (double)g_ring.stats.waits / (double)g_ring_ticks, (unsigned long long)g_ring.stats.sqes,
+                            (unsigned long long)g_ring.stats.cqes);
+                    g_ring.stats = (UringStats){0};
+                    g_ring_ticks = 0;
+                }
+                last_bot_report_ms = now;
+            }
         }
 
-        sleep_ms(5);
+        if (g_uring) ring_poll(5);
+        else sleep_ms(5);
     }
 
-    close(listen_fd);
+    for (int i=0;i<acceptors;i++) pthread_join(acceptor_tids[i], NULL);
+    pthread_join(timer_tid, NULL);
+    if (g_timeouts[CONN_HANDSHAKE] + g_timeouts[CONN_IDLE] + g_timeouts[CONN_SEND_STALL] > 0) {
+        printf("Timed out: %llu in handshake, %llu idle, %llu stalled sends\n",
+               (unsigned long long)g_timeouts[CONN_HANDSHAKE], (unsigned long long)g_timeouts[CONN_IDLE],
+               (unsigned long long)g_timeouts[CONN_SEND_STALL]);
+    }
+    for (int i=0;i<nlisten;i++) net_unlisten(listen_addrs[i], listen_fds[i]);
+    if (g_event_log) {
+        /* The ticks still in the lag window stand as they are. */
+        pthread_mutex_lock(&g_game.mtx);
+        lag_reset(&g_lag);
+        pthread_mutex_unlock(&g_game.mtx);
+        EventLogStats es;
+        eventlog_close(&es);
+        printf("Event log: %llu events in %u file(s), %llu dropped%s\n", (unsigned long long)es.written,
+               (unsigned)es.files, (unsigned long long)es.dropped, es.failed ? ", writing failed" : "");
+    }
+
+    /* A stop for a deploy leaves a final checkpoint to restore from; a
+     * finished match leaves none, so the next --restore starts afresh. */
+    if (g_checkpoint_path) {
+        while (__atomic_load_n(&g_checkpoint_busy, __ATOMIC_ACQUIRE)) sleep_ms(1);
+        if (g_game.game_over) {
+            (void)unlink(g_checkpoint_path);
+        } else {
+            CheckpointBuf final_state;
+            memset(&final_state, 0, sizeof(final_state));
+            pthread_mutex_lock(&g_game.mtx);
+            bool ok = checkpoint_capture(&g_game, &g_sessions, now_ms(), &final_state);
+            pthread_mutex_unlock(&g_game.mtx);
+            if (ok && checkpoint_write(g_checkpoint_path, &final_state, g_config->buf, g_config->len)) {
+                printf("Checkpoint written to %s\n", g_checkpoint_path);
+            }
+            checkpoint_buf_free(&final_state);
+        }
+    }
+    if (sharing) {
+        printf("Published %llu snapshots to %s\n", (unsigned long long)shm.published, shm.name);
+        shm_writer_close(&shm);
+    }
+    if (recording) {
+        uint32_t frames = rec.frames;
+        if (rec_writer_close(&rec)) printf("Recording written to %s (%u frames)\n", record_path, (unsigned)frames);
+        else fprintf(stderr, "Recording to %s failed\n", record_path);
+    }
+    /* Connections still on the ring go with the process, as detached
+     * client threads do. */
+    if (g_uring) uring_free(&g_ring);
+    bot_planner_free(&planner);
+    lag_free(&g_lag);
+    session_free(&g_sessions);
+    config_unref(g_config);
+    pending_reload_free(g_pending_reload);
+    pool_destroy(g_game.pool);
+    game_free(&g_game);
     return 0;
 }
 
@@ -3,16 +3,10 @@
 
 #include <stdint.h>
 
-int run_server(
-    int port,
-    const char *map_path,
-    int mode,
-    int world,
-    int time_limit,
-    int w,
-    int h
-);
-
-void on_sigint(int sig);
+/* Runs a game to completion with the usual command line (argv[0] is
+ * ignored). local_fd, when >= 0, is an already connected stream that is
+ * served like an accepted client as soon as the game is up; the client's
+ * "New game" hands one end of a socketpair in here. */
+int run_server(int argc, char **argv, int local_fd);
 
 #endif
@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "session.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+bool session_init(SessionTable *st, int max_players) {
+    memset(st, 0, sizeof(*st));
+    st->urandom_fd = -1;
+    size_t cap = 8;
+    while (cap < (size_t)max_players * 4) cap <<= 1;
+    st->buckets = (SessionEntry*)calloc(cap, sizeof(SessionEntry));
+    st->slot_bucket = (int*)malloc((size_t)max_players * sizeof(int));
+    if (!st->buckets || !st->slot_bucket) {
+        session_free(st);
+        return false;
+    }
+    for (size_t i=0;i<cap;i++) st->buckets[i].slot = -1;
+    for (int i=0;i<max_players;i++) st->slot_bucket[i] = -1;
+    st->mask = cap - 1;
+    st->max_players = max_players;
+    st->urandom_fd = open("/dev/urandom", O_RDONLY);
+    return true;
+}
+
+void session_free(SessionTable *st) {
+    free(st->buckets);
+    free(st->slot_bucket);
+    if (st->urandom_fd >= 0) close(st->urandom_fd);
+    memset(st, 0, sizeof(*st));
+    st->urandom_fd = -1;
+}
+
+/* Tokens are uniformly random, so their first bytes are already a hash. */
+static size_t token_home(const SessionTable *st, const uint8_t *token) {
+    uint64_t h;
+    memcpy(&h, token, sizeof(h));
+    return (size_t)h & st->mask;
+}
+
+/* Compares every byte so lookup time does not reveal a matching prefix. */
+static bool token_equal(const uint8_t *a, const uint8_t *b) {
+    uint8_t diff = 0;
+    for (int i=0;i<RESUME_TOKEN_LEN;i++) diff |= (uint8_t)(a[i] ^ b[i]);
+    return diff == 0;
+}
+
+static void fill_random(SessionTable *st, uint8_t *out, size_t n) {
+    size_t got = 0;
+    while (st->urandom_fd >= 0 && got < n) {
+        ssize_t r = read(st->urandom_fd, out + got, n - got);
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    if (got == n) return;
+    /* No urandom: weak, but still unguessable from the player name. */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t x = (uint64_t)ts.tv_nsec ^ ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)rand();
+    for (size_t i=got;i<n;i++) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        out[i] = (uint8_t)x;
+    }
+}
+
+void session_revoke(SessionTable *st, int slot) {
+    if (slot < 0 || slot >= st->max_players) return;
+    int b = st->slot_bucket[slot];
+    if (b < 0) return;
+    st->slot_bucket[slot] = -1;
+
+    /* Backward-shift deletion keeps probe chains intact without tombstones. */
+    size_t hole = (size_t)b;
+    st->buckets[hole].slot = -1;
+    for (size_t i = (hole + 1) & st->mask; st->buckets[i].slot >= 0; i = (i + 1) & st->mask) {
+        size_t home = token_home(st, st->buckets[i].token);
+        if (((i - home) & st->mask) < ((i - hole) & st->mask)) continue;
+        st->buckets[hole] = st->buckets[i];
+        st->slot_bucket[st->buckets[hole].slot] = (int)hole;
+        st->buckets[i].slot = -1;
+        hole = i;
+    }
+}
+
+static void session_insert(SessionTable *st, int slot, const uint8_t *token) {
+    size_t i = token_home(st, token);
+    while (st->buckets[i].slot >= 0) i = (i + 1) & st->mask;
+    memcpy(st->buckets[i].token, token, RESUME_TOKEN_LEN);
+    st->buckets[i].slot = slot;
+    st->slot_bucket[slot] = (int)i;
+}
+
+bool session_issue(SessionTable *st, int slot, uint8_t token[RESUME_TOKEN_LEN]) {
+    if (slot < 0 || slot >= st->max_players) return false;
+    session_revoke(st, slot);
+    for (;;) {
+        fill_random(st, token, RESUME_TOKEN_LEN);
+        if (session_lookup(st, token) < 0) break;
+    }
+    session_insert(st, slot, token);
+    return true;
+}
+
+bool session_restore(SessionTable *st, int slot, const uint8_t token[RESUME_TOKEN_LEN]) {
+    if (slot < 0 || slot >= st->max_players) return false;
+    session_revoke(st, slot);
+    if (session_lookup(st, token) >= 0) return false;
+    session_insert(st, slot, token);
+    return true;
+}
+
+bool session_token(const SessionTable *st, int slot, uint8_t token[RESUME_TOKEN_LEN]) {
+    if (slot < 0 || slot >= st->max_players || st->slot_bucket[slot] < 0) return false;
+    memcpy(token, st->buckets[st->slot_bucket[slot]].token, RESUME_TOKEN_LEN);
+    return true;
+}
+
+int session_lookup(const SessionTable *st, const uint8_t token[RESUME_TOKEN_LEN]) {
+    for (size_t i = token_home(st, token); st->buckets[i].slot >= 0; i = (i + 1) & st->mask) {
+        if (token_equal(st->buckets[i].token, token)) return st->buckets[i].slot;
+    }
+    return -1;
+}
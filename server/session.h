@@ -0,0 +1,38 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "../common/protocol.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Resume tokens: random 128-bit values mapped to player slots through an
+ * open-addressing table, so a reconnect is one probe sequence instead of a
+ * scan over names. Callers hold the game mutex. */
+typedef struct {
+    uint8_t token[RESUME_TOKEN_LEN];
+    int slot;                   /* -1 when the bucket is empty */
+} SessionEntry;
+
+typedef struct {
+    SessionEntry *buckets;
+    size_t mask;                /* bucket count - 1, a power of two */
+    int *slot_bucket;           /* bucket holding each slot's token, or -1 */
+    int max_players;
+    int urandom_fd;
+} SessionTable;
+
+bool session_init(SessionTable *st, int max_players);
+void session_free(SessionTable *st);
+
+/* Replaces any token the slot had with a fresh one. */
+bool session_issue(SessionTable *st, int slot, uint8_t token[RESUME_TOKEN_LEN]);
+int session_lookup(const SessionTable *st, const uint8_t token[RESUME_TOKEN_LEN]);
+void session_revoke(SessionTable *st, int slot);
+
+/* Checkpoint support: read a slot's token, or put a saved one back. */
+bool session_token(const SessionTable *st, int slot, uint8_t token[RESUME_TOKEN_LEN]);
+bool session_restore(SessionTable *st, int slot, const uint8_t token[RESUME_TOKEN_LEN]);
+
+#endif
@@ -0,0 +1,127 @@
+#include "timer.h"
+
+#define SLOT_BITS 6
+#define SLOT_MASK (TIMER_SLOTS - 1)
+#define MAX_DELTA ((1ULL << (SLOT_BITS * TIMER_LEVELS)) - 1)
+
+static void list_init(Timer *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static void list_add(Timer *head, Timer *t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static void list_del(Timer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = NULL;
+    t->prev = NULL;
+}
+
+void timer_wheel_init(TimerWheel *tw, uint64_t now_ms, uint32_t tick_ms) {
+    for (int l=0;l<TIMER_LEVELS;l++) {
+        for (int s=0;s<TIMER_SLOTS;s++) list_init(&tw->slots[l][s]);
+    }
+    tw->tick = 0;
+    tw->base_ms = now_ms;
+    tw->tick_ms = tick_ms ? tick_ms : 1;
+    tw->count = 0;
+}
+
+void timer_init(Timer *t, timer_fn fn, void *data) {
+    t->next = NULL;
+    t->prev = NULL;
+    t->expires = 0;
+    t->fn = fn;
+    t->data = data;
+}
+
+/* Files t by how far away it is: the level is the first whose span
+ * covers the distance, the slot is picked by the deadline's own bits so
+ * it lines up with the cascade below. */
+static void place(TimerWheel *tw, Timer *t) {
+    uint64_t at = t->expires;
+    if (at < tw->tick) at = tw->tick;
+    uint64_t delta = at - tw->tick;
+    if (delta > MAX_DELTA) {
+        delta = MAX_DELTA;
+        at = tw->tick + MAX_DELTA;
+    }
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1)))) level++;
+    list_add(&tw->slots[level][(at >> (SLOT_BITS * level)) & SLOT_MASK], t);
+}
+
+void timer_arm(TimerWheel *tw, Timer *t, uint64_t deadline_ms) {
+    if (timer_pending(t)) list_del(t);
+    else tw->count++;
+    uint64_t ms = (deadline_ms > tw->base_ms) ? deadline_ms - tw->base_ms : 0;
+    t->expires = (ms + tw->tick_ms - 1) / tw->tick_ms;
+    place(tw, t);
+}
+
+void timer_cancel(TimerWheel *tw, Timer *t) {
+    if (!timer_pending(t)) return;
+    list_del(t);
+    tw->count--;
+}
+
+/* Moves one higher-level slot down; returns the slot index so the caller
+ * knows whether this level wrapped too. */
+static int cascade(TimerWheel *tw, int level) {
+    int idx = (int)((tw->tick >> (SLOT_BITS * level)) & SLOT_MASK);
+    Timer *head = &tw->slots[level][idx];
+    Timer pending;
+    list_init(&pending);
+    if (head->next != head) {
+        pending.next = head->next;
+        pending.prev = head->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        list_init(head);
+    }
+    while (pending.next != &pending) {
+        Timer *t = pending.next;
+        list_del(t);
+        place(tw, t);
+    }
+    return idx;
+}
+
+size_t timer_wheel_advance(TimerWheel *tw, uint64_t now_ms, void *arg) {
+    if (now_ms < tw->base_ms) return 0;
+    uint64_t target = (now_ms - tw->base_ms) / tw->tick_ms;
+    size_t fired = 0;
+    while (tw->tick <= target) {
+        int idx = (int)(tw->tick & SLOT_MASK);
+        if (idx == 0) {
+            for (int l=1;l<TIMER_LEVELS && cascade(tw, l) == 0;l++) {}
+        }
+        Timer *head = &tw->slots[0][idx];
+        tw->tick++;
+        /* Re-arming from fn may land in this very slot (a deadline already
+         * past goes to the current tick), so the slot is emptied first. */
+        Timer due;
+        list_init(&due);
+        if (head->next != head) {
+            due.next = head->next;
+            due.prev = head->prev;
+            due.next->prev = &due;
+            due.prev->next = &due;
+            list_init(head);
+        }
+        while (due.next != &due) {
+            Timer *t = due.next;
+            list_del(t);
+            tw->count--;
+            fired++;
+            t->fn(t, arg);
+        }
+    }
+    return fired;
+}
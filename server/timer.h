@@ -0,0 +1,56 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hierarchical timing wheel. Time is counted in ticks of tick_ms; level k
+ * has 64 slots of 64^k ticks each, so four levels cover 64^4 ticks (about
+ * 1.9 days at 10 ms) and a longer deadline is parked in the last slot and
+ * re-filed when it comes round. Arming and cancelling are O(1) list
+ * operations; an advance touches one level-0 slot per tick and moves a
+ * higher slot down a level each time the wheel below it wraps. A timer
+ * never fires early: deadlines round up to the next tick.
+ *
+ * Timers are intrusive nodes the caller embeds in its own structs, each
+ * with its own callback. The wheel does no locking. */
+typedef struct Timer Timer;
+
+/* Called once per expired timer, which is already unlinked and may be
+ * armed again from here; arg is what was passed to the advance. */
+typedef void (*timer_fn)(Timer *t, void *arg);
+
+struct Timer {
+    Timer *next;
+    Timer *prev;
+    uint64_t expires;           /* in ticks */
+    timer_fn fn;
+    void *data;
+};
+
+#define TIMER_LEVELS 4
+#define TIMER_SLOTS 64
+
+typedef struct {
+    Timer slots[TIMER_LEVELS][TIMER_SLOTS];     /* list heads */
+    uint64_t tick;              /* the next tick to run */
+    uint64_t base_ms;
+    uint32_t tick_ms;
+    size_t count;
+} TimerWheel;
+
+void timer_wheel_init(TimerWheel *tw, uint64_t now_ms, uint32_t tick_ms);
+
+void timer_init(Timer *t, timer_fn fn, void *data);
+static inline bool timer_pending(const Timer *t) { return t->next != NULL; }
+
+/* (Re)arms t for deadline_ms; a deadline already past fires on the next
+ * advance. */
+void timer_arm(TimerWheel *tw, Timer *t, uint64_t deadline_ms);
+void timer_cancel(TimerWheel *tw, Timer *t);
+
+/* Runs every tick up to now_ms and returns how many timers fired. */
+size_t timer_wheel_advance(TimerWheel *tw, uint64_t now_ms, void *arg);
+
+#endif
@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /* syscall, MAP_POPULATE */
+
+#include "uring.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned wait_nr, unsigned flags, const void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait_nr, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned op, const void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+static void fail(char *err, size_t cap, const char *what) {
+    if (err && cap) (void)snprintf(err, cap, "%s: %s", what, strerror(errno));
+}
+
+static bool setup_buffers(Uring *r, unsigned count, unsigned size, char *err, size_t cap) {
+    r->br_len = (size_t)count * sizeof(struct io_uring_buf);
+    void *br = mmap(NULL, r->br_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *bufs = mmap(NULL, (size_t)count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (br == MAP_FAILED || bufs == MAP_FAILED) {
+        fail(err, cap, "buffers");
+        if (br != MAP_FAILED) (void)munmap(br, r->br_len);
+        if (bufs != MAP_FAILED) (void)munmap(bufs, (size_t)count * size);
+        return false;
+    }
+    r->br = (struct io_uring_buf_ring*)br;
+    r->bufs = (uint8_t*)bufs;
+    r->buf_size = size;
+    r->buf_count = (uint16_t)count;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)br;
+    reg.ring_entries = count;
+    reg.bgid = URING_BGID;
+    if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        fail(err, cap, "provided buffer ring");
+        return false;
+    }
+    for (unsigned i=0;i<count;i++) {
+        struct io_uring_buf *b = &r->br->bufs[i];
+        b->addr = (uint64_t)(uintptr_t)(r->bufs + (size_t)i * size);
+        b->len = size;
+        b->bid = (uint16_t)i;
+    }
+    __atomic_store_n(&r->br->tail, (uint16_t)count, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Multishot receive came in 6.0, after everything else used here, and
+ * an older kernel only says so when the receive completes. */
+static bool check_multishot(Uring *r, char *err, size_t cap) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        fail(err, cap, "socketpair");
+        return false;
+    }
+    bool ok = false;
+    struct io_uring_sqe *sqe = uring_sqe(r);
+    if (sqe) {
+        uring_prep_recv_multishot(sqe, sv[0], 1);
+        ok = uring_submit(r, 0, 0) == 0 && send(sv[1], "x", 1, 0) == 1 && uring_submit(r, 1, 1000) == 0;
+    }
+    struct io_uring_cqe *cqe = ok ? uring_peek(r) : NULL;
+    ok = cqe && cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE);
+    if (cqe) {
+        if (cqe->flags & IORING_CQE_F_BUFFER) uring_buf_return(r, cqe);
+        uring_cqe_seen(r);
+    }
+    if (!ok && err && cap) (void)snprintf(err, cap, "multishot receive not supported");
+    /* Closing the socket ends the receive; drain its last completion. */
+    close(sv[0]);
+    close(sv[1]);
+    if (ok) {
+        sqe = uring_sqe(r);
+        if (sqe) uring_prep_cancel(sqe, 1, 0);
+        (void)uring_submit(r, 2, 100);
+        while ((cqe = uring_peek(r)) != NULL) {
+            if (cqe->flags & IORING_CQE_F_BUFFER) uring_buf_return(r, cqe);
+            uring_cqe_seen(r);
+        }
+    }
+    r->stats = (UringStats){0};
+    return ok;
+}
+
+bool uring_init(Uring *r, unsigned entries, unsigned buf_count, unsigned buf_size, char *err, size_t cap) {
+    memset(r, 0, sizeof(*r));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = sys_setup(entries, &p);
+    if (r->fd < 0) {
+        r->fd = -1;
+        fail(err, cap, "io_uring_setup");
+        return false;
+    }
+    const unsigned need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((p.features & need) != need) {
+        if (err && cap) (void)snprintf(err, cap, "kernel too old (features %#x)", p.features);
+        uring_free(r);
+        return false;
+    }
+
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->ring_map_len = (sq_len > cq_len) ? sq_len : cq_len;
+    r->ring_map = mmap(NULL, r->ring_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                       IORING_OFF_SQ_RING);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->ring_map == MAP_FAILED || sqes == MAP_FAILED) {
+        fail(err, cap, "mapping the rings");
+        if (r->ring_map == MAP_FAILED) r->ring_map = NULL;
+        if (sqes != MAP_FAILED) r->sqes = (struct io_uring_sqe*)sqes;
+        uring_free(r);
+        return false;
+    }
+    uint8_t *m = (uint8_t*)r->ring_map;
+    r->sqes = (struct io_uring_sqe*)sqes;
+    r->sq_head = (unsigned*)(m + p.sq_off.head);
+    r->sq_tail = (unsigned*)(m + p.sq_off.tail);
+    r->sq_array = (unsigned*)(m + p.sq_off.array);
+    r->sq_mask = *(unsigned*)(m + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->cq_head = (unsigned*)(m + p.cq_off.head);
+    r->cq_tail = (unsigned*)(m + p.cq_off.tail);
+    r->cq_mask = *(unsigned*)(m + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(m + p.cq_off.cqes);
+
+    if (!setup_buffers(r, buf_count, buf_size, err, cap) || !check_multishot(r, err, cap)) {
+        uring_free(r);
+        return false;
+    }
+    return true;
+}
+
+void uring_free(Uring *r) {
+    if (r->fd >= 0) close(r->fd);
+    if (r->ring_map) (void)munmap(r->ring_map, r->ring_map_len);
+    if (r->sqes) (void)munmap(r->sqes, r->sqes_len);
+    if (r->br) (void)munmap(r->br, r->br_len);
+    if (r->bufs) (void)munmap(r->bufs, (size_t)r->buf_count * r->buf_size);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+struct io_uring_sqe *uring_sqe(Uring *r) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *r->sq_tail + r->sq_queued;
+    if (tail - head >= r->sq_entries) {
+        if (uring_submit(r, 0, 0) != 0) return NULL;
+        head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        tail = *r->sq_tail;
+        if (tail - head >= r->sq_entries) return NULL;
+    }
+    unsigned idx = tail & r->sq_mask;
+    r->sq_array[idx] = idx;
+    r->sq_queued++;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, uint64_t data) {
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = data;
+}
+
+void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint64_t data) {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = data;
+}
+
+void uring_prep_cancel(struct io_uring_sqe *sqe, uint64_t target, uint64_t data) {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = data;
+}
+
+int uring_submit(Uring *r, unsigned wait_nr, int timeout_ms) {
+    unsigned n = r->sq_queued;
+    if (wait_nr > 0 && uring_peek(r)) wait_nr = 0;
+    if (n == 0 && wait_nr == 0) return 0;
+    __atomic_store_n(r->sq_tail, *r->sq_tail + n, __ATOMIC_RELEASE);
+    r->sq_queued = 0;
+
+    unsigned flags = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (wait_nr > 0) {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    int rc = sys_enter(r->fd, n, wait_nr, flags, wait_nr ? &arg : NULL, wait_nr ? sizeof(arg) : 0);
+    r->stats.enters++;
+    if (wait_nr > 0) r->stats.waits++;
+    /* A wait cut short by the timeout or a signal still submitted. */
+    if (rc < 0) return (errno == ETIME || errno == EINTR) ? 0 : -errno;
+    r->stats.sqes += (uint64_t)rc;
+    return 0;
+}
+
+struct io_uring_cqe *uring_peek(Uring *r) {
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &r->cqes[head & r->cq_mask];
+}
+
+void uring_cqe_seen(Uring *r) {
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+    r->stats.cqes++;
+}
+
+const uint8_t *uring_buf(const Uring *r, const struct io_uring_cqe *cqe) {
+    uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    return r->bufs + (size_t)bid * r->buf_size;
+}
+
+void uring_buf_return(Uring *r, const struct io_uring_cqe *cqe) {
+    uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    uint16_t tail = r->br->tail;
+    struct io_uring_buf *b = &r->br->bufs[tail & (uint16_t)(r->buf_count - 1)];
+    b->addr = (uint64_t)(uintptr_t)(r->bufs + (size_t)bid * r->buf_size);
+    b->len = r->buf_size;
+    b->bid = bid;
+    __atomic_store_n(&r->br->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,85 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/* A small io_uring on the raw syscalls: the submission and completion
+ * rings mapped from the kernel, plus one ring of provided buffers that
+ * multishot receives fill. Operations are queued with uring_sqe() and a
+ * prep call and go to the kernel together on the next uring_submit(), one
+ * syscall however many there are. There is no locking: the thread that
+ * owns the ring does all of the queueing, submitting and reaping. */
+
+typedef struct {
+    uint64_t enters;          /* io_uring_enter calls */
+    uint64_t waits;           /* of which waited for completions */
+    uint64_t sqes;            /* operations submitted */
+    uint64_t cqes;            /* completions reaped */
+} UringStats;
+
+typedef struct {
+    int fd;
+    /* submission ring */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_queued;       /* prepared, not yet seen by the kernel */
+    struct io_uring_sqe *sqes;
+    /* completion ring */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *ring_map;
+    size_t ring_map_len;
+    size_t sqes_len;
+    /* provided receive buffers, group URING_BGID */
+    struct io_uring_buf_ring *br;
+    size_t br_len;
+    uint8_t *bufs;
+    uint32_t buf_size;
+    uint16_t buf_count;
+    UringStats stats;
+} Uring;
+
+#define URING_BGID 0
+
+/* Sets up a ring of entries submissions (a power of two) with buf_count
+ * receive buffers of buf_size bytes (buf_count a power of two). Fails
+ * with a reason in err on a kernel without what the server needs: mapped
+ * rings, waits with a timeout, provided buffer rings and multishot
+ * receive, the last checked by receiving over a socketpair. */
+bool uring_init(Uring *r, unsigned entries, unsigned buf_count, unsigned buf_size, char *err, size_t cap);
+void uring_free(Uring *r);
+
+/* A zeroed submission slot; a full ring is submitted first to make room.
+ * NULL only when that submit fails. */
+struct io_uring_sqe *uring_sqe(Uring *r);
+/* msg and everything it points at must stay put until the completion. */
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, uint64_t data);
+/* Receives into provided buffers until it fails or is cancelled; each
+ * completion with IORING_CQE_F_MORE set means it is still armed. */
+void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint64_t data);
+void uring_prep_cancel(struct io_uring_sqe *sqe, uint64_t target, uint64_t data);
+
+/* Submits what is queued and waits up to timeout_ms (0 = not at all) for
+ * wait_nr completions. Returns 0 or -errno; running out of time is not an
+ * error. */
+int uring_submit(Uring *r, unsigned wait_nr, int timeout_ms);
+
+/* The next completion or NULL; uring_cqe_seen() hands it back. */
+struct io_uring_cqe *uring_peek(Uring *r);
+void uring_cqe_seen(Uring *r);
+
+/* The provided buffer a receive completion filled, and returning it to
+ * the kernel once read. */
+const uint8_t *uring_buf(const Uring *r, const struct io_uring_cqe *cqe);
+void uring_buf_return(Uring *r, const struct io_uring_cqe *cqe);
+
+#endif
@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../server/eventlog.h"
+#include "../server/game.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Summarises one or more --event-log files: what happened, how often and
+ * how busy the server was. Files are read a column block at a time and
+ * each figure is a pass over the columns it needs. */
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+typedef struct {
+    uint64_t events;
+    uint64_t by_type[256];
+    uint64_t deaths_by_cause[4];
+    uint64_t leaves_by_reason[5];
+    uint64_t leaves_kept;
+    uint64_t bot_joins;
+    uint64_t pauses;
+    uint64_t dropped;
+    uint64_t death_score_sum;
+    uint32_t death_score_max;
+    uint64_t match_ms_sum;
+    uint64_t results, result_score_sum, bot_results, bot_score_sum;
+    uint32_t best_score;
+    uint64_t first_us, last_us;
+    /* players online: a slot counts from its join or resume to its leave */
+    uint64_t online_mask;
+    int online, online_peak;
+    /* busiest second */
+    uint64_t sec, sec_events, peak_sec_events;
+    uint32_t files, truncated;
+} Stats;
+
+static void scan_block(Stats *s, const EventReader *r) {
+    uint32_t n = r->count;
+    s->events += n;
+    for (uint32_t i=0;i<n;i++) s->by_type[r->type[i]]++;
+
+    for (uint32_t i=0;i<n;i++) {
+        uint64_t us = r->base_us + r->dt_us[i];
+        if (s->first_us == 0 || us < s->first_us) s->first_us = us;
+        if (us > s->last_us) s->last_us = us;
+        uint64_t sec = us / 1000000ULL;
+        if (sec != s->sec) {
+            s->sec = sec;
+            s->sec_events = 0;
+        }
+        if (++s->sec_events > s->peak_sec_events) s->peak_sec_events = s->sec_events;
+    }
+
+    for (uint32_t i=0;i<n;i++) {
+        uint8_t t = r->type[i];
+        uint64_t bit = (r->slot[i] < 64) ? 1ULL << r->slot[i] : 0;
+        switch (t) {
+        case EV_JOIN:
+            if (r->arg[i]) s->bot_joins++;
+            /* fall through */
+        case EV_RESUME:
+            if (!(s->online_mask & bit)) {
+                s->online_mask |= bit;
+                if (++s->online > s->online_peak) s->online_peak = s->online;
+            }
+            break;
+        case EV_LEAVE:
+            if (r->arg[i] < 5) s->leaves_by_reason[r->arg[i]]++;
+            if (r->a[i]) s->leaves_kept++;
+            if (s->online_mask & bit) {
+                s->online_mask &= ~bit;
+                s->online--;
+            }
+            break;
+        case EV_PAUSE:
+            if (r->arg[i]) s->pauses++;
+            break;
+        case EV_DEATH:
+            if (r->arg[i] < 4) s->deaths_by_cause[r->arg[i]]++;
+            s->death_score_sum += r->c[i];
+            if (r->c[i] > s->death_score_max) s->death_score_max = r->c[i];
+            break;
+        case EV_MATCH_END:
+            s->match_ms_sum += r->b[i];
+            break;
+        case EV_RESULT:
+            if (r->arg[i]) {
+                s->bot_results++;
+                s->bot_score_sum += r->a[i];
+            } else {
+                s->results++;
+                s->result_score_sum += r->a[i];
+            }
+            if (r->a[i] > s->best_score) s->best_score = r->a[i];
+            break;
+        case EV_DROPPED:
+            s->dropped += r->a[i];
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static double pct(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+static double per(uint64_t sum, uint64_t n) {
+    return n ? (double)sum / (double)n : 0.0;
+}
+
+static void report(const Stats *s, uint64_t read_us) {
+    double span = (s->last_us > s->first_us) ? (double)(s->last_us - s->first_us) / 1e6 : 0.0;
+    printf("%u file(s), %llu events over %.0f s; read in %.1f ms (%.1f M events/s)%s\n",
+           (unsigned)s->files, (unsigned long long)s->events, span, (double)read_us / 1000.0,
+           read_us ? (double)s->events / (double)read_us : 0.0,
+           s->truncated ? ", last block cut short" : "");
+    if (s->dropped) printf("dropped by the server: %llu\n", (unsigned long long)s->dropped);
+
+    printf("\n%-12s %12s\n", "event", "count");
+    for (int t=1;t<EV_TYPES;t++) {
+        if (s->by_type[t]) printf("%-12s %12llu\n", event_type_name((uint8_t)t), (unsigned long long)s->by_type[t]);
+    }
+
+    uint64_t deaths = s->by_type[EV_DEATH];
+    printf("\ndeaths: %.1f%% wall, %.1f%% body, %.1f%% head-on; score at death %.1f mean, %u max\n",
+           pct(s->deaths_by_cause[DIE_WALL], deaths), pct(s->deaths_by_cause[DIE_BODY], deaths),
+           pct(s->deaths_by_cause[DIE_HEAD_ON], deaths), per(s->death_score_sum, deaths),
+           (unsigned)s->death_score_max);
+    printf("fruit: %.1f per death, %.1f per minute\n", per(s->by_type[EV_FRUIT], deaths),
+           span > 0 ? (double)s->by_type[EV_FRUIT] * 60.0 / span : 0.0);
+
+    uint64_t leaves = s->by_type[EV_LEAVE];
+    printf("players: %llu joins (%llu bots), %llu resumes, %llu pauses, %d online at most\n",
+           (unsigned long long)s->by_type[EV_JOIN], (unsigned long long)s->bot_joins,
+           (unsigned long long)s->by_type[EV_RESUME], (unsigned long long)s->pauses, s->online_peak);
+    printf("leaves: %.1f%% quit, %.1f%% lost, %.1f%% handshake timeout, %.1f%% idle, %.1f%% stalled; %.1f%% kept for a resume\n",
+           pct(s->leaves_by_reason[EV_LEAVE_QUIT], leaves), pct(s->leaves_by_reason[EV_LEAVE_LOST], leaves),
+           pct(s->leaves_by_reason[EV_LEAVE_HANDSHAKE], leaves), pct(s->leaves_by_reason[EV_LEAVE_IDLE], leaves),
+           pct(s->leaves_by_reason[EV_LEAVE_SEND_STALL], leaves), pct(s->leaves_kept, leaves));
+    printf("matches: %llu finished, %.0f s long on average; final score %.1f for players, %.1f for bots, %u best\n",
+           (unsigned long long)s->by_type[EV_MATCH_END], per(s->match_ms_sum, s->by_type[EV_MATCH_END]) / 1000.0,
+           per(s->result_score_sum, s->results), per(s->bot_score_sum, s->bot_results), (unsigned)s->best_score);
+    printf("load: %.1f events/s on average, %llu in the busiest second\n",
+           span > 0 ? (double)s->events / span : 0.0, (unsigned long long)s->peak_sec_events);
+}
+
+/* Usage: eventstat FILE... (e.g. events.log.* events.log) */
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s EVENT_LOG...\n", argv[0]);
+        return 2;
+    }
+    Stats *s = (Stats*)calloc(1, sizeof(Stats));
+    if (!s) return 1;
+    uint64_t t0 = now_us();
+    int bad = 0;
+    for (int i=1;i<argc;i++) {
+        EventReader r;
+        char err[128];
+        if (!event_reader_open(&r, argv[i], err, sizeof(err))) {
+            fprintf(stderr, "%s: %s\n", argv[i], err);
+            bad++;
+            continue;
+        }
+        while (event_reader_next(&r)) scan_block(s, &r);
+        if (r.truncated) s->truncated++;
+        s->files++;
+        event_reader_close(&r);
+    }
+    report(s, now_us() - t0);
+    free(s);
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../common/protocol.h"
+#include "../common/shm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Follows a server's --shm segment: one line a tick with the leaders, and
+ * the board whenever the config changes. An example of the reader side;
+ * the server never knows it is there. */
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static void show_config(const uint8_t *buf, uint32_t len, uint64_t gen) {
+    MsgConfig cfg;
+    if (len == 0) {
+        printf("config %llu: too large for the segment\n", (unsigned long long)gen);
+    } else if (msg_config_decode(&cfg, buf, len)) {
+        printf("config %llu: %ux%u board, mode %u, %s, %u bytes of map\n", (unsigned long long)gen, (unsigned)cfg.w,
+               (unsigned)cfg.h, (unsigned)cfg.mode, cfg.world ? "walls" : "open", (unsigned)cfg.map_len);
+    }
+}
+
+static void show_state(const MsgState *st, uint64_t age_ms) {
+    int order[MAX_PLAYERS];
+    int n = 0, alive = 0;
+    for (int i=0;i<MAX_PLAYERS;i++) {
+        const PlayerState *p = &st->players[i];
+        if (!p->active && !p->connected) continue;
+        if (p->alive) alive++;
+        int k = n++;
+        while (k > 0 && st->players[order[k - 1]].score < p->score) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = i;
+    }
+    printf("tick %u%s: %d playing, %d alive, %u fruit, %llu ms old |", (unsigned)st->tick,
+           st->game_over ? " (over)" : "", n, alive, (unsigned)st->num_fruits, (unsigned long long)age_ms);
+    for (int k=0;k<n && k<5;k++) {
+        const PlayerState *p = &st->players[order[k]];
+        printf(" #%u %u%s", (unsigned)p->player_id, (unsigned)p->score, p->alive ? "" : "x");
+    }
+    printf("\n");
+}
+
+/* Usage: shmwatch NAME [--once] [--poll-ms N] */
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s NAME [--once] [--poll-ms N]\n", argv[0]);
+        return 2;
+    }
+    const char *name = argv[1];
+    bool once = false;
+    int poll_ms = 20;
+    for (int i=2;i<argc;i++) {
+        if (strcmp(argv[i], "--once") == 0) once = true;
+        else if (strcmp(argv[i], "--poll-ms") == 0 && i + 1 < argc) poll_ms = atoi(argv[++i]);
+    }
+    if (poll_ms < 1) poll_ms = 1;
+
+    static uint8_t state_buf[MSG_STATE_MAX_LEN];
+    static MsgState st;
+    uint8_t *config_buf = NULL;
+    uint32_t config_cap = 0;
+
+    ShmReader r;
+    char err[128];
+    if (!shm_reader_open(&r, name, err, sizeof(err))) {
+        fprintf(stderr, "%s: %s\n", name, err);
+        return 1;
+    }
+    uint64_t last_tick = UINT64_MAX, last_gen = UINT64_MAX, busy = 0;
+    for (;;) {
+        uint32_t len;
+        uint64_t stamp;
+        ShmResult rc = shm_read_config(&r, config_buf, config_cap, &len, &stamp);
+        if (rc == SHM_TOO_SMALL) {
+            free(config_buf);
+            config_cap = len;
+            config_buf = (uint8_t*)malloc(config_cap);
+            if (!config_buf) return 1;
+            rc = shm_read_config(&r, config_buf, config_cap, &len, &stamp);
+        }
+        if (rc == SHM_OK && stamp != last_gen) {
+            show_config(config_buf, len, stamp);
+            last_gen = stamp;
+        }
+
+        uint64_t ms;
+        rc = shm_read_state(&r, state_buf, sizeof(state_buf), &len, &stamp, &ms);
+        if (rc == SHM_BUSY) busy++;
+        if (rc == SHM_OK && stamp != last_tick && msg_state_decode(&st, state_buf, len)) {
+            uint64_t now = now_ms();
+            show_state(&st, now > ms ? now - ms : 0);
+            last_tick = stamp;
+            if (once) break;
+        }
+
+        if (shm_reader_closed(&r)) {
+            /* Wait for the next server under the same name. */
+            printf("server gone\n");
+            fflush(stdout);
+            if (once) break;
+            shm_reader_close(&r);
+            while (!shm_reader_open(&r, name, err, sizeof(err))) sleep_ms(500);
+            last_tick = last_gen = UINT64_MAX;
+            continue;
+        }
+        fflush(stdout);
+        sleep_ms(poll_ms);
+    }
+    if (busy) fprintf(stderr, "%llu reads gave up on a busy writer\n", (unsigned long long)busy);
+    shm_reader_close(&r);
+    free(config_buf);
+    return 0;
+}